@@ -33,6 +33,8 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <unistd.h>
+#include <poll.h>
+#include <time.h>
 #include <err.h>
 
 #include "gpio.h"
@@ -53,6 +55,7 @@ static char *ocp = NULL;
 		.direction = NULL,     \
 		.active_low = NULL,    \
 		.value = NULL,         \
+		.edge = NULL,          \
 		.fd = -1               \
 	}
 
@@ -67,6 +70,12 @@ static char *ocp = NULL;
 #define DIRECTION_in  "in"
 #define DIRECTION_out "out"
 
+#define EDGE_both "both"
+#define EDGE_none "none"
+
+// longest poll() in GPIO_wait_for in case edges are not reported
+#define WAIT_POLL_MS 10
+
 // GPIO control information
 static struct {
 	const char *name;   // e.g. "gpio-P8.15" -> /lib/firmware/gpio-P8.15.dtbo
@@ -78,6 +87,7 @@ static struct {
 	char *value;        // e.g. "/sys/class/gpio/gpio47/value" <- [ "0" | "1" ]
 	char *active_low;   // e.g. "/sys/class/gpio/gpio47/active_low" <- [ "0" | "1" ]
 	char *direction;    // e.g. "/sys/class/gpio/gpio47/direction" <- DIRECTION_xxx
+	char *edge;         // e.g. "/sys/class/gpio/gpio47/edge" <- EDGE_xxx
 	int fd;             // open fd to value file for fast access
 } gpio_info[] = {
 	// Connector P8
@@ -224,6 +234,10 @@ bool GPIO_teardown() {
 			free(gpio_info[i].value);
 			gpio_info[i].value = NULL;
 		}
+		if (NULL != gpio_info[i].edge) {
+			free(gpio_info[i].edge);
+			gpio_info[i].edge = NULL;
+		}
 	}
 
 	for (size_t i = 0; i < SIZE_OF_ARRAY(pwm); ++i) {
@@ -270,12 +284,14 @@ void GPIO_mode(GPIO_pin_type pin, GPIO_mode_type mode) {
 		write_file(gpio_info[pin].direction, DIRECTION_in "\n", CONST_STRLEN(DIRECTION_in "\n"));
 		write_file(gpio_info[pin].active_low, "0\n", 2);
 		write_file(gpio_info[pin].state, STATE_rxEnable_pullNone "\n", CONST_STRLEN(STATE_rxEnable_pullNone "\n"));
+		write_file(gpio_info[pin].edge, EDGE_both "\n", CONST_STRLEN(EDGE_both "\n"));
 		break;
 
 	case GPIO_OUTPUT:
 		if (gpio_info[pin].fd < 0 && !GPIO_enable(pin)) {
 			return;
 		}
+		write_file(gpio_info[pin].edge, EDGE_none "\n", CONST_STRLEN(EDGE_none "\n"));
 		write_file(gpio_info[pin].direction, DIRECTION_out "\n", CONST_STRLEN(DIRECTION_out "\n"));
 		write_file(gpio_info[pin].active_low, "0\n", 2);
 		write_file(gpio_info[pin].state, STATE_rxDisable_pullNone "\n", CONST_STRLEN(STATE_rxDisable_pullNone "\n"));
@@ -343,6 +359,39 @@ void GPIO_write(GPIO_pin_type pin, int value) {
 }
 
 
+// reading the value clears a pending edge so poll() only returns
+// for edges after the read
+bool GPIO_wait_for(int pin, int level, unsigned int timeout_ms) {
+	// ignore unimplemented or inactive pins
+	if (pin < 0 || pin >= SIZE_OF_ARRAY(gpio_info) || NULL == gpio_info[pin].name || gpio_info[pin].fd < 0) {
+		return false;
+	}
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (;;) {
+		if ((0 != level) == (0 != GPIO_read(pin))) {
+			return true;
+		}
+
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		long elapsed = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+		if (elapsed >= timeout_ms) {
+			return false;
+		}
+
+		long wait = timeout_ms - elapsed;
+		struct pollfd event = {
+			.fd = gpio_info[pin].fd,
+			.events = POLLPRI | POLLERR
+		};
+		poll(&event, 1, wait < WAIT_POLL_MS ? wait : WAIT_POLL_MS);
+	}
+}
+
+
 // only affect PWM if correct pin is addressed
 void GPIO_pwm_write(int pin, uint32_t value) {
 	if (value > 1023) {
@@ -389,6 +438,7 @@ void GPIO_pwm_write(int pin, uint32_t value) {
 #define DIRECTION "direction"
 #define ACTIVE_LOW "active_low"
 #define VALUE "value"
+#define EDGE "edge"
 
 
 // pwm files
@@ -647,6 +697,21 @@ static bool GPIO_enable(int pin) {
 			strcat(gpio_info[pin].value, "/");
 			strcat(gpio_info[pin].value, VALUE);
 
+			// the edge file name
+			gpio_info[pin].edge = malloc(CONST_STRLEN(SYS_CLASS_GPIO)
+						     + l
+						     + sizeof((char)('/'))
+						     + CONST_STRLEN(EDGE)
+						     + sizeof((char)('\0')));
+			if (NULL == gpio_info[pin].edge) {
+				break;  // failed
+			}
+
+			strcpy(gpio_info[pin].edge, SYS_CLASS_GPIO);
+			strncat(gpio_info[pin].edge, p, l);
+			strcat(gpio_info[pin].edge, "/");
+			strcat(gpio_info[pin].edge, EDGE);
+
 			// open a file handle to the value - to speed
 			// up access assumes most read/write go to
 			// this as other items (like direction) are
@@ -689,6 +754,10 @@ static bool GPIO_enable(int pin) {
 		free(gpio_info[pin].value);
 		gpio_info[pin].value = NULL;
 	}
+	if (NULL != gpio_info[pin].edge) {
+		free(gpio_info[pin].edge);
+		gpio_info[pin].edge = NULL;
+	}
 
 	return false; // failed
 }
@@ -152,6 +152,10 @@ int GPIO_read(int pin);
 // set or clear a given output pin
 void GPIO_write(GPIO_pin_type pin, int value);
 
+// wait until an input pin has the given value (0/1)
+// return false if it did not within timeout_ms milliseconds
+bool GPIO_wait_for(int pin, int level, unsigned int timeout_ms);
+
 // set the PWM ration 0..1023 for hardware PWM pin (GPIO_P1_12)
 void GPIO_pwm_write(int pin, uint32_t value);
 
@@ -20,8 +20,29 @@
 #include <fcntl.h>
 //#include <sys/mman.h>
 #include <unistd.h>
+#include <poll.h>
+#include <time.h>
 #include <err.h>
 
+// GPIO_CHARDEV=1 uses the GPIO character device (/dev/gpiochipN) for
+// input and output pins falling back to sysfs if a line cannot be
+// requested, GPIO_CHARDEV=0 only uses sysfs.  The default is to use
+// it when the kernel headers have the v2 line request interface.
+#if !defined(GPIO_CHARDEV) || GPIO_CHARDEV
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#endif
+
+#if !defined(GPIO_CHARDEV)
+#if defined(GPIO_V2_GET_LINE_IOCTL)
+#define GPIO_CHARDEV 1
+#else
+#define GPIO_CHARDEV 0
+#endif
+#elif GPIO_CHARDEV && !defined(GPIO_V2_GET_LINE_IOCTL)
+#error "GPIO_CHARDEV needs the Linux 5.10 GPIO v2 uAPI headers"
+#endif
+
 #include "gpio.h"
 
 
@@ -54,7 +75,8 @@
 typedef enum {
 	Mode_NONE,
 	Mode_GPIO,
-	Mode_PWM
+	Mode_PWM,
+	Mode_LINE  // GPIO using a character device line request
 } internal_mode_t;
 
 // GPIO control information
@@ -66,6 +88,7 @@ static struct {
 	int pwm_channel;        // channel number
 	int pwm_state;          // index of a state file for multiplexor control
 	int fd;                 // open fd to value/duty_cycle file for fast access
+	int line;               // index in the line request of its bank (Mode_LINE)
 } gpio_info[] = {
 	// Connector P8
 	MAKE_PIN("P8.03", 1, 6),   //  GPIO1_6
@@ -174,6 +197,7 @@ static struct {
 //#define STATE_rxEnable_pullDown  "rxEnable_pullDown"
 
 #define GPIO_EDGE_none     "none"
+#define GPIO_EDGE_both     "both"
 #define GPIO_DIRECTION_in  "in"
 #define GPIO_DIRECTION_out "out"
 
@@ -200,6 +224,9 @@ const char *const pwm_state_file[] = {
 #define PWM_POLARITY_normal "normal"
 #define PWM_DEFAULT_PERIOD 500000
 
+// longest poll() in GPIO_wait_for in case edges are not reported
+#define WAIT_POLL_MS 10
+
 
 // SPI initialisation
 const char *const spi_state_file[] = {
@@ -238,13 +265,30 @@ static void unexport_pwm(int chip, int number);
 static bool GPIO_enable(int pin);
 static bool PWM_enable(int pin);
 static void PWM_set_duty(int pin, int16_t value);
+#if GPIO_CHARDEV
+static bool line_setup(void);
+static void line_teardown(void);
+static bool line_mode(int pin, bool output);
+static int line_read(int pin);
+static void line_write(int pin, int value);
+static int line_event_fd(int pin);
+static void line_discard_events(int pin);
+#endif
 
 
 // set up access to the GPIO and PWM
 bool GPIO_setup() {
 
+#if GPIO_CHARDEV
+	// newer kernels have no cape manager and set up the pin
+	// multiplexor from the device tree
+	bool lines = line_setup();
+#else
+	bool lines = false;
+#endif
+
 	// ensure the base firmware is setup
-	if (load_firmware(NULL)) {
+	if (load_firmware(NULL) || lines) {
 		// return success
 		return true;
 	}
@@ -274,6 +318,7 @@ bool GPIO_teardown() {
 
 		switch(gpio_info[pin].active) {
 		case Mode_NONE:
+		case Mode_LINE:
 			break;
 
 		case Mode_GPIO:
@@ -298,6 +343,10 @@ bool GPIO_teardown() {
 		gpio_info[pin].active = Mode_NONE;
 	}
 
+#if GPIO_CHARDEV
+	line_teardown();
+#endif
+
 	return true;
 }
 
@@ -312,22 +361,32 @@ void GPIO_mode(GPIO_pin_type pin, GPIO_mode_type mode) {
 	switch (mode) {
 	default:
 	case GPIO_INPUT:
+#if GPIO_CHARDEV
+		if (line_mode(pin, false)) {
+			break;
+		}
+#endif
 		if (gpio_info[pin].fd < 0 && !GPIO_enable(pin)) {
 			return;
 		}
 		write_pin_file(GPIO_DIRECTION, pin, GPIO_DIRECTION_in "\n", CONST_STRLEN(GPIO_DIRECTION_in "\n"));
 		write_pin_file(GPIO_ACTIVE_LOW, pin, "0\n", 2);
-		write_pin_file(GPIO_EDGE, pin, GPIO_EDGE_none "\n", CONST_STRLEN(GPIO_EDGE_none "\n"));
+		write_pin_file(GPIO_EDGE, pin, GPIO_EDGE_both "\n", CONST_STRLEN(GPIO_EDGE_both "\n"));
 		//write_pin_file(GPIO_STATE, pin, STATE_rxEnable_pullNone "\n", CONST_STRLEN(STATE_rxEnable_pullNone "\n"));
 		break;
 
 	case GPIO_OUTPUT:
+#if GPIO_CHARDEV
+		if (line_mode(pin, true)) {
+			break;
+		}
+#endif
 		if (gpio_info[pin].fd < 0 && !GPIO_enable(pin)) {
 			return;
 		}
+		write_pin_file(GPIO_EDGE, pin, GPIO_EDGE_none "\n", CONST_STRLEN(GPIO_EDGE_none "\n"));
 		write_pin_file(GPIO_DIRECTION, pin, GPIO_DIRECTION_out "\n", CONST_STRLEN(GPIO_DIRECTION_out "\n"));
 		write_pin_file(GPIO_ACTIVE_LOW, pin, "0\n", 2);
-		write_pin_file(GPIO_EDGE, pin, GPIO_EDGE_none "\n", CONST_STRLEN(GPIO_EDGE_none "\n"));
 		//write_pin_file(GPIO_STATE, pin, STATE_rxDisable_pullNone "\n", CONST_STRLEN(STATE_rxDisable_pullNone "\n"));
 		break;
 
@@ -342,7 +401,15 @@ void GPIO_mode(GPIO_pin_type pin, GPIO_mode_type mode) {
 
 int GPIO_read(int pin) {
 	// ignore unimplemented or inactive pins
-	if (pin < 0 || pin >= SIZE_OF_ARRAY(gpio_info) || NULL == gpio_info[pin].name || gpio_info[pin].fd < 0) {
+	if (pin < 0 || pin >= SIZE_OF_ARRAY(gpio_info) || NULL == gpio_info[pin].name) {
+		return 0;
+	}
+#if GPIO_CHARDEV
+	if (Mode_LINE == gpio_info[pin].active) {
+		return line_read(pin);
+	}
+#endif
+	if (gpio_info[pin].fd < 0) {
 		return 0;
 	}
 
@@ -363,7 +430,16 @@ int GPIO_read(int pin) {
 
 void GPIO_write(GPIO_pin_type pin, int value) {
 	// ignore unimplemented or inactive pins
-	if (pin < 0 || pin >= SIZE_OF_ARRAY(gpio_info) || NULL == gpio_info[pin].name || gpio_info[pin].fd < 0) {
+	if (pin < 0 || pin >= SIZE_OF_ARRAY(gpio_info) || NULL == gpio_info[pin].name) {
+		return;
+	}
+#if GPIO_CHARDEV
+	if (Mode_LINE == gpio_info[pin].active) {
+		line_write(pin, value);
+		return;
+	}
+#endif
+	if (gpio_info[pin].fd < 0) {
 		return;
 	}
 
@@ -380,6 +456,55 @@ void GPIO_write(GPIO_pin_type pin, int value) {
 }
 
 
+// a line request reports edges as events and a sysfs value file
+// reports them to poll(); reading the level first means poll() only
+// returns for edges after the read
+bool GPIO_wait_for(int pin, int level, unsigned int timeout_ms) {
+	// ignore unimplemented or inactive pins
+	if (pin < 0 || pin >= SIZE_OF_ARRAY(gpio_info) || NULL == gpio_info[pin].name) {
+		return false;
+	}
+
+	struct pollfd event = {
+		.fd = gpio_info[pin].fd,
+		.events = POLLPRI | POLLERR
+	};
+#if GPIO_CHARDEV
+	if (Mode_LINE == gpio_info[pin].active) {
+		event.fd = line_event_fd(pin);
+		event.events = POLLIN;
+	}
+#endif
+	if (event.fd < 0) {
+		return false;
+	}
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (;;) {
+#if GPIO_CHARDEV
+		if (Mode_LINE == gpio_info[pin].active) {
+			line_discard_events(pin);
+		}
+#endif
+		if ((0 != level) == (0 != GPIO_read(pin))) {
+			return true;
+		}
+
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		long elapsed = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+		if (elapsed >= timeout_ms) {
+			return false;
+		}
+
+		long wait = timeout_ms - elapsed;
+		poll(&event, 1, wait < WAIT_POLL_MS ? wait : WAIT_POLL_MS);
+	}
+}
+
+
 // only affect PWM if correct pin is addressed
 void GPIO_pwm_write(int pin, uint32_t value) {
 	if (value > 1023) {
@@ -462,7 +587,7 @@ static void write_file(const char *file_name, const char *buffer, size_t length)
 	size_t n = write(fd, buffer, length);
 	fsync(fd);
 	if (n != length) {
-		fprintf(stderr, "write_file only wrote: %d of %d\n", n, length); fflush(stderr);
+		fprintf(stderr, "write_file only wrote: %zu of %zu\n", n, length); fflush(stderr);
 	}
 	close(fd);
 }
@@ -547,8 +672,8 @@ static bool GPIO_enable(int pin) {
 	if (Mode_GPIO == gpio_info[pin].active) {
 		return true;  // already a GPIO
 	}
-	if (Mode_PWM == gpio_info[pin].active) {
-		return false;  // already a PWM
+	if (Mode_PWM == gpio_info[pin].active || Mode_LINE == gpio_info[pin].active) {
+		return false;  // already a PWM or a line
 	}
 
 	// as the kernel to allocate the pin
@@ -580,7 +705,7 @@ static bool PWM_enable(int pin) {
 	if (pin < 0 || pin >= SIZE_OF_ARRAY(gpio_info) || NULL == gpio_info[pin].name) {
 		return false; // invalid pin
 	}
-	if (Mode_GPIO == gpio_info[pin].active) {
+	if (Mode_GPIO == gpio_info[pin].active || Mode_LINE == gpio_info[pin].active) {
 		return false; // already a GPIO
 	}
 	if (Mode_PWM == gpio_info[pin].active) {
@@ -656,3 +781,226 @@ static void PWM_set_duty(int pin, int16_t value) {
 	}
 	fsync(gpio_info[pin].fd);
 }
+
+
+#if GPIO_CHARDEV
+
+// GPIO character device
+// =====================
+//
+// each of the four 32 bit banks is a gpiochip labelled "gpio-FIRST-LAST"
+// and all the input and output pins of a bank share one line request,
+// so a read or write is a single ioctl on the request instead of
+// lseek + read/write + fsync on a sysfs value file.  Inputs report
+// both edges as events on the request for GPIO_wait_for.
+
+#define GPIO_BANKS 4
+#define GPIO_BANK_LINES 32
+#define GPIO_CHIP_DEVICE "/dev/gpiochip%d"
+#define GPIO_CHIP_SEARCH 16   // /dev/gpiochip0 .. 15
+#define GPIO_CONSUMER "epd"
+
+static struct {
+	int chip_fd;                         // open gpiochip, -1 => bank uses sysfs
+	int request_fd;                      // line request, -1 => no lines yet
+	uint32_t count;                      // number of lines in the request
+	uint32_t offsets[GPIO_BANK_LINES];   // chip offset of each requested line
+	uint64_t outputs;                    // request bits of output lines
+	uint64_t values;                     // request bits of outputs set high
+} line_bank[GPIO_BANKS] = {
+	[0 ... GPIO_BANKS - 1] = {
+		.chip_fd = -1,
+		.request_fd = -1
+	}
+};
+
+
+// find the chip for each bank, false if there are none
+static bool line_setup(void) {
+	bool found = false;
+
+	for (int n = 0; n < GPIO_CHIP_SEARCH; ++n) {
+		char *path = make_formatted_buffer(GPIO_CHIP_DEVICE, n);
+		int fd = open(path, O_RDWR | O_CLOEXEC);
+		free(path);
+		if (fd < 0) {
+			continue;
+		}
+
+		struct gpiochip_info info;
+		memset(&info, 0, sizeof(info));
+
+		int first = -1;
+		int last = -1;
+		if (ioctl(fd, GPIO_GET_CHIPINFO_IOCTL, &info) < 0
+		    || 2 != sscanf(info.label, "gpio-%d-%d", &first, &last)
+		    || 0 != first % GPIO_BANK_LINES
+		    || first / GPIO_BANK_LINES >= GPIO_BANKS
+		    || last != first + GPIO_BANK_LINES - 1
+		    || line_bank[first / GPIO_BANK_LINES].chip_fd >= 0) {
+			close(fd);
+			continue;
+		}
+		line_bank[first / GPIO_BANK_LINES].chip_fd = fd;
+		found = true;
+	}
+	return found;
+}
+
+
+// release all line requests and chips
+static void line_teardown(void) {
+	for (int b = 0; b < GPIO_BANKS; ++b) {
+		if (line_bank[b].request_fd >= 0) {
+			close(line_bank[b].request_fd);
+			line_bank[b].request_fd = -1;
+		}
+		if (line_bank[b].chip_fd >= 0) {
+			close(line_bank[b].chip_fd);
+			line_bank[b].chip_fd = -1;
+		}
+		line_bank[b].count = 0;
+		line_bank[b].outputs = 0;
+		line_bank[b].values = 0;
+	}
+}
+
+
+// direction of every line and the value of each output
+static void line_config(struct gpio_v2_line_config *config, uint64_t outputs, uint64_t values) {
+	memset(config, 0, sizeof(*config));
+	config->flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+	if (0 != outputs) {
+		config->num_attrs = 2;
+		config->attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+		config->attrs[0].attr.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+		config->attrs[0].mask = outputs;
+		config->attrs[1].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+		config->attrs[1].attr.values = values;
+		config->attrs[1].mask = outputs;
+	}
+}
+
+
+// request the lines of a bank, returns the request fd or -1
+static int line_request(int bank, uint32_t count, uint64_t outputs, uint64_t values) {
+	struct gpio_v2_line_request request;
+	memset(&request, 0, sizeof(request));
+
+	memcpy(request.offsets, line_bank[bank].offsets, count * sizeof(request.offsets[0]));
+	strncpy(request.consumer, GPIO_CONSUMER, sizeof(request.consumer) - 1);
+	line_config(&request.config, outputs, values);
+	request.num_lines = count;
+
+	if (ioctl(line_bank[bank].chip_fd, GPIO_V2_GET_LINE_IOCTL, &request) < 0) {
+		return -1;
+	}
+	return request.fd;
+}
+
+
+// make pin an input or output line of its bank request, false => use sysfs
+//
+// a new line needs a new request for the whole bank so the existing
+// request is released first and outputs keep their values in the new
+// one; this only happens while the pins are set up.  A direction
+// change on a requested line just reconfigures the request.
+static bool line_mode(int pin, bool output) {
+	int b = pin / GPIO_BANK_LINES;
+	if (line_bank[b].chip_fd < 0
+	    || (Mode_NONE != gpio_info[pin].active && Mode_LINE != gpio_info[pin].active)) {
+		return false;
+	}
+
+	int line = gpio_info[pin].line;
+	if (Mode_LINE == gpio_info[pin].active) {
+		uint64_t bit = (uint64_t)1 << line;
+		uint64_t outputs = output ? line_bank[b].outputs | bit : line_bank[b].outputs & ~bit;
+		uint64_t values = line_bank[b].values & outputs;
+
+		struct gpio_v2_line_config config;
+		line_config(&config, outputs, values);
+		if (ioctl(line_bank[b].request_fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config) < 0) {
+			fprintf(stderr, "GPIO line config failed: %s\n", gpio_info[pin].name); fflush(stderr);
+			return true;  // line is still held by the request
+		}
+		line_bank[b].outputs = outputs;
+		line_bank[b].values = values;
+		return true;
+	}
+
+	line = line_bank[b].count;
+	uint64_t bit = (uint64_t)1 << line;
+	uint64_t outputs = output ? line_bank[b].outputs | bit : line_bank[b].outputs;
+	line_bank[b].offsets[line] = pin % GPIO_BANK_LINES;
+
+	if (line_bank[b].request_fd >= 0) {
+		close(line_bank[b].request_fd);
+	}
+	int fd = line_request(b, line + 1, outputs, line_bank[b].values);
+	if (fd < 0) {
+		// e.g. already exported to sysfs, restore the previous request
+		fprintf(stderr, "GPIO line request failed: %s using sysfs\n", gpio_info[pin].name); fflush(stderr);
+		line_bank[b].request_fd = 0 == line ? -1 : line_request(b, line, line_bank[b].outputs, line_bank[b].values);
+		return false;
+	}
+
+	line_bank[b].request_fd = fd;
+	line_bank[b].count = line + 1;
+	line_bank[b].outputs = outputs;
+	gpio_info[pin].line = line;
+	gpio_info[pin].active = Mode_LINE;
+	return true;
+}
+
+
+static int line_read(int pin) {
+	int b = pin / GPIO_BANK_LINES;
+	struct gpio_v2_line_values values = {
+		.bits = 0,
+		.mask = (uint64_t)1 << gpio_info[pin].line
+	};
+
+	if (ioctl(line_bank[b].request_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0) {
+		return 0;
+	}
+	return 0 != (values.bits & values.mask) ? 1 : 0;
+}
+
+
+static void line_write(int pin, int value) {
+	int b = pin / GPIO_BANK_LINES;
+	uint64_t bit = (uint64_t)1 << gpio_info[pin].line;
+
+	if (0 == (line_bank[b].outputs & bit)) {
+		return;  // input
+	}
+
+	struct gpio_v2_line_values values = {
+		.bits = 0 == value ? 0 : bit,
+		.mask = bit
+	};
+	if (ioctl(line_bank[b].request_fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) >= 0) {
+		line_bank[b].values = (line_bank[b].values & ~bit) | values.bits;
+	}
+}
+
+// the fd that reports the edge events of pin
+static int line_event_fd(int pin) {
+	return line_bank[pin / GPIO_BANK_LINES].request_fd;
+}
+
+
+// drop queued edge events of the bank of pin
+static void line_discard_events(int pin) {
+	struct pollfd event = {
+		.fd = line_event_fd(pin),
+		.events = POLLIN
+	};
+	struct gpio_v2_line_event events[16];
+
+	while (poll(&event, 1, 0) > 0 && read(event.fd, events, sizeof(events)) > 0) {
+	}
+}
+
+#endif
@@ -30,6 +30,7 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <unistd.h>
+#include <time.h>
 #include <err.h>
 
 #include "gpio.h"
@@ -224,6 +225,8 @@ const chip_version chips[] = {
 
 #define SIZE_OF_ARRAY(a) (sizeof(a)/ sizeof((a)[0]))
 
+static const char *memory_device = "/dev/mem";
+
 
 // access to peripherals
 volatile uint32_t *gpio_map;
@@ -248,8 +251,6 @@ bool GPIO_setup() {
 		return false;
 	}
 
-	const char *memory_device = "/dev/mem";
-
 	int mem_fd = open(memory_device, O_RDWR | O_SYNC | O_CLOEXEC);
 
 	if (mem_fd < 0) {
@@ -342,6 +343,12 @@ void GPIO_mode(GPIO_pin_type pin, GPIO_mode_type mode) {
 			pwm_map[DAT1] = 0;     // initially zero
 		}
 		break;
+	case GPIO_SPI:  // only the SPI0 pins
+		if (GPIO_P1_19 == pin || GPIO_P1_21 == pin || GPIO_P1_23 == pin ||
+		    GPIO_P1_24 == pin || GPIO_P1_26 == pin) {
+			pin_function = GPFSEL_ALT_0;
+		}
+		break;
 	}
 
 	pin_function <<= shift;
@@ -382,6 +389,26 @@ void GPIO_write(GPIO_pin_type pin, int value) {
 }
 
 
+// the mapped registers have no edge events so poll the level
+bool GPIO_wait_for(GPIO_pin_type pin, int level, unsigned int timeout_ms) {
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (;;) {
+		if ((0 != level) == (0 != GPIO_read(pin))) {
+			return true;
+		}
+
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000 >= timeout_ms) {
+			return false;
+		}
+		usleep(10);
+	}
+}
+
+
 // only affetct PWM if correct pin is addressed
 void GPIO_pwm_write(GPIO_pin_type pin, uint32_t value) {
 	if (GPIO_P1_12 == pin) {
@@ -390,6 +417,39 @@ void GPIO_pwm_write(GPIO_pin_type pin, uint32_t value) {
 }
 
 
+// map a peripheral register block for another driver
+volatile uint32_t *GPIO_map_peripheral(uint32_t offset) {
+
+	uint32_t base_address = 0;
+
+	if (!get_cpu_io_base_address(&base_address)) {
+		warn("cannot get the peripheral base address");
+		return NULL;
+	}
+
+	int mem_fd = open(memory_device, O_RDWR | O_SYNC | O_CLOEXEC);
+
+	if (mem_fd < 0) {
+		warn("cannot open: %s", memory_device);
+		return NULL;
+	}
+
+	volatile uint32_t *map = NULL;
+	bool ok = create_rw_map(&map, mem_fd, base_address, offset);
+	close(mem_fd);
+
+	return ok ? map : NULL;
+}
+
+
+// release a peripheral map
+void GPIO_unmap_peripheral(volatile uint32_t *map) {
+	if (NULL != map) {
+		delete_map(map);
+	}
+}
+
+
 // private functions
 // =================
 
@@ -55,7 +55,8 @@ typedef enum {
 typedef enum {
 	GPIO_INPUT,   // as input
 	GPIO_OUTPUT,  // as output
-	GPIO_PWM      // as PWM output (only for P1_12
+	GPIO_PWM,     // as PWM output (only for P1_12
+	GPIO_SPI      // as SPI0 (only for P1_19, P1_21, P1_23, P1_24 and P1_26)
 } GPIO_mode_type;
 
 
@@ -78,8 +79,20 @@ int GPIO_read(GPIO_pin_type pin);
 // set or clear a given output pin
 void GPIO_write(GPIO_pin_type pin, int value);
 
+// wait until an input pin has the given value (0/1)
+// return false if it did not within timeout_ms milliseconds
+bool GPIO_wait_for(GPIO_pin_type pin, int level, unsigned int timeout_ms);
+
 // set the PWM ration 0..1023 for hardware PWM pin (GPIO_P1_12)
 void GPIO_pwm_write(GPIO_pin_type pin, uint32_t value);
 
+// map the 4 KiB block of peripheral registers at offset from the
+// peripheral base (e.g. 0x00204000 for SPI0) for another driver
+// return NULL if failure
+volatile uint32_t *GPIO_map_peripheral(uint32_t offset);
+
+// release a map from GPIO_map_peripheral
+void GPIO_unmap_peripheral(volatile uint32_t *map);
+
 
 #endif
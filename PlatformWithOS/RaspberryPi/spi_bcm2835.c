@@ -0,0 +1,292 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+
+// SPI backend driving the SPI0 controller through its registers
+//
+// selected by the SPI path "bcm2835:CS" where CS is the chip select, 0
+// (CE0, in place of /dev/spidev0.0) or 1 (CE1).  The registers are
+// mapped like the GPIO (see gpio.c) and the FIFO is filled and emptied
+// by the CPU, so a transfer has no system call, no copy into the
+// kernel and no spidev bufsiz limit.  The chip select is asserted by
+// the controller while TA is set, so each segment is one transfer as
+// with spidev.
+//
+// The kernel SPI driver must not use SPI0 (any /dev/spidev0.N) while
+// a panel does, as both would program the same registers.
+//
+// For the SPI0 register layout see Chapter 10 of:
+//   http://www.raspberrypi.org/wp-content/uploads/2012/02/BCM2835-ARM-Peripherals.pdf
+
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <err.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+#include "gpio.h"
+#include "spi.h"
+#include "spi_backend.h"
+
+
+// register block, from the peripheral base
+enum {
+	SPI0_REGISTERS = 0x00204000
+};
+
+// SPI0 registers (all registers are 32 bit)
+// (Manual Chapter 10)
+enum {                     // byte offset     function
+	SPI0_CS   = 0x00,  // 0x00  SPI Master Control and Status
+	SPI0_FIFO = 0x01,  // 0x04  SPI Master TX and RX FIFOs
+	SPI0_CLK  = 0x02,  // 0x08  SPI Master Clock Divider
+	SPI0_DLEN = 0x03,  // 0x0c  SPI Master Data Length (DMA only)
+	SPI0_LTOH = 0x04,  // 0x10  SPI LOSSI mode TOH
+	SPI0_DC   = 0x05   // 0x14  SPI DMA DREQ Controls
+};
+
+// SPI0_CS bits
+enum {
+	CS_CS_MASK  = 0x00000003,  // chip select
+	CS_CPHA     = 0x00000004,  // clock phase
+	CS_CPOL     = 0x00000008,  // clock polarity
+	CS_CLEAR_TX = 0x00000010,  // clear TX FIFO
+	CS_CLEAR_RX = 0x00000020,  // clear RX FIFO
+	CS_TA       = 0x00000080,  // transfer active (asserts chip select)
+	CS_DONE     = 0x00010000,  // transfer done
+	CS_RXD      = 0x00020000,  // RX FIFO contains data
+	CS_TXD      = 0x00040000   // TX FIFO can accept data
+};
+
+// the SPI clock is the core clock divided by an even number
+#define CORE_CLOCK_DEFAULT 250000000
+#define CLOCK_DIVIDER_MAX 65534
+
+// delay before chip select is released, as the spidev backend
+#define CS_HOLD_NS 2000
+
+// a transfer making no progress for this long has failed
+#define TRANSFER_TIMEOUT_NS 1000000000
+
+// VideoCore mailbox property interface (for the core clock)
+#define VCIO_DEVICE "/dev/vcio"
+#define VCIO_PROPERTY _IOWR(100, 0, char *)
+#define VCIO_GET_CLOCK_RATE 0x00030002
+#define VCIO_CLOCK_CORE 4
+#define VCIO_RESPONSE_OK 0x80000000
+
+
+typedef struct {
+	volatile uint32_t *registers;
+	uint32_t control;      // SPI0_CS with TA clear: chip select and mode
+	bool timed_out;        // only warn once
+} bcm2835_data;
+
+
+// prototypes
+static uint32_t core_clock_hz(void);
+static uint32_t clock_divider(uint32_t bps);
+static void transfer(SPI_type *spi, const uint8_t *buffer, uint8_t *received, size_t length);
+static uint64_t monotonic_ns(void);
+
+
+static bool bcm2835_create(SPI_type *spi, const char *path) {
+	unsigned int chip_select = 0;
+	char tail = '\0';
+	if ('\0' != *path && (1 != sscanf(path, "%u%c", &chip_select, &tail) || chip_select > 1)) {
+		warnx("SPI: bcm2835 chip select must be 0 or 1: %s", path);
+		return false;
+	}
+
+	bcm2835_data *data = malloc(sizeof(bcm2835_data));
+	if (NULL == data) {
+		warn("failed to allocate SPI bcm2835 structure");
+		return false;
+	}
+	data->registers = GPIO_map_peripheral(SPI0_REGISTERS);
+	if (NULL == data->registers) {
+		warn("failed to mmap spi");
+		free(data);
+		return false;
+	}
+	data->control = chip_select & CS_CS_MASK;
+	data->timed_out = false;
+
+	// the SPI0 pins, set by the kernel only if it has SPI enabled
+	GPIO_mode(GPIO_P1_19, GPIO_SPI);
+	GPIO_mode(GPIO_P1_21, GPIO_SPI);
+	GPIO_mode(GPIO_P1_23, GPIO_SPI);
+	GPIO_mode(0 == chip_select ? GPIO_P1_24 : GPIO_P1_26, GPIO_SPI);
+
+	data->registers[SPI0_CS] = data->control | CS_CLEAR_TX | CS_CLEAR_RX;
+	data->registers[SPI0_CLK] = clock_divider(spi->bps);
+	spi->data = data;
+	return true;
+}
+
+
+static bool bcm2835_destroy(SPI_type *spi) {
+	bcm2835_data *data = spi->data;
+	data->registers[SPI0_CS] = data->control | CS_CLEAR_TX | CS_CLEAR_RX;
+	GPIO_unmap_peripheral(data->registers);
+	bool ok = !data->timed_out;
+	free(data);
+	return ok;
+}
+
+
+static void bcm2835_set_mode(SPI_type *spi, uint8_t mode) {
+	bcm2835_data *data = spi->data;
+	data->control &= CS_CS_MASK;
+	if (0 != (mode & SPI_CPHA)) {
+		data->control |= CS_CPHA;
+	}
+	if (0 != (mode & SPI_CPOL)) {
+		data->control |= CS_CPOL;
+	}
+	data->registers[SPI0_CS] = data->control;
+}
+
+
+static void bcm2835_send(SPI_type *spi, const SPI_segment *segments, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		transfer(spi, segments[i].buffer, NULL, segments[i].length);
+	}
+}
+
+
+static void bcm2835_read(SPI_type *spi, const void *buffer, void *received, size_t length) {
+	transfer(spi, buffer, received, length);
+}
+
+
+const SPI_backend SPI_bcm2835_backend = {
+	.prefix   = "bcm2835:",
+	.create   = bcm2835_create,
+	.destroy  = bcm2835_destroy,
+	.set_mode = bcm2835_set_mode,
+	.send     = bcm2835_send,
+	.read     = bcm2835_read
+};
+
+
+// private functions
+// =================
+
+// the core clock from the VideoCore, or the usual value if it cannot
+// be read
+static uint32_t core_clock_hz(void) {
+	int fd = open(VCIO_DEVICE, O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		return CORE_CLOCK_DEFAULT;
+	}
+
+	uint32_t message[8] __attribute__((aligned(16))) = {
+		sizeof(message), 0,              // size, request
+		VCIO_GET_CLOCK_RATE, 8, 0,       // tag, value size, request
+		VCIO_CLOCK_CORE, 0,              // clock id, rate
+		0                                // end tag
+	};
+	int rc = ioctl(fd, VCIO_PROPERTY, message);
+	close(fd);
+
+	if (rc < 0 || VCIO_RESPONSE_OK != message[1] || 0 == message[6]) {
+		return CORE_CLOCK_DEFAULT;
+	}
+	return message[6];
+}
+
+
+// the smallest even divider giving at most bps
+static uint32_t clock_divider(uint32_t bps) {
+	if (0 == bps) {
+		return CLOCK_DIVIDER_MAX;
+	}
+	uint32_t divider = (core_clock_hz() + bps - 1) / bps;
+	divider = (divider + 1) & ~1u;
+	if (divider < 2) {
+		divider = 2;
+	} else if (divider > CLOCK_DIVIDER_MAX) {
+		divider = CLOCK_DIVIDER_MAX;
+	}
+	return divider;
+}
+
+
+// one transfer with chip select asserted, received may be NULL
+// the FIFOs are serviced in turn so the RX FIFO never stops the TX
+static void transfer(SPI_type *spi, const uint8_t *buffer, uint8_t *received, size_t length) {
+	bcm2835_data *data = spi->data;
+	volatile uint32_t *registers = data->registers;
+
+	if (0 == length) {
+		return;
+	}
+
+	registers[SPI0_CS] = data->control | CS_CLEAR_TX | CS_CLEAR_RX | CS_TA;
+
+	size_t sent = 0;
+	size_t read = 0;
+	uint64_t progress = monotonic_ns();
+	while (read < length) {
+		bool moved = false;
+		while (sent < length && 0 != (registers[SPI0_CS] & CS_TXD)) {
+			registers[SPI0_FIFO] = buffer[sent++];
+			moved = true;
+		}
+		while (read < length && 0 != (registers[SPI0_CS] & CS_RXD)) {
+			uint8_t c = registers[SPI0_FIFO];
+			if (NULL != received) {
+				received[read] = c;
+			}
+			++read;
+			moved = true;
+		}
+		if (moved) {
+			progress = monotonic_ns();
+		} else if (monotonic_ns() - progress > TRANSFER_TIMEOUT_NS) {
+			break;
+		}
+	}
+	while (read == length && 0 == (registers[SPI0_CS] & CS_DONE)) {
+		if (monotonic_ns() - progress > TRANSFER_TIMEOUT_NS) {
+			break;
+		}
+	}
+	if (read < length || 0 == (registers[SPI0_CS] & CS_DONE)) {
+		if (!data->timed_out) {
+			warnx("SPI: bcm2835 transfer timed out");
+		}
+		data->timed_out = true;
+	}
+
+	// hold chip select after the last bit as spidev does
+	uint64_t start = monotonic_ns();
+	while (monotonic_ns() - start < CS_HOLD_NS) {
+	}
+	registers[SPI0_CS] = data->control;
+}
+
+
+static uint64_t monotonic_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
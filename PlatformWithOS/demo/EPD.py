@@ -17,6 +17,71 @@ from PIL import Image
 from PIL import ImageOps
 import re
 import os
+import mmap
+import socket
+import struct
+import time
+
+try:
+    import numpy
+except ImportError:
+    numpy = None
+
+
+# image library packing (leftmost pixel in the top bit, 1 => white) to
+# the panel's (leftmost pixel in the bottom bit, 1 => black), as the
+# driver's LE/display_inverse does, for when numpy is not available
+_PANEL_BYTES = bytes(bytearray(int('{0:08b}'.format(b ^ 0xff)[::-1], 2) for b in range(256)))
+
+# epd_socket.h request header (including the region) and reply
+_SOCKET_MAGIC = 0x53445045
+_SOCKET_REQUEST = struct.Struct('=IIIHBBhH6H')
+_SOCKET_REPLY = struct.Struct('=IIIi')
+_SOCKET_IMAGE = 0x0001
+
+# epd_shm.h header up to completed_sequence, then the slot_sequence array
+_SHM_MAGIC = 0x31445045
+_SHM_HEADER = struct.Struct('=9I')
+_SHM_COMPLETED_SEQUENCE = _SHM_HEADER.size - 4
+_SHM_SLOT_SEQUENCE = _SHM_HEADER.size
+
+# epd_sequence.h header and frame entry
+_SEQUENCE_MAGIC = 0x51445045
+_SEQUENCE_HEADER = struct.Struct('=IHHHHI')
+_SEQUENCE_FRAME = struct.Struct('=HH')
+
+
+def rle_encode(data):
+    """PackBits run length coding as accepted by display_rle
+
+a control byte n of 0..127 is followed by n + 1 literal bytes and
+129..255 by one byte repeated 257 - n times
+"""
+    data = bytearray(data)
+    coded = bytearray()
+    size = len(data)
+    i = 0
+    while i < size:
+        run = 1
+        while i + run < size and run < 128 and data[i + run] == data[i]:
+            run += 1
+        if run > 1:
+            coded.append(257 - run)
+            coded.append(data[i])
+            i += run
+            continue
+        j = i + 1
+        while j < size and j - i < 128 and not (j + 1 < size and data[j] == data[j + 1]):
+            j += 1
+        coded.append(j - i - 1)
+        coded.extend(data[i:j])
+        i = j
+    return bytes(coded)
+
+
+def delta_encode(data, previous):
+    """run length coded XOR of two images as accepted by display_delta"""
+    return rle_encode(bytearray(a ^ b for a, b in zip(bytearray(data), bytearray(previous))))
 
 
 class EPDError(Exception):
@@ -34,13 +99,28 @@ class EPD(object):
 to use:
   from EPD import EPD
 
-  epd = EPD([path='/path/to/epd'], [auto=boolean])
+  epd = EPD([path='/path/to/epd'], [auto=boolean], [socket='/path/to/socket'])
 
   image = Image.new('1', epd.size, 0)
   # draw on image
   epd.clear()         # clear the panel
   epd.display(image)  # tranfer image data
   epd.update()        # refresh the panel image - not deeed if auto=true
+
+  # over a slow link send only the changes since the last image
+  epd.display_delta(image)
+  epd.partial_update()
+
+display also takes an image already in the layout of the display file
+(as returned by pack()) as bytes, bytearray, memoryview or a numpy
+uint8 array, which is written as it is (only padded when it has just
+the width * height / 8 pixel bytes); pack fixed images once.
+
+the display and command files stay open until close(), with
+socket= (epd_fuse -o socket=PATH) update, partial_update and clear
+instead send the image and command in one request and return once the
+panel has been updated, and with shm= (epd_fuse -o shm=NAME) display
+draws into a free shared memory slot that the next command then uses
 """
 
 
@@ -54,6 +134,13 @@ to use:
         self._cog = 0
         self._film = 0
         self._auto = False
+        self._previous = None
+        self._fds = {}
+        self._socket = None
+        self._frame = None          # for the next socket request
+        self._tag = 0
+        self._shm = None
+        self._slot = None           # shared memory slot for the next command
 
         if len(args) > 0:
             self._epd_path = args[0]
@@ -80,6 +167,40 @@ to use:
         if self._width < 1 or self._height < 1:
             raise EPDError('invalid panel geometry')
 
+        # the daemon's image may have bytes after the pixels (the 1.44
+        # panel has 1568 for 128x96), every frame sent is padded to it
+        self._image_size = self._width * self._height // 8
+        self._size = os.stat(os.path.join(self._epd_path, 'display')).st_size
+        if self._size < self._image_size:
+            raise EPDError('invalid display size')
+
+        if kwargs.get('socket'):
+            self._socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            self._socket.connect(kwargs['socket'])
+        else:
+            if kwargs.get('shm'):
+                self._map_shm(kwargs['shm'])
+            self._open('display')
+            self._open('command')
+
+    def close(self):
+        """close the files and socket kept open for updates"""
+        for fd in self._fds.values():
+            os.close(fd)
+        self._fds = {}
+        if self._socket is not None:
+            self._socket.close()
+            self._socket = None
+        if self._shm is not None:
+            self._shm.close()
+            self._shm = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.close()
+
 
     @property
     def size(self):
@@ -122,6 +243,78 @@ to use:
 
 
     def display(self, image):
+        data = self.pack(image)
+
+        if self._socket is not None:
+            self._frame = data
+        elif self._shm is not None:
+            self._fill_slot(data)
+        else:
+            self._write('display', data)
+        self._previous = data
+
+        if self.auto:
+            self.update()
+
+    def display_rle(self, image):
+        """same as display but run length coded, for mostly blank images"""
+        data = self.pack(image)
+
+        self._write('display_rle', rle_encode(data))
+        self._previous = data
+
+        if self.auto:
+            self.update()
+
+    def display_delta(self, image):
+        """same as display but only send the changes from the panel image
+
+the previous image sent is assumed to be on the panel, so the update
+for it must have completed
+"""
+        data = self.pack(image)
+
+        if self._previous is None:
+            with open(os.path.join(self._epd_path, 'current'), 'rb') as f:
+                self._previous = f.read()
+
+        self._write('display_delta', delta_encode(data, self._previous))
+        self._previous = data
+
+        if self.auto:
+            self.update()
+
+    def pack(self, image):
+        """an image in the panel's layout, as bytes or a buffer
+
+an image from the imaging library is converted, anything else must
+already be packed (see display) and is returned as it is
+"""
+        if isinstance(image, Image.Image):
+            return self._pack_image(image)
+
+        if numpy is not None and isinstance(image, numpy.ndarray):
+            if image.dtype != numpy.uint8:
+                raise EPDError('packed image must be uint8')
+            image = numpy.ascontiguousarray(image).reshape(-1)
+        elif isinstance(image, memoryview) and (1 != image.ndim or 'B' != image.format):
+            image = image.cast('B')
+        if len(image) == self._image_size:
+            return self._pad(image)
+        if len(image) != self._size:
+            raise EPDError('image size mismatch')
+        return image
+
+    def _pad(self, data):
+        """extend packed pixels with zeros to the daemon's image size"""
+        padding = self._size - self._image_size
+        if 0 == padding:
+            return data
+        if numpy is not None and isinstance(data, numpy.ndarray):
+            return numpy.concatenate((data, numpy.zeros(padding, dtype=numpy.uint8)))
+        return bytes(data) + bytes(padding)
+
+    def _pack_image(self, image):
 
         # attempt grayscale conversion, and then to single bit.
         # better to do this before calling this if the image is to
@@ -135,13 +328,38 @@ to use:
         if image.size != self.size:
             raise EPDError('image size mismatch')
 
-        with open(os.path.join(self._epd_path, 'LE', 'display_inverse'), 'r+b') as f:
-            f.write(image.tobytes())
+        if numpy is not None:
+            # each group of 8 pixels reversed for the bottom bit first
+            black = numpy.asarray(image) == 0
+            groups = black.reshape(self._height, self._width // 8, 8)[:, :, ::-1]
+            return self._pad(numpy.packbits(groups, axis=2).reshape(-1))
 
-        if self.auto:
-            self.update()
+        return self._pad(image.tobytes().translate(_PANEL_BYTES))
 
 
+    def sequence(self, images, stage_times=None, loops=1):
+        """upload images for play() with a stage time in milliseconds for each
+
+a stage time of 0 (the default) uses the 'P' stage time and loops of 0
+repeats the images until another command; each image is padded by
+pack() to the daemon's image size given in the header
+"""
+        frames = [self.pack(image) for image in images]
+        if stage_times is None:
+            stage_times = [0] * len(frames)
+        if len(stage_times) != len(frames):
+            raise EPDError('one stage time is needed for each image')
+        data = bytearray(_SEQUENCE_HEADER.pack(_SEQUENCE_MAGIC, len(frames), loops, 0, 0, self._size))
+        for t in stage_times:
+            data.extend(_SEQUENCE_FRAME.pack(t, 0))
+        for frame in frames:
+            data.extend(bytearray(frame))
+        self._write('sequence', data)
+
+    def play(self):
+        """draw the uploaded sequence (not available over the socket)"""
+        self._write('command', b'S')
+
     def update(self):
         self._command('U')
 
@@ -152,5 +370,82 @@ to use:
         self._command('C')
 
     def _command(self, c):
-        with open(os.path.join(self._epd_path, 'command'), 'wb') as f:
-            f.write(c)
+        if self._socket is not None:
+            self._request(c)
+        elif self._slot is not None and 'C' != c:
+            self._write('command', '{c:s}{n:d}'.format(c=c, n=self._slot).encode('ascii'))
+        else:
+            self._write('command', c.encode('ascii'))
+
+    def _open(self, name):
+        fd = self._fds.get(name)
+        if fd is None:
+            fd = os.open(os.path.join(self._epd_path, name), os.O_WRONLY)
+            self._fds[name] = fd
+        return fd
+
+    def _write(self, name, data):
+        """write a whole file from the start on its open descriptor"""
+        fd = self._open(name)
+        os.lseek(fd, 0, os.SEEK_SET)
+        view = memoryview(data)
+        while len(view) > 0:
+            view = view[os.write(fd, view):]
+
+    def _request(self, c):
+        """send the waiting frame with a command and wait for the reply"""
+        frame = self._frame if 'C' != c else None
+        self._frame = None
+        self._tag = (self._tag + 1) & 0xffffffff
+        length = 0 if frame is None else self._size
+        flags = 0 if frame is None else _SOCKET_IMAGE
+        header = _SOCKET_REQUEST.pack(_SOCKET_MAGIC, self._tag, length, flags,
+                                      ord(c), 0, 0, 0, 0, 0, 0, 0, 0, 0)
+        if frame is None:
+            self._socket.sendall(header)
+        elif not hasattr(self._socket, 'sendmsg'):
+            self._socket.sendall(header)
+            self._socket.sendall(frame)
+        else:
+            # header and frame in one send without joining them
+            sent = self._socket.sendmsg([header, frame])
+            if sent < len(header):
+                self._socket.sendall(header[sent:])
+                sent = len(header)
+            if sent < len(header) + self._size:
+                self._socket.sendall(memoryview(frame)[sent - len(header):])
+
+        reply = b''
+        while len(reply) < _SOCKET_REPLY.size:
+            data = self._socket.recv(_SOCKET_REPLY.size - len(reply))
+            if not data:
+                raise EPDError('socket closed')
+            reply += data
+        magic, tag, sequence, error = _SOCKET_REPLY.unpack(reply)
+        if _SOCKET_MAGIC != magic or tag != self._tag:
+            raise EPDError('invalid socket reply')
+        if 0 != error:
+            raise EPDError('update failed: {e:d}'.format(e=error))
+
+    def _map_shm(self, name):
+        with open(os.path.join('/dev/shm', name), 'r+b') as f:
+            self._shm = mmap.mmap(f.fileno(), 0)
+        (magic, self._shm_header_size, self._shm_slot_size, self._shm_slots,
+         width, height, image_size, queued, completed) = _SHM_HEADER.unpack_from(self._shm)
+        if _SHM_MAGIC != magic or (width, height) != self.size or image_size != self._size:
+            self._shm.close()
+            self._shm = None
+            raise EPDError('invalid shared memory frame buffer')
+
+    def _fill_slot(self, data):
+        """copy an image to the slot after the last one, once it is free"""
+        slot = 0 if self._slot is None else (self._slot + 1) % self._shm_slots
+        while True:
+            completed = struct.unpack_from('=I', self._shm, _SHM_COMPLETED_SEQUENCE)[0]
+            used = struct.unpack_from('=I', self._shm, _SHM_SLOT_SEQUENCE + 4 * slot)[0]
+            if (completed - used) & 0x80000000 == 0:
+                break
+            time.sleep(0.005)
+        start = self._shm_header_size + slot * self._shm_slot_size
+        self._shm[start:start + self._size] = data
+        self._slot = slot
@@ -34,6 +34,9 @@
 #define digitalRead(pin) GPIO_read(pin)
 #define digitalWrite(pin, value) GPIO_write(pin, value)
 
+// maximum time for BUSY to go low after the COG reset
+#define BUSY_TIMEOUT_MS 1000
+
 
 // inline arrays
 #define ARRAY(type, ...) ((type[]){__VA_ARGS__})
@@ -73,12 +76,15 @@ struct EPD_struct {
 	int stage_time;
 	int factored_stage_time;
 	int lines_per_display;
+	int first_changed_line;  // masked frames only change these lines
+	int end_changed_line;
 	int dots_per_line;
 	int bytes_per_line;
 	int bytes_per_scan;
 	bool filler;
 
 	EPD_error status;
+	bool committed;  // EPD_commit was called since EPD_begin
 
 	const uint8_t *channel_select;
 	size_t channel_select_length;
@@ -107,7 +113,7 @@ EPD_type *EPD_create(EPD_size size,
 	struct sigevent event;
 	event.sigev_notify = SIGEV_NONE;
 
-	if (-1 == timer_create(CLOCK_REALTIME, &event, &timer)) {
+	if (-1 == timer_create(CLOCK_MONOTONIC, &event, &timer)) {
 		warn("falled to create timer");
 		return NULL;
 	}
@@ -187,6 +193,8 @@ EPD_type *EPD_create(EPD_size size,
 	}
 
 	epd->factored_stage_time = epd->stage_time;
+	epd->first_changed_line = 0;
+	epd->end_changed_line = epd->lines_per_display;
 
 	// buffer for frame line
 	epd->line_buffer_size = 2 * epd->bytes_per_line + epd->bytes_per_scan
@@ -201,6 +209,7 @@ EPD_type *EPD_create(EPD_size size,
 
 	// ensure I/O is all set to ZERO
 	power_off(epd);
+	epd->committed = false;
 
 	return epd;
 }
@@ -228,6 +237,7 @@ void EPD_begin(EPD_type *epd) {
 
 	// assume OK
 	epd->status = EPD_OK;
+	epd->committed = false;
 
 	// power up sequence
 	digitalWrite(epd->EPD_Pin_RESET, LOW);
@@ -253,8 +263,10 @@ void EPD_begin(EPD_type *epd) {
 	Delay_ms(5);
 
 	// wait for COG to become ready
-	while (HIGH == digitalRead(epd->EPD_Pin_BUSY)) {
-		Delay_us(10);
+	if (!GPIO_wait_for(epd->EPD_Pin_BUSY, LOW, BUSY_TIMEOUT_MS)) {
+		epd->status = EPD_BUSY_TIMEOUT;
+		power_off(epd);
+		return;
 	}
 
 	// channel select
@@ -346,22 +358,35 @@ void EPD_begin(EPD_type *epd) {
 }
 
 
-void EPD_end(EPD_type *epd) {
+// finish the image: after the dummy frame and the dummy line the
+// panel no longer changes, only the power down remains
+void EPD_commit(EPD_type *epd) {
+	if (epd->committed) {
+		return;
+	}
 
 	// dummy frame
 	frame_fixed(epd, 0x55, EPD_normal);
 
-	// dummy line and border
+	// dummy line
+	line(epd, 0x7fffu, 0, 0x55, NULL, EPD_normal);
+
+	epd->committed = true;
+}
+
+
+void EPD_end(EPD_type *epd) {
+
+	EPD_commit(epd);
+	epd->committed = false;
+
+	// border
 	if (EPD_1_44 == epd->size) {
 		// only for 1.44" EPD
-		line(epd, 0x7fffu, 0, 0x55, NULL, EPD_normal);
-
 		Delay_ms(250);
 
 	} else {
 		// all other display sizes
-		line(epd, 0x7fffu, 0, 0x55, NULL, EPD_normal);
-
 		Delay_ms(25);
 
 		digitalWrite(epd->EPD_Pin_BORDER, LOW);
@@ -500,6 +525,16 @@ void EPD_partial_image(EPD_type *epd, const uint8_t *old_image, const uint8_t *n
 	frame_data_repeat(epd, new_image, old_image, EPD_normal);
 }
 
+// as EPD_partial_image for lines first_line to end_line - 1 only
+// a frame still scans every line, the others are sent as "nothing"
+void EPD_partial_lines(EPD_type *epd, const uint8_t *old_image, const uint8_t *new_image, int first_line, int end_line) {
+	epd->first_changed_line = first_line;
+	epd->end_changed_line = end_line;
+	EPD_partial_image(epd, old_image, new_image);
+	epd->first_changed_line = 0;
+	epd->end_changed_line = epd->lines_per_display;
+}
+
 
 // internal functions
 // ==================
@@ -549,7 +584,11 @@ static void frame_data(EPD_type *epd, const uint8_t *image, const uint8_t *mask,
 	} else {
 		for (uint8_t l = 0; l < epd->lines_per_display ; ++l) {
 			size_t n = l * epd->bytes_per_line;
-			line(epd, l, &image[n], 0, &mask[n], stage);
+			if (l < epd->first_changed_line || l >= epd->end_changed_line) {
+				line(epd, l, &mask[n], 0, &mask[n], stage);  // no pixel differs
+			} else {
+				line(epd, l, &image[n], 0, &mask[n], stage);
+			}
 		}
 	}
 }
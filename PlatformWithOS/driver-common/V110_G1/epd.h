@@ -24,6 +24,10 @@
 #define EPD_IMAGE_ONE_ARG     0
 #define EPD_IMAGE_TWO_ARG     1
 #define EPD_PARTIAL_AVAILABLE 1
+#define EPD_STANDBY_AVAILABLE 0
+#define EPD_STATS_AVAILABLE   0
+#define EPD_TIMING_AVAILABLE  0
+#define EPD_ENCODED_AVAILABLE 0
 
 // display panels supported
 #define EPD_1_44_SUPPORT      1
@@ -42,6 +46,7 @@ typedef enum {
 
 typedef enum {           // error codes
 	EPD_OK,
+	EPD_BUSY_TIMEOUT,
 } EPD_error;
 
 typedef struct EPD_struct EPD_type;
@@ -73,6 +78,10 @@ void EPD_set_factored_stage_time(EPD_type *epd, int pu_stagetime);
 void EPD_begin(EPD_type *epd);
 void EPD_end(EPD_type *epd);
 
+// the first part of end: once it returns the image is final and end
+// only powers down, which can be left until there is time for it
+void EPD_commit(EPD_type *epd);
+
 // ok/error status
 EPD_error EPD_status(EPD_type *epd);
 
@@ -92,5 +101,9 @@ void EPD_image(EPD_type *epd, const uint8_t *old_image, const uint8_t *new_image
 // only updating changed pixels
 void EPD_partial_image(EPD_type *epd, const uint8_t *old_image, const uint8_t *new_image);
 
+// as EPD_partial_image but only pixels in lines first_line to
+// end_line - 1 are changed
+void EPD_partial_lines(EPD_type *epd, const uint8_t *old_image, const uint8_t *new_image, int first_line, int end_line);
+
 
 #endif
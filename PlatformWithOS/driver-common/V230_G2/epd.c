@@ -25,7 +25,10 @@
 
 #include "gpio.h"
 #include "spi.h"
+#include "spi_queue.h"
 #include "epd.h"
+#include "epd_pixels.h"
+#include "epd_neon.h"
 
 // delays - more consistent naming
 #define Delay_ms(ms) usleep(1000 * (ms))
@@ -35,6 +38,9 @@
 #define digitalRead(pin) GPIO_read(pin)
 #define digitalWrite(pin, value) GPIO_write(pin, value)
 
+// maximum time for BUSY to go low after the COG reset
+#define BUSY_TIMEOUT_MS 1000
+
 // values for border byte
 #define BORDER_BYTE_BLACK 0xff
 #define BORDER_BYTE_WHITE 0xaa
@@ -63,6 +69,7 @@ static void frame_stage2(EPD_type *epd);
 static void nothing_frame(EPD_type *epd);
 static void dummy_line(EPD_type *epd);
 static void border_dummy_line(EPD_type *epd);
+static void send_voltage_level(EPD_type *epd);
 static void one_line(EPD_type *epd, uint16_t line, const uint8_t *data, uint8_t fixed_value,
 		     EPD_stage stage, uint8_t border_byte);
 
@@ -94,20 +101,24 @@ struct EPD_struct {
 	int bytes_per_scan;
 
 	EPD_error status;
+	bool committed;  // EPD_commit was called since EPD_begin
 
 	const uint8_t *channel_select;
 	size_t channel_select_length;
 
 	uint8_t voltage_level;
+	uint8_t voltage_data[2];  // 0x72, voltage_level as queued lines send it
 
 	const compensation_type *compensation;
 	uint16_t temperature_offset;
 
-	uint8_t *line_buffer;
 	size_t line_buffer_size;
 
 	timer_t timer;
+	bool neon;  // use the NEON line encoders
+
 	SPI_type *spi;
+	SPI_queue_type *queue;  // lines are sent by its thread
 };
 
 
@@ -124,7 +135,7 @@ EPD_type *EPD_create(EPD_size size,
 	struct sigevent event;
 	event.sigev_notify = SIGEV_NONE;
 
-	if (-1 == timer_create(CLOCK_REALTIME, &event, &timer)) {
+	if (-1 == timer_create(CLOCK_MONOTONIC, &event, &timer)) {
 		warn("falled to create timer");
 		return NULL;
 	}
@@ -192,23 +203,28 @@ EPD_type *EPD_create(EPD_size size,
 	}
 	}
 
+	epd->voltage_data[0] = 0x72;
+	epd->voltage_data[1] = epd->voltage_level;
+
 	// buffer for frame line
 	epd->line_buffer_size = 2 * epd->bytes_per_line
 		+ epd->bytes_per_scan
 		+ 2; // command byte, border byte
 
-	epd->line_buffer = malloc(epd->line_buffer_size + 4096);
-	if (NULL == epd->line_buffer) {
+	// lines are encoded into the queue's buffers while it sends
+	// the previous ones
+	epd->queue = SPI_queue_create(spi, epd->line_buffer_size);
+	if (NULL == epd->queue) {
 		free(epd);
-		warn("falled to allocate EPD line buffer");
 		return NULL;
 	}
 
-	// ensure zero
-	memset(epd->line_buffer, 0x00, epd->line_buffer_size);
+	// select the line encoders for this CPU
+	epd->neon = EPD_neon_available();
 
 	// ensure I/O is all set to ZERO
 	power_off(epd);
+	epd->committed = false;
 
 	return epd;
 }
@@ -219,9 +235,7 @@ void EPD_destroy(EPD_type *epd) {
 	if (NULL == epd) {
 		return;
 	}
-	if (NULL != epd->line_buffer) {
-		free(epd->line_buffer);
-	}
+	SPI_queue_destroy(epd->queue);
 	free(epd);
 }
 
@@ -237,6 +251,7 @@ void EPD_begin(EPD_type *epd) {
 
 	// assume OK
 	epd->status = EPD_OK;
+	epd->committed = false;
 
 	// power up sequence
 	digitalWrite(epd->EPD_Pin_RESET, LOW);
@@ -261,8 +276,10 @@ void EPD_begin(EPD_type *epd) {
 	Delay_ms(5);
 
 	// wait for COG to become ready
-	while (HIGH == digitalRead(epd->EPD_Pin_BUSY)) {
-		Delay_us(10);
+	if (!GPIO_wait_for(epd->EPD_Pin_BUSY, LOW, BUSY_TIMEOUT_MS)) {
+		epd->status = EPD_BUSY_TIMEOUT;
+		power_off(epd);
+		return;
 	}
 
 	// read the COG ID
@@ -366,7 +383,12 @@ void EPD_begin(EPD_type *epd) {
 }
 
 
-void EPD_end(EPD_type *epd) {
+// finish the image: after the nothing frame and the dummy lines the
+// panel no longer changes, only the power down remains
+void EPD_commit(EPD_type *epd) {
+	if (epd->committed) {
+		return;
+	}
 
 	nothing_frame(epd);
 
@@ -375,6 +397,15 @@ void EPD_end(EPD_type *epd) {
 	}
 	dummy_line(epd);
 
+	epd->committed = true;
+}
+
+
+void EPD_end(EPD_type *epd) {
+
+	EPD_commit(epd);
+	epd->committed = false;
+
 	if (EPD_2_7 == epd->size) {
 		// only pulse border pin for 2.70" EPD
 		digitalWrite(epd->EPD_Pin_BORDER, LOW);
@@ -539,6 +570,7 @@ static void frame_fixed_timed(EPD_type *epd, uint8_t fixed_value, long stage_tim
 		for (uint8_t line = 0; line < epd->lines_per_display ; ++line) {
 			one_line(epd, epd->lines_per_display - line - 1, 0, fixed_value, EPD_normal, BORDER_BYTE_NULL);
 		}
+		SPI_queue_flush(epd->queue);  // the frame ends when it is sent
 
 		if (-1 == timer_gettime(epd->timer, &its)) {
 			err(1, "timer_gettime failed");
@@ -593,6 +625,7 @@ static void frame_fixed_13(EPD_type *epd, uint8_t value, EPD_stage stage) {
 			}
 		}
 	}
+	SPI_queue_flush(epd->queue);
 }
 
 
@@ -642,6 +675,7 @@ static void frame_data_13(EPD_type *epd, const uint8_t *image, EPD_stage stage)
 			}
 		}
 	}
+	SPI_queue_flush(epd->queue);
 }
 
 
@@ -657,35 +691,50 @@ static void nothing_frame(EPD_type *epd) {
 	for (int line = 0; line < epd->lines_per_display; ++line) {
 
 		// charge pump voltage level reduce voltage shift
-		SPI_send(epd->spi, CU8(0x70, 0x04), 2);
-		SPI_send(epd->spi, CU8(0x72, epd->voltage_level), 2);
+		send_voltage_level(epd);
 
 		one_line(epd, line, 0, 0x00, EPD_normal, BORDER_BYTE_NULL);
 	}
+	SPI_queue_flush(epd->queue);
 }
 
 
 static void dummy_line(EPD_type *epd) {
 	// charge pump voltage level reduce voltage shift
-	SPI_send(epd->spi, CU8(0x70, 0x04), 2);
-	SPI_send(epd->spi, CU8(0x72, epd->voltage_level), 2);
+	send_voltage_level(epd);
 	one_line(epd, 0x7fffu, 0, 0x00, EPD_normal, BORDER_BYTE_NULL);
+	SPI_queue_flush(epd->queue);
 }
 
 
 static void border_dummy_line(EPD_type *epd) {
 	one_line(epd, 0x7fffu, 0, 0x00, EPD_normal, BORDER_BYTE_BLACK);
+	SPI_queue_flush(epd->queue);
 	Delay_ms(40);
 	one_line(epd, 0x7fffu, 0, 0x00, EPD_normal, BORDER_BYTE_WHITE);
+	SPI_queue_flush(epd->queue);
 	Delay_ms(200);
 }
 
 
+// queue the charge pump voltage level command
+static void send_voltage_level(EPD_type *epd) {
+	static const uint8_t command[] = {0x70, 0x04};
+	const SPI_segment segments[] = {
+		{command, sizeof(command)},
+		{epd->voltage_data, sizeof(epd->voltage_data)}
+	};
+	SPI_queue_send(epd->queue, segments, sizeof(segments) / sizeof(segments[0]));
+}
+
+
 static void one_line(EPD_type *epd, uint16_t line, const uint8_t *data, uint8_t fixed_value,
 		     EPD_stage stage, uint8_t border_byte) {
 
-	// set up data buffer
-	uint8_t *p = epd->line_buffer;
+	// set up data buffer, queued so the next line can be encoded
+	// while this one is sent
+	uint8_t *buffer = SPI_queue_buffer(epd->queue);
+	uint8_t *p = buffer;
 	*p++ = 0x72;
 
 	// border byte
@@ -698,47 +747,48 @@ static void one_line(EPD_type *epd, uint16_t line, const uint8_t *data, uint8_t
 
 	// pixels
 	if (0 != data) {
-		for (uint16_t b = 0; b < epd->bytes_per_line; ++b) {
-			uint8_t pixels = data[b];
-			switch(stage) {
-			case EPD_inverse:      // B -> W, W -> B
-				pixels ^= 0xff;
-				break;
-			case EPD_normal:       // B -> B, W -> W
-				break;
-			}
-
-			*--odd = 0xaa | pixels;
-
-			pixels >>= 1;
-			pixels |= 0xaa;
-
-			*even++ = ((pixels & 0xc0) >> 6)
-				| ((pixels & 0x30) >> 2)
-				| ((pixels & 0x0c) << 2)
-				| ((pixels & 0x03) << 6);
+		// inverse (B -> W, W -> B) is the normal conversion of the
+		// complemented image, the same as the G2 compensate stage
+		int pixel_stage = EPD_inverse == stage ? EPD_PIXELS_COMPENSATE : EPD_PIXELS_NORMAL;
+		const uint8_t *odd_pixels = EPD_odd_pixels[pixel_stage];
+		const uint8_t *even_pixels = EPD_even_pixels[pixel_stage];
+		uint16_t odd_end = epd->bytes_per_line;
+		uint16_t even_start = 0;
+		if (epd->neon) {
+			// odd: the last image bytes go first, so NEON fills the start
+			odd_end -= EPD_neon_odd_pixels(p, data, NULL, epd->bytes_per_line, pixel_stage);
+			even_start = EPD_neon_even_pixels(even, data, NULL, epd->bytes_per_line, pixel_stage);
+		}
+		for (uint16_t b = 0; b < odd_end; ++b) {
+			*--odd = odd_pixels[data[b]];
+		}
+		for (uint16_t b = even_start; b < epd->bytes_per_line; ++b) {
+			even[b] = even_pixels[data[b]];
 		}
 	} else {
 		memset(p, fixed_value, epd->bytes_per_line);
 		memset(even, fixed_value, epd->bytes_per_line);
 	}
 
-	// scan line
-	int scan_pos = 0;
+	// scan line, the buffer may hold another line's scan byte
+	memset(scan, 0x00, epd->bytes_per_scan);
 	if (line < epd->lines_per_display) {
-		scan_pos = (epd->lines_per_display - line - 1) >> 2;
+		int scan_pos = (epd->lines_per_display - line - 1) >> 2;
 		int scan_shift = (line & 0x03) << 1;
 		scan[scan_pos] = 0x03 << scan_shift;
 	}
 
-	// send the accumulated line buffer
-	SPI_send(epd->spi, CU8(0x70, 0x0a), 2);
-	SPI_send(epd->spi, epd->line_buffer, epd->line_buffer_size);
-
-	// restore scan buffer
-	scan[scan_pos] = 0x00;
-
-	// turn on OE
-	SPI_send(epd->spi, CU8(0x70, 0x02), 2);
-	SPI_send(epd->spi, CU8(0x72, 0x07), 2);
+	// the commands outlive this call as the queue sends them later
+	static const uint8_t data_command[] = {0x70, 0x0a};
+	static const uint8_t output_command[] = {0x70, 0x02};
+	static const uint8_t output_data[] = {0x72, 0x07};
+
+	// send the accumulated line buffer then turn on OE
+	const SPI_segment segments[] = {
+		{data_command, sizeof(data_command)},
+		{buffer, epd->line_buffer_size},
+		{output_command, sizeof(output_command)},
+		{output_data, sizeof(output_data)}
+	};
+	SPI_queue_send(epd->queue, segments, sizeof(segments) / sizeof(segments[0]));
 }
@@ -24,6 +24,10 @@
 #define EPD_IMAGE_ONE_ARG     1
 #define EPD_IMAGE_TWO_ARG     0
 #define EPD_PARTIAL_AVAILABLE 0
+#define EPD_STANDBY_AVAILABLE 0
+#define EPD_STATS_AVAILABLE   0
+#define EPD_TIMING_AVAILABLE  0
+#define EPD_ENCODED_AVAILABLE 0
 
 // display panels supported
 #define EPD_1_44_SUPPORT      1
@@ -42,6 +46,7 @@ typedef enum {
 
 typedef enum {           // error codes
 	EPD_OK,
+	EPD_BUSY_TIMEOUT,
 	EPD_UNSUPPORTED_COG,
 	EPD_PANEL_BROKEN,
 	EPD_DC_FAILED
@@ -72,6 +77,10 @@ void EPD_set_temperature(EPD_type *epd, int temperature);
 void EPD_begin(EPD_type *epd);
 void EPD_end(EPD_type *epd);
 
+// the first part of end: once it returns the image is final and end
+// only powers down, which can be left until there is time for it
+void EPD_commit(EPD_type *epd);
+
 // ok/error status
 EPD_error EPD_status(EPD_type *epd);
 
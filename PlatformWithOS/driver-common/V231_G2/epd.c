@@ -21,11 +21,13 @@
 #include <stdlib.h>
 #include <err.h>
 #include <time.h>
-#include <signal.h>
 
 #include "gpio.h"
 #include "spi.h"
+#include "spi_queue.h"
 #include "epd.h"
+#include "epd_pixels.h"
+#include "epd_neon.h"
 
 // delays - more consistent naming
 #define Delay_ms(ms) usleep(1000 * (ms))
@@ -35,6 +37,12 @@
 #define digitalRead(pin) GPIO_read(pin)
 #define digitalWrite(pin, value) GPIO_write(pin, value)
 
+// maximum time for BUSY to go low after the COG reset
+#define BUSY_TIMEOUT_MS 1000
+
+// fraction bits of the measured time per line
+#define LINE_TIME_SHIFT 8
+
 // values for border byte
 #define BORDER_BYTE_BLACK 0xff
 #define BORDER_BYTE_WHITE 0xaa
@@ -46,7 +54,7 @@
 #define CU8(...) (ARRAY(const uint8_t, __VA_ARGS__))
 
 // types
-typedef enum {           // Image pixel -> Display pixel
+typedef enum {           // Image pixel -> Display pixel (order of EPD_PIXELS_* and EPD_STATS_* values)
 	EPD_compensate,  // B -> W, W -> B (Current Image)
 	EPD_white,       // B -> N, W -> W (Current Image)
 	EPD_inverse,     // B -> N, W -> B (New Image)
@@ -61,14 +69,21 @@ typedef enum {
 
 // function prototypes
 
+static void power_on(EPD_type *epd);
 static void power_off(EPD_type *epd);
+static uint64_t monotonic_ns(void);
 
 static int temperature_to_factor_10x(int temperature);
-static void frame_fixed(EPD_type *epd, uint8_t fixed_value, EPD_stage stage);
-static void frame_data(EPD_type *epd, const uint8_t *image, const uint8_t *mask, EPD_stage stage);
+static void frame_encode(EPD_type *epd, const uint8_t *image, uint8_t fixed_value, const uint8_t *mask, EPD_stage stage);
+static void frame_encode_changed(EPD_type *epd, const uint8_t *image, const uint8_t *mask, int first_line, int end_line, EPD_stage stage);
+static void frame_send(EPD_type *epd);
 static void frame_fixed_repeat(EPD_type *epd, uint8_t fixed_value, EPD_stage stage);
 static void frame_data_repeat(EPD_type *epd, const uint8_t *image, const uint8_t *mask, EPD_stage stage);
+static void frame_send_repeat(EPD_type *epd);
+static void frame_time_range(uint64_t t, uint64_t *shortest, uint64_t *longest);
 static void one_line(EPD_type *epd, uint16_t line, const uint8_t *data, uint8_t fixed_value, const uint8_t *mask, EPD_stage stage);
+static size_t encode_line(EPD_type *epd, uint8_t *buffer, uint16_t line, const uint8_t *data, uint8_t fixed_value, const uint8_t *mask, EPD_stage stage);
+static void send_line(EPD_type *epd, const uint8_t *buffer, size_t length);
 static void nothing_frame(EPD_type *epd);
 static void dummy_line(EPD_type *epd);
 static void border_dummy_line(EPD_type *epd);
@@ -99,13 +114,27 @@ struct EPD_struct {
 	const uint8_t *channel_select;
 	size_t channel_select_length;
 
-	uint8_t *line_buffer;
 	size_t line_buffer_size;
 
-	timer_t timer;
+	uint8_t *frame_buffer;     // one stage of encoded lines (line_buffer_size stride)
+	const uint8_t *frame_data; // lines to send: frame_buffer or a pre-encoded stage
+	size_t frame_stride;       // bytes between lines in frame_data
+	size_t frame_line_length;  // bytes used by each line in frame_data
+	int frame_lines;           // number of lines in frame_data
+	EPD_stage frame_stage;     // stage encoded in frame_data
+
+	bool neon;  // use the NEON line encoders
+
+	EPD_timing timing;
+	uint64_t line_time;  // moving average time to send one line in 1/256 ns, 0 => not measured yet
+
 	SPI_type *spi;
+	SPI_queue_type *queue;  // lines are sent by its thread
 
 	bool COG_on;
+	bool committed;  // EPD_commit was called since the last update
+
+	EPD_stats_type stats;
 };
 
 
@@ -117,16 +146,6 @@ EPD_type *EPD_create(EPD_size size,
 		     int busy_pin,
 		     SPI_type *spi) {
 
-	// create a polled timer
-	timer_t timer;
-	struct sigevent event;
-	event.sigev_notify = SIGEV_NONE;
-
-	if (-1 == timer_create(CLOCK_REALTIME, &event, &timer)) {
-		warn("falled to create timer");
-		return NULL;
-	}
-
 	// allocate memory
 	EPD_type *epd = malloc(sizeof(EPD_type));
 	if (NULL == epd) {
@@ -136,7 +155,8 @@ EPD_type *EPD_create(EPD_size size,
 
 	epd->status = EPD_UNDEFINED;
 	epd->spi = spi;
-	epd->timer = timer;
+	epd->timing = EPD_TIMING_DEADLINE;
+	epd->line_time = 0;
 
 	epd->EPD_Pin_PANEL_ON = panel_on_pin;
 	epd->EPD_Pin_BORDER = border_pin;
@@ -234,26 +254,44 @@ EPD_type *EPD_create(EPD_size size,
 			+ epd->bytes_per_scan
 			+ 3; // command byte, pre_border_byte, border byte
 	} else {
-		epd->line_buffer_size = epd->bytes_per_line
+		epd->line_buffer_size = 2 * epd->bytes_per_line  // all_pixels: two bytes per image byte
 			+ 2 * epd->bytes_per_scan
 			+ 3; // command byte, pre_border_byte, border byte
 	}
 
-	epd->line_buffer = malloc(epd->line_buffer_size + 4096);
-	if (NULL == epd->line_buffer) {
+	// buffer for a complete pre-encoded frame
+	epd->frame_buffer = malloc(epd->lines_per_display * epd->line_buffer_size);
+	if (NULL == epd->frame_buffer) {
 		free(epd);
-		warn("falled to allocate EPD line buffer");
+		warn("falled to allocate EPD frame buffer");
 		return NULL;
 	}
 
-	// ensure zero
-	memset(epd->line_buffer, 0x00, epd->line_buffer_size);
+	// lines are encoded into the queue's buffers while it sends
+	// the previous ones
+	epd->queue = SPI_queue_create(spi, epd->line_buffer_size);
+	if (NULL == epd->queue) {
+		free(epd->frame_buffer);
+		free(epd);
+		return NULL;
+	}
+	epd->frame_data = epd->frame_buffer;
+	epd->frame_stride = epd->line_buffer_size;
+	epd->frame_line_length = 0;
+	epd->frame_lines = 0;
+	epd->frame_stage = EPD_normal;
+
+	// select the line encoders for this CPU
+	epd->neon = EPD_neon_available();
+
+	EPD_reset_stats(epd);
 
 	// ensure I/O is all set to ZERO
 	power_off(epd);
 
 	// COG state for partial update
 	epd->COG_on = false;
+	epd->committed = false;
 
 	return epd;
 }
@@ -264,8 +302,9 @@ void EPD_destroy(EPD_type *epd) {
 	if (NULL == epd) {
 		return;
 	}
-	if (NULL != epd->line_buffer) {
-		free(epd->line_buffer);
+	SPI_queue_destroy(epd->queue);
+	if (NULL != epd->frame_buffer) {
+		free(epd->frame_buffer);
 	}
 	free(epd);
 }
@@ -277,14 +316,39 @@ EPD_error EPD_status(EPD_type *epd) {
 }
 
 
+// copy the counters
+void EPD_get_stats(EPD_type *epd, EPD_stats_type *stats) {
+	*stats = epd->stats;
+}
+
+
+// zero the counters
+void EPD_reset_stats(EPD_type *epd) {
+	memset(&epd->stats, 0, sizeof(epd->stats));
+}
+
+
 // starts an EPD sequence
 void EPD_begin(EPD_type *epd) {
 
+	// an update follows so EPD_end must send the nothing frame again
+	epd->committed = false;
+
 	// Nothing to do when COG still on
 	if (epd->COG_on) {
 		return;
 	}
 
+	uint64_t start = monotonic_ns();
+	power_on(epd);
+	++epd->stats.begins;
+	epd->stats.begin_ns += monotonic_ns() - start;
+}
+
+
+// COG power up sequence
+static void power_on(EPD_type *epd) {
+
 	// assume OK
 	epd->status = EPD_OK;
 
@@ -311,8 +375,10 @@ void EPD_begin(EPD_type *epd) {
 	Delay_ms(5);
 
 	// wait for COG to become ready
-	while (HIGH == digitalRead(epd->EPD_Pin_BUSY)) {
-		Delay_us(10);
+	if (!GPIO_wait_for(epd->EPD_Pin_BUSY, LOW, BUSY_TIMEOUT_MS)) {
+		epd->status = EPD_BUSY_TIMEOUT;
+		power_off(epd);
+		return;
 	}
 
 	// read the COG ID
@@ -377,6 +443,10 @@ void EPD_begin(EPD_type *epd) {
 	bool dc_ok = false;
 
 	for (int i = 0; i < 4; ++i) {
+		if (i > 0) {
+			++epd->stats.dc_retries;
+		}
+
 		// charge pump positive voltage on - VGH/VDL on
 		SPI_send(epd->spi, CU8(0x70, 0x05), 2);
 		SPI_send(epd->spi, CU8(0x72, 0x01), 2);
@@ -418,19 +488,48 @@ void EPD_begin(EPD_type *epd) {
 }
 
 
-void EPD_end(EPD_type *epd) {
+// finish the image: after the nothing frame and the dummy line the
+// panel no longer changes, only the power down remains
+void EPD_commit(EPD_type *epd) {
+
+	// Nothing to do when COG already off or committed
+	if (!epd->COG_on || epd->committed) {
+		return;
+	}
+
+	uint64_t start = monotonic_ns();
 
 	nothing_frame(epd);
 
 	if (EPD_2_7 == epd->size) {
 		dummy_line(epd);
+	} else {
+		border_dummy_line(epd);
+	}
+
+	epd->committed = true;
+	epd->stats.end_ns += monotonic_ns() - start;
+}
+
+
+void EPD_end(EPD_type *epd) {
+
+	// Nothing to do when COG already off
+	if (!epd->COG_on) {
+		return;
+	}
+
+	EPD_commit(epd);
+
+	uint64_t start = monotonic_ns();
+
+	if (EPD_2_7 == epd->size) {
 		// only pulse border pin for 2.70" EPD
 		Delay_ms(25);
 		digitalWrite(epd->EPD_Pin_BORDER, LOW);
 		Delay_ms(200);
 		digitalWrite(epd->EPD_Pin_BORDER, HIGH);
 	} else {
-		border_dummy_line(epd);
 		Delay_ms(200);
 	}
 
@@ -469,6 +568,10 @@ void EPD_end(EPD_type *epd) {
 	power_off(epd);
 
 	epd->COG_on = false;
+	epd->committed = false;
+
+	++epd->stats.ends;
+	epd->stats.end_ns += monotonic_ns() - start;
 }
 
 
@@ -488,6 +591,14 @@ static void power_off(EPD_type *epd) {
 }
 
 
+// time for the counters
+static uint64_t monotonic_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
 void EPD_set_temperature(EPD_type *epd, int temperature) {
 	epd->factored_stage_time = epd->base_stage_time * temperature_to_factor_10x(temperature) / 10;
 }
@@ -496,6 +607,10 @@ void EPD_set_factored_stage_time(EPD_type *epd, int pu_stagetime) {
 	epd->factored_stage_time = pu_stagetime;
 }
 
+void EPD_set_timing(EPD_type *epd, EPD_timing timing) {
+	epd->timing = timing;
+}
+
 
 // clear display (anything -> white)
 void EPD_clear(EPD_type *epd) {
@@ -521,11 +636,66 @@ void EPD_image(EPD_type *epd, const uint8_t *old_image, const uint8_t *new_image
 	frame_data_repeat(epd, new_image, NULL, EPD_normal);
 }
 
+// encode the stages of EPD_image_0 or EPD_image without sending them
+void EPD_encode_image(EPD_type *epd, uint8_t *stages, const uint8_t *old_image, const uint8_t *new_image) {
+	uint64_t start = monotonic_ns();
+	size_t length = EPD_encoded_line_length(epd);
+	for (EPD_stage stage = EPD_compensate; stage <= EPD_normal; ++stage) {
+		const uint8_t *image = (stage < EPD_inverse) ? old_image : new_image;
+		for (int l = 0; l < epd->lines_per_display; ++l) {
+			const uint8_t *data = (NULL == image) ? NULL : &image[l * epd->bytes_per_line];
+			encode_line(epd, stages, l, data, 0xaa, NULL, stage);
+			stages += length;
+		}
+	}
+	epd->stats.encode_ns += monotonic_ns() - start;
+}
+
+// send the stages of EPD_encode_image straight from stages
+void EPD_encoded_image(EPD_type *epd, const uint8_t *stages) {
+	size_t length = EPD_encoded_line_length(epd);
+	for (EPD_stage stage = EPD_compensate; stage <= EPD_normal; ++stage) {
+		epd->frame_data = stages;
+		epd->frame_stride = length;
+		epd->frame_line_length = length;
+		epd->frame_lines = epd->lines_per_display;
+		epd->frame_stage = stage;
+		frame_send_repeat(epd);
+		stages += epd->lines_per_display * length;
+	}
+}
+
+// the same for every line and stage: the bytes encode_line places
+// only uses the fixed panel settings, so it does not disturb an update
+size_t EPD_encoded_line_length(EPD_type *epd) {
+	return 1  // command byte
+		+ (epd->pre_border_byte ? 1 : 0)
+		+ 2 * epd->bytes_per_line
+		+ (epd->middle_scan ? 1 : 2) * epd->bytes_per_scan
+		+ (EPD_BORDER_BYTE_NONE == epd->border_byte ? 0 : 1);
+}
+
 // change from old image to new image
 void EPD_partial_image(EPD_type *epd, const uint8_t *old_image, const uint8_t *new_image) {
+	EPD_partial_lines(epd, old_image, new_image, 0, epd->lines_per_display);
+}
+
+// as EPD_partial_image for lines first_line to end_line - 1 only
+void EPD_partial_lines(EPD_type *epd, const uint8_t *old_image, const uint8_t *new_image, int first_line, int end_line) {
+	if (first_line < 0) {
+		first_line = 0;
+	}
+	if (end_line > epd->lines_per_display) {
+		end_line = epd->lines_per_display;
+	}
 	// Only need last stage for partial update
 	// See discussion on issue #19 in the repaper/gratis repository on github
-	frame_data_repeat(epd, new_image, old_image, EPD_normal);
+	// Lines without any changed pixels would only send "nothing" so
+	// they are skipped, giving more frames to the changed lines
+	frame_encode_changed(epd, new_image, old_image, first_line, end_line, EPD_normal);
+	if (epd->frame_lines > 0) {
+		frame_send_repeat(epd);
+	}
 }
 
 
@@ -562,65 +732,145 @@ static int temperature_to_factor_10x(int temperature) {
 // the image is arranged by line which matches the display size
 // so smallest would have 96 * 32 bytes
 
-static void frame_fixed(EPD_type *epd, uint8_t fixed_value, EPD_stage stage) {
+// encode every line of one stage into the frame buffer
+// so that repeated frames only need to be transmitted
+static void frame_encode(EPD_type *epd, const uint8_t *image, uint8_t fixed_value, const uint8_t *mask, EPD_stage stage) {
+	uint64_t start = monotonic_ns();
+	uint8_t *p = epd->frame_buffer;
+	epd->frame_data = epd->frame_buffer;
+	epd->frame_stride = epd->line_buffer_size;
 	for (uint8_t l = 0; l < epd->lines_per_display ; ++l) {
-		one_line(epd, l, NULL, fixed_value, NULL, stage);
+		size_t n = l * epd->bytes_per_line;
+		const uint8_t *data = (NULL == image) ? NULL : &image[n];
+		const uint8_t *line_mask = (NULL == mask) ? NULL : &mask[n];
+		epd->frame_line_length = encode_line(epd, p, l, data, fixed_value, line_mask, stage);
+		p += epd->line_buffer_size;
 	}
+	epd->frame_lines = epd->lines_per_display;
+	epd->frame_stage = stage;
+	epd->stats.encode_ns += monotonic_ns() - start;
 }
 
 
-static void frame_data(EPD_type *epd, const uint8_t *image, const uint8_t *mask, EPD_stage stage) {
-	if (NULL == mask) {
-		for (uint8_t l = 0; l < epd->lines_per_display ; ++l) {
-			one_line(epd, l, &image[l * epd->bytes_per_line], 0, NULL, stage);
-		}
-	} else {
-		for (uint8_t l = 0; l < epd->lines_per_display ; ++l) {
-			size_t n = l * epd->bytes_per_line;
-			one_line(epd, l, &image[n], 0, &mask[n], stage);
+// encode only the lines of image that differ from mask (the old image)
+// from first_line up to end_line
+static void frame_encode_changed(EPD_type *epd, const uint8_t *image, const uint8_t *mask, int first_line, int end_line, EPD_stage stage) {
+	uint64_t start = monotonic_ns();
+	uint8_t *p = epd->frame_buffer;
+	epd->frame_data = epd->frame_buffer;
+	epd->frame_stride = epd->line_buffer_size;
+	epd->frame_lines = 0;
+	for (int l = first_line; l < end_line; ++l) {
+		size_t n = l * epd->bytes_per_line;
+		if (0 == memcmp(&image[n], &mask[n], epd->bytes_per_line)) {
+			continue;
 		}
+		epd->frame_line_length = encode_line(epd, p, l, &image[n], 0, &mask[n], stage);
+		p += epd->line_buffer_size;
+		++epd->frame_lines;
 	}
+	epd->frame_stage = stage;
+	epd->stats.encode_ns += monotonic_ns() - start;
+}
+
+
+// transmit the pre-encoded frame once
+// returns after the last line was sent so the frame times stay exact
+static void frame_send(EPD_type *epd) {
+	const uint8_t *p = epd->frame_data;
+	for (int l = 0; l < epd->frame_lines; ++l) {
+		send_line(epd, p, epd->frame_line_length);
+		p += epd->frame_stride;
+	}
+	SPI_queue_flush(epd->queue);
 }
 
 
 static void frame_fixed_repeat(EPD_type *epd, uint8_t fixed_value, EPD_stage stage) {
-	struct itimerspec its;
-	its.it_value.tv_sec = epd->factored_stage_time / 1000;
-	its.it_value.tv_nsec = (epd->factored_stage_time % 1000) * 1000000;
-	its.it_interval.tv_sec = 0;
-	its.it_interval.tv_nsec = 0;
+	frame_encode(epd, NULL, fixed_value, NULL, stage);
+	frame_send_repeat(epd);
+}
+
+
+static void frame_data_repeat(EPD_type *epd, const uint8_t *image, const uint8_t *mask, EPD_stage stage) {
+	frame_encode(epd, image, 0, mask, stage);
+	frame_send_repeat(epd);
+}
+
+
+// repeatedly transmit the frame buffer for the stage time
+//
+// EPD_TIMING_FRAME_COUNT sends the number of frames that fit the stage
+// time at the measured time per line without checking the clock to end
+// the stage; until there is a measurement the stage uses the deadline
+//
+// with the deadline the clock is read after every frame anyway, so the
+// shortest and longest frame are kept too: the stage's worst difference
+// from its average frame time is the jitter from preemption, page
+// faults and SPI delays (a counted stage only reads the clock at the
+// start and end, so it gives no jitter)
+static void frame_send_repeat(EPD_type *epd) {
+	uint64_t stage_ns = (uint64_t)epd->factored_stage_time * 1000000;
+	uint64_t start = monotonic_ns();
+	uint64_t now = start;
+	uint64_t shortest = UINT64_MAX;
+	uint64_t longest = 0;
+	unsigned long int n = 0;
+	bool counted = EPD_TIMING_FRAME_COUNT == epd->timing && epd->line_time > 0;
+
+	if (counted) {
+		uint64_t frame_time = epd->line_time * epd->frame_lines;
+		n = ((stage_ns << LINE_TIME_SHIFT) + frame_time / 2) / frame_time;
+		if (n < 1) {
+			n = 1;
+		}
+		for (unsigned long int i = 0; i < n; ++i) {
+			frame_send(epd);
+		}
+		now = monotonic_ns();
+	} else {
+		do {
+			uint64_t previous = now;
+			frame_send(epd);
+			now = monotonic_ns();
+			frame_time_range(now - previous, &shortest, &longest);
+			++n;
+		} while (now - start < stage_ns);
+	}
 
-	if (-1 == timer_settime(epd->timer, 0, &its, NULL)) {
-		err(1, "timer_settime failed");
+	// average over the last few stages so the count follows changes
+	// in SPI speed without one slow stage changing it much
+	uint64_t line_time = ((now - start) << LINE_TIME_SHIFT) / (n * epd->frame_lines);
+	if (0 == line_time) {
+		line_time = 1;
 	}
-	do {
-		frame_fixed(epd, fixed_value, stage);
+	epd->line_time = (0 == epd->line_time) ? line_time : (3 * epd->line_time + line_time) / 4;
 
-		if (-1 == timer_gettime(epd->timer, &its)) {
-			err(1, "timer_gettime failed");
+	if (!counted) {
+		uint64_t average = (now - start) / n;
+		uint64_t jitter = longest - average;
+		if (average - shortest > jitter) {
+			jitter = average - shortest;
 		}
-	} while (its.it_value.tv_sec > 0 || its.it_value.tv_nsec > 0);
+		if (jitter > epd->stats.frame_jitter_ns) {
+			epd->stats.frame_jitter_ns = jitter;
+		}
+	}
+
+	epd->stats.frames[epd->frame_stage] += n;
+	++epd->stats.stages[epd->frame_stage];
+	epd->stats.frame_ns += now - start;
 }
 
 
-static void frame_data_repeat(EPD_type *epd, const uint8_t *image, const uint8_t *mask, EPD_stage stage) {
-	struct itimerspec its;
-	its.it_value.tv_sec = epd->factored_stage_time / 1000;
-	its.it_value.tv_nsec = (epd->factored_stage_time % 1000) * 1000000;
-	its.it_interval.tv_sec = 0;
-	its.it_interval.tv_nsec = 0;
-
-	int n = 0;
-	if (-1 == timer_settime(epd->timer, 0, &its, NULL)) {
-		err(1, "timer_settime failed");
-	}
-	do {
-		frame_data(epd, image, mask, stage);
-		if (-1 == timer_gettime(epd->timer, &its)) {
-			err(1, "timer_gettime failed");
-		}
-		++n;
-	} while (its.it_value.tv_sec > 0 || its.it_value.tv_nsec > 0);
+// widen the range of frame times to include t
+static void frame_time_range(uint64_t t, uint64_t *shortest, uint64_t *longest) {
+	if (t < *shortest) {
+		*shortest = t;
+	}
+	if (t > *longest) {
+		*longest = t;
+	}
 }
 
 
@@ -629,143 +879,124 @@ static void nothing_frame(EPD_type *epd) {
 	for (int line = 0; line < epd->lines_per_display; ++line) {
 		one_line(epd, 0x7fffu, NULL, 0x00, NULL, EPD_compensate);
 	}
+	SPI_queue_flush(epd->queue);
 }
 
 
 static void dummy_line(EPD_type *epd) {
 	one_line(epd, 0x7fffu, NULL, 0x00, NULL, EPD_compensate);
+	SPI_queue_flush(epd->queue);
 }
 
 
 static void border_dummy_line(EPD_type *epd) {
 	one_line(epd, 0x7fffu, NULL, 0x00, NULL, EPD_normal);
+	SPI_queue_flush(epd->queue);
 }
 
 
 // pixels on display are numbered from 1 so even is actually bits 1,3,5,...
 static void even_pixels(EPD_type *epd, uint8_t **pp, const uint8_t *data, uint8_t fixed_value, const uint8_t *mask, EPD_stage stage) {
-
-	for (uint16_t b = 0; b < epd->bytes_per_line; ++b) {
-		if (NULL != data) {
-			uint8_t pixels = data[b] & 0xaa;
-			uint8_t pixel_mask = 0xff;
-			if (NULL != mask) {
-				pixel_mask = (mask[b] ^ pixels) & 0xaa;
-				pixel_mask |= pixel_mask >> 1;
-			}
-			switch(stage) {
-			case EPD_compensate:  // B -> W, W -> B (Current Image)
-				pixels = 0xaa | ((pixels ^ 0xaa) >> 1);
-				break;
-			case EPD_white:       // B -> N, W -> W (Current Image)
-				pixels = 0x55 + ((pixels ^ 0xaa) >> 1);
-				break;
-			case EPD_inverse:     // B -> N, W -> B (New Image)
-				pixels = 0x55 | (pixels ^ 0xaa);
-				break;
-			case EPD_normal:       // B -> B, W -> W (New Image)
-				pixels = 0xaa | (pixels >> 1);
-				break;
+	uint8_t *p = *pp;
+	if (NULL == data) {
+		memset(p, fixed_value, epd->bytes_per_line);
+		p += epd->bytes_per_line;
+	} else {
+		uint16_t b = 0;
+		if (epd->neon) {
+			b = EPD_neon_even_pixels(p, data, mask, epd->bytes_per_line, stage);
+			p += b;
+		}
+		const uint8_t *pixels = EPD_even_pixels[stage];
+		if (NULL == mask) {
+			for (; b < epd->bytes_per_line; ++b) {
+				*p++ = pixels[data[b]];
 			}
-			pixels = (pixels & pixel_mask) | (~pixel_mask & 0x55);
-			uint8_t p1 = (pixels >> 6) & 0x03;
-			uint8_t p2 = (pixels >> 4) & 0x03;
-			uint8_t p3 = (pixels >> 2) & 0x03;
-			uint8_t p4 = (pixels >> 0) & 0x03;
-			pixels = (p1 << 0) | (p2 << 2) | (p3 << 4) | (p4 << 6);
-			*(*pp)++ = pixels;
 		} else {
-			*(*pp)++ = fixed_value;
+			for (; b < epd->bytes_per_line; ++b) {
+				uint8_t pixel_mask = EPD_even_mask[mask[b] ^ data[b]];
+				*p++ = (pixels[data[b]] & pixel_mask) | (~pixel_mask & EPD_PIXELS_NOTHING);
+			}
 		}
 	}
+	*pp = p;
 }
 
 // pixels on display are numbered from 1 so odd is actually bits 0,2,4,...
 static void odd_pixels(EPD_type *epd, uint8_t **pp, const uint8_t *data, uint8_t fixed_value, const uint8_t *mask, EPD_stage stage) {
-	for (uint16_t b = epd->bytes_per_line; b > 0; --b) {
-		if (NULL != data) {
-			uint8_t pixels = data[b - 1] & 0x55;
-			uint8_t pixel_mask = 0xff;
-			if (NULL != mask) {
-				pixel_mask = (mask[b - 1] ^ pixels) & 0x55;
-				pixel_mask |= pixel_mask << 1;
-			}
-			switch(stage) {
-			case EPD_compensate:  // B -> W, W -> B (Current Image)
-				pixels = 0xaa | (pixels ^ 0x55);
-				break;
-			case EPD_white:       // B -> N, W -> W (Current Image)
-				pixels = 0x55 + (pixels ^ 0x55);
-				break;
-			case EPD_inverse:     // B -> N, W -> B (New Image)
-				pixels = 0x55 | ((pixels ^ 0x55) << 1);
-				break;
-			case EPD_normal:       // B -> B, W -> W (New Image)
-				pixels = 0xaa | pixels;
-				break;
+	uint8_t *p = *pp;
+	if (NULL == data) {
+		memset(p, fixed_value, epd->bytes_per_line);
+		p += epd->bytes_per_line;
+	} else {
+		uint16_t b = epd->bytes_per_line;
+		if (epd->neon) {
+			size_t n = EPD_neon_odd_pixels(p, data, mask, b, stage);
+			p += n;
+			b -= n;
+		}
+		const uint8_t *pixels = EPD_odd_pixels[stage];
+		if (NULL == mask) {
+			for (; b > 0; --b) {
+				*p++ = pixels[data[b - 1]];
 			}
-			pixels = (pixels & pixel_mask) | (~pixel_mask & 0x55);
-			*(*pp)++ = pixels;
 		} else {
-			*(*pp)++ = fixed_value;
+			for (; b > 0; --b) {
+				uint8_t pixel_mask = EPD_odd_mask[mask[b - 1] ^ data[b - 1]];
+				*p++ = (pixels[data[b - 1]] & pixel_mask) | (~pixel_mask & EPD_PIXELS_NOTHING);
+			}
 		}
 	}
-}
-
-// interleave bits: (byte)76543210 -> (16 bit).7.6.5.4.3.2.1
-static inline uint16_t interleave_bits(uint16_t value) {
-	value = (value | (value << 4)) & 0x0f0f;
-	value = (value | (value << 2)) & 0x3333;
-	value = (value | (value << 1)) & 0x5555;
-	return value;
+	*pp = p;
 }
 
 // pixels on display are numbered from 1
 static void all_pixels(EPD_type *epd, uint8_t **pp, const uint8_t *data, uint8_t fixed_value, const uint8_t *mask, EPD_stage stage) {
-	for (uint16_t b = epd->bytes_per_line; b > 0; --b) {
-		if (NULL != data) {
-			uint16_t pixels = interleave_bits(data[b - 1]);
-
-			uint16_t pixel_mask = 0xffff;
-			if (NULL != mask) {
-				uint16_t pixel_mask = interleave_bits(mask[b - 1]);
-				pixel_mask = (pixel_mask ^ pixels) & 0x5555;
-				pixel_mask |= pixel_mask << 1;
-			}
-			switch(stage) {
-			case EPD_compensate:  // B -> W, W -> B (Current Image)
-				pixels = 0xaaaa | (pixels ^ 0x5555);
-				break;
-			case EPD_white:       // B -> N, W -> W (Current Image)
-				pixels = 0x5555 + (pixels ^ 0x5555);
-				break;
-			case EPD_inverse:     // B -> N, W -> B (New Image)
-				pixels = 0x5555 | ((pixels ^ 0x5555) << 1);
-				break;
-			case EPD_normal:       // B -> B, W -> W (New Image)
-				pixels = 0xaaaa | pixels;
-				break;
+	uint8_t *p = *pp;
+	if (NULL == data) {
+		memset(p, fixed_value, 2 * epd->bytes_per_line);
+		p += 2 * epd->bytes_per_line;
+	} else {
+		uint16_t b = epd->bytes_per_line;
+		if (epd->neon) {
+			size_t n = EPD_neon_all_pixels(p, data, mask, b, stage);
+			p += 2 * n;
+			b -= n;
+		}
+		const uint16_t *pixels = EPD_all_pixels[stage];
+		if (NULL == mask) {
+			for (; b > 0; --b) {
+				uint16_t value = pixels[data[b - 1]];
+				*p++ = value >> 8;
+				*p++ = value;
 			}
-			pixels = (pixels & pixel_mask) | (~pixel_mask & 0x5555);
-			*(*pp)++ = pixels >> 8;
-			*(*pp)++ = pixels;
 		} else {
-			*(*pp)++ = fixed_value;
-			*(*pp)++ = fixed_value;
+			for (; b > 0; --b) {
+				uint16_t pixel_mask = EPD_all_mask[mask[b - 1] ^ data[b - 1]];
+				uint16_t value = (pixels[data[b - 1]] & pixel_mask) | (~pixel_mask & (EPD_PIXELS_NOTHING * 0x0101));
+				*p++ = value >> 8;
+				*p++ = value;
+			}
 		}
 	}
+	*pp = p;
 }
 
 // output one line of scan and data bytes to the display
+// the line is queued, so the next can be encoded while it is sent
 static void one_line(EPD_type *epd, uint16_t line, const uint8_t *data, uint8_t fixed_value, const uint8_t *mask, EPD_stage stage) {
+	uint8_t *buffer = SPI_queue_buffer(epd->queue);
+	size_t length = encode_line(epd, buffer, line, data, fixed_value, mask, stage);
+	send_line(epd, buffer, length);
+}
 
-	SPI_on(epd->spi);
 
-	// send data
-	SPI_send(epd->spi, CU8(0x70, 0x0a), 2);
+// convert one line of scan and data bytes to the form sent to the display
+// returns the number of bytes placed in buffer
+static size_t encode_line(EPD_type *epd, uint8_t *buffer, uint16_t line, const uint8_t *data, uint8_t fixed_value, const uint8_t *mask, EPD_stage stage) {
 
 	// CS low
-	uint8_t *p = epd->line_buffer;
+	uint8_t *p = buffer;
 
 	*p++ = 0x72;
 
@@ -834,13 +1065,31 @@ static void one_line(EPD_type *epd, uint16_t line, const uint8_t *data, uint8_t
 		}
 		break;
 	}
-	// send the accumulated line buffer
-	SPI_send(epd->spi, epd->line_buffer, p - epd->line_buffer);
+	return p - buffer;
+}
 
-	// output data to panel
-	SPI_send(epd->spi, CU8(0x70, 0x02), 2);
-	SPI_send(epd->spi, CU8(0x72, 0x07), 2);
 
-	//Delay_ms(1);
-	SPI_off(epd->spi);
+// queue an encoded line for the display, buffer must not change
+// until the queue is flushed
+static void send_line(EPD_type *epd, const uint8_t *buffer, size_t length) {
+
+	// the commands outlive this call as the queue sends them later
+	static const uint8_t zero[] = {0x00};
+	static const uint8_t data_command[] = {0x70, 0x0a};
+	static const uint8_t output_command[] = {0x70, 0x02};
+	static const uint8_t output_data[] = {0x72, 0x07};
+
+	// send the whole line as a single chained transfer:
+	// SPI on, data command, the accumulated line buffer,
+	// output data to panel and SPI off
+	// (SPI mode was already set by EPD_begin)
+	const SPI_segment segments[] = {
+		{zero, sizeof(zero)},
+		{data_command, sizeof(data_command)},
+		{buffer, length},
+		{output_command, sizeof(output_command)},
+		{output_data, sizeof(output_data)},
+		{zero, sizeof(zero)}
+	};
+	SPI_queue_send(epd->queue, segments, sizeof(segments) / sizeof(segments[0]));
 }
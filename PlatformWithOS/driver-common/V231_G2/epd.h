@@ -24,6 +24,10 @@
 #define EPD_IMAGE_ONE_ARG     0
 #define EPD_IMAGE_TWO_ARG     1
 #define EPD_PARTIAL_AVAILABLE 1
+#define EPD_STANDBY_AVAILABLE 1
+#define EPD_STATS_AVAILABLE   1
+#define EPD_TIMING_AVAILABLE  1
+#define EPD_ENCODED_AVAILABLE 1
 
 // display panels supported
 #define EPD_1_44_SUPPORT      1
@@ -44,6 +48,7 @@ typedef enum {
 
 typedef enum {           // error codes
 	EPD_OK,
+	EPD_BUSY_TIMEOUT,
 	EPD_UNSUPPORTED_COG,
 	EPD_PANEL_BROKEN,
 	EPD_DC_FAILED,
@@ -52,6 +57,32 @@ typedef enum {           // error codes
 
 typedef struct EPD_struct EPD_type;
 
+typedef enum {           // how the frames of a stage are timed
+	EPD_TIMING_DEADLINE,     // repeat frames until the stage time has passed
+	EPD_TIMING_FRAME_COUNT   // frame count from the measured time per line
+} EPD_timing;
+
+typedef enum {           // index of stage counters
+	EPD_STATS_COMPENSATE,
+	EPD_STATS_WHITE,
+	EPD_STATS_INVERSE,
+	EPD_STATS_NORMAL,
+	EPD_STATS_STAGES     // number of stages
+} EPD_stats_stage;
+
+typedef struct {         // counters since EPD_create or EPD_reset_stats
+	unsigned long int frames[EPD_STATS_STAGES];  // frames sent in each stage
+	unsigned long int stages[EPD_STATS_STAGES];  // times each stage was run
+	uint64_t frame_ns;                           // time sending all the frames
+	uint64_t frame_jitter_ns;                    // worst difference of a frame from its stage's average (deadline timing only)
+	uint64_t encode_ns;                          // time encoding frames
+	unsigned long int begins;                    // power up sequences
+	uint64_t begin_ns;
+	unsigned long int ends;                      // power down sequences
+	uint64_t end_ns;
+	unsigned long int dc_retries;                // extra DC/DC start attempts
+} EPD_stats_type;
+
 
 // functions
 // =========
@@ -74,13 +105,37 @@ void EPD_set_temperature(EPD_type *epd, int temperature);
 // set factored_stage_time directly ('F' command)
 void EPD_set_factored_stage_time(EPD_type *epd, int pu_stagetime);
 
+// select how stages are timed (default EPD_TIMING_DEADLINE)
+void EPD_set_timing(EPD_type *epd, EPD_timing timing);
+
 // sequence start/end
+// the COG stays powered from begin to end so several updates can be
+// sent between them (hot standby): begin does nothing if the COG is
+// still on and end does nothing if it is already off
 void EPD_begin(EPD_type *epd);
 void EPD_end(EPD_type *epd);
 
+// the first part of end: once it returns the image is final and end
+// only powers down, which can be left until there is time for it; with
+// the COG still on another update may be sent first (begin again)
+void EPD_commit(EPD_type *epd);
+
 // ok/error status
 EPD_error EPD_status(EPD_type *epd);
 
+// copy/zero the counters
+void EPD_get_stats(EPD_type *epd, EPD_stats_type *stats);
+void EPD_reset_stats(EPD_type *epd);
+
+// bytes in each line sent to the panel
+size_t EPD_encoded_line_length(EPD_type *epd);
+
+// encode the stages of EPD_image (or of EPD_image_0 if old_image is
+// NULL) into stages without sending anything: the compensate, white,
+// inverse and normal stages one after the other, each of the panel's
+// lines of EPD_encoded_line_length bytes (see epd_frame.h)
+void EPD_encode_image(EPD_type *epd, uint8_t *stages, const uint8_t *old_image, const uint8_t *new_image);
+
 // items below must be bracketed by begin/end
 // ==========================================
 
@@ -93,9 +148,16 @@ void EPD_image_0(EPD_type *epd, const uint8_t *image);
 // change from old image to new image
 void EPD_image(EPD_type *epd, const uint8_t *old_image, const uint8_t *new_image);
 
+// send stages from EPD_encode_image, no encoding is done
+void EPD_encoded_image(EPD_type *epd, const uint8_t *stages);
+
 // change from old image to new image
-// only updating changed pixels
+// only updating changed pixels, lines with no changes are not sent
 void EPD_partial_image(EPD_type *epd, const uint8_t *old_image, const uint8_t *new_image);
 
+// as EPD_partial_image but only lines first_line to end_line - 1 are
+// compared and sent, for callers that know the other lines are unchanged
+void EPD_partial_lines(EPD_type *epd, const uint8_t *old_image, const uint8_t *new_image, int first_line, int end_line);
+
 
 #endif
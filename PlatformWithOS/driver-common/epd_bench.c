@@ -0,0 +1,511 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <err.h>
+
+#include "spi.h"
+#include "epd.h"
+
+// benchmark the panel driver without any hardware
+//
+// the real driver code is linked with the fake SPI and GPIO below
+// which only count what would have been sent, so the results show
+// the time spent in the driver itself
+
+// 1.44" test images
+#include "aphrodite_1_44.xbm"
+#include "cat_1_44.xbm"
+#include "saturn_1_44.xbm"
+#include "text_hello_1_44.xbm"
+#include "text_image_1_44.xbm"
+#include "venus_1_44.xbm"
+
+#if EPD_1_9_SUPPORT
+// 1.9" test images
+#include "aphrodite_1_9.xbm"
+#include "cat_1_9.xbm"
+#include "saturn_1_9.xbm"
+#include "text_hello_1_9.xbm"
+#include "text_image_1_9.xbm"
+#include "venus_1_9.xbm"
+#endif
+
+// 2.0" test images
+#include "aphrodite_2_0.xbm"
+#include "cat_2_0.xbm"
+#include "saturn_2_0.xbm"
+#include "text_hello_2_0.xbm"
+#include "text_image_2_0.xbm"
+#include "venus_2_0.xbm"
+
+#if EPD_2_6_SUPPORT
+// 2.6" test images
+#include "aphrodite_2_6.xbm"
+#include "cat_2_6.xbm"
+#include "saturn_2_6.xbm"
+#include "text_hello_2_6.xbm"
+#include "text_image_2_6.xbm"
+#include "venus_2_6.xbm"
+#endif
+
+// 2.7" test images
+#include "aphrodite_2_7.xbm"
+#include "cat_2_7.xbm"
+#include "saturn_2_7.xbm"
+#include "text_hello_2_7.xbm"
+#include "text_image_2_7.xbm"
+#include "venus_2_7.xbm"
+
+
+static const uint8_t *images_1_44[] = {
+	aphrodite_1_44_bits,
+	cat_1_44_bits,
+	saturn_1_44_bits,
+	text_hello_1_44_bits,
+	text_image_1_44_bits,
+	venus_1_44_bits
+};
+
+#if EPD_1_9_SUPPORT
+static const uint8_t *images_1_9[] = {
+	aphrodite_1_9_bits,
+	cat_1_9_bits,
+	saturn_1_9_bits,
+	text_hello_1_9_bits,
+	text_image_1_9_bits,
+	venus_1_9_bits
+};
+#endif
+
+static const uint8_t *images_2_0[] = {
+	aphrodite_2_0_bits,
+	cat_2_0_bits,
+	saturn_2_0_bits,
+	text_hello_2_0_bits,
+	text_image_2_0_bits,
+	venus_2_0_bits
+};
+
+#if EPD_2_6_SUPPORT
+static const uint8_t *images_2_6[] = {
+	aphrodite_2_6_bits,
+	cat_2_6_bits,
+	saturn_2_6_bits,
+	text_hello_2_6_bits,
+	text_image_2_6_bits,
+	venus_2_6_bits
+};
+#endif
+
+static const uint8_t *images_2_7[] = {
+	aphrodite_2_7_bits,
+	cat_2_7_bits,
+	saturn_2_7_bits,
+	text_hello_2_7_bits,
+	text_image_2_7_bits,
+	venus_2_7_bits
+};
+
+
+#define SIZE_OF_ARRAY(a) (sizeof(a) / sizeof((a)[0]))
+
+static const struct panel_struct {
+	const char *key;
+	EPD_size size;
+	int lines;                   // lines per frame
+	const uint8_t *const *images;
+	int image_count;
+} panels[] = {
+	{"1.44", EPD_1_44,  96, images_1_44, SIZE_OF_ARRAY(images_1_44)},
+#if EPD_1_9_SUPPORT
+	{"1.9",  EPD_1_9,  128, images_1_9,  SIZE_OF_ARRAY(images_1_9)},
+#endif
+	{"2.0",  EPD_2_0,   96, images_2_0,  SIZE_OF_ARRAY(images_2_0)},
+#if EPD_2_6_SUPPORT
+	{"2.6",  EPD_2_6,  128, images_2_6,  SIZE_OF_ARRAY(images_2_6)},
+#endif
+	{"2.7",  EPD_2_7,  176, images_2_7,  SIZE_OF_ARRAY(images_2_7)},
+	{NULL, 0, 0, NULL, 0}  // must be last entry
+};
+
+
+// fake SPI
+// ========
+
+// counts the system calls that spi.c would make and the lines of
+// display data i.e. a transfer starting 0x72 after selecting
+// register 0x0a
+struct SPI_struct {
+	bool mode_valid;
+	uint8_t mode;
+	uint8_t index;               // last register selected
+	SPI_stats_type stats;
+	unsigned long int lines;     // data lines sent
+	uint64_t line_bytes;         // bytes in the data lines
+};
+
+static void fake_transfer(SPI_type *spi, const uint8_t *buffer, size_t length) {
+	spi->stats.bytes += length;
+	if (2 == length && 0x70 == buffer[0]) {
+		spi->index = buffer[1];
+	} else if (0x0a == spi->index && length > 2 && 0x72 == buffer[0]) {
+		++spi->lines;
+		spi->line_bytes += length;
+	}
+}
+
+static void fake_mode(SPI_type *spi, uint8_t mode) {
+	if (!spi->mode_valid || mode != spi->mode) {
+		spi->stats.calls += 4;  // mode, bits, bit order and speed
+		spi->mode = mode;
+		spi->mode_valid = true;
+	}
+}
+
+SPI_type *SPI_create(const char *spi_path, uint32_t bps) {
+	SPI_type *spi = malloc(sizeof(SPI_type));
+	if (NULL == spi) {
+		warn("falled to allocate SPI structure");
+		return NULL;
+	}
+	memset(spi, 0, sizeof(SPI_type));
+	return spi;
+}
+
+bool SPI_destroy(SPI_type *spi) {
+	free(spi);
+	return true;
+}
+
+void SPI_on(SPI_type *spi) {
+	const uint8_t buffer[1] = {0};
+
+	fake_mode(spi, 0);
+	SPI_send(spi, buffer, sizeof(buffer));
+}
+
+void SPI_off(SPI_type *spi) {
+	const uint8_t buffer[1] = {0};
+
+	fake_mode(spi, 0);
+	SPI_send(spi, buffer, sizeof(buffer));
+}
+
+void SPI_send(SPI_type *spi, const void *buffer, size_t length) {
+	++spi->stats.calls;
+	fake_transfer(spi, buffer, length);
+}
+
+// reply as a working COG: ID 0x12, DC/DC on and panel not broken
+void SPI_read(SPI_type *spi, const void *buffer, void *received, size_t length) {
+	const uint8_t *command = buffer;
+	uint8_t *reply = received;
+	++spi->stats.calls;
+	fake_transfer(spi, buffer, length);
+	memset(reply, 0, length);
+	if (length > 1) {
+		reply[length - 1] = (0x71 == command[0]) ? 0x12 : 0xc0;
+	}
+}
+
+// as spi.c: up to SPI_VECTOR_MAX segments and the default spidev
+// bufsiz per ioctl; the SPI queue's thread makes the calls, passing
+// all the lines queued since the last call, so the count varies
+void SPI_send_vector(SPI_type *spi, const SPI_segment *segments, size_t count) {
+	size_t n = 0;
+	size_t bytes = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (0 == n || n >= 128 || bytes + segments[i].length > 4096) {
+			++spi->stats.calls;
+			n = 0;
+			bytes = 0;
+		}
+		++n;
+		bytes += segments[i].length;
+		fake_transfer(spi, segments[i].buffer, segments[i].length);
+	}
+}
+
+void SPI_get_stats(SPI_type *spi, SPI_stats_type *stats) {
+	*stats = spi->stats;
+}
+
+void SPI_reset_stats(SPI_type *spi) {
+	memset(&spi->stats, 0, sizeof(spi->stats));
+	spi->lines = 0;
+	spi->line_bytes = 0;
+}
+
+
+// fake GPIO
+// =========
+
+// gpio.h is not included as the pin type differs between platforms,
+// these only need to be call compatible with the driver
+int GPIO_read(int pin) {
+	return 0;  // BUSY is never set
+}
+
+void GPIO_write(int pin, int value) {
+}
+
+bool GPIO_wait_for(int pin, int level, unsigned int timeout_ms) {
+	return 0 == level;
+}
+
+void GPIO_pwm_write(int pin, uint32_t value) {
+}
+
+
+// benchmark
+// =========
+
+typedef enum {
+	OP_CLEAR,
+	OP_IMAGE_0,
+	OP_IMAGE,
+	OP_PARTIAL
+} operation_type;
+
+static const struct operation_struct {
+	const char *name;
+	operation_type op;
+	bool images;                 // uses image-count image changes
+} operations[] = {
+	{"clear",   OP_CLEAR,   false},
+#if EPD_IMAGE_TWO_ARG
+	{"image_0", OP_IMAGE_0, false},
+#endif
+	{"image",   OP_IMAGE,   true},
+#if EPD_PARTIAL_AVAILABLE && EPD_IMAGE_TWO_ARG
+	{"partial", OP_PARTIAL, true},
+#endif
+	{NULL, 0, false}  // must be last entry
+};
+
+
+static uint64_t monotonic_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+// one display operation from images[n] to images[n + 1]
+static void run_operation(EPD_type *epd, operation_type op, const uint8_t *const *images, int n) {
+	switch (op) {
+	case OP_CLEAR:
+		EPD_clear(epd);
+		break;
+#if EPD_IMAGE_TWO_ARG
+	case OP_IMAGE_0:
+		EPD_image_0(epd, images[0]);
+		break;
+	case OP_IMAGE:
+		EPD_image(epd, images[n], images[n + 1]);
+		break;
+#elif EPD_IMAGE_ONE_ARG
+	case OP_IMAGE:
+		EPD_image(epd, images[n + 1]);
+		break;
+#else
+#error "unsupported EPD_image() function"
+#endif
+#if EPD_PARTIAL_AVAILABLE && EPD_IMAGE_TWO_ARG
+	case OP_PARTIAL:
+		EPD_partial_image(epd, images[n], images[n + 1]);
+		break;
+#endif
+	default:
+		break;
+	}
+}
+
+
+// print usage message and exit
+static void usage(const char *program_name, const char *message, ...) {
+
+	if (NULL != message) {
+		va_list ap;
+		va_start(ap, message);
+		printf("error: ");
+		vprintf(message, ap);
+		printf("\n");
+		va_end(ap);
+	}
+
+	printf("usage: %s [-s size] [-t stage-ms] [-n image-count] [-c]\n"
+	       "  -s size         only this panel size e.g. 2.0\n"
+	       "  -t stage-ms     stage time in milliseconds\n"
+	       "                  (default: driver value at 25 Celsius)\n"
+	       "  -n image-count  image changes for each image operation [1]\n"
+	       "  -c              fixed frame count stage timing\n",
+	       program_name);
+	exit(1);
+}
+
+
+int main(int argc, char *argv[]) {
+
+	const char *size_key = NULL;
+	int stage_time = 0;
+	int image_changes = 1;
+	bool timing_count = false;
+
+	int opt;
+	while (-1 != (opt = getopt(argc, argv, "s:t:n:ch"))) {
+		switch (opt) {
+		case 's':
+			size_key = optarg;
+			break;
+		case 't':
+			stage_time = atoi(optarg);
+			if (stage_time <= 0) {
+				usage(argv[0], "stage-ms must be positive");
+			}
+#if !EPD_PARTIAL_AVAILABLE
+			usage(argv[0], "this driver has no settable stage time");
+#endif
+			break;
+		case 'c':
+#if !EPD_TIMING_AVAILABLE
+			usage(argv[0], "this driver has no stage timing modes");
+#endif
+			timing_count = true;
+			break;
+		case 'n':
+			image_changes = atoi(optarg);
+			if (image_changes < 1) {
+				usage(argv[0], "image-count must be at least one");
+			}
+			break;
+		default:
+			usage(argv[0], NULL);
+		}
+	}
+	if (optind != argc) {
+		usage(argv[0], "extraneous extra argument(s)");
+	}
+
+	SPI_type *spi = SPI_create("", 0);
+	if (NULL == spi) {
+		return 1;
+	}
+
+	printf("COG %d FILM %d\n", EPD_CHIP_VERSION, EPD_FILM_VERSION);
+	printf("%-5s %-8s %10s %8s %10s %12s %12s %12s\n",
+	       "size", "op", "ms", "lines", "lines/s", "bytes/s", "calls/frame", "frames/stage");
+
+	bool found = false;
+	for (const struct panel_struct *panel = panels; NULL != panel->key; ++panel) {
+		if (NULL != size_key && 0 != strcmp(size_key, panel->key)) {
+			continue;
+		}
+		found = true;
+
+		int changes = image_changes;
+		if (changes > panel->image_count - 1) {
+			changes = panel->image_count - 1;
+		}
+
+		EPD_type *epd = EPD_create(panel->size, 1, 2, 3,
+#if EPD_PWM_REQUIRED
+					   4,
+#endif
+					   5, 6, spi);
+		if (NULL == epd) {
+			warn("EPD_create failed");
+			return 1;
+		}
+		if (timing_count) {
+#if EPD_TIMING_AVAILABLE
+			EPD_set_timing(epd, EPD_TIMING_FRAME_COUNT);
+#endif
+		}
+
+		uint64_t start = monotonic_ns();
+		EPD_begin(epd);
+		printf("%-5s %-8s %10.1f\n", panel->key, "begin", (monotonic_ns() - start) / 1e6);
+		if (EPD_OK != EPD_status(epd)) {
+			warn("EPD_begin failed");
+			return 1;
+		}
+
+		for (const struct operation_struct *op = operations; NULL != op->name; ++op) {
+			SPI_reset_stats(spi);
+#if EPD_STATS_AVAILABLE
+			EPD_reset_stats(epd);
+#endif
+			int count = op->images ? changes : 1;
+
+			start = monotonic_ns();
+			for (int n = 0; n < count; ++n) {
+#if EPD_PARTIAL_AVAILABLE
+				if (stage_time > 0) {
+					EPD_set_factored_stage_time(epd, stage_time);
+				}
+#endif
+				run_operation(epd, op->op, panel->images, n);
+			}
+			double seconds = (monotonic_ns() - start) / 1e9;
+
+			SPI_stats_type stats;
+			SPI_get_stats(spi, &stats);
+			double frames = (double)spi->lines / panel->lines;
+
+			char per_stage[16] = "-";
+#if EPD_STATS_AVAILABLE
+			EPD_stats_type epd_stats;
+			EPD_get_stats(epd, &epd_stats);
+			unsigned long int stage_frames = 0;
+			unsigned long int stages = 0;
+			for (int i = 0; i < EPD_STATS_STAGES; ++i) {
+				stage_frames += epd_stats.frames[i];
+				stages += epd_stats.stages[i];
+			}
+			if (stages > 0) {
+				snprintf(per_stage, sizeof(per_stage), "%.1f", (double)stage_frames / stages);
+			}
+#endif
+			printf("%-5s %-8s %10.1f %8lu %10.0f %12.0f %12.1f %12s\n",
+			       panel->key, op->name, seconds * 1e3 / count,
+			       spi->lines / count,
+			       spi->lines / seconds,
+			       spi->line_bytes / seconds,
+			       frames > 0 ? stats.calls / frames : 0.0,
+			       per_stage);
+		}
+
+		start = monotonic_ns();
+		EPD_end(epd);
+		printf("%-5s %-8s %10.1f\n", panel->key, "end", (monotonic_ns() - start) / 1e6);
+
+		EPD_destroy(epd);
+	}
+	SPI_destroy(spi);
+
+	if (!found) {
+		usage(argv[0], "unknown display size: %s", size_key);
+	}
+	return 0;
+}
@@ -0,0 +1,229 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#include "spi.h"
+#include "epd.h"
+#include "epd_frame.h"
+
+// write a pre-encoded frame file (see epd_frame.h)
+//
+// the stages are made by the panel driver itself, linked with the
+// do-nothing SPI and GPIO below as no panel is driven, so the file
+// holds exactly the lines the driver would have sent
+
+static const struct panel_struct {
+	const char *key;
+	EPD_size size;
+	int width;
+	int height;
+} panels[] = {
+	{"1.44", EPD_1_44, 128,  96},
+#if EPD_1_9_SUPPORT
+	{"1.9",  EPD_1_9,  144, 128},
+#endif
+	{"2.0",  EPD_2_0,  200,  96},
+#if EPD_2_6_SUPPORT
+	{"2.6",  EPD_2_6,  232, 128},
+#endif
+	{"2.7",  EPD_2_7,  264, 176},
+	{NULL, 0, 0, 0}  // must be last entry
+};
+
+// need to sync size with above (max of all sizes)
+#define IMAGE_SIZE (264 * 176 / 8)
+
+
+// no SPI or GPIO
+// ==============
+
+SPI_type *SPI_create(const char *spi_path, uint32_t bps) {
+	return NULL;
+}
+
+bool SPI_destroy(SPI_type *spi) {
+	return true;
+}
+
+void SPI_on(SPI_type *spi) {
+}
+
+void SPI_off(SPI_type *spi) {
+}
+
+void SPI_send(SPI_type *spi, const void *buffer, size_t length) {
+}
+
+void SPI_read(SPI_type *spi, const void *buffer, void *received, size_t length) {
+	memset(received, 0, length);
+}
+
+void SPI_send_vector(SPI_type *spi, const SPI_segment *segments, size_t count) {
+}
+
+void SPI_get_stats(SPI_type *spi, SPI_stats_type *stats) {
+	memset(stats, 0, sizeof(SPI_stats_type));
+}
+
+void SPI_reset_stats(SPI_type *spi) {
+}
+
+// gpio.h is not included as the pin type differs between platforms
+int GPIO_read(int pin) {
+	return 0;
+}
+
+void GPIO_write(int pin, int value) {
+}
+
+bool GPIO_wait_for(int pin, int level, unsigned int timeout_ms) {
+	return 0 == level;
+}
+
+void GPIO_pwm_write(int pin, uint32_t value) {
+}
+
+
+// converter
+// =========
+
+// print usage message and exit
+static void usage(const char *program_name, const char *message, ...) {
+
+	if (NULL != message) {
+		va_list ap;
+		va_start(ap, message);
+		fprintf(stderr, "error: ");
+		vfprintf(stderr, message, ap);
+		fprintf(stderr, "\n");
+		va_end(ap);
+	}
+
+	fprintf(stderr,
+		"usage: %s [-p previous] size < image > frame.epdf\n"
+		"  size         panel size e.g. 2.0\n"
+		"  -p previous  the image already on the panel (default: white)\n"
+		"images are binary as the display file (see xbm2bin)\n",
+		program_name);
+	exit(1);
+}
+
+
+// read exactly size bytes of an image
+static bool read_image(FILE *f, uint8_t *image, size_t size) {
+	if (size != fread(image, 1, size, f)) {
+		return false;
+	}
+	return EOF == fgetc(f);
+}
+
+
+int main(int argc, char *argv[]) {
+
+	const char *previous_path = NULL;
+
+	int opt;
+	while (-1 != (opt = getopt(argc, argv, "p:h"))) {
+		switch (opt) {
+		case 'p':
+			previous_path = optarg;
+			break;
+		default:
+			usage(argv[0], NULL);
+		}
+	}
+	if (optind + 1 != argc) {
+		usage(argv[0], optind == argc ? "missing size" : "extraneous extra argument(s)");
+	}
+
+	const struct panel_struct *panel = panels;
+	for (; NULL != panel->key && 0 != strcmp(argv[optind], panel->key); ++panel) {
+	}
+	if (NULL == panel->key) {
+		usage(argv[0], "unknown display size: %s", argv[optind]);
+	}
+	size_t image_size = panel->width * panel->height / 8;
+
+	static uint8_t new_image[IMAGE_SIZE];
+	static uint8_t old_image[IMAGE_SIZE];
+	if (!read_image(stdin, new_image, image_size)) {
+		errx(1, "image is not %zu bytes", image_size);
+	}
+	if (NULL != previous_path) {
+		FILE *f = fopen(previous_path, "rb");
+		if (NULL == f) {
+			err(1, "cannot open: %s", previous_path);
+		}
+		bool ok = read_image(f, old_image, image_size);
+		fclose(f);
+		if (!ok) {
+			errx(1, "%s: image is not %zu bytes", previous_path, image_size);
+		}
+	}
+
+#if !EPD_ENCODED_AVAILABLE
+	errx(1, "FILM %d driver has no pre-encoded images", EPD_FILM_VERSION);
+#else
+	EPD_type *epd = EPD_create(panel->size, 1, 2, 3,
+#if EPD_PWM_REQUIRED
+				   4,
+#endif
+				   5, 6, NULL);
+	if (NULL == epd) {
+		errx(1, "EPD_create failed");
+	}
+
+	EPD_frame_header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = EPD_FRAME_MAGIC;
+	header.version = EPD_FRAME_VERSION;
+	header.header_size = sizeof(header);
+	header.film = EPD_FILM_VERSION;
+	header.width = panel->width;
+	header.height = panel->height;
+	header.line_length = EPD_encoded_line_length(epd);
+	header.image_size = image_size;
+	header.new_image = header.header_size;
+	header.old_image = (NULL == previous_path) ? 0 : header.new_image + image_size;
+	header.stages = header.new_image + (NULL == previous_path ? 1 : 2) * image_size;
+	size_t stages_size = EPD_FRAME_STAGES * panel->height * header.line_length;
+	header.file_size = header.stages + stages_size;
+
+	uint8_t *stages = malloc(stages_size);
+	if (NULL == stages) {
+		errx(1, "failed to allocate stages");
+	}
+	EPD_encode_image(epd, stages, NULL == previous_path ? NULL : old_image, new_image);
+	EPD_destroy(epd);
+
+	if (1 != fwrite(&header, sizeof(header), 1, stdout) ||
+	    1 != fwrite(new_image, image_size, 1, stdout) ||
+	    (NULL != previous_path && 1 != fwrite(old_image, image_size, 1, stdout)) ||
+	    1 != fwrite(stages, stages_size, 1, stdout) ||
+	    0 != fflush(stdout)) {
+		err(1, "write failed");
+	}
+	free(stages);
+	return 0;
+#endif
+}
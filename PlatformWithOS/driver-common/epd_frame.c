@@ -0,0 +1,129 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "epd.h"
+#include "epd_frame.h"
+
+
+#if EPD_ENCODED_AVAILABLE
+// true if an item of size bytes at offset is inside the file
+static bool inside(const EPD_frame_header *header, uint32_t offset, uint64_t size) {
+	return offset >= header->header_size && offset + size <= header->file_size;
+}
+
+// read exactly size bytes at offset, 0 or a negative errno (-EINVAL if
+// the file is shorter)
+static int read_all(int fd, void *buffer, size_t size, off_t offset) {
+	uint8_t *p = buffer;
+	while (size > 0) {
+		ssize_t n = pread(fd, p, size, offset);
+		if (n < 0) {
+			if (EINTR == errno) {
+				continue;
+			}
+			return -errno;
+		} else if (0 == n) {
+			return -EINVAL;
+		}
+		p += n;
+		size -= n;
+		offset += n;
+	}
+	return 0;
+}
+#endif
+
+
+// read and check a frame file
+int EPD_frame_load(EPD_frame_type *frame, const char *path, EPD_type *epd, int width, int height) {
+	memset(frame, 0, sizeof(EPD_frame_type));
+
+#if EPD_ENCODED_AVAILABLE
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -errno;
+	}
+	struct stat st;
+	if (0 != fstat(fd, &st)) {
+		int rc = -errno;
+		close(fd);
+		return rc;
+	}
+	EPD_frame_header header;
+	int rc = S_ISREG(st.st_mode) ? read_all(fd, &header, sizeof(header), 0) : -EINVAL;
+	if (0 != rc) {
+		close(fd);
+		return rc;
+	}
+
+	uint64_t image_size = (uint64_t)width * height / 8;
+	uint64_t stages_size = (uint64_t)EPD_FRAME_STAGES * height * header.line_length;
+	if (EPD_FRAME_MAGIC != header.magic ||
+	    EPD_FRAME_VERSION != header.version ||
+	    header.header_size < sizeof(EPD_frame_header) ||
+	    header.file_size != st.st_size ||
+	    EPD_FILM_VERSION != header.film ||
+	    width != header.width || height != header.height ||
+	    EPD_encoded_line_length(epd) != header.line_length ||
+	    image_size != header.image_size ||
+	    !inside(&header, header.new_image, image_size) ||
+	    (0 != header.old_image && !inside(&header, header.old_image, image_size)) ||
+	    !inside(&header, header.stages, stages_size)) {
+		close(fd);
+		return -EINVAL;
+	}
+
+	// a private copy, so the file can be replaced or truncated while
+	// the update is queued without the stages changing under it
+	uint8_t *p = malloc(header.file_size);
+	if (NULL == p) {
+		close(fd);
+		return -ENOMEM;
+	}
+	rc = read_all(fd, p, header.file_size, 0);
+	close(fd);
+	if (0 == rc && 0 != memcmp(p, &header, sizeof(header))) {
+		rc = -EINVAL;  // rewritten between the two reads
+	}
+	if (0 != rc) {
+		free(p);
+		return rc;
+	}
+
+	frame->header = (const EPD_frame_header *)p;
+	frame->size = header.file_size;
+	frame->new_image = p + header.new_image;
+	frame->old_image = (0 == header.old_image) ? NULL : p + header.old_image;
+	frame->stages = p + header.stages;
+	return 0;
+#else
+	return -ENOTSUP;
+#endif
+}
+
+
+// release a loaded frame file
+void EPD_frame_free(EPD_frame_type *frame) {
+	free((void *)frame->header);
+	memset(frame, 0, sizeof(EPD_frame_type));
+}
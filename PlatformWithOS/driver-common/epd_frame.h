@@ -0,0 +1,80 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+#if !defined(EPD_FRAME_H)
+#define EPD_FRAME_H 1
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "epd.h"
+
+
+// pre-encoded frame file (.epdf)
+//
+// An image already converted to the line packets the panel is sent in
+// each stage, so displaying it only costs SPI time.  It is made by
+// "xbm2bin -e SIZE" (epd_encode) with the driver of one film version
+// and is only valid for that film and panel size.  The stages change a
+// white panel to new_image as EPD_image_0 does or, with an old_image,
+// change that image to new_image as EPD_image does.
+//
+// The file is this header, the images and then EPD_FRAME_STAGES stages
+// (compensate, white, inverse, normal) of height lines each of
+// line_length bytes, at the offsets given.  All fields are in host
+// byte order, which is little endian on all the supported boards.
+
+#define EPD_FRAME_MAGIC 0x46445045  // "EPDF" in memory order
+#define EPD_FRAME_VERSION 1
+#define EPD_FRAME_STAGES 4
+
+typedef struct {
+	uint32_t magic;              // EPD_FRAME_MAGIC
+	uint16_t version;            // EPD_FRAME_VERSION
+	uint16_t header_size;        // sizeof(EPD_frame_header)
+	uint16_t film;               // EPD_FILM_VERSION of the encoder
+	uint16_t width;              // panel width in pixels
+	uint16_t height;             // panel height in pixels, lines in each stage
+	uint16_t line_length;        // bytes in each encoded line
+	uint32_t image_size;         // bytes in each image (as the display file)
+	uint32_t new_image;          // offset of the image drawn
+	uint32_t old_image;          // offset of the image it changes from, 0 => white
+	uint32_t stages;             // offset of the first stage
+	uint32_t file_size;          // bytes in the file
+} EPD_frame_header;
+
+
+// a frame file read into memory
+typedef struct {
+	const EPD_frame_header *header;
+	size_t size;                 // bytes read
+	const uint8_t *new_image;
+	const uint8_t *old_image;    // NULL => white
+	const uint8_t *stages;       // for EPD_encoded_image
+} EPD_frame_type;
+
+
+// functions
+// =========
+
+// read the frame file path into memory and check it was made for this
+// driver and a width x height panel, returns 0 or a negative errno
+// (-EINVAL if it is not a usable frame file, -ENOTSUP if the driver
+// cannot send one).  The file is copied, so it may change afterwards.
+int EPD_frame_load(EPD_frame_type *frame, const char *path, EPD_type *epd, int width, int height);
+
+// release a loaded frame file
+void EPD_frame_free(EPD_frame_type *frame);
+
+#endif
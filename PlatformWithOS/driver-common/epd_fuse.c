@@ -19,6 +19,7 @@
 #define STR(x) STR1(x)
 
 #define FUSE_USE_VERSION 26
+#define _GNU_SOURCE 1   // CPU affinity
 
 #include <stdint.h>
 #include <fuse.h>
@@ -28,11 +29,26 @@
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <err.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
 
 #include "gpio.h"
 #include "spi.h"
 #include "epd.h"
+#include "epd_neon.h"
+#include "epd_frame.h"
+#include "epd_shm.h"
+#include "epd_region.h"
+#include "epd_socket.h"
+#include "epd_sequence.h"
+#include "temperature.h"
 #include EPD_IO
 
 
@@ -47,18 +63,69 @@ static const char *current_path          = "/current";          // the current s
 static const char *current_inverted_path = "/current_inverse";  // the current screen image
 static const char *display_path          = "/display";          // the next image to display
 static const char *display_inverted_path = "/display_inverse";  // the next image to display
+static const char *display_rle_path      = "/display_rle";      // the next image, run length coded
+static const char *display_rle_inverted_path = "/display_rle_inverse";  // the next image, run length coded
+static const char *display_delta_path    = "/display_delta";    // the next image, run length coded XOR current
 static const char *command_path          = "/command";          // any write transfers display -> EPD and updates current
+static const char *region_path           = "/region";           // write a rectangle of pixels and update its lines
+static const char *encoded_path          = "/encoded";          // write the path of a pre-encoded frame file to show it
+static const char *sequence_path         = "/sequence";         // write an animation for 'S' to play
 static const char *temperature_path      = "/temperature";      // read/write temperature compensation setting
 static const char *pu_stagetime_path     = "/pu_stagetime";     // stagetime to use for 'F' command,
                                                                 // bypassing temperature compensation.
 static const char *error_path            = "/error";            // error text
+static const char *status_path           = "/status";           // update progress: idle/busy and sequence numbers
+static const char *stats_path            = "/stats";            // counters: key=value lines
+static const char *standby_path          = "/standby";          // seconds to keep the COG powered when idle
 static const char *spi_device = SPI_DEVICE;        // default SPI device path
 static const uint32_t spi_bps = SPI_BPS;           // default SPI device speed
 
 // expect that external process changes this just before update command
 // by sending text string e.g. shell:  echo 19 > /dev/epd/temperature
+// unless a sensor is sampled (-o sensor=SOURCE)
 static int temperature = 25;                       // for external temperature compensation
-static int pu_stagetime = 500;                     // stagetime to use in 'F' command
+static const int pu_stagetime = 500;               // initial stagetime to use in 'F' command
+
+// hot standby: leave the COG powered after a command and only power
+// it down when no command has been queued for this many seconds
+// zero gives the original behaviour: power down after 'C' and 'U',
+// which is done once the command is reported complete and nothing is
+// queued (see cog_state)
+#define STANDBY_MAX 3600
+static unsigned int standby_timeout = 0;          // initial value for each display
+
+// stage timing: false => repeat frames until the stage time has
+// passed, true => a fixed frame count from the measured line time
+static bool timing_count = false;
+
+// temperature sensor: sampled by its own thread every sensor_interval
+// seconds, the smoothed value is used unless a number was written to
+// temperature (manual override, writing "auto" returns to the sensor)
+#define SENSOR_INTERVAL_MAX 3600
+static const char *sensor_source = NULL;
+static unsigned int sensor_interval = 60;
+
+// control socket (-o socket=PATH, messages in epd_socket.h): each
+// connection has its own thread that reads a request, queues it and
+// replies once it has completed
+#define SOCKET_CLIENTS_MAX 8
+static const char *socket_path = NULL;
+
+// real time updates (-o realtime=PRIO,cpu=N): the update threads run at
+// SCHED_FIFO priority PRIO, optionally all on CPU N, and the memory
+// mapped once the displays have started (the driver's line and frame
+// buffers, SPI data, screen buffers and the update thread stacks) is
+// locked and faulted in, so frames are not stretched by other processes
+// or page faults.  Later mappings (FUSE and socket threads) are not
+// locked as the update path does not use them, frame files written to
+// encoded are locked while they are queued.
+#define REALTIME_STACK_SIZE (256 * 1024)    // bounds the memory locked for each update thread
+static int realtime_priority = 0;           // 0 => normal scheduling
+static int realtime_cpu = -1;               // -1 => any CPU
+
+// LE and inverse copies use the NEON conversion (epd_neon.h), set
+// by display_init when the CPU has NEON
+static bool neon_convert = false;
 
 #define MAKE_STRING_HELPER(s) #s
 #define MAKE_STRING(s) MAKE_STRING_HELPER(s)
@@ -99,6 +166,7 @@ static const struct panel_struct {
 
 static const char *error_texts[] = {
   "OK\n",               // EPD_OK
+  "Busy timeout\n",     // EPD_BUSY_TIMEOUT
   "Unsupported COG\n",  // EPD_UNSUPPORTED_COG
   "Panel broken\n",     // EPD_PANEL_BROKEN
   "DC Failed\n",        // EPD_DC_FAILED
@@ -106,20 +174,236 @@ static const char *error_texts[] = {
 };
 
 // need to sync size with above (max of all sizes)
-// this will be the next display
-static char display_buffer[264 * 176 / 8];
-
-// this is the current display
-static char current_buffer[sizeof(display_buffer)];
+#define IMAGE_SIZE (264 * 176 / 8)
 
+// settings for the display without --display definitions,
+// -o panel=SIZE, -o spi=DEVICE and -o shm=NAME
 static const struct panel_struct *panel = NULL;
-static EPD_type *epd = NULL;
-static SPI_type *spi = NULL;
+static const char *shm_name = NULL;
+
+
+// an uploaded animation (see epd_sequence.h), shared by its display
+// and any queued 'S' so a new upload does not change one being played
+// references are protected by update_mutex
+typedef struct {
+	unsigned int references;
+	unsigned int frame_count;
+	unsigned int loops;                  // 0 => until another command is queued
+	size_t image_size;
+	uint16_t stage_times[EPD_SEQUENCE_FRAMES_MAX];  // 0 => pu_stagetime of the 'S'
+	uint8_t images[];                    // frame_count images coded as display
+} sequence_type;
+
+
+// display commands are run by a separate thread so that a write to
+// command returns at once and reads continue during an update
+// each queued command has a copy of the settings and display buffer
+// at the time it was written
+typedef struct {
+	char command;
+	unsigned int sequence;
+	int temperature;
+	int pu_stagetime;
+	int slot;                            // shared memory slot or -1 to use image
+	int first_line;                      // lines that 'P' and 'F' compare and send
+	int end_line;
+	EPD_frame_type frame;                // 'E' only: loaded until the command has run
+	sequence_type *animation;            // 'S' only: referenced until the command has run
+	char image[IMAGE_SIZE];
+} update_type;
+
+#define UPDATE_QUEUE_SIZE 16
+
+// COG left by a command: after EPD_commit the image is final so the
+// command is reported complete before the power down sequence, which
+// the update thread runs once nothing is queued; a command queued first
+// reuses the powered COG where EPD_begin allows it (hot standby drivers)
+// and otherwise waits for EPD_end
+typedef enum {
+	COG_OFF,                             // powered down
+	COG_ON,                              // left on for the next command
+	COG_COMMITTED                        // image final, power down when idle
+} cog_state;
+
+// displays on the same SPI bus take turns to run whole commands so
+// the stage timing of one panel is not stretched by another's frames
+typedef struct bus_struct {
+	struct bus_struct *next;
+	char *key;                           // "spidevB" or the whole SPI path
+	pthread_mutex_t lock;                // held while a command runs
+} bus_type;
+
+static bus_type *buses = NULL;
+
+// one panel: its settings, buffers, command queue and update thread
+// everything but the driver handles is protected by update_mutex
+typedef struct {
+	unsigned int index;                  // directory number with --display
+	const struct panel_struct *panel;
+	const char *spi_device;
+	const char *shm_name;                // optional shared memory frame buffer (see epd_shm.h)
+	int panel_on_pin;
+	int border_pin;
+	int discharge_pin;
+	int pwm_pin;
+	int reset_pin;
+	int busy_pin;
+
+	EPD_type *epd;
+	SPI_type *spi;
+	bus_type *bus;
+	EPD_shm_header *shm;
+	size_t shm_size;
+
+	int pu_stagetime;                    // stagetime to use in 'F' command
+	unsigned int standby_timeout;        // hot standby seconds (see above)
+	sequence_type *animation;            // last complete upload to sequence, for 'S'
+
+	// this will be the next display
+	char display_buffer[IMAGE_SIZE];
+
+	// this is the current display
+	char current_buffer[IMAGE_SIZE];
+
+	// lines of display written since the last queued image command,
+	// 'P' and 'F' only compare and send these
+	uint32_t dirty_lines[(176 + 31) / 32];
+
+	update_type update_queue[UPDATE_QUEUE_SIZE];
+	unsigned int update_head;            // next command to run
+	unsigned int update_count;           // includes a running command
+	unsigned int queued_sequence;        // sequence of last queued command
+	unsigned int completed_sequence;
+	EPD_error completed_error;           // panel status after the last completed command
+	bool update_busy;
+
+	// counters for stats
+	unsigned long int commands_queued;
+	unsigned long int commands_completed;
+	unsigned long int frames_coalesced;  // images replaced by a newer one before being drawn
+	unsigned long int updates_skipped;   // partial updates with no changed lines
+	unsigned long int frames_decoded;    // images written to display_rle or display_delta
+	unsigned long int frames_encoded;    // 'E' frame files sent without encoding
+	unsigned long int frames_reencoded;  // 'E' frame files for another image, encoded again
+	unsigned long int sequence_frames;   // images drawn by 'S'
+
+	// driver counters copied by the update thread around each command
+	// only the update thread uses the driver so a reset just zeroes the
+	// copies and sets stats_reset for the update thread to do the rest
+	SPI_stats_type spi_stats;
+#if EPD_STATS_AVAILABLE
+	EPD_stats_type driver_stats;
+#endif
+	bool stats_reset;
+
+	struct open_file_struct *status_files;  // list of open status files
+	pthread_t update_thread;
+	bool update_running;                 // update_thread was started
+	pthread_cond_t update_queued;        // uses CLOCK_MONOTONIC
+	pthread_cond_t update_completed;
+} screen_type;
+
+// displays from --display definitions, or the single display
+// from the options above in the root directory
+#define SCREENS_MAX 8
+static screen_type *screens[SCREENS_MAX];
+static unsigned int screen_count = 0;
+static bool screen_directories = false;     // true => /0, /1, ... directories
+
+static bool update_quit = false;
+static pthread_mutex_t update_mutex = PTHREAD_MUTEX_INITIALIZER;  // protects all of the above and the buffers
+
+// items that a file can refer to
+typedef enum {
+	TARGET_VERSION,
+	TARGET_PANEL,
+	TARGET_CURRENT,
+	TARGET_DISPLAY,
+	TARGET_DISPLAY_RLE,
+	TARGET_COMMAND,
+	TARGET_REGION,
+	TARGET_ENCODED,
+	TARGET_SEQUENCE,
+	TARGET_TEMPERATURE,
+	TARGET_PU_STAGETIME,
+	TARGET_ERROR,
+	TARGET_STATUS,
+	TARGET_STATS,
+	TARGET_STANDBY
+} target_type;
+
+// per open file state, the path is resolved once in open()
+// and this is kept in fuse_file_info.fh
+typedef struct open_file_struct {
+	screen_type *screen;
+	target_type target;
+	bool bit_reversed;                       // LE directory
+	bool inverted;                           // *_inverse files
+	bool delta;                              // display_delta
+
+	// region file only: a region being collected from several writes
+	uint8_t *region;                         // header + pixels
+	size_t region_length;                    // bytes collected
+	off_t region_offset;                     // file offset of region[0]
+
+	// run length coded display files only: a frame being decoded from
+	// several writes (see rle_write)
+	uint8_t *frame;                          // decoded bytes
+	size_t frame_length;                     // bytes decoded
+	off_t frame_offset;                      // file offset of the next coded byte
+	unsigned int run_count;                  // bytes left in the current run, 0 => control byte next
+	bool run_repeat;                         // the run repeats the next byte
+
+	// sequence file only: an upload being collected from several writes
+	uint8_t *sequence;                       // header, frames and images
+	size_t sequence_length;                  // bytes collected
+
+	// status file only
+	struct open_file_struct *next;           // list of open status files
+	unsigned int wait_sequence;              // a read blocks until this sequence completes
+	unsigned int seen_sequence;              // completed sequence at the last read
+	struct fuse_pollhandle *poll_handle;
+} open_file;
+
+// sensor state, protected by update_mutex
+static TEMPERATURE_type *sensor = NULL;
+static bool sensor_valid = false;          // sensor_average has a sample
+static bool sensor_failed = false;         // the last read failed (warn once)
+static bool temperature_manual = false;    // use temperature, not the sensor
+static int sensor_average = 0;             // millidegrees Celsius
+static unsigned long int sensor_samples = 0;
+static unsigned long int sensor_errors = 0;
+static bool sensor_quit = false;
+static pthread_t sensor_thread;
+static pthread_cond_t sensor_wakeup;       // uses CLOCK_MONOTONIC, set up in display_init
 
 
 // function prototypes
 static void special_memcpy(char *d, const char *s, size_t size, bool bit_reversed, bool inverted);
-static void run_command(const char c);
+static void sequence_release(sequence_type *sequence);
+static bool queue_command(screen_type *screen, const char c, int slot, const EPD_frame_type *frame,
+			  const int *temperature, unsigned int *sequence);
+static void *update_worker(void *arg);
+static void power_down(screen_type *screen);
+static cog_state run_command(screen_type *screen, const update_type *update, bool standby);
+static cog_state finish_command(screen_type *screen, bool standby);
+#if EPD_PARTIAL_AVAILABLE
+static cog_state run_sequence(screen_type *screen, const update_type *update);
+#endif
+static int status_text(screen_type *screen, char *buffer, size_t size);
+static int stats_text(screen_type *screen, char *buffer, size_t size);
+static void reset_stats(screen_type *screen);
+static void copy_driver_stats(screen_type *screen);
+static bool screen_start(screen_type *screen);
+static void update_thread_attributes(pthread_attr_t *attributes);
+static void screen_stop(screen_type *screen);
+static bool shm_create(screen_type *screen);
+static void shm_destroy(screen_type *screen);
+static int current_temperature(void);
+static bool sensor_start(void);
+static void sensor_stop(void);
+static bool socket_start(void);
+static void socket_stop(void);
 
 
 // fuse callbacks
@@ -130,20 +414,47 @@ static int display_access(const char *path, int mode) {
 }
 
 
-static int display_subdir_getattr(const char *path, struct stat *stbuf) {
+// the display a path refers to and the path within its directory
+// without --display the root directory is the only display
+// returns NULL for the root directory with --display or no such display
+static screen_type *resolve_screen(const char *path, const char **screen_path) {
+	if (!screen_directories) {
+		*screen_path = path;
+		return screens[0];
+	}
+	if ('/' != path[0] || path[1] < '0' || path[1] > '9') {
+		return NULL;
+	}
+	char *end = NULL;
+	unsigned long int n = strtoul(path + 1, &end, 10);
+	if (n >= screen_count || ('\0' != *end && '/' != *end)) {
+		return NULL;
+	}
+	*screen_path = '\0' == *end ? "/" : end;
+	return screens[n];
+}
+
+
+static int display_subdir_getattr(screen_type *screen, const char *path, struct stat *stbuf) {
 	if (strcmp(path, current_path) == 0 ||
 	    strcmp(path, current_inverted_path) == 0) {
 		stbuf->st_mode = S_IFREG | 0444;
 		stbuf->st_nlink = 1;
-		stbuf->st_size = panel->byte_count;
+		stbuf->st_size = screen->panel->byte_count;
 	} else if (strcmp(path, display_path) == 0 ||
 		   strcmp(path, display_inverted_path) == 0) {
 		stbuf->st_mode = S_IFREG | 0666;
 		stbuf->st_nlink = 1;
-		stbuf->st_size = panel->byte_count;
+		stbuf->st_size = screen->panel->byte_count;
 		//stbuf->st_atim.tv_sec = 100000;
 		//stbuf->st_mtim.tv_sec = 200000;
 		//stbuf->st_ctim.tv_sec = 300000;
+	} else if (strcmp(path, display_rle_path) == 0 ||
+		   strcmp(path, display_rle_inverted_path) == 0 ||
+		   strcmp(path, display_delta_path) == 0) {
+		stbuf->st_mode = S_IFREG | 0222;
+		stbuf->st_nlink = 1;
+		stbuf->st_size = 0;
 	} else {
 		return -ENOENT;
 	}
@@ -154,6 +465,16 @@ static int display_subdir_getattr(const char *path, struct stat *stbuf) {
 static int display_getattr(const char *path, struct stat *stbuf) {
 
 	memset(stbuf, 0, sizeof(struct stat));
+	screen_type *screen = resolve_screen(path, &path);
+	if (NULL == screen) {
+		if (strcmp(path, "/") == 0) {
+			stbuf->st_mode = S_IFDIR | 0777;
+			stbuf->st_nlink = 2 + screen_count;
+			return 0;
+		}
+		return -ENOENT;
+	}
+
 	if (strcmp(path, "/") == 0) {
 		stbuf->st_mode = S_IFDIR | 01777;
 		stbuf->st_nlink = 2;
@@ -165,7 +486,7 @@ static int display_getattr(const char *path, struct stat *stbuf) {
 
 	} else if (strncmp(path, "/BE/", 4) == 0 ||
 		   strncmp(path, "/LE/", 4) == 0) {
-		return display_subdir_getattr(path + 3, stbuf);
+		return display_subdir_getattr(screen, path + 3, stbuf);
 
 	} else if (strcmp(path, version_path) == 0) {
 		stbuf->st_mode = S_IFREG | 0444;
@@ -175,13 +496,24 @@ static int display_getattr(const char *path, struct stat *stbuf) {
 	} else if (strcmp(path, panel_path) == 0) {
 		stbuf->st_mode = S_IFREG | 0444;
 		stbuf->st_nlink = 1;
-		stbuf->st_size = strlen(panel->description);
+		stbuf->st_size = strlen(screen->panel->description);
 
 	} else if (strcmp(path, command_path) == 0) {
 		stbuf->st_mode = S_IFREG | 0222;
 		stbuf->st_nlink = 1;
 		stbuf->st_size = 1;
 
+	} else if (strcmp(path, region_path) == 0) {
+		stbuf->st_mode = S_IFREG | 0222;
+		stbuf->st_nlink = 1;
+		stbuf->st_size = 0;
+
+	} else if (strcmp(path, encoded_path) == 0 ||
+		   strcmp(path, sequence_path) == 0) {
+		stbuf->st_mode = S_IFREG | 0222;
+		stbuf->st_nlink = 1;
+		stbuf->st_size = 0;
+
 	} else if (strcmp(path, temperature_path) == 0) {
 		stbuf->st_mode = S_IFREG | 0666;
 		stbuf->st_nlink = 1;
@@ -192,13 +524,34 @@ static int display_getattr(const char *path, struct stat *stbuf) {
 		stbuf->st_nlink = 1;
 		stbuf->st_size = 5;
 
+	} else if (strcmp(path, standby_path) == 0) {
+		stbuf->st_mode = S_IFREG | 0666;
+		stbuf->st_nlink = 1;
+		stbuf->st_size = 5;
+
 	} else if (strcmp(path, error_path) == 0) {
 		stbuf->st_mode = S_IFREG | 0444;
 		stbuf->st_nlink = 1;
-		stbuf->st_size = (epd ? strlen(error_texts[EPD_status(epd)]) : 0);
+		stbuf->st_size = (screen->epd ? strlen(error_texts[EPD_status(screen->epd)]) : 0);
+
+	} else if (strcmp(path, status_path) == 0) {
+		char t_buffer[64];
+		stbuf->st_mode = S_IFREG | 0666;
+		stbuf->st_nlink = 1;
+		pthread_mutex_lock(&update_mutex);
+		stbuf->st_size = status_text(screen, t_buffer, sizeof(t_buffer));
+		pthread_mutex_unlock(&update_mutex);
+
+	} else if (strcmp(path, stats_path) == 0) {
+		char t_buffer[1024];
+		stbuf->st_mode = S_IFREG | 0444;
+		stbuf->st_nlink = 1;
+		pthread_mutex_lock(&update_mutex);
+		stbuf->st_size = stats_text(screen, t_buffer, sizeof(t_buffer));
+		pthread_mutex_unlock(&update_mutex);
 
 	} else {
-		return display_subdir_getattr(path, stbuf);
+		return display_subdir_getattr(screen, path, stbuf);
 	}
 	return 0;
 }
@@ -208,6 +561,21 @@ static int display_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
 	(void) offset;
 	(void) fi;
 
+	screen_type *screen = resolve_screen(path, &path);
+	if (NULL == screen) {
+		if (strcmp(path, "/") != 0) {
+			return -ENOENT;
+		}
+		filler(buf, ".", NULL, 0);
+		filler(buf, "..", NULL, 0);
+		for (unsigned int i = 0; i < screen_count; ++i) {
+			char name[16];
+			snprintf(name, sizeof(name), "%u", i);
+			filler(buf, name, NULL, 0);
+		}
+		return 0;
+	}
+
 	if (strcmp(path, "/") == 0) {
 		filler(buf, ".", NULL, 0);
 		filler(buf, "..", NULL, 0);
@@ -217,12 +585,21 @@ static int display_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
 		filler(buf, current_inverted_path + 1, NULL, 0);
 		filler(buf, display_path + 1, NULL, 0);
 		filler(buf, display_inverted_path + 1, NULL, 0);
+		filler(buf, display_rle_path + 1, NULL, 0);
+		filler(buf, display_rle_inverted_path + 1, NULL, 0);
+		filler(buf, display_delta_path + 1, NULL, 0);
 		filler(buf, panel_path + 1, NULL, 0);
 		filler(buf, command_path + 1, NULL, 0);
+		filler(buf, region_path + 1, NULL, 0);
+		filler(buf, encoded_path + 1, NULL, 0);
+		filler(buf, sequence_path + 1, NULL, 0);
 		filler(buf, temperature_path + 1, NULL, 0);
 		filler(buf, pu_stagetime_path + 1, NULL, 0);
+		filler(buf, standby_path + 1, NULL, 0);
 		filler(buf, version_path + 1, NULL, 0);
 		filler(buf, error_path + 1, NULL, 0);
+		filler(buf, status_path + 1, NULL, 0);
+		filler(buf, stats_path + 1, NULL, 0);
 		return 0;
 	} else if (strcmp(path, "/BE") == 0 ||
 		   strcmp(path, "/LE") == 0) {
@@ -232,110 +609,267 @@ static int display_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
 		filler(buf, current_inverted_path + 1, NULL, 0);
 		filler(buf, display_path + 1, NULL, 0);
 		filler(buf, display_inverted_path + 1, NULL, 0);
+		filler(buf, display_rle_path + 1, NULL, 0);
+		filler(buf, display_rle_inverted_path + 1, NULL, 0);
+		filler(buf, display_delta_path + 1, NULL, 0);
 		return 0;
 	}
 	return -ENOENT;
 }
 
-static int display_open(const char *path, struct fuse_file_info *fi) {
-	bool write_allowed = false;
-
-	// read-write items
-	if (strcmp(path, command_path) == 0 ||
-	    strcmp(path, temperature_path) == 0 ||
-	    strcmp(path, pu_stagetime_path) == 0) {
-		write_allowed = true;
-	} else if (strcmp(path, panel_path) == 0 ||
-		   strcmp(path, version_path) == 0 ||
-		   strcmp(path, error_path) == 0) {
-		write_allowed = false;
+// resolve a file path to the item it refers to
+// returns false if there is no such file
+static bool resolve_target(const char *path, open_file *file) {
+	file->bit_reversed = false;
+	file->inverted = false;
+	file->delta = false;
+	file->screen = resolve_screen(path, &path);
+	if (NULL == file->screen) {
+		return false;
+	}
+
+	if (strcmp(path, version_path) == 0) {
+		file->target = TARGET_VERSION;
+	} else if (strcmp(path, panel_path) == 0) {
+		file->target = TARGET_PANEL;
+	} else if (strcmp(path, command_path) == 0) {
+		file->target = TARGET_COMMAND;
+	} else if (strcmp(path, region_path) == 0) {
+		file->target = TARGET_REGION;
+	} else if (strcmp(path, encoded_path) == 0) {
+		file->target = TARGET_ENCODED;
+	} else if (strcmp(path, sequence_path) == 0) {
+		file->target = TARGET_SEQUENCE;
+	} else if (strcmp(path, temperature_path) == 0) {
+		file->target = TARGET_TEMPERATURE;
+	} else if (strcmp(path, pu_stagetime_path) == 0) {
+		file->target = TARGET_PU_STAGETIME;
+	} else if (strcmp(path, standby_path) == 0) {
+		file->target = TARGET_STANDBY;
+	} else if (strcmp(path, error_path) == 0) {
+		file->target = TARGET_ERROR;
+	} else if (strcmp(path, status_path) == 0) {
+		file->target = TARGET_STATUS;
+	} else if (strcmp(path, stats_path) == 0) {
+		file->target = TARGET_STATS;
 	} else {
+		// test big/little endian
 		if (strncmp(path, "/BE/", 4) == 0) {
 			path += 3;
 		} else if (strncmp(path, "/LE/", 4) == 0) {
 			path += 3;
+			file->bit_reversed = true;
 		}
 
-		if (strcmp(path, display_path) == 0 ||
-		    strcmp(path, display_inverted_path) == 0) {
-			write_allowed = true;
-		} else if (strcmp(path, current_path) == 0 ||
-			   strcmp(path, current_inverted_path) == 0) {
-			write_allowed = false;
+		if (strcmp(path, current_path) == 0) {
+			file->target = TARGET_CURRENT;
+		} else if (strcmp(path, current_inverted_path) == 0) {
+			file->target = TARGET_CURRENT;
+			file->inverted = true;
+		} else if (strcmp(path, display_path) == 0) {
+			file->target = TARGET_DISPLAY;
+		} else if (strcmp(path, display_inverted_path) == 0) {
+			file->target = TARGET_DISPLAY;
+			file->inverted = true;
+		} else if (strcmp(path, display_rle_path) == 0) {
+			file->target = TARGET_DISPLAY_RLE;
+		} else if (strcmp(path, display_rle_inverted_path) == 0) {
+			file->target = TARGET_DISPLAY_RLE;
+			file->inverted = true;
+		} else if (strcmp(path, display_delta_path) == 0) {
+			file->target = TARGET_DISPLAY_RLE;
+			file->delta = true;
 		} else {
-			return -ENOENT;
+			return false;
 		}
 	}
+	return true;
+}
 
-	// check access mode
-	if (write_allowed) {
 
+static int display_open(const char *path, struct fuse_file_info *fi) {
+	open_file target;
+
+	if (!resolve_target(path, &target)) {
+		return -ENOENT;
+	}
+
+	// check access mode
+	switch (target.target) {
+	case TARGET_COMMAND:
+	case TARGET_REGION:
+	case TARGET_ENCODED:
+	case TARGET_SEQUENCE:
+	case TARGET_TEMPERATURE:
+	case TARGET_PU_STAGETIME:
+	case TARGET_STANDBY:
+	case TARGET_DISPLAY:
+	case TARGET_DISPLAY_RLE:
+	case TARGET_STATUS:
+		// read-write items
 		switch (fi->flags & (O_RDONLY | O_WRONLY | O_APPEND | O_TRUNC)) {
 		case O_RDONLY:
 		case O_WRONLY:
 		case O_WRONLY | O_TRUNC:
 		case O_WRONLY | O_APPEND:
 		case O_RDWR:
-			return 0;
+			break;
 		default:
 			return -EACCES;
 		}
-		return 0;
+		break;
+
+	default:
+		// read-only items
+		if ((fi->flags & 3) != O_RDONLY) {
+			return -EACCES;
+		}
+		break;
 	}
 
-	// read-only items
-	if ((fi->flags & 3) != O_RDONLY) {
-		return -EACCES;
+	open_file *file = malloc(sizeof(open_file));
+	if (NULL == file) {
+		return -ENOMEM;
+	}
+	*file = target;
+	file->next = NULL;
+	file->poll_handle = NULL;
+	file->region = NULL;
+	file->region_length = 0;
+	file->region_offset = 0;
+	file->frame = NULL;
+	file->frame_length = 0;
+	file->frame_offset = 0;
+	file->run_count = 0;
+	file->run_repeat = false;
+	file->sequence = NULL;
+	file->sequence_length = 0;
+	screen_type *screen = file->screen;
+
+	switch (file->target) {
+	case TARGET_STATUS:
+		pthread_mutex_lock(&update_mutex);
+		file->wait_sequence = screen->completed_sequence;
+		file->seen_sequence = screen->completed_sequence;
+		file->next = screen->status_files;
+		screen->status_files = file;
+		pthread_mutex_unlock(&update_mutex);
+		fi->direct_io = 1;  // content changes without writes
+		break;
+
+	case TARGET_STATS:
+		fi->direct_io = 1;  // content changes without writes
+		break;
+
+	case TARGET_REGION:
+		file->region = malloc(sizeof(EPD_region_header) + IMAGE_SIZE);
+		if (NULL == file->region) {
+			free(file);
+			return -ENOMEM;
+		}
+		break;
+
+	case TARGET_DISPLAY_RLE:
+		file->frame = malloc(IMAGE_SIZE);
+		if (NULL == file->frame) {
+			free(file);
+			return -ENOMEM;
+		}
+		break;
+
+	case TARGET_SEQUENCE:
+		// grown to the whole sequence once its header has arrived
+		file->sequence = malloc(sizeof(EPD_sequence_header));
+		if (NULL == file->sequence) {
+			free(file);
+			return -ENOMEM;
+		}
+		break;
+
+	default:
+		break;
 	}
+
+	fi->fh = (uintptr_t)file;
 	return 0;
 }
 
 
-static int display_create(const char *path, mode_t mode, struct fuse_file_info *fi) {
-	(void) mode;
-	(void) fi;
-
-	if (strcmp(path, command_path) == 0 ||
-	    strcmp(path, temperature_path) == 0 ||
-	    strcmp(path, pu_stagetime_path) == 0) {
+static int display_release(const char *path, struct fuse_file_info *fi) {
+	open_file *file = (open_file *)(uintptr_t)fi->fh;
+	if (NULL == file) {
 		return 0;
 	}
 
-	if (strncmp(path, "/BE/", 4) == 0) {
-		path += 3;
-	} else if (strncmp(path, "/LE/", 4) == 0) {
-		path += 3;
+	if (TARGET_STATUS == file->target) {
+		screen_type *screen = file->screen;
+		pthread_mutex_lock(&update_mutex);
+		for (open_file **p = &screen->status_files; NULL != *p; p = &(*p)->next) {
+			if (*p == file) {
+				*p = file->next;
+				break;
+			}
+		}
+		pthread_mutex_unlock(&update_mutex);
+		if (NULL != file->poll_handle) {
+			fuse_pollhandle_destroy(file->poll_handle);
+		}
 	}
+	free(file->region);
+	free(file->frame);
+	free(file->sequence);
+	free(file);
+	return 0;
+}
 
-	if (strcmp(path, display_path) == 0 ||
-	    strcmp(path, display_inverted_path) == 0) {
-		return 0;
-	}
 
-	return -EACCES;
+static int display_create(const char *path, mode_t mode, struct fuse_file_info *fi) {
+	(void) mode;
+	open_file target;
+
+	if (!resolve_target(path, &target)) {
+		return -EACCES;
+	}
+	switch (target.target) {
+	case TARGET_COMMAND:
+	case TARGET_REGION:
+	case TARGET_ENCODED:
+	case TARGET_SEQUENCE:
+	case TARGET_TEMPERATURE:
+	case TARGET_PU_STAGETIME:
+	case TARGET_STANDBY:
+	case TARGET_DISPLAY:
+	case TARGET_DISPLAY_RLE:
+	case TARGET_STATUS:
+		return display_open(path, fi);
+	default:
+		return -EACCES;
+	}
 }
 
 
 static int display_truncate(const char *path, off_t offset) {
 	(void) offset;
-	if (strcmp(path, command_path) == 0 ||
-	    strcmp(path, temperature_path) == 0 ||
-	    strcmp(path, pu_stagetime_path) == 0) {
-		return 0;
-	}
+	open_file target;
 
-	if (strncmp(path, "/BE/", 4) == 0) {
-		path += 3;
-	} else if (strncmp(path, "/LE/", 4) == 0) {
-		path += 3;
+	if (!resolve_target(path, &target)) {
+		return -EACCES;
 	}
-
-	if (strcmp(path, display_path) == 0 ||
-	    strcmp(path, display_inverted_path) == 0) {
+	switch (target.target) {
+	case TARGET_COMMAND:
+	case TARGET_REGION:
+	case TARGET_ENCODED:
+	case TARGET_SEQUENCE:
+	case TARGET_TEMPERATURE:
+	case TARGET_PU_STAGETIME:
+	case TARGET_STANDBY:
+	case TARGET_DISPLAY:
+	case TARGET_DISPLAY_RLE:
+	case TARGET_STATUS:
 		return 0;
+	default:
+		return -EACCES;
 	}
-
-	return -EACCES;
 }
 
 
@@ -358,197 +892,863 @@ static int buffer_read(char *buffer, size_t size, off_t offset,
 
 static int display_read(const char *path, char *buffer, size_t size, off_t offset,
 			struct fuse_file_info *fi) {
-	(void) fi;
-
-	if (strcmp(path, version_path) == 0) {
+	open_file *file = (open_file *)(uintptr_t)fi->fh;
+	screen_type *screen = file->screen;
+	char t_buffer[1024];
+	int length = 0;
+	int result = 0;
+
+	switch (file->target) {
+	case TARGET_VERSION:
 		return buffer_read(buffer, size, offset, version_buffer, VERSION_SIZE, false, false);
-	} else if (strcmp(path, panel_path) == 0) {
-		return buffer_read(buffer, size, offset, panel->description, strlen(panel->description), false, false);
-	} else if (strcmp(path, temperature_path) == 0) {
-		int t = temperature;
+
+	case TARGET_PANEL:
+		return buffer_read(buffer, size, offset, screen->panel->description, strlen(screen->panel->description), false, false);
+
+	case TARGET_TEMPERATURE: {
+		pthread_mutex_lock(&update_mutex);
+		int t = current_temperature();
+		pthread_mutex_unlock(&update_mutex);
 		if (t < -99) {
 			t = -99;
 		} else if  (t > 99) {
 			t = 99;
 		}
-		char t_buffer[16];
-		int length = snprintf(t_buffer, sizeof(t_buffer), "%3d\n", t);
+		length = snprintf(t_buffer, sizeof(t_buffer), "%3d\n", t);
 		return buffer_read(buffer, size, offset, t_buffer, length, false, false);
-	} else if (strcmp(path, pu_stagetime_path) == 0) {
-		int s = pu_stagetime;
+	}
+
+	case TARGET_PU_STAGETIME: {
+		int s = screen->pu_stagetime;
 		if (s < 50) {
 			s = 50;
 		} else if (s > 2000) {
 			s = 2000;
 		}
-		char s_buffer[16];
-		int length = snprintf(s_buffer, sizeof(s_buffer), "%4d\n", s);
-		return buffer_read(buffer, size, offset, s_buffer, length, false, false);
-	} else if (strcmp(path, error_path) == 0) {
-		const char *t_buf = error_texts[EPD_status(epd)];
-		return buffer_read(buffer, size, offset, t_buf, strlen(t_buf), false, false);
+		length = snprintf(t_buffer, sizeof(t_buffer), "%4d\n", s);
+		return buffer_read(buffer, size, offset, t_buffer, length, false, false);
 	}
 
-	// test big/little endian
-	bool bit_reversed = false;
-	if (strncmp(path, "/BE/", 4) == 0) {
-		path += 3;
-	} else if (strncmp(path, "/LE/", 4) == 0) {
-		path += 3;
-		bit_reversed = true;
+	case TARGET_STANDBY:
+		pthread_mutex_lock(&update_mutex);
+		length = snprintf(t_buffer, sizeof(t_buffer), "%4u\n", screen->standby_timeout);
+		pthread_mutex_unlock(&update_mutex);
+		return buffer_read(buffer, size, offset, t_buffer, length, false, false);
+
+	case TARGET_ERROR: {
+		const char *t_buf = error_texts[EPD_status(screen->epd)];
+		return buffer_read(buffer, size, offset, t_buf, strlen(t_buf), false, false);
 	}
 
-	if (strcmp(path, current_path) == 0) {
-		return buffer_read(buffer, size, offset, current_buffer, panel->byte_count, bit_reversed, false);
-	} else if (strcmp(path, current_inverted_path) == 0) {
-		return buffer_read(buffer, size, offset, current_buffer, panel->byte_count, bit_reversed, true);
-	} else if (strcmp(path, display_path) == 0) {
-		return buffer_read(buffer, size, offset, display_buffer, panel->byte_count, bit_reversed, false);
-	} else if (strcmp(path, display_inverted_path) == 0) {
-		return buffer_read(buffer, size, offset, display_buffer, panel->byte_count, bit_reversed, true);
+	case TARGET_STATUS:
+		pthread_mutex_lock(&update_mutex);
+		// block until the sequence written to this file has completed
+		while ((int)(screen->completed_sequence - file->wait_sequence) < 0 && !update_quit) {
+			pthread_cond_wait(&screen->update_completed, &update_mutex);
+		}
+		file->seen_sequence = screen->completed_sequence;
+		length = status_text(screen, t_buffer, sizeof(t_buffer));
+		pthread_mutex_unlock(&update_mutex);
+		return buffer_read(buffer, size, offset, t_buffer, length, false, false);
+
+	case TARGET_STATS:
+		pthread_mutex_lock(&update_mutex);
+		length = stats_text(screen, t_buffer, sizeof(t_buffer));
+		pthread_mutex_unlock(&update_mutex);
+		return buffer_read(buffer, size, offset, t_buffer, length, false, false);
+
+	case TARGET_CURRENT:
+		pthread_mutex_lock(&update_mutex);
+		result = buffer_read(buffer, size, offset, screen->current_buffer, screen->panel->byte_count, file->bit_reversed, file->inverted);
+		pthread_mutex_unlock(&update_mutex);
+		return result;
+
+	case TARGET_DISPLAY:
+		pthread_mutex_lock(&update_mutex);
+		result = buffer_read(buffer, size, offset, screen->display_buffer, screen->panel->byte_count, file->bit_reversed, file->inverted);
+		pthread_mutex_unlock(&update_mutex);
+		return result;
+
+	default:
+		break;
 	}
+	return -EACCES;
+}
 
-	return -ENOENT;
+
+// copy a small write to a terminated string
+static void text_buffer(char *text, size_t text_size, const char *buffer, size_t size) {
+	if (size > text_size - 1) {
+		size = text_size - 1;
+	}
+	memcpy(text, buffer, size);
+	text[size] = '\0';
 }
 
 
-static int display_write(const char *path, const char *buffer, size_t size, off_t offset,
-			 struct fuse_file_info *fi) {
-	size_t len;
-	(void) fi;
-	bool inverted = false;
-	bool bit_reversed = false;
+// mark lines first_line to end_line - 1 of display as written
+// caller must hold update_mutex
+static void dirty_mark(screen_type *screen, int first_line, int end_line) {
+	for (int l = first_line; l < end_line && l < screen->panel->height; ++l) {
+		screen->dirty_lines[l / 32] |= UINT32_C(1) << (l % 32);
+	}
+}
 
-	if (strcmp(path, command_path) == 0) {
-		if (size > 0) {
-			run_command(buffer[0]);
-		}
-		return size;
-	} else if (strcmp(path, temperature_path) == 0) {
-		if (size > 0) {
-			char *end = NULL;
-			long int n = strtol(buffer, &end, 0);
-			if (buffer != end && n >= -99 && n <= 99) {
-				temperature = (int)n;
+
+// take the range of written lines, first_line == end_line if none
+// caller must hold update_mutex
+static void dirty_take(screen_type *screen, int *first_line, int *end_line) {
+	*first_line = 0;
+	*end_line = 0;
+	for (int l = 0; l < screen->panel->height; ++l) {
+		if (0 != (screen->dirty_lines[l / 32] & (UINT32_C(1) << (l % 32)))) {
+			if (*first_line == *end_line) {
+				*first_line = l;
 			}
+			*end_line = l + 1;
 		}
-		return size;
-	} else if (strcmp(path, pu_stagetime_path) == 0) {
-		if (size > 0) {
-			char *end = NULL;
-			long int s = strtol(buffer, &end, 0);
-			if (buffer != end && s >= 50 && s <= 2000) {
-				pu_stagetime = (int)s;
+	}
+	memset(screen->dirty_lines, 0, sizeof(screen->dirty_lines));
+}
+
+
+// copy the pixels of a region into display
+// caller must hold update_mutex
+static void region_copy(screen_type *screen, const EPD_region_header *header, const uint8_t *pixels) {
+	const size_t bytes_per_line = screen->panel->width / 8;
+	const size_t row_bytes = EPD_REGION_ROW_BYTES(header->width);
+	const bool bit_reversed = 0 != (header->flags & EPD_REGION_LE);
+	const bool inverted = 0 != (header->flags & EPD_REGION_INVERSE);
+	uint8_t *d = (uint8_t *)screen->display_buffer + header->y * bytes_per_line;
+
+	for (unsigned int row = 0; row < header->height; ++row, d += bytes_per_line, pixels += row_bytes) {
+		// whole bytes use the same conversion as the display files
+		if (0 == (header->x & 7) && 0 == (header->width & 7)) {
+			special_memcpy((char *)d + header->x / 8, (const char *)pixels, row_bytes, bit_reversed, inverted);
+			continue;
+		}
+		for (unsigned int i = 0; i < header->width; ++i) {
+			unsigned int bit = bit_reversed ? (i & 7) : 7 - (i & 7);
+			unsigned int value = ((pixels[i / 8] >> bit) & 1) ^ (inverted ? 1 : 0);
+			unsigned int x = header->x + i;
+			uint8_t mask = 0x80 >> (x & 7);
+			if (0 != value) {
+				d[x / 8] |= mask;
+			} else {
+				d[x / 8] &= ~mask;
 			}
 		}
-		return size;
 	}
+}
+
+
+// collect regions from writes to the region file, each complete
+// region is copied to display and its lines queued for 'P'
+static int region_write(open_file *file, const char *buffer, size_t size, off_t offset) {
+	screen_type *screen = file->screen;
 
-	// test big/little endian
-	if (strncmp(path, "/BE/", 4) == 0) {
-		path += 3;
-	} else if (strncmp(path, "/LE/", 4) == 0) {
-		path += 3;
-		bit_reversed = true;
+	// a region continues at the end of the previous write
+	if (0 == file->region_length) {
+		file->region_offset = offset;
+	} else if (offset != file->region_offset + (off_t)file->region_length) {
+		file->region_length = 0;
+		return -EINVAL;
 	}
 
-	if (strcmp(path, display_inverted_path) == 0) {
-		inverted = true;
-	} else if (strcmp(path, display_path) != 0) {
-		return -ENOENT;
+	size_t done = 0;
+	while (done < size) {
+		size_t n = size - done;
+		size_t need = sizeof(EPD_region_header);
+		const EPD_region_header *header = (const EPD_region_header *)file->region;
+		if (file->region_length >= need) {
+			if (0 != header->reserved ||
+			    0 != (header->flags & ~EPD_REGION_FLAGS) ||
+			    0 == header->width || 0 == header->height ||
+			    header->x + header->width > screen->panel->width ||
+			    header->y + header->height > screen->panel->height) {
+				file->region_length = 0;
+				return -EINVAL;
+			}
+			need += header->height * EPD_REGION_ROW_BYTES(header->width);
+		}
+		if (n > need - file->region_length) {
+			n = need - file->region_length;
+		}
+		memcpy(file->region + file->region_length, buffer + done, n);
+		file->region_length += n;
+		done += n;
+
+		if (file->region_length == need && need > sizeof(EPD_region_header)) {
+			pthread_mutex_lock(&update_mutex);
+			region_copy(screen, header, file->region + sizeof(EPD_region_header));
+			dirty_mark(screen, header->y, header->y + header->height);
+			pthread_mutex_unlock(&update_mutex);
+			if (0 == (header->flags & EPD_REGION_NO_UPDATE) &&
+			    !queue_command(screen, 'P', -1, NULL, NULL, NULL)) {
+				return -ESHUTDOWN;
+			}
+			file->region_offset += need;
+			file->region_length = 0;
+		}
 	}
+	return size;
+}
 
-	len = sizeof(display_buffer);
-	if (offset < len) {
-		if (offset + size > len) {
-			size = len - offset;
+
+// copy a decoded frame into display, a delta frame is XORed with
+// current first, only lines that change are marked as written
+static void frame_copy(open_file *file) {
+	screen_type *screen = file->screen;
+	const size_t bytes_per_line = screen->panel->width / 8;
+	char image[IMAGE_SIZE];
+
+	pthread_mutex_lock(&update_mutex);
+	if (file->delta) {
+		// inverting both sides of a XOR cancels so only bit order matters
+		special_memcpy(image, (const char *)file->frame, screen->panel->byte_count, file->bit_reversed, false);
+		for (size_t i = 0; i < screen->panel->byte_count; ++i) {
+			image[i] ^= screen->current_buffer[i];
 		}
-		special_memcpy(display_buffer + offset, buffer, size, bit_reversed, inverted);
 	} else {
-		size = 0;
+		special_memcpy(image, (const char *)file->frame, screen->panel->byte_count, file->bit_reversed, file->inverted);
+	}
+	for (int line = 0; line < screen->panel->height; ++line) {
+		size_t i = line * bytes_per_line;
+		if (0 != memcmp(screen->display_buffer + i, image + i, bytes_per_line)) {
+			memcpy(screen->display_buffer + i, image + i, bytes_per_line);
+			dirty_mark(screen, line, line + 1);
+		}
+	}
+	++screen->frames_decoded;
+	pthread_mutex_unlock(&update_mutex);
+}
+
+
+// decode writes to the run length coded display files
+//
+// The coding is PackBits: a control byte n of 0..127 is followed by
+// n + 1 literal bytes, 129..255 by one byte to repeat 257 - n times and
+// 128 is ignored.  Decoded bytes are coded like display (or
+// display_inverse) and go to display once a whole image has arrived,
+// which is byte_count bytes like display and not just the pixels;
+// for display_delta they are XORed with current first, so an image
+// that mostly matches the panel is a few hundred bytes.  A frame may
+// be split over several writes and the next one may follow at once,
+// a write at offset zero always starts a new frame.
+static int rle_write(open_file *file, const uint8_t *buffer, size_t size, off_t offset) {
+	const size_t length = file->screen->panel->byte_count;
+
+	if (0 == offset) {
+		file->frame_length = 0;
+		file->run_count = 0;
+	} else if (offset != file->frame_offset) {
+		file->frame_length = 0;
+		file->run_count = 0;
+		file->frame_offset = 0;
+		return -EINVAL;
+	}
+	file->frame_offset = offset + size;
+
+	for (size_t i = 0; i < size; ++i) {
+		uint8_t b = buffer[i];
+		if (0 == file->run_count) {
+			if (b < 128) {
+				file->run_count = b + 1;
+				file->run_repeat = false;
+			} else if (b > 128) {
+				file->run_count = 257 - b;
+				file->run_repeat = true;
+			}
+			if (file->frame_length + file->run_count > length) {
+				file->frame_length = 0;
+				file->run_count = 0;
+				file->frame_offset = 0;
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (file->run_repeat) {
+			memset(file->frame + file->frame_length, b, file->run_count);
+			file->frame_length += file->run_count;
+			file->run_count = 0;
+		} else {
+			file->frame[file->frame_length++] = b;
+			--file->run_count;
+		}
+		if (0 == file->run_count && length == file->frame_length) {
+			frame_copy(file);
+			file->frame_length = 0;
+		}
 	}
 	return size;
 }
 
 
-static void *display_init(struct fuse_conn_info *conn) {
+// show a pre-encoded frame file (see epd_frame.h)
+//
+// The write is the absolute path of the file, it is read into a private
+// copy and checked here so a file for another panel fails the write
+// with EINVAL, and 'E' is queued to send its stages.  The stages only change the image
+// they were encoded from, so if current is a different image at the
+// time the file's image is encoded as for 'U' instead.
+static int encoded_write(screen_type *screen, const char *buffer, size_t size) {
+	char path[PATH_MAX];
+	if (size >= sizeof(path)) {
+		return -ENAMETOOLONG;
+	}
+	text_buffer(path, sizeof(path), buffer, size);
+	path[strcspn(path, "\n")] = '\0';
+	if ('/' != path[0]) {
+		return -EINVAL;
+	}
 
-	if (!GPIO_setup()) {
-		warn("GPIO_setup failed");
-		goto done;
+	EPD_frame_type frame;
+	int error = EPD_frame_load(&frame, path, screen->epd, screen->panel->width, screen->panel->height);
+	if (0 != error) {
+		return error;
 	}
+	if (!queue_command(screen, 'E', -1, &frame, NULL, NULL)) {
+		EPD_frame_free(&frame);
+		return -ESHUTDOWN;
+	}
+	return size;
+}
 
-	spi = SPI_create(spi_device, spi_bps);
-	if (NULL == spi) {
-		warn("SPI_setup failed");
-		goto done_gpio;
+
+#if EPD_PARTIAL_AVAILABLE
+// bytes in the whole sequence for a header, 0 if it is not valid
+static size_t sequence_size(screen_type *screen, const EPD_sequence_header *header) {
+	if (EPD_SEQUENCE_MAGIC != header->magic ||
+	    0 == header->frame_count || header->frame_count > EPD_SEQUENCE_FRAMES_MAX ||
+	    0 != (header->flags & ~(EPD_SEQUENCE_LE | EPD_SEQUENCE_INVERSE)) ||
+	    0 != header->reserved ||
+	    screen->panel->byte_count != header->image_size) {
+		return 0;
 	}
+	return sizeof(EPD_sequence_header)
+		+ header->frame_count * (sizeof(EPD_sequence_frame) + header->image_size);
+}
 
-	GPIO_mode(panel_on_pin, GPIO_OUTPUT);
-	GPIO_mode(border_pin, GPIO_OUTPUT);
-	GPIO_mode(discharge_pin, GPIO_OUTPUT);
-#if EPD_PWM_REQUIRED
-	GPIO_mode(pwm_pin, GPIO_PWM);
-#endif
-	GPIO_mode(reset_pin, GPIO_OUTPUT);
-	GPIO_mode(busy_pin, GPIO_INPUT);
 
-	epd = EPD_create(panel->size,
-			 panel_on_pin,
-			 border_pin,
-			 discharge_pin,
-#if EPD_PWM_REQUIRED
-			 pwm_pin,
-#endif
-			 reset_pin,
-			 busy_pin,
-			 spi);
+// check the frames of a complete upload and make it the display's
+// sequence, converting the images to the coding of display
+static int sequence_install(open_file *file) {
+	screen_type *screen = file->screen;
+	const EPD_sequence_header *header = (const EPD_sequence_header *)file->sequence;
+	const EPD_sequence_frame *frames = (const EPD_sequence_frame *)(header + 1);
+	const char *images = (const char *)(frames + header->frame_count);
 
-	if (NULL == epd) {
-		warn("EPD_setup failed");
-		goto done_spi;
+	for (unsigned int i = 0; i < header->frame_count; ++i) {
+		unsigned int t = frames[i].stage_time;
+		if ((0 != t && (t < 50 || t > 2000)) || 0 != frames[i].reserved) {
+			return -EINVAL;
+		}
 	}
 
-	return (void *)epd;
+	size_t length = header->frame_count * header->image_size;
+	sequence_type *sequence = malloc(sizeof(sequence_type) + length);
+	if (NULL == sequence) {
+		return -ENOMEM;
+	}
+	sequence->references = 1;
+	sequence->frame_count = header->frame_count;
+	sequence->loops = header->loops;
+	sequence->image_size = header->image_size;
+	for (unsigned int i = 0; i < header->frame_count; ++i) {
+		sequence->stage_times[i] = frames[i].stage_time;
+	}
+	special_memcpy((char *)sequence->images, images, length,
+		       0 != (header->flags & EPD_SEQUENCE_LE), 0 != (header->flags & EPD_SEQUENCE_INVERSE));
 
-	// release resources
-//done_epd:
-//        EPD_destroy(epd);
-done_spi:
-	SPI_destroy(spi);
-done_gpio:
-	GPIO_teardown();
-done:
-	return NULL;
+	pthread_mutex_lock(&update_mutex);
+	sequence_release(screen->animation);
+	screen->animation = sequence;
+	pthread_mutex_unlock(&update_mutex);
+	return 0;
 }
+#endif
 
 
-static void display_destroy(void *param) {
-	if (NULL != param) {
-		EPD_destroy(epd);
-		SPI_destroy(spi);
-		GPIO_teardown();
+// collect an animation from writes to the sequence file (see
+// epd_sequence.h), it replaces the display's sequence once it has
+// all arrived, a write at offset zero always starts a new one
+static int sequence_write(open_file *file, const char *buffer, size_t size, off_t offset) {
+#if EPD_PARTIAL_AVAILABLE
+	if (0 == offset) {
+		file->sequence_length = 0;
+	} else if (0 == file->sequence_length || offset != (off_t)file->sequence_length) {
+		file->sequence_length = 0;
+		return -EINVAL;
+	}
+
+	size_t done = 0;
+	while (done < size) {
+		size_t need = sizeof(EPD_sequence_header);
+		if (file->sequence_length >= need) {
+			need = sequence_size(file->screen, (const EPD_sequence_header *)file->sequence);
+		}
+		size_t n = size - done;
+		if (n > need - file->sequence_length) {
+			n = need - file->sequence_length;
+		}
+		memcpy(file->sequence + file->sequence_length, buffer + done, n);
+		file->sequence_length += n;
+		done += n;
+
+		if (sizeof(EPD_sequence_header) == file->sequence_length) {
+			size_t total = sequence_size(file->screen, (const EPD_sequence_header *)file->sequence);
+			uint8_t *p = (0 == total) ? NULL : realloc(file->sequence, total);
+			if (NULL == p) {
+				file->sequence_length = 0;
+				return 0 == total ? -EINVAL : -ENOMEM;
+			}
+			file->sequence = p;
+		} else if (file->sequence_length == need) {
+			file->sequence_length = 0;
+			if (done < size) {
+				return -EINVAL;  // only one sequence per upload
+			}
+			int error = sequence_install(file);
+			return (0 == error) ? (int)size : error;
+		}
 	}
+	return size;
+#else
+	return -ENOTSUP;  // needs partial updates
+#endif
 }
 
 
-static struct fuse_operations display_operations = {
-	.access   = display_access,
-	.getattr  = display_getattr,
-	.readdir  = display_readdir,
-	.truncate = display_truncate,
-	.open     = display_open,
-	.create   = display_create,
-	.read     = display_read,
-	.write    = display_write,
-	.init     = display_init,
-	.destroy  = display_destroy
-};
+// drop a reference to a sequence, freeing it with the last one
+// caller must hold update_mutex
+static void sequence_release(sequence_type *sequence) {
+	if (NULL != sequence && 0 == --sequence->references) {
+		free(sequence);
+	}
+}
 
 
-// bit reversed table
-static const char reverse[256] = {
-//	__00____01____02____03____04____05____06____07____08____09____0a____0b____0c____0d____0e____0f
+static int display_write(const char *path, const char *buffer, size_t size, off_t offset,
+			 struct fuse_file_info *fi) {
+	open_file *file = (open_file *)(uintptr_t)fi->fh;
+	screen_type *screen = file->screen;
+	char t_buffer[16];
+	char *end = NULL;
+	size_t len;
+
+	switch (file->target) {
+	case TARGET_COMMAND:
+		if (size > 0) {
+			// optional shared memory slot number after the command
+			int slot = -1;
+			if (size > 1 && buffer[1] >= '0' && buffer[1] < '0' + EPD_SHM_SLOTS) {
+				if (NULL == screen->shm) {
+					return -EINVAL;
+				}
+				slot = buffer[1] - '0';
+			}
+			if (!queue_command(screen, buffer[0], slot, NULL, NULL, NULL)) {
+				return -ESHUTDOWN;
+			}
+		}
+		return size;
+
+	case TARGET_REGION:
+		return region_write(file, buffer, size, offset);
+
+	case TARGET_ENCODED:
+		return encoded_write(screen, buffer, size);
+
+	case TARGET_SEQUENCE:
+		return sequence_write(file, buffer, size, offset);
+
+	case TARGET_DISPLAY_RLE:
+		return rle_write(file, (const uint8_t *)buffer, size, offset);
+
+	case TARGET_TEMPERATURE:
+		if (size > 0) {
+			text_buffer(t_buffer, sizeof(t_buffer), buffer, size);
+			long int n = strtol(t_buffer, &end, 0);
+			pthread_mutex_lock(&update_mutex);
+			if (t_buffer != end && n >= -99 && n <= 99) {
+				temperature = (int)n;
+				temperature_manual = true;
+			} else if (0 == strncmp(t_buffer, "auto", 4)) {
+				temperature_manual = false;
+			}
+			pthread_mutex_unlock(&update_mutex);
+		}
+		return size;
+
+	case TARGET_PU_STAGETIME:
+		if (size > 0) {
+			text_buffer(t_buffer, sizeof(t_buffer), buffer, size);
+			long int s = strtol(t_buffer, &end, 0);
+			if (t_buffer != end && s >= 50 && s <= 2000) {
+				screen->pu_stagetime = (int)s;
+			}
+		}
+		return size;
+
+	case TARGET_STANDBY:
+		if (size > 0) {
+			text_buffer(t_buffer, sizeof(t_buffer), buffer, size);
+			long int n = strtol(t_buffer, &end, 0);
+			if (t_buffer != end && n >= 0 && n <= STANDBY_MAX) {
+				pthread_mutex_lock(&update_mutex);
+				screen->standby_timeout = (unsigned int)n;
+				pthread_cond_signal(&screen->update_queued);  // worker uses the new timeout
+				pthread_mutex_unlock(&update_mutex);
+			}
+		}
+		return size;
+
+	case TARGET_STATUS:
+		// set sequence number for the next read to wait for
+		if (size > 0) {
+			text_buffer(t_buffer, sizeof(t_buffer), buffer, size);
+			unsigned long int sequence = strtoul(t_buffer, &end, 0);
+			if (t_buffer != end) {
+				pthread_mutex_lock(&update_mutex);
+				file->wait_sequence = (unsigned int)sequence;
+				pthread_mutex_unlock(&update_mutex);
+			}
+		}
+		return size;
+
+	case TARGET_DISPLAY:
+		len = IMAGE_SIZE;
+		if (offset < len) {
+			if (offset + size > len) {
+				size = len - offset;
+			}
+			pthread_mutex_lock(&update_mutex);
+			special_memcpy(screen->display_buffer + offset, buffer, size, file->bit_reversed, file->inverted);
+			if (size > 0) {
+				size_t bytes_per_line = screen->panel->width / 8;
+				dirty_mark(screen, offset / bytes_per_line, (offset + size - 1) / bytes_per_line + 1);
+			}
+			pthread_mutex_unlock(&update_mutex);
+		} else {
+			size = 0;
+		}
+		return size;
+
+	default:
+		break;
+	}
+	return -EACCES;
+}
+
+
+static int display_poll(const char *path, struct fuse_file_info *fi,
+			struct fuse_pollhandle *ph, unsigned *reventsp) {
+	open_file *file = (open_file *)(uintptr_t)fi->fh;
+
+	if (TARGET_STATUS != file->target) {
+		// always ready
+		if (NULL != ph) {
+			fuse_pollhandle_destroy(ph);
+		}
+		*reventsp |= POLLIN | POLLOUT;
+		return 0;
+	}
+
+	// readable once a command completes after the last read of this file
+	screen_type *screen = file->screen;
+	pthread_mutex_lock(&update_mutex);
+	if (NULL != ph) {
+		if (NULL != file->poll_handle) {
+			fuse_pollhandle_destroy(file->poll_handle);
+		}
+		file->poll_handle = ph;
+	}
+	if (file->seen_sequence != screen->completed_sequence) {
+		*reventsp |= POLLIN;
+	}
+	*reventsp |= POLLOUT;
+	pthread_mutex_unlock(&update_mutex);
+	return 0;
+}
+
+
+// the bus lock for an SPI path, spidev devices with the same bus
+// number share one (bcm2835:CS is SPI0, the same bus as spidev0), any
+// other path has its own
+static bus_type *bus_find(const char *spi_path) {
+	char key[32];
+	unsigned int bus_number = 0;
+	unsigned int chip_select = 0;
+	char tail = '\0';
+	if (2 == sscanf(spi_path, "/dev/spidev%u.%u%c", &bus_number, &chip_select, &tail)) {
+		snprintf(key, sizeof(key), "spidev%u", bus_number);
+		spi_path = key;
+	} else if (0 == strncmp(spi_path, "bcm2835:", 8)) {
+		spi_path = "spidev0";
+	}
+
+	for (bus_type *bus = buses; NULL != bus; bus = bus->next) {
+		if (0 == strcmp(bus->key, spi_path)) {
+			return bus;
+		}
+	}
+
+	bus_type *bus = malloc(sizeof(bus_type));
+	if (NULL == bus) {
+		warn("failed to allocate bus");
+		return NULL;
+	}
+	bus->key = strdup(spi_path);
+	if (NULL == bus->key) {
+		warn("failed to allocate bus");
+		free(bus);
+		return NULL;
+	}
+	pthread_mutex_init(&bus->lock, NULL);
+	bus->next = buses;
+	buses = bus;
+	return bus;
+}
+
+
+// release all bus locks
+static void bus_destroy_all(void) {
+	while (NULL != buses) {
+		bus_type *bus = buses;
+		buses = bus->next;
+		pthread_mutex_destroy(&bus->lock);
+		free(bus->key);
+		free(bus);
+	}
+}
+
+
+// open the SPI device and panel of a display and start its update thread
+static bool screen_start(screen_type *screen) {
+
+	screen->bus = bus_find(screen->spi_device);
+	if (NULL == screen->bus) {
+		goto done;
+	}
+
+	screen->spi = SPI_create(screen->spi_device, spi_bps);
+	if (NULL == screen->spi) {
+		warn("SPI_setup failed: %s", screen->spi_device);
+		goto done;
+	}
+
+	GPIO_mode(screen->panel_on_pin, GPIO_OUTPUT);
+	GPIO_mode(screen->border_pin, GPIO_OUTPUT);
+	GPIO_mode(screen->discharge_pin, GPIO_OUTPUT);
+#if EPD_PWM_REQUIRED
+	GPIO_mode(screen->pwm_pin, GPIO_PWM);
+#endif
+	GPIO_mode(screen->reset_pin, GPIO_OUTPUT);
+	GPIO_mode(screen->busy_pin, GPIO_INPUT);
+
+	screen->epd = EPD_create(screen->panel->size,
+				 screen->panel_on_pin,
+				 screen->border_pin,
+				 screen->discharge_pin,
+#if EPD_PWM_REQUIRED
+				 screen->pwm_pin,
+#endif
+				 screen->reset_pin,
+				 screen->busy_pin,
+				 screen->spi);
+
+	if (NULL == screen->epd) {
+		warn("EPD_setup failed");
+		goto done_spi;
+	}
+
+#if EPD_TIMING_AVAILABLE
+	EPD_set_timing(screen->epd, timing_count ? EPD_TIMING_FRAME_COUNT : EPD_TIMING_DEADLINE);
+#endif
+
+	if (NULL != screen->shm_name && !shm_create(screen)) {
+		goto done_epd;
+	}
+
+	// start the update thread
+	// the idle timeout must not jump when the clock is set
+	pthread_condattr_t cond_attributes;
+	pthread_condattr_init(&cond_attributes);
+	pthread_condattr_setclock(&cond_attributes, CLOCK_MONOTONIC);
+	pthread_cond_init(&screen->update_queued, &cond_attributes);
+	pthread_condattr_destroy(&cond_attributes);
+	pthread_cond_init(&screen->update_completed, NULL);
+
+	pthread_attr_t thread_attributes;
+	pthread_attr_init(&thread_attributes);
+	update_thread_attributes(&thread_attributes);
+	int rc = pthread_create(&screen->update_thread, &thread_attributes, update_worker, screen);
+	if (EPERM == rc) {
+		warnx("no permission for real time scheduling, using normal scheduling");
+		pthread_attr_setinheritsched(&thread_attributes, PTHREAD_INHERIT_SCHED);
+		rc = pthread_create(&screen->update_thread, &thread_attributes, update_worker, screen);
+	}
+	pthread_attr_destroy(&thread_attributes);
+	if (0 != rc) {
+		warn("update thread failed");
+		goto done_shm;
+	}
+	screen->update_running = true;
+	return true;
+
+	// release resources
+done_shm:
+	pthread_cond_destroy(&screen->update_queued);
+	pthread_cond_destroy(&screen->update_completed);
+	shm_destroy(screen);
+done_epd:
+	EPD_destroy(screen->epd);
+	screen->epd = NULL;
+done_spi:
+	SPI_destroy(screen->spi);
+	screen->spi = NULL;
+done:
+	return false;
+}
+
+
+// scheduling of an update thread for -o realtime and -o cpu
+static void update_thread_attributes(pthread_attr_t *attributes) {
+	if (realtime_priority > 0) {
+		struct sched_param param = {
+			.sched_priority = realtime_priority
+		};
+		pthread_attr_setinheritsched(attributes, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(attributes, SCHED_FIFO);
+		pthread_attr_setschedparam(attributes, &param);
+		pthread_attr_setstacksize(attributes, REALTIME_STACK_SIZE);
+	}
+	if (realtime_cpu >= 0) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(realtime_cpu, &cpus);
+		pthread_attr_setaffinity_np(attributes, sizeof(cpus), &cpus);
+	}
+}
+
+
+// finish the queued commands of a display (update_quit must be set)
+// and release it
+static void screen_stop(screen_type *screen) {
+	if (screen->update_running) {
+		pthread_join(screen->update_thread, NULL);
+		pthread_mutex_lock(&update_mutex);
+		sequence_release(screen->animation);
+		screen->animation = NULL;
+		pthread_mutex_unlock(&update_mutex);
+		pthread_cond_destroy(&screen->update_queued);
+		pthread_cond_destroy(&screen->update_completed);
+		screen->update_running = false;
+		shm_destroy(screen);
+		EPD_destroy(screen->epd);
+		screen->epd = NULL;
+		SPI_destroy(screen->spi);
+		screen->spi = NULL;
+	}
+}
+
+
+// tell all update threads to finish their queues
+static void update_stop_all(void) {
+	pthread_mutex_lock(&update_mutex);
+	update_quit = true;
+	for (unsigned int i = 0; i < screen_count; ++i) {
+		if (screens[i]->update_running) {
+			pthread_cond_broadcast(&screens[i]->update_queued);
+			pthread_cond_broadcast(&screens[i]->update_completed);
+		}
+	}
+	pthread_mutex_unlock(&update_mutex);
+}
+
+
+static void *display_init(struct fuse_conn_info *conn) {
+
+	neon_convert = EPD_neon_available();
+
+	if (!GPIO_setup()) {
+		warn("GPIO_setup failed");
+		goto done;
+	}
+
+	// the first command already uses a sensor reading
+	if (NULL != sensor_source && !sensor_start()) {
+		goto done_gpio;
+	}
+
+	unsigned int started = 0;
+	for (; started < screen_count; ++started) {
+		if (!screen_start(screens[started])) {
+			goto done_screens;
+		}
+	}
+
+	if (NULL != socket_path && !socket_start()) {
+		goto done_screens;
+	}
+
+	// everything the update threads use is now mapped
+	if (realtime_priority > 0 && 0 != mlockall(MCL_CURRENT)) {
+		warn("mlockall failed");
+	}
+
+	return (void *)screens;
+
+	// release resources
+done_screens:
+	update_stop_all();
+	for (unsigned int i = 0; i < started; ++i) {
+		screen_stop(screens[i]);
+	}
+	bus_destroy_all();
+	sensor_stop();
+done_gpio:
+	GPIO_teardown();
+done:
+	return NULL;
+}
+
+
+static void display_destroy(void *param) {
+	if (NULL != param) {
+		// finish any queued commands, displays stop together
+		update_stop_all();
+		socket_stop();
+		for (unsigned int i = 0; i < screen_count; ++i) {
+			screen_stop(screens[i]);
+		}
+
+		sensor_stop();
+		bus_destroy_all();
+		GPIO_teardown();
+	}
+}
+
+
+static struct fuse_operations display_operations = {
+	.access   = display_access,
+	.getattr  = display_getattr,
+	.readdir  = display_readdir,
+	.truncate = display_truncate,
+	.open     = display_open,
+	.release  = display_release,
+	.create   = display_create,
+	.read     = display_read,
+	.write    = display_write,
+	.poll     = display_poll,
+	.init     = display_init,
+	.destroy  = display_destroy
+};
+
+
+// bit reversed table
+static const char reverse[256] = {
+//	__00____01____02____03____04____05____06____07____08____09____0a____0b____0c____0d____0e____0f
 	0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0, 0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0,
 //	__10____11____12____13____14____15____16____17____18____19____1a____1b____1c____1d____1e____1f
 	0x08, 0x88, 0x48, 0xc8, 0x28, 0xa8, 0x68, 0xe8, 0x18, 0x98, 0x58, 0xd8, 0x38, 0xb8, 0x78, 0xf8,
@@ -583,99 +1783,1087 @@ static const char reverse[256] = {
 };
 
 
-// copy buffer
-static void special_memcpy(char *d, const char *s, size_t size, bool bit_reversed, bool inverted) {
-	if (bit_reversed) {
-		if (inverted) {
-			for (size_t n = 0; n < size; ++n) {
-				*d++ = reverse[(unsigned)(*s++)] ^ 0xff;
+// reverse the bits in each byte of a 64 bit word
+static inline uint64_t reverse_byte_bits(uint64_t w) {
+	w = ((w >> 1) & UINT64_C(0x5555555555555555)) | ((w & UINT64_C(0x5555555555555555)) << 1);
+	w = ((w >> 2) & UINT64_C(0x3333333333333333)) | ((w & UINT64_C(0x3333333333333333)) << 2);
+	w = ((w >> 4) & UINT64_C(0x0f0f0f0f0f0f0f0f)) | ((w & UINT64_C(0x0f0f0f0f0f0f0f0f)) << 4);
+	return w;
+}
+
+// copy buffer
+// d may be the display buffer itself, so writes need no staging copy
+// converts 16 bytes at a time with NEON (when the CPU has it, see
+// epd_neon.h), 8 bytes at a time otherwise and uses the table for any
+// remaining bytes
+static void special_memcpy(char *d, const char *s, size_t size, bool bit_reversed, bool inverted) {
+	if (!bit_reversed && !inverted) {
+		memcpy(d, s, size);
+		return;
+	}
+
+	const uint8_t flip = inverted ? 0xff : 0x00;
+	size_t n = 0;
+	if (neon_convert) {
+		n = EPD_neon_convert((uint8_t *)d, (const uint8_t *)s, size, bit_reversed, flip);
+	}
+
+	// memcpy to and from the word avoids unaligned access problems
+	const uint64_t flip_64 = inverted ? ~UINT64_C(0) : 0;
+	if (bit_reversed) {
+		for (; n + 8 <= size; n += 8) {
+			uint64_t w;
+			memcpy(&w, s + n, sizeof(w));
+			w = reverse_byte_bits(w) ^ flip_64;
+			memcpy(d + n, &w, sizeof(w));
+		}
+		for (; n < size; ++n) {
+			d[n] = reverse[(uint8_t)s[n]] ^ flip;
+		}
+	} else {
+		for (; n + 8 <= size; n += 8) {
+			uint64_t w;
+			memcpy(&w, s + n, sizeof(w));
+			w ^= flip_64;
+			memcpy(d + n, &w, sizeof(w));
+		}
+		for (; n < size; ++n) {
+			d[n] = s[n] ^ flip;
+		}
+	}
+}
+
+// true for commands that draw the display buffer
+static bool is_image_command(const char c) {
+	return 'U' == c || 'P' == c || 'F' == c;
+}
+
+
+// give a queue entry a new sequence number, the current settings and
+// the image to draw: a copy of display or a shared memory slot
+// 'P' and 'F' of display get the range of lines written since the last
+// image command, anything that leaves current different from display
+// marks every line
+// temperature is NULL to use the current setting
+// caller must hold update_mutex
+static void set_update(screen_type *screen, update_type *update, int slot, const int *temperature) {
+	update->sequence = ++screen->queued_sequence;
+	update->temperature = NULL != temperature ? *temperature : current_temperature();
+	update->pu_stagetime = screen->pu_stagetime;
+	update->slot = slot;
+	update->first_line = 0;
+	update->end_line = screen->panel->height;
+	if (slot >= 0 || 'C' == update->command || 'E' == update->command || 'S' == update->command) {
+		dirty_mark(screen, 0, screen->panel->height);
+	} else if ('U' == update->command) {
+		memset(screen->dirty_lines, 0, sizeof(screen->dirty_lines));
+	} else {
+		dirty_take(screen, &update->first_line, &update->end_line);
+	}
+	if (slot < 0) {
+		memcpy(update->image, screen->display_buffer, sizeof(update->image));
+	} else {
+		__atomic_store_n(&screen->shm->slot_sequence[slot], update->sequence, __ATOMIC_RELEASE);
+	}
+	if (NULL != screen->shm) {
+		__atomic_store_n(&screen->shm->queued_sequence, screen->queued_sequence, __ATOMIC_RELEASE);
+	}
+	++screen->commands_queued;
+}
+
+
+// queue a command for the update thread
+// an image command replaces the image of an image command that is
+// still waiting, so only the newest image is drawn (a full update is
+// never changed to a partial one)
+// only blocks if the queue is full
+// 'E' takes over the loaded frame, which the update thread frees
+// 'S' takes a reference to the display's sequence (ignored if none)
+// temperature is NULL to use the current setting, the sequence number
+// of the queued command is stored in sequence if it is not NULL
+// returns false if the daemon is shutting down
+static bool queue_command(screen_type *screen, const char c, int slot, const EPD_frame_type *frame,
+			  const int *temperature, unsigned int *sequence) {
+	switch(c) {
+	case 'R':  // not queued: zero the counters now
+		reset_stats(screen);
+		return true;
+
+	case 'E':
+		if (NULL == frame) {
+			return true;  // only from encoded
+		}
+		break;
+
+	case 'C':
+	case 'U':
+	case 'P':
+	case 'F':
+	case 'S':
+		break;
+	default:
+		return true;  // ignore unknown commands
+	}
+
+	pthread_mutex_lock(&update_mutex);
+	if ('S' == c && NULL == screen->animation) {
+		pthread_mutex_unlock(&update_mutex);
+		return true;  // nothing uploaded
+	}
+
+	// last entry if it has not been started
+	unsigned int waiting = screen->update_count - (screen->update_busy ? 1 : 0);
+	if (waiting > 0 && is_image_command(c)) {
+		update_type *update = &screen->update_queue[(screen->update_head + screen->update_count - 1) % UPDATE_QUEUE_SIZE];
+		if (is_image_command(update->command)) {
+			if ('U' != update->command) {
+				update->command = c;
+			}
+			// the newer image still has to draw the waiting lines
+			int first_line = update->first_line;
+			int end_line = update->end_line;
+			set_update(screen, update, slot, temperature);
+			if (first_line < end_line) {
+				if (update->first_line == update->end_line || first_line < update->first_line) {
+					update->first_line = first_line;
+				}
+				if (end_line > update->end_line) {
+					update->end_line = end_line;
+				}
+			}
+			++screen->frames_coalesced;
+			if (NULL != sequence) {
+				*sequence = update->sequence;
+			}
+			pthread_mutex_unlock(&update_mutex);
+			return true;
+		}
+	}
+
+	while (UPDATE_QUEUE_SIZE == screen->update_count && !update_quit) {
+		pthread_cond_wait(&screen->update_completed, &update_mutex);
+	}
+	if (update_quit) {
+		pthread_mutex_unlock(&update_mutex);
+		return false;
+	}
+	update_type *update = &screen->update_queue[(screen->update_head + screen->update_count) % UPDATE_QUEUE_SIZE];
+	update->command = c;
+	set_update(screen, update, slot, temperature);
+	if (NULL != frame) {
+		update->frame = *frame;
+	} else {
+		memset(&update->frame, 0, sizeof(update->frame));
+	}
+	update->animation = NULL;
+	if ('S' == c) {
+		update->animation = screen->animation;
+		++update->animation->references;
+	}
+	if (NULL != sequence) {
+		*sequence = update->sequence;
+	}
+	++screen->update_count;
+	pthread_cond_signal(&screen->update_queued);
+	pthread_mutex_unlock(&update_mutex);
+	return true;
+}
+
+
+// shrink the line range of 'P' and 'F' to the lines that differ from
+// current, on the update thread so current is not changing
+// returns false if nothing would change
+static bool trim_update(screen_type *screen, update_type *update) {
+	if ('P' != update->command && 'F' != update->command) {
+		return true;
+	}
+	const char *image = update->image;
+	if (update->slot >= 0) {
+		image = (const char *)screen->shm + screen->shm->header_size + update->slot * screen->shm->slot_size;
+	}
+	size_t bytes_per_line = screen->panel->width / 8;
+	while (update->first_line < update->end_line &&
+	       0 == memcmp(image + update->first_line * bytes_per_line,
+			   screen->current_buffer + update->first_line * bytes_per_line, bytes_per_line)) {
+		++update->first_line;
+	}
+	while (update->first_line < update->end_line &&
+	       0 == memcmp(image + (update->end_line - 1) * bytes_per_line,
+			   screen->current_buffer + (update->end_line - 1) * bytes_per_line, bytes_per_line)) {
+		--update->end_line;
+	}
+	return update->first_line < update->end_line;
+}
+
+
+// run queued commands of one display until shutdown and the queue is
+// empty, each command holds the bus lock so displays on other buses
+// update at the same time
+// in standby the COG is left on and powered down after
+// standby_timeout seconds with nothing queued, a committed image is
+// powered down as soon as nothing is queued
+static void *update_worker(void *arg) {
+	screen_type *screen = (screen_type *)arg;
+	cog_state cog = COG_OFF;        // COG left by the last command
+	struct timespec idle_start;     // when the last command completed
+
+	pthread_mutex_lock(&update_mutex);
+	for (;;) {
+		while (0 == screen->update_count && !update_quit) {
+			if (COG_COMMITTED == cog) {
+				power_down(screen);
+				cog = COG_OFF;
+			} else if (COG_ON == cog && screen->standby_timeout > 0) {
+				struct timespec deadline = idle_start;
+				deadline.tv_sec += screen->standby_timeout;
+				if (ETIMEDOUT == pthread_cond_timedwait(&screen->update_queued, &update_mutex, &deadline)) {
+					power_down(screen);
+					cog = COG_OFF;
+				}
+			} else {
+				pthread_cond_wait(&screen->update_queued, &update_mutex);
+			}
+		}
+		if (0 == screen->update_count) {
+			break;  // quit
+		}
+
+		// the head entry is not reused until it is removed below
+		// and is not coalesced once it is busy
+		update_type *update = &screen->update_queue[screen->update_head];
+		bool standby = EPD_STANDBY_AVAILABLE && screen->standby_timeout > 0;
+		screen->update_busy = true;
+		copy_driver_stats(screen);
+		pthread_mutex_unlock(&update_mutex);
+
+		// a partial update with no changed lines does not touch the
+		// panel, a COG in standby stays on and keeps its timeout
+		bool changed = trim_update(screen, update);
+		EPD_error error = EPD_OK;
+		if (changed) {
+			pthread_mutex_lock(&screen->bus->lock);
+#if !EPD_STANDBY_AVAILABLE
+			// EPD_begin always powers up, finish the last power down first
+			if (COG_COMMITTED == cog) {
+				EPD_end(screen->epd);
+			}
+#endif
+			cog = run_command(screen, update, standby);
+			error = EPD_status(screen->epd);
+			pthread_mutex_unlock(&screen->bus->lock);
+			clock_gettime(CLOCK_MONOTONIC, &idle_start);
+		}
+		EPD_frame_free(&update->frame);
+
+		pthread_mutex_lock(&update_mutex);
+		sequence_release(update->animation);
+		update->animation = NULL;
+		if (!changed) {
+			++screen->updates_skipped;
+		}
+		copy_driver_stats(screen);
+		screen->completed_sequence = update->sequence;
+		screen->completed_error = error;
+		++screen->commands_completed;
+		if (NULL != screen->shm) {
+			__atomic_store_n(&screen->shm->completed_sequence, screen->completed_sequence, __ATOMIC_RELEASE);
+		}
+		screen->update_head = (screen->update_head + 1) % UPDATE_QUEUE_SIZE;
+		--screen->update_count;
+		screen->update_busy = false;
+		pthread_cond_broadcast(&screen->update_completed);
+
+		// wake any poll() on status
+		for (open_file *h = screen->status_files; NULL != h; h = h->next) {
+			if (NULL != h->poll_handle) {
+				fuse_notify_poll(h->poll_handle);
+				fuse_pollhandle_destroy(h->poll_handle);
+				h->poll_handle = NULL;
+			}
+		}
+	}
+	pthread_mutex_unlock(&update_mutex);
+
+	// do not leave the COG on at exit
+	if (COG_OFF != cog) {
+		pthread_mutex_lock(&screen->bus->lock);
+		EPD_end(screen->epd);
+		pthread_mutex_unlock(&screen->bus->lock);
+	}
+	return NULL;
+}
+
+
+// run the COG power down sequence (called with update_mutex held, on
+// the update thread)
+static void power_down(screen_type *screen) {
+	copy_driver_stats(screen);
+	pthread_mutex_unlock(&update_mutex);
+	pthread_mutex_lock(&screen->bus->lock);
+	EPD_end(screen->epd);
+	pthread_mutex_unlock(&screen->bus->lock);
+	pthread_mutex_lock(&update_mutex);
+	copy_driver_stats(screen);
+}
+
+
+// status file contents: "<idle|busy> <completed sequence> <queued sequence>"
+// caller must hold update_mutex
+static int status_text(screen_type *screen, char *buffer, size_t size) {
+	return snprintf(buffer, size, "%s %u %u\n",
+			screen->update_busy || screen->update_count > 0 ? "busy" : "idle",
+			screen->completed_sequence, screen->queued_sequence);
+}
+
+
+// stats file contents
+// times are in nanoseconds
+// caller must hold update_mutex
+static int stats_text(screen_type *screen, char *buffer, size_t size) {
+	int length = snprintf(buffer, size,
+			      "commands_queued=%lu\n"
+			      "commands_completed=%lu\n"
+			      "frames_coalesced=%lu\n"
+			      "updates_skipped=%lu\n"
+			      "frames_decoded=%lu\n"
+			      "frames_encoded=%lu\n"
+			      "frames_reencoded=%lu\n"
+			      "sequence_frames=%lu\n"
+			      "spi_bytes=%llu\n"
+			      "spi_calls=%lu\n"
+			      "spi_ns=%llu\n",
+			      screen->commands_queued, screen->commands_completed, screen->frames_coalesced,
+			      screen->updates_skipped, screen->frames_decoded,
+			      screen->frames_encoded, screen->frames_reencoded, screen->sequence_frames,
+			      (unsigned long long)screen->spi_stats.bytes, screen->spi_stats.calls,
+			      (unsigned long long)screen->spi_stats.ns);
+	if (NULL != sensor) {
+		length += snprintf(buffer + length, size - length,
+				   "sensor_samples=%lu\n"
+				   "sensor_errors=%lu\n"
+				   "sensor_millidegrees=%d\n",
+				   sensor_samples, sensor_errors, sensor_average);
+	}
+#if EPD_STATS_AVAILABLE
+	static const char *stage_names[EPD_STATS_STAGES] = {
+		"compensate", "white", "inverse", "normal"
+	};
+	unsigned long int frames = 0;
+	for (int i = 0; i < EPD_STATS_STAGES; ++i) {
+		frames += screen->driver_stats.frames[i];
+		length += snprintf(buffer + length, size - length,
+				   "frames_%s=%lu\n"
+				   "stages_%s=%lu\n",
+				   stage_names[i], screen->driver_stats.frames[i],
+				   stage_names[i], screen->driver_stats.stages[i]);
+	}
+	length += snprintf(buffer + length, size - length,
+			   "frame_ns=%llu\n"
+			   "ns_per_frame=%llu\n"
+			   "frame_jitter_ns=%llu\n"
+			   "encode_ns=%llu\n"
+			   "begins=%lu\n"
+			   "begin_ns=%llu\n"
+			   "ends=%lu\n"
+			   "end_ns=%llu\n"
+			   "dc_retries=%lu\n",
+			   (unsigned long long)screen->driver_stats.frame_ns,
+			   (unsigned long long)(0 == frames ? 0 : screen->driver_stats.frame_ns / frames),
+			   (unsigned long long)screen->driver_stats.frame_jitter_ns,
+			   (unsigned long long)screen->driver_stats.encode_ns,
+			   screen->driver_stats.begins,
+			   (unsigned long long)screen->driver_stats.begin_ns,
+			   screen->driver_stats.ends,
+			   (unsigned long long)screen->driver_stats.end_ns,
+			   screen->driver_stats.dc_retries);
+#endif
+	return length;
+}
+
+
+// zero all counters, the driver counters are zeroed by the update
+// thread before it next uses the driver
+static void reset_stats(screen_type *screen) {
+	pthread_mutex_lock(&update_mutex);
+	screen->commands_queued = 0;
+	screen->commands_completed = 0;
+	screen->frames_coalesced = 0;
+	screen->updates_skipped = 0;
+	screen->frames_decoded = 0;
+	screen->frames_encoded = 0;
+	screen->frames_reencoded = 0;
+	screen->sequence_frames = 0;
+	sensor_samples = 0;
+	sensor_errors = 0;
+	memset(&screen->spi_stats, 0, sizeof(screen->spi_stats));
+#if EPD_STATS_AVAILABLE
+	memset(&screen->driver_stats, 0, sizeof(screen->driver_stats));
+#endif
+	screen->stats_reset = true;
+	pthread_mutex_unlock(&update_mutex);
+}
+
+
+// update thread: apply a pending reset and take a copy of the driver
+// counters, called before and after using the driver so a command
+// running at the time of a reset is not counted
+// caller must hold update_mutex
+static void copy_driver_stats(screen_type *screen) {
+	if (screen->stats_reset) {
+		SPI_reset_stats(screen->spi);
+#if EPD_STATS_AVAILABLE
+		EPD_reset_stats(screen->epd);
+#endif
+		screen->stats_reset = false;
+	}
+	SPI_get_stats(screen->spi, &screen->spi_stats);
+#if EPD_STATS_AVAILABLE
+	EPD_get_stats(screen->epd, &screen->driver_stats);
+#endif
+}
+
+
+// create the shared memory frame buffer
+static bool shm_create(screen_type *screen) {
+	size_t header_size = (sizeof(EPD_shm_header) + 63) & ~63;
+	size_t slot_size = (IMAGE_SIZE + 63) & ~63;
+	screen->shm_size = header_size + EPD_SHM_SLOTS * slot_size;
+
+	int fd = shm_open(screen->shm_name, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		warn("shm_open: %s failed", screen->shm_name);
+		return false;
+	}
+	if (0 != ftruncate(fd, screen->shm_size)) {
+		warn("shm ftruncate failed");
+		close(fd);
+		shm_unlink(screen->shm_name);
+		return false;
+	}
+	void *p = mmap(NULL, screen->shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == p) {
+		warn("shm mmap failed");
+		shm_unlink(screen->shm_name);
+		return false;
+	}
+
+	// new object is all zero: both slots are free and white
+	screen->shm = (EPD_shm_header *)p;
+	screen->shm->header_size = header_size;
+	screen->shm->slot_size = slot_size;
+	screen->shm->slot_count = EPD_SHM_SLOTS;
+	screen->shm->width = screen->panel->width;
+	screen->shm->height = screen->panel->height;
+	screen->shm->image_size = screen->panel->byte_count;
+	__atomic_store_n(&screen->shm->magic, EPD_SHM_MAGIC, __ATOMIC_RELEASE);
+	return true;
+}
+
+
+// remove the shared memory frame buffer
+static void shm_destroy(screen_type *screen) {
+	if (NULL != screen->shm) {
+		munmap(screen->shm, screen->shm_size);
+		shm_unlink(screen->shm_name);
+		screen->shm = NULL;
+	}
+}
+
+
+// the temperature for the next command: the smoothed sensor value
+// rounded to whole degrees unless overridden by writing temperature
+// caller must hold update_mutex
+static int current_temperature(void) {
+	if (sensor_valid && !temperature_manual) {
+		int t = sensor_average;
+		return (t >= 0 ? t + 500 : t - 500) / 1000;
+	}
+	return temperature;
+}
+
+
+// add a sensor reading to the average, the first reading is used
+// directly so a restart does not start from a default
+// caller must hold update_mutex
+static void sensor_update(bool ok, int millidegrees) {
+	if (!ok) {
+		++sensor_errors;
+		if (!sensor_failed) {
+			warnx("temperature sensor read failed: %s", sensor_source);
+			sensor_failed = true;
+		}
+		return;
+	}
+	sensor_failed = false;
+	++sensor_samples;
+	if (sensor_valid) {
+		sensor_average += (millidegrees - sensor_average) / 4;
+	} else {
+		sensor_average = millidegrees;
+		sensor_valid = true;
+	}
+}
+
+
+// read the sensor every sensor_interval seconds until sensor_stop
+// the read is done without the lock so a slow I2C bus never delays
+// a command or a read of temperature
+static void *sensor_worker(void *arg) {
+	(void) arg;
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+	pthread_mutex_lock(&update_mutex);
+	while (!sensor_quit) {
+		deadline.tv_sec += sensor_interval;
+		while (!sensor_quit &&
+		       ETIMEDOUT != pthread_cond_timedwait(&sensor_wakeup, &update_mutex, &deadline)) {
+		}
+		if (sensor_quit) {
+			break;
+		}
+		pthread_mutex_unlock(&update_mutex);
+		int millidegrees = 0;
+		bool ok = TEMPERATURE_read(sensor, &millidegrees);
+		pthread_mutex_lock(&update_mutex);
+		sensor_update(ok, millidegrees);
+	}
+	pthread_mutex_unlock(&update_mutex);
+	return NULL;
+}
+
+
+// open the sensor, take a first reading and start the sampler thread
+static bool sensor_start(void) {
+	sensor = TEMPERATURE_create(sensor_source);
+	if (NULL == sensor) {
+		return false;
+	}
+
+	int millidegrees = 0;
+	bool ok = TEMPERATURE_read(sensor, &millidegrees);
+	pthread_mutex_lock(&update_mutex);
+	sensor_update(ok, millidegrees);
+	sensor_quit = false;
+	pthread_mutex_unlock(&update_mutex);
+
+	pthread_condattr_t cond_attributes;
+	pthread_condattr_init(&cond_attributes);
+	pthread_condattr_setclock(&cond_attributes, CLOCK_MONOTONIC);
+	pthread_cond_init(&sensor_wakeup, &cond_attributes);
+	pthread_condattr_destroy(&cond_attributes);
+
+	if (0 != pthread_create(&sensor_thread, NULL, sensor_worker, NULL)) {
+		warn("sensor thread failed");
+		pthread_cond_destroy(&sensor_wakeup);
+		TEMPERATURE_destroy(sensor);
+		sensor = NULL;
+		return false;
+	}
+	return true;
+}
+
+
+// stop the sampler thread and close the sensor
+static void sensor_stop(void) {
+	if (NULL != sensor) {
+		pthread_mutex_lock(&update_mutex);
+		sensor_quit = true;
+		pthread_cond_signal(&sensor_wakeup);
+		pthread_mutex_unlock(&update_mutex);
+		pthread_join(sensor_thread, NULL);
+		pthread_cond_destroy(&sensor_wakeup);
+
+		pthread_mutex_lock(&update_mutex);
+		TEMPERATURE_destroy(sensor);
+		sensor = NULL;
+		sensor_valid = false;
+		pthread_mutex_unlock(&update_mutex);
+	}
+}
+
+
+// control socket state, clients is protected by socket_mutex
+typedef struct {
+	int fd;                              // -1 => free
+	bool finished;                       // thread has returned, join it and close fd
+	pthread_t thread;
+	uint8_t pixels[IMAGE_SIZE];
+} socket_client;
+
+static int socket_fd = -1;
+static bool socket_quit = false;
+static pthread_t socket_thread;
+static pthread_mutex_t socket_mutex = PTHREAD_MUTEX_INITIALIZER;
+static socket_client socket_clients[SOCKET_CLIENTS_MAX];
+
+
+// read exactly size bytes, false at end of file or on error
+static bool socket_read(int fd, void *buffer, size_t size) {
+	uint8_t *p = buffer;
+	while (size > 0) {
+		ssize_t n = recv(fd, p, size, MSG_WAITALL);
+		if (n < 0 && EINTR == errno) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return true;
+}
+
+
+// check a request, copy its pixels into display, queue its command
+// and wait for it to complete
+// fatal is set if the rest of the connection cannot be read
+// returns the reply error
+static int socket_request(socket_client *client, const EPD_socket_request *request,
+			  unsigned int *sequence, bool *fatal) {
+	if (EPD_SOCKET_MAGIC != request->magic || request->length > sizeof(client->pixels)) {
+		*fatal = true;
+		return -EPROTO;
+	}
+	if (!socket_read(client->fd, client->pixels, request->length)) {
+		*fatal = true;
+		return -EIO;
+	}
+
+	if (request->display >= screen_count) {
+		return -ENODEV;
+	}
+	screen_type *screen = screens[request->display];
+	const bool image = 0 != (request->flags & EPD_SOCKET_IMAGE);
+	const bool region = 0 != (request->flags & EPD_SOCKET_REGION);
+	const EPD_region_header *r = &request->region;
+	size_t length = 0;
+	if (image && region) {
+		return -EINVAL;
+	} else if (image) {
+		length = screen->panel->byte_count;
+	} else if (region) {
+		if (0 == r->width || 0 == r->height ||
+		    r->x + r->width > screen->panel->width ||
+		    r->y + r->height > screen->panel->height) {
+			return -EINVAL;
+		}
+		length = r->height * EPD_REGION_ROW_BYTES(r->width);
+	}
+	if (request->length != length || 0 != request->reserved ||
+	    (0 != request->command && !is_image_command(request->command) && 'C' != request->command)) {
+		return -EINVAL;
+	}
+	int temperature = request->temperature;
+	if (0 != (request->flags & EPD_SOCKET_TEMPERATURE) && (temperature < -99 || temperature > 99)) {
+		return -EINVAL;
+	}
+
+	const bool bit_reversed = 0 != (request->flags & EPD_SOCKET_LE);
+	const bool inverted = 0 != (request->flags & EPD_SOCKET_INVERSE);
+	pthread_mutex_lock(&update_mutex);
+	if (image) {
+		special_memcpy(screen->display_buffer, (const char *)client->pixels, length, bit_reversed, inverted);
+		dirty_mark(screen, 0, screen->panel->height);
+	} else if (region) {
+		EPD_region_header header = *r;
+		header.flags = (bit_reversed ? EPD_REGION_LE : 0) | (inverted ? EPD_REGION_INVERSE : 0);
+		region_copy(screen, &header, client->pixels);
+		dirty_mark(screen, header.y, header.y + header.height);
+	}
+	pthread_mutex_unlock(&update_mutex);
+
+	if (0 == request->command) {
+		return 0;
+	}
+	if (!queue_command(screen, request->command, -1, NULL,
+			   0 != (request->flags & EPD_SOCKET_TEMPERATURE) ? &temperature : NULL, sequence)) {
+		return -ESHUTDOWN;
+	}
+
+	// a later image command may have taken over this one, its status
+	// is then the status of this image
+	int error = -ESHUTDOWN;
+	pthread_mutex_lock(&update_mutex);
+	while ((int)(screen->completed_sequence - *sequence) < 0 && !update_quit) {
+		pthread_cond_wait(&screen->update_completed, &update_mutex);
+	}
+	if ((int)(screen->completed_sequence - *sequence) >= 0) {
+		error = screen->completed_error;
+	}
+	pthread_mutex_unlock(&update_mutex);
+	return error;
+}
+
+
+// serve the requests of one connection until it closes
+static void *socket_worker(void *arg) {
+	socket_client *client = (socket_client *)arg;
+	EPD_socket_request request;
+
+	while (socket_read(client->fd, &request, sizeof(request))) {
+		unsigned int sequence = 0;
+		bool fatal = false;
+		int error = socket_request(client, &request, &sequence, &fatal);
+		EPD_socket_reply reply = {
+			.magic = EPD_SOCKET_MAGIC,
+			.tag = request.tag,
+			.sequence = sequence,
+			.error = error
+		};
+		if (sizeof(reply) != send(client->fd, &reply, sizeof(reply), MSG_NOSIGNAL) || fatal) {
+			break;
+		}
+	}
+
+	// the client sees the end now, fd is closed when the thread is joined
+	shutdown(client->fd, SHUT_RDWR);
+	pthread_mutex_lock(&socket_mutex);
+	client->finished = true;
+	pthread_mutex_unlock(&socket_mutex);
+	return NULL;
+}
+
+
+// join a finished or shut down connection thread
+// caller must hold socket_mutex or the listener must have stopped
+static void socket_client_release(socket_client *client) {
+	pthread_join(client->thread, NULL);
+	close(client->fd);
+	client->fd = -1;
+	client->finished = false;
+}
+
+
+// accept connections until socket_stop, each gets a free client
+static void *socket_listener(void *arg) {
+	(void)arg;
+	for (;;) {
+		int fd = accept(socket_fd, NULL, NULL);
+		pthread_mutex_lock(&socket_mutex);
+		if (socket_quit) {
+			pthread_mutex_unlock(&socket_mutex);
+			if (fd >= 0) {
+				close(fd);
 			}
-		} else {
-			for (size_t n = 0; n < size; ++n) {
-				*d++ = reverse[(unsigned)(*s++)];
+			break;
+		}
+		if (fd < 0) {
+			pthread_mutex_unlock(&socket_mutex);
+			if (EINTR != errno && ECONNABORTED != errno) {
+				warn("socket accept failed");
+				usleep(100000);
+			}
+			continue;
+		}
+
+		socket_client *client = NULL;
+		for (unsigned int i = 0; i < SOCKET_CLIENTS_MAX; ++i) {
+			if (socket_clients[i].fd >= 0 && socket_clients[i].finished) {
+				socket_client_release(&socket_clients[i]);
+			}
+			if (NULL == client && socket_clients[i].fd < 0) {
+				client = &socket_clients[i];
 			}
 		}
-	} else if (inverted) {
-		for (size_t n = 0; n < size; ++n) {
-			*d++ = *s++ ^ 0xff;
+		if (NULL != client) {
+			client->fd = fd;
+			client->finished = false;
+			if (0 != pthread_create(&client->thread, NULL, socket_worker, client)) {
+				warn("socket thread failed");
+				client->fd = -1;
+				client = NULL;
+			}
 		}
-	} else {
-		memcpy(d, s, size);
+		if (NULL == client) {
+			close(fd);  // too many connections
+		}
+		pthread_mutex_unlock(&socket_mutex);
 	}
+	return NULL;
 }
 
-// run a command
-static void run_command(const char c) {
-	switch(c) {
+
+// listen on socket_path, a stale socket left by a crash is replaced
+static bool socket_start(void) {
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(address.sun_path)) {
+		warnx("socket path too long: %s", socket_path);
+		return false;
+	}
+	strcpy(address.sun_path, socket_path);
+
+	for (unsigned int i = 0; i < SOCKET_CLIENTS_MAX; ++i) {
+		socket_clients[i].fd = -1;
+	}
+	socket_quit = false;
+
+	socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (socket_fd < 0) {
+		warn("socket failed");
+		return false;
+	}
+	unlink(socket_path);
+	if (0 != bind(socket_fd, (const struct sockaddr *)&address, sizeof(address)) ||
+	    0 != listen(socket_fd, SOCKET_CLIENTS_MAX)) {
+		warn("socket failed: %s", socket_path);
+		goto done;
+	}
+	if (0 != pthread_create(&socket_thread, NULL, socket_listener, NULL)) {
+		warn("socket thread failed");
+		unlink(socket_path);
+		goto done;
+	}
+	return true;
+
+done:
+	close(socket_fd);
+	socket_fd = -1;
+	return false;
+}
+
+
+// close the socket and all connections (update_quit must be set so
+// requests waiting for a command return)
+static void socket_stop(void) {
+	if (socket_fd < 0) {
+		return;
+	}
+	pthread_mutex_lock(&socket_mutex);
+	socket_quit = true;
+	pthread_mutex_unlock(&socket_mutex);
+	shutdown(socket_fd, SHUT_RDWR);  // wakes accept()
+	pthread_join(socket_thread, NULL);
+	close(socket_fd);
+	socket_fd = -1;
+	unlink(socket_path);
+
+	pthread_mutex_lock(&socket_mutex);
+	for (unsigned int i = 0; i < SOCKET_CLIENTS_MAX; ++i) {
+		if (socket_clients[i].fd >= 0) {
+			shutdown(socket_clients[i].fd, SHUT_RDWR);
+		}
+	}
+	pthread_mutex_unlock(&socket_mutex);
+	for (unsigned int i = 0; i < SOCKET_CLIENTS_MAX; ++i) {
+		if (socket_clients[i].fd >= 0) {
+			socket_client_release(&socket_clients[i]);
+		}
+	}
+}
+
+
+// run a command (on the update thread)
+// current_buffer is only changed here so it can be read without locking
+// in standby the COG is not powered down after the command, otherwise
+// the power down is left to the update thread (see cog_state)
+static cog_state run_command(screen_type *screen, const update_type *update, bool standby) {
+	cog_state cog = COG_OFF;
+	const uint8_t *image = (const uint8_t *)update->image;
+	if (update->slot >= 0) {
+		image = (const uint8_t *)screen->shm + screen->shm->header_size + update->slot * screen->shm->slot_size;
+	}
+
+	switch(update->command) {
 	case 'C':  // clear the display
-		EPD_set_temperature(epd, temperature);
-		EPD_begin(epd);
-		if (EPD_OK != EPD_status(epd)) {
+		EPD_set_temperature(screen->epd, update->temperature);
+		EPD_begin(screen->epd);
+		if (EPD_OK != EPD_status(screen->epd)) {
 			warn("EPD_begin failed");
 		}
-		EPD_clear(epd);
-		EPD_end(epd);
+		EPD_clear(screen->epd);
+		cog = finish_command(screen, standby);
 
-		memset(current_buffer, 0, sizeof(current_buffer));
+		pthread_mutex_lock(&update_mutex);
+		memset(screen->current_buffer, 0, sizeof(screen->current_buffer));
+		pthread_mutex_unlock(&update_mutex);
 		break;
 
 	case 'U':  // update with contents of display
-		EPD_set_temperature(epd, temperature);
-		EPD_begin(epd);
-		if (EPD_OK != EPD_status(epd)) {
+		EPD_set_temperature(screen->epd, update->temperature);
+		EPD_begin(screen->epd);
+		if (EPD_OK != EPD_status(screen->epd)) {
 			warn("EPD_begin failed");
 		}
 #if EPD_IMAGE_ONE_ARG
-		EPD_image(epd, (const uint8_t *)display_buffer);
+		EPD_image(screen->epd, image);
 #elif EPD_IMAGE_TWO_ARG
-		EPD_image(epd, (const uint8_t *)current_buffer, (const uint8_t *)display_buffer);
+		EPD_image(screen->epd, (const uint8_t *)screen->current_buffer, image);
 #else
 #error "unsupported EPD_image() function"
 #endif
-		EPD_end(epd);
+		cog = finish_command(screen, standby);
+
+		pthread_mutex_lock(&update_mutex);
+		memcpy(screen->current_buffer, image, sizeof(screen->current_buffer));
+		pthread_mutex_unlock(&update_mutex);
+		break;
+
+#if EPD_ENCODED_AVAILABLE
+	case 'E': {  // pre-encoded frame file
+		const EPD_frame_type *frame = &update->frame;
+		const size_t length = frame->header->image_size;  // can be less than byte_count
+		bool matches = true;
+		if (NULL != frame->old_image) {
+			matches = 0 == memcmp(screen->current_buffer, frame->old_image, length);
+		} else {
+			for (size_t i = 0; i < length && matches; ++i) {
+				matches = 0 == screen->current_buffer[i];
+			}
+		}
+
+		EPD_set_temperature(screen->epd, update->temperature);
+		EPD_begin(screen->epd);
+		if (EPD_OK != EPD_status(screen->epd)) {
+			warn("EPD_begin failed");
+		}
+		if (matches) {
+			EPD_encoded_image(screen->epd, frame->stages);
+		} else {
+			EPD_image(screen->epd, (const uint8_t *)screen->current_buffer, frame->new_image);
+		}
+		cog = finish_command(screen, standby);
 
-		memcpy(current_buffer, display_buffer, sizeof(display_buffer));
+		pthread_mutex_lock(&update_mutex);
+		memcpy(screen->current_buffer, frame->new_image, length);
+		if (matches) {
+			++screen->frames_encoded;
+		} else {
+			++screen->frames_reencoded;
+		}
+		pthread_mutex_unlock(&update_mutex);
 		break;
+	}
+#endif
 
 	case 'P':  // partial update with contents of display
 	case 'F':  // partial update bypassing temperature compensation for stagetime
-		if (c == 'P') {
-			EPD_set_temperature(epd, temperature);
+		if (update->command == 'P') {
+			EPD_set_temperature(screen->epd, update->temperature);
 		}
 #if EPD_PARTIAL_AVAILABLE
 		else {
-			EPD_set_factored_stage_time(epd, pu_stagetime);
+			EPD_set_factored_stage_time(screen->epd, update->pu_stagetime);
 		}
 #endif 
-		EPD_begin(epd);
-		if (EPD_OK != EPD_status(epd)) {
+		EPD_begin(screen->epd);
+		if (EPD_OK != EPD_status(screen->epd)) {
 			warn("EPD_begin failed");
 		}
 #if EPD_PARTIAL_AVAILABLE
-		// use partial update
-		EPD_partial_image(epd, (const uint8_t *)current_buffer, (const uint8_t *)display_buffer);
+		// use partial update, only the queued lines
+		EPD_partial_lines(screen->epd, (const uint8_t *)screen->current_buffer, image,
+				  update->first_line, update->end_line);
 #elif EPD_IMAGE_ONE_ARG
 		// no partial so just normal display
-		EPD_image(epd, (const uint8_t *)display_buffer);
+		EPD_image(screen->epd, image);
 #elif EPD_IMAGE_TWO_ARG
 		// no partial so just normal display
-		EPD_image(epd, (const uint8_t *)current_buffer, (const uint8_t *)display_buffer);
+		EPD_image(screen->epd, (const uint8_t *)screen->current_buffer, image);
 #else
 #error "unsupported EPD_image() function"
 #endif
 
-#ifndef EPD_PARTIAL_AVAILABLE
+#if EPD_PARTIAL_AVAILABLE
 		// Do not switch off COG when doing a partial update.
-		EPD_end(epd);
+		cog = COG_ON;
+
+		// lines outside the range were not sent
+		{
+			size_t bytes_per_line = screen->panel->width / 8;
+			size_t first = update->first_line * bytes_per_line;
+			size_t length = (update->end_line - update->first_line) * bytes_per_line;
+			pthread_mutex_lock(&update_mutex);
+			memcpy(screen->current_buffer + first, image + first, length);
+			pthread_mutex_unlock(&update_mutex);
+		}
+#else
+		cog = finish_command(screen, false);
+
+		pthread_mutex_lock(&update_mutex);
+		memcpy(screen->current_buffer, image, sizeof(screen->current_buffer));
+		pthread_mutex_unlock(&update_mutex);
 #endif
+		break;
 
-		memcpy(current_buffer, display_buffer, sizeof(display_buffer));
+#if EPD_PARTIAL_AVAILABLE
+	case 'S':  // play the uploaded sequence
+		cog = run_sequence(screen, update);
 		break;
+#endif
 
 	default:
 		break;
 	}
+	return cog;
+}
+
+
+// end of a command that would power down the COG: in standby it is
+// left on, otherwise only the image is committed now
+static cog_state finish_command(screen_type *screen, bool standby) {
+	if (standby) {
+		return COG_ON;
+	}
+	EPD_commit(screen->epd);
+	return COG_COMMITTED;
+}
+
+
+#if EPD_PARTIAL_AVAILABLE
+// play a sequence (on the update thread, holding the bus lock)
+// each image is a partial update from the one before with the COG left
+// on, images that match the panel are skipped; between images another
+// display on the bus may run a command and playback stops once another
+// command has been queued for this one
+// the COG is left on
+static cog_state run_sequence(screen_type *screen, const update_type *update) {
+	const sequence_type *sequence = update->animation;
+	const size_t length = screen->panel->byte_count;
+
+	EPD_begin(screen->epd);
+	if (EPD_OK != EPD_status(screen->epd)) {
+		warn("EPD_begin failed");
+	}
+	for (unsigned int loop = 0; 0 == sequence->loops || loop < sequence->loops; ++loop) {
+		bool changed = false;
+		for (unsigned int i = 0; i < sequence->frame_count; ++i) {
+			pthread_mutex_lock(&update_mutex);
+			bool stop = update_quit || screen->update_count > 1;
+			pthread_mutex_unlock(&update_mutex);
+			if (stop) {
+				return COG_ON;
+			}
+
+			const uint8_t *image = &sequence->images[i * sequence->image_size];
+			if (0 == memcmp(screen->current_buffer, image, length)) {
+				continue;
+			}
+			int stage_time = sequence->stage_times[i];
+			EPD_set_factored_stage_time(screen->epd, 0 == stage_time ? update->pu_stagetime : stage_time);
+			EPD_partial_image(screen->epd, (const uint8_t *)screen->current_buffer, image);
+			changed = true;
+
+			pthread_mutex_lock(&update_mutex);
+			memcpy(screen->current_buffer, image, length);
+			++screen->sequence_frames;
+			pthread_mutex_unlock(&update_mutex);
+
+			pthread_mutex_unlock(&screen->bus->lock);
+			sched_yield();
+			pthread_mutex_lock(&screen->bus->lock);
+		}
+		if (!changed) {
+			break;  // every image is already on the panel, it would never end
+		}
+	}
+	return COG_ON;
 }
+#endif
 
 
 // values for setting options
@@ -683,7 +2871,16 @@ enum {
      KEY_HELP,
      KEY_VERSION,
      KEY_PANEL,
-     KEY_SPI
+     KEY_SPI,
+     KEY_SHM,
+     KEY_STANDBY,
+     KEY_TIMING,
+     KEY_SENSOR,
+     KEY_SENSOR_INTERVAL,
+     KEY_SOCKET,
+     KEY_REALTIME,
+     KEY_CPU,
+     KEY_DISPLAY
 };
 
 
@@ -694,6 +2891,32 @@ static struct fuse_opt display_options[] = {
 	FUSE_OPT_KEY("--spi=%s",    KEY_SPI),
 	FUSE_OPT_KEY("spi=%s",      KEY_SPI),
 
+	FUSE_OPT_KEY("--shm=%s",    KEY_SHM),
+	FUSE_OPT_KEY("shm=%s",      KEY_SHM),
+
+	FUSE_OPT_KEY("--standby=%s", KEY_STANDBY),
+	FUSE_OPT_KEY("standby=%s",  KEY_STANDBY),
+
+	FUSE_OPT_KEY("--timing=%s", KEY_TIMING),
+	FUSE_OPT_KEY("timing=%s",   KEY_TIMING),
+
+	FUSE_OPT_KEY("--sensor=%s", KEY_SENSOR),
+	FUSE_OPT_KEY("sensor=%s",   KEY_SENSOR),
+
+	FUSE_OPT_KEY("--sensor_interval=%s", KEY_SENSOR_INTERVAL),
+	FUSE_OPT_KEY("sensor_interval=%s",   KEY_SENSOR_INTERVAL),
+
+	FUSE_OPT_KEY("--socket=%s", KEY_SOCKET),
+	FUSE_OPT_KEY("socket=%s",   KEY_SOCKET),
+
+	FUSE_OPT_KEY("--realtime=%s", KEY_REALTIME),
+	FUSE_OPT_KEY("realtime=%s", KEY_REALTIME),
+
+	FUSE_OPT_KEY("--cpu=%s",    KEY_CPU),
+	FUSE_OPT_KEY("cpu=%s",      KEY_CPU),
+
+	FUSE_OPT_KEY("--display=%s", KEY_DISPLAY),
+
 	FUSE_OPT_KEY("-V",          KEY_VERSION),
 	FUSE_OPT_KEY("--version",   KEY_VERSION),
 	FUSE_OPT_KEY("-h",          KEY_HELP),
@@ -702,6 +2925,152 @@ static struct fuse_opt display_options[] = {
 };
 
 
+// find a panel by its size e.g. "2.0"
+static const struct panel_struct *panel_find(const char *key) {
+	for (const struct panel_struct *p = panels; NULL != p->key; ++p) {
+		if (strcmp(p->key, key) == 0) {
+			return p;
+		}
+	}
+	return NULL;
+}
+
+
+// shm_open name from an option value, NULL if invalid
+static char *shm_name_create(const char *p) {
+	if ('/' == *p) {
+		++p;  // shm_open names start with a single '/'
+	}
+	if ('\0' == *p || NULL != strchr(p, '/')) {
+		return NULL;
+	}
+	char *name = malloc(strlen(p) + 2);
+	if (NULL != name) {
+		sprintf(name, "/%s", p);
+	}
+	return name;
+}
+
+
+// add a display from a --display definition: comma separated
+// panel=SIZE, spi=DEVICE, shm=NAME and
+// pins=PANEL_ON:BORDER:DISCHARGE:RESET:BUSY[:PWM] (PWM only for
+// panels that need it), items not given are set in main
+static bool screen_parse(const char *definition) {
+	if (SCREENS_MAX == screen_count) {
+		fprintf(stderr, "at most %d displays\n", SCREENS_MAX);
+		return false;
+	}
+	screen_type *screen = calloc(1, sizeof(screen_type));
+	char *items = strdup(definition);
+	if (NULL == screen || NULL == items) {
+		free(screen);
+		free(items);
+		return false;
+	}
+
+	screen->panel_on_pin = -1;  // => default pins
+	char *save = NULL;
+	for (char *item = strtok_r(items, ",", &save); NULL != item; item = strtok_r(NULL, ",", &save)) {
+		if (0 == strncmp(item, "panel=", 6)) {
+			screen->panel = panel_find(item + 6);
+			if (NULL == screen->panel) {
+				goto fail;
+			}
+		} else if (0 == strncmp(item, "spi=", 4) && '\0' != item[4]) {
+			screen->spi_device = strdup(item + 4);
+		} else if (0 == strncmp(item, "shm=", 4)) {
+			screen->shm_name = shm_name_create(item + 4);
+			if (NULL == screen->shm_name) {
+				goto fail;
+			}
+		} else if (0 == strncmp(item, "pins=", 5)) {
+			int *pins[] = {
+				&screen->panel_on_pin,
+				&screen->border_pin,
+				&screen->discharge_pin,
+				&screen->reset_pin,
+				&screen->busy_pin,
+#if EPD_PWM_REQUIRED
+				&screen->pwm_pin
+#endif
+			};
+			char *p = item + 5;
+			for (size_t i = 0; i < sizeof(pins) / sizeof(pins[0]); ++i) {
+				char *end = NULL;
+				long int n = strtol(p, &end, 0);
+				if (p == end || n < 0 || (':' != *end && '\0' != *end)) {
+					goto fail;
+				}
+				*pins[i] = (int)n;
+				p = ':' == *end ? end + 1 : end;
+				if ('\0' == *end && i + 1 != sizeof(pins) / sizeof(pins[0])) {
+					goto fail;  // too few pins
+				}
+			}
+			if ('\0' != *p) {
+				goto fail;  // too many pins
+			}
+		} else {
+			goto fail;
+		}
+	}
+	free(items);
+	screen->index = screen_count;
+	screens[screen_count++] = screen;
+	screen_directories = true;
+	return true;
+
+fail:
+	fprintf(stderr, "invalid display definition: %s\n", definition);
+	free(items);
+	free(screen);
+	return false;
+}
+
+
+// fill in the items that a display definition left out, without any
+// definitions there is a single display using the header pins
+static bool screens_finish(void) {
+	if (0 == screen_count) {
+		screen_type *screen = calloc(1, sizeof(screen_type));
+		if (NULL == screen) {
+			return false;
+		}
+		screen->shm_name = shm_name;
+		screen->panel_on_pin = -1;
+		screens[screen_count++] = screen;
+	}
+
+	for (unsigned int i = 0; i < screen_count; ++i) {
+		screen_type *screen = screens[i];
+		if (NULL == screen->panel) {
+			screen->panel = panel;
+		}
+		if (NULL == screen->panel || NULL == screen->panel->key) {
+			fprintf(stderr, "missing panel size for display %u\n", i);
+			return false;
+		}
+		if (NULL == screen->spi_device) {
+			screen->spi_device = spi_device;
+		}
+		if (screen->panel_on_pin < 0) {
+			screen->panel_on_pin = panel_on_pin;
+			screen->border_pin = border_pin;
+			screen->discharge_pin = discharge_pin;
+#if EPD_PWM_REQUIRED
+			screen->pwm_pin = pwm_pin;
+#endif
+			screen->reset_pin = reset_pin;
+			screen->busy_pin = busy_pin;
+		}
+		screen->pu_stagetime = pu_stagetime;
+		screen->standby_timeout = standby_timeout;
+	}
+	return true;
+}
+
+
 static int option_processor(void *data, const char *arg, int key, struct fuse_args *outargs)
 {
      switch (key) {
@@ -717,8 +3086,35 @@ static int option_processor(void *data, const char *arg, int key, struct fuse_ar
 		     "Myfs options:\n"
 		     "    -o panel=SIZE     set panel size\n"
 		     "    -o spi=DEVICE     override default SPI device [%s]\n"
+		     "                      also null, record:TRACE[:DEVICE] or replay:TRACE\n"
+#if defined(SPI_BCM2835_BACKEND)
+		     "                      or bcm2835:CS for the SPI0 registers\n"
+#endif
+		     "    -o shm=NAME       create shared memory frame buffer /dev/shm/NAME\n"
+		     "    -o standby=SEC    keep COG powered for SEC idle seconds [0]\n"
+		     "    -o timing=MODE    stage timing: deadline or count [deadline]\n"
+		     "    -o sensor=SOURCE  sample temperature: soc, lm75:I2C_DEVICE[:ADDR] or PATH\n"
+		     "    -o sensor_interval=SEC  seconds between sensor readings [60]\n"
+		     "    -o socket=PATH    also take requests on a Unix domain socket\n"
+		     "    -o realtime=PRIO  run updates at SCHED_FIFO priority PRIO and lock memory [0 => off]\n"
+		     "    -o cpu=N          run updates on CPU N only\n"
 		     "    --panel=NUM       same as '-opanel=SIZE'\n"
 		     "    --spi=DEVICE      same as '-ospi=DEVICE'\n"
+		     "    --shm=NAME        same as '-oshm=NAME'\n"
+		     "    --standby=SEC     same as '-ostandby=SEC'\n"
+		     "    --timing=MODE     same as '-otiming=MODE'\n"
+		     "    --sensor=SOURCE   same as '-osensor=SOURCE'\n"
+		     "    --sensor_interval=SEC  same as '-osensor_interval=SEC'\n"
+		     "    --socket=PATH     same as '-osocket=PATH'\n"
+		     "    --realtime=PRIO   same as '-orealtime=PRIO'\n"
+		     "    --cpu=N           same as '-ocpu=N'\n"
+		     "    --display=panel=SIZE,spi=DEVICE,pins=ON:BORDER:DISCHARGE:RESET:BUSY"
+#if EPD_PWM_REQUIRED
+		     ":PWM"
+#endif
+		     ",shm=NAME\n"
+		     "                      add a display as directory /0, /1, ... (repeat for\n"
+		     "                      each), items left out use the options above\n"
 		     , outargs->argv[0], spi_device);
 	     fuse_opt_add_arg(outargs, "-ho");
 	     fuse_main(outargs->argc, outargs->argv, &display_operations, NULL);
@@ -733,17 +3129,110 @@ static int option_processor(void *data, const char *arg, int key, struct fuse_ar
      case KEY_PANEL: {
 	     const char *p = strchr(arg, '=');
 	     ++p;
-	     panel = panels;
-	     for (panel = panels; NULL != panel->key; ++panel) {
-		     if (strcmp(panel->key, p) == 0) {
-			     return 0;
-		     }
+	     panel = panel_find(p);
+	     return NULL == panel ? 1 : 0;
+     }
+
+     case KEY_SHM: {
+	     const char *p = strchr(arg, '=');
+	     char *name = shm_name_create(p + 1);
+	     if (NULL == name) {
+		     return 1;
 	     }
-	     return 1;
+	     shm_name = name;
+	     return 0;
+     }
+
+     case KEY_DISPLAY:
+	     if (!screen_parse(strchr(arg, '=') + 1)) {
+		     exit(1);
+	     }
+	     return 0;
+
+     case KEY_STANDBY: {
+	     const char *p = strchr(arg, '=');
+	     char *end = NULL;
+	     ++p;
+	     long int n = strtol(p, &end, 10);
+	     if (p == end || '\0' != *end || n < 0 || n > STANDBY_MAX) {
+		     return 1;
+	     }
+	     standby_timeout = (unsigned int)n;
+	     return 0;
+     }
+
+     case KEY_TIMING: {
+	     const char *p = strchr(arg, '=');
+	     ++p;
+	     if (0 == strcmp(p, "deadline")) {
+		     timing_count = false;
+	     } else if (0 == strcmp(p, "count")) {
+		     timing_count = true;
+	     } else {
+		     return 1;
+	     }
+	     return 0;
+     }
+
+     case KEY_SENSOR: {
+	     const char *p = strchr(arg, '=');
+	     ++p;
+	     if ('\0' == *p) {
+		     return 1;
+	     }
+	     sensor_source = strdup(p);
+	     return 0;
+     }
+
+     case KEY_SOCKET: {
+	     const char *p = strchr(arg, '=');
+	     ++p;
+	     if ('\0' == *p) {
+		     return 1;
+	     }
+	     socket_path = strdup(p);
+	     return 0;
+     }
+
+     case KEY_SENSOR_INTERVAL: {
+	     const char *p = strchr(arg, '=');
+	     char *end = NULL;
+	     ++p;
+	     long int n = strtol(p, &end, 10);
+	     if (p == end || '\0' != *end || n < 1 || n > SENSOR_INTERVAL_MAX) {
+		     return 1;
+	     }
+	     sensor_interval = (unsigned int)n;
+	     return 0;
+     }
+
+     case KEY_REALTIME: {
+	     const char *p = strchr(arg, '=');
+	     char *end = NULL;
+	     ++p;
+	     long int n = strtol(p, &end, 10);
+	     if (p == end || '\0' != *end || n < 0 || n > sched_get_priority_max(SCHED_FIFO)) {
+		     return 1;
+	     }
+	     realtime_priority = (int)n;
+	     return 0;
+     }
+
+     case KEY_CPU: {
+	     const char *p = strchr(arg, '=');
+	     char *end = NULL;
+	     ++p;
+	     long int n = strtol(p, &end, 10);
+	     if (p == end || '\0' != *end || n < 0 || n >= CPU_SETSIZE) {
+		     return 1;
+	     }
+	     realtime_cpu = (int)n;
+	     return 0;
      }
 
      case KEY_SPI: {
 	     const char *p = strchr(arg, '=');
+	     ++p;
 	     spi_device = strdup(p);
 	     if (1) {    // test for spi path exists
 		     return 0;
@@ -759,10 +3248,10 @@ int main(int argc, char *argv[])
 {
      struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
 
-     memset(current_buffer, 0, sizeof(current_buffer));
-     memset(display_buffer, 0, sizeof(display_buffer));
-
      fuse_opt_parse(&args, NULL, display_options, option_processor);
+     if (!screens_finish()) {
+	     return 1;
+     }
 
      // run fuse
      return fuse_main(args.argc, args.argv, &display_operations, NULL);
@@ -0,0 +1,209 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "epd_pixels.h"
+#include "epd_neon.h"
+
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <arm_neon.h>
+
+#if defined(__arm__)
+#include <sys/auxv.h>
+#if !defined(HWCAP_ARM_NEON)
+#define HWCAP_ARM_NEON (1 << 12)
+#endif
+#endif
+
+#define BLOCK_SIZE 16
+
+// value of one pixel for each stage with the pixels in bits 0,2,4,...
+// same transforms as used to build the epd_pixels.h tables
+static inline uint8x16_t stage_pixels(uint8x16_t pixels, int stage) {
+	const uint8x16_t v55 = vdupq_n_u8(0x55);
+	const uint8x16_t vaa = vdupq_n_u8(0xaa);
+
+	switch(stage) {
+	case EPD_PIXELS_COMPENSATE:  // B -> W, W -> B (Current Image)
+		return vorrq_u8(vaa, veorq_u8(pixels, v55));
+	case EPD_PIXELS_WHITE:       // B -> N, W -> W (Current Image)
+		return vaddq_u8(v55, veorq_u8(pixels, v55));
+	case EPD_PIXELS_INVERSE:     // B -> N, W -> B (New Image)
+		return vorrq_u8(v55, vshlq_n_u8(veorq_u8(pixels, v55), 1));
+	default:                     // B -> B, W -> W (New Image)
+		return vorrq_u8(vaa, pixels);
+	}
+}
+
+// replace unchanged pixels (bits 0,2,4,... of changed are zero) by nothing
+static inline uint8x16_t mask_pixels(uint8x16_t pixels, uint8x16_t changed) {
+	uint8x16_t pixel_mask = vorrq_u8(changed, vshlq_n_u8(changed, 1));
+	return vbslq_u8(pixel_mask, pixels, vdupq_n_u8(EPD_PIXELS_NOTHING));
+}
+
+// reverse the order of the 16 bytes
+static inline uint8x16_t reverse_bytes(uint8x16_t value) {
+	value = vrev64q_u8(value);
+	return vcombine_u8(vget_high_u8(value), vget_low_u8(value));
+}
+
+// reverse the order of the four pixel pairs in each byte
+static inline uint8x16_t reverse_pairs(uint8x16_t value) {
+	value = vorrq_u8(vshrq_n_u8(value, 4), vshlq_n_u8(value, 4));
+	return vorrq_u8(vandq_u8(vshrq_n_u8(value, 2), vdupq_n_u8(0x33)),
+			vandq_u8(vshlq_n_u8(value, 2), vdupq_n_u8(0xcc)));
+}
+
+// interleave bits of each nibble: 3210 -> .3.2.1.0
+static inline uint8x16_t interleave_nibbles(uint8x16_t nibbles) {
+	static const uint8_t spread[16] = {
+		0x00, 0x01, 0x04, 0x05, 0x10, 0x11, 0x14, 0x15,
+		0x40, 0x41, 0x44, 0x45, 0x50, 0x51, 0x54, 0x55
+	};
+	const uint8x8x2_t table = {{vld1_u8(spread), vld1_u8(spread + 8)}};
+	return vcombine_u8(vtbl2_u8(table, vget_low_u8(nibbles)),
+			   vtbl2_u8(table, vget_high_u8(nibbles)));
+}
+
+// reverse the bits of each byte
+static inline uint8x16_t reverse_bits(uint8x16_t value) {
+#if defined(__aarch64__)
+	return vrbitq_u8(value);
+#else
+	// no vrbit in A32: look up each nibble reversed and swap them over
+	static const uint8_t reversed[16] = {
+		0x00, 0x08, 0x04, 0x0c, 0x02, 0x0a, 0x06, 0x0e,
+		0x01, 0x09, 0x05, 0x0d, 0x03, 0x0b, 0x07, 0x0f
+	};
+	const uint8x8x2_t table = {{vld1_u8(reversed), vld1_u8(reversed + 8)}};
+	uint8x16_t low = vandq_u8(value, vdupq_n_u8(0x0f));
+	uint8x16_t high = vshrq_n_u8(value, 4);
+	low = vcombine_u8(vtbl2_u8(table, vget_low_u8(low)), vtbl2_u8(table, vget_high_u8(low)));
+	high = vcombine_u8(vtbl2_u8(table, vget_low_u8(high)), vtbl2_u8(table, vget_high_u8(high)));
+	return vorrq_u8(vshlq_n_u8(low, 4), high);
+#endif
+}
+
+
+bool EPD_neon_available(void) {
+#if defined(__arm__)
+	return 0 != (getauxval(AT_HWCAP) & HWCAP_ARM_NEON);
+#else
+	return true;  // mandatory on AArch64
+#endif
+}
+
+
+// pixels on display are numbered from 1 so odd is actually bits 0,2,4,...
+size_t EPD_neon_odd_pixels(uint8_t *output, const uint8_t *data, const uint8_t *mask, size_t count, int stage) {
+	const uint8x16_t v55 = vdupq_n_u8(0x55);
+	size_t b = count;
+	for (; b >= BLOCK_SIZE; b -= BLOCK_SIZE) {
+		uint8x16_t image = vld1q_u8(data + b - BLOCK_SIZE);
+		uint8x16_t pixels = stage_pixels(vandq_u8(image, v55), stage);
+		if (NULL != mask) {
+			uint8x16_t changed = veorq_u8(image, vld1q_u8(mask + b - BLOCK_SIZE));
+			pixels = mask_pixels(pixels, vandq_u8(changed, v55));
+		}
+		vst1q_u8(output, reverse_bytes(pixels));
+		output += BLOCK_SIZE;
+	}
+	return count - b;
+}
+
+// pixels on display are numbered from 1 so even is actually bits 1,3,5,...
+size_t EPD_neon_even_pixels(uint8_t *output, const uint8_t *data, const uint8_t *mask, size_t count, int stage) {
+	const uint8x16_t v55 = vdupq_n_u8(0x55);
+	size_t b = 0;
+	for (; b + BLOCK_SIZE <= count; b += BLOCK_SIZE) {
+		uint8x16_t image = vld1q_u8(data + b);
+		uint8x16_t pixels = stage_pixels(vandq_u8(vshrq_n_u8(image, 1), v55), stage);
+		if (NULL != mask) {
+			uint8x16_t changed = veorq_u8(image, vld1q_u8(mask + b));
+			pixels = mask_pixels(pixels, vandq_u8(vshrq_n_u8(changed, 1), v55));
+		}
+		vst1q_u8(output, reverse_pairs(pixels));
+		output += BLOCK_SIZE;
+	}
+	return b;
+}
+
+// pixels on display are numbered from 1
+size_t EPD_neon_all_pixels(uint8_t *output, const uint8_t *data, const uint8_t *mask, size_t count, int stage) {
+	const uint8x16_t v0f = vdupq_n_u8(0x0f);
+	size_t b = count;
+	for (; b >= BLOCK_SIZE; b -= BLOCK_SIZE) {
+		uint8x16_t image = reverse_bytes(vld1q_u8(data + b - BLOCK_SIZE));
+		uint8x16x2_t pixels = {{
+			stage_pixels(interleave_nibbles(vshrq_n_u8(image, 4)), stage),
+			stage_pixels(interleave_nibbles(vandq_u8(image, v0f)), stage)
+		}};
+		if (NULL != mask) {
+			uint8x16_t changed = veorq_u8(image, reverse_bytes(vld1q_u8(mask + b - BLOCK_SIZE)));
+			pixels.val[0] = mask_pixels(pixels.val[0], interleave_nibbles(vshrq_n_u8(changed, 4)));
+			pixels.val[1] = mask_pixels(pixels.val[1], interleave_nibbles(vandq_u8(changed, v0f)));
+		}
+		vst2q_u8(output, pixels);  // high byte, low byte for each image byte
+		output += 2 * BLOCK_SIZE;
+	}
+	return count - b;
+}
+
+// image copy for the fuse LE and inverse files
+size_t EPD_neon_convert(uint8_t *output, const uint8_t *data, size_t count, bool bit_reversed, uint8_t flip) {
+	const uint8x16_t flip_16 = vdupq_n_u8(flip);
+	size_t b = 0;
+	if (bit_reversed) {
+		for (; b + BLOCK_SIZE <= count; b += BLOCK_SIZE) {
+			vst1q_u8(output + b, veorq_u8(reverse_bits(vld1q_u8(data + b)), flip_16));
+		}
+	} else {
+		for (; b + BLOCK_SIZE <= count; b += BLOCK_SIZE) {
+			vst1q_u8(output + b, veorq_u8(vld1q_u8(data + b), flip_16));
+		}
+	}
+	return b;
+}
+
+
+#else
+
+// no NEON: callers always use the scalar tables
+
+bool EPD_neon_available(void) {
+	return false;
+}
+
+size_t EPD_neon_odd_pixels(uint8_t *output, const uint8_t *data, const uint8_t *mask, size_t count, int stage) {
+	return 0;
+}
+
+size_t EPD_neon_even_pixels(uint8_t *output, const uint8_t *data, const uint8_t *mask, size_t count, int stage) {
+	return 0;
+}
+
+size_t EPD_neon_all_pixels(uint8_t *output, const uint8_t *data, const uint8_t *mask, size_t count, int stage) {
+	return 0;
+}
+
+size_t EPD_neon_convert(uint8_t *output, const uint8_t *data, size_t count, bool bit_reversed, uint8_t flip) {
+	return 0;
+}
+
+#endif
@@ -0,0 +1,59 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+#if !defined(EPD_NEON_H)
+#define EPD_NEON_H 1
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+
+// NEON versions of the G2 line encoders
+//
+// These must produce the same bytes as the EPD_*_pixels tables in
+// epd_pixels.h (epd_pixels_test compares them on a NEON CPU), 16 image
+// bytes at a time.  Each function encodes
+// as many whole 16 byte blocks as fit in count and returns the
+// number of image bytes encoded; the caller finishes the remainder
+// with the scalar tables.  stage is an EPD_PIXELS_* value and mask
+// is the old image for a partial update (NULL for a full update).
+//
+// On a CPU without NEON (or a non-ARM build) EPD_neon_available
+// returns false and the encoders do nothing and return zero.
+
+
+// functions
+// =========
+
+// true if the CPU supports NEON
+bool EPD_neon_available(void);
+
+// odd pixels: encodes the last blocks of data, output in reverse byte order
+size_t EPD_neon_odd_pixels(uint8_t *output, const uint8_t *data, const uint8_t *mask, size_t count, int stage);
+
+// even pixels: encodes the first blocks of data, output in byte order
+size_t EPD_neon_even_pixels(uint8_t *output, const uint8_t *data, const uint8_t *mask, size_t count, int stage);
+
+// all pixels: encodes the last blocks of data, two output bytes per
+// image byte in reverse byte order
+size_t EPD_neon_all_pixels(uint8_t *output, const uint8_t *data, const uint8_t *mask, size_t count, int stage);
+
+// image copy for the fuse LE and inverse files: reverses the bits of
+// each byte if bit_reversed and XORs with flip, encodes the first
+// blocks of data (output in byte order, may be the same as data)
+size_t EPD_neon_convert(uint8_t *output, const uint8_t *data, size_t count, bool bit_reversed, uint8_t flip);
+
+
+#endif
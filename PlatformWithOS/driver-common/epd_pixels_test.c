@@ -0,0 +1,397 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#include "epd_pixels.h"
+#include "epd_neon.h"
+
+// check the epd_pixels.h tables
+//
+// every entry of the stage and mask tables is compared with the per
+// pixel arithmetic the drivers used before the tables, for each stage,
+// image byte and old image byte, then where the CPU has NEON the
+// NEON line encoders are compared with the tables for random lines of
+// each panel size and the NEON fuse image copy with a byte at a time
+// copy; exits non-zero on any difference
+
+
+// count of differences found
+static unsigned long int failures = 0;
+
+static void check(const char *name, int stage, unsigned int image, unsigned int old, unsigned int expected, unsigned int actual) {
+	if (expected != actual) {
+		if (++failures <= 20) {
+			warnx("%s: stage %d image 0x%02x old 0x%02x: expected 0x%04x got 0x%04x",
+			      name, stage, image, old, expected, actual);
+		}
+	}
+}
+
+
+// V231_G2 arithmetic, mask is the old image byte or -1 for a full update
+// ----------------------------------------------------------------------
+
+// pixels on display are numbered from 1 so even is actually bits 1,3,5,...
+static uint8_t even_arithmetic(int stage, uint8_t data, int mask) {
+	uint8_t pixels = data & 0xaa;
+	uint8_t pixel_mask = 0xff;
+	if (mask >= 0) {
+		pixel_mask = (mask ^ pixels) & 0xaa;
+		pixel_mask |= pixel_mask >> 1;
+	}
+	switch(stage) {
+	case EPD_PIXELS_COMPENSATE:  // B -> W, W -> B (Current Image)
+		pixels = 0xaa | ((pixels ^ 0xaa) >> 1);
+		break;
+	case EPD_PIXELS_WHITE:       // B -> N, W -> W (Current Image)
+		pixels = 0x55 + ((pixels ^ 0xaa) >> 1);
+		break;
+	case EPD_PIXELS_INVERSE:     // B -> N, W -> B (New Image)
+		pixels = 0x55 | (pixels ^ 0xaa);
+		break;
+	case EPD_PIXELS_NORMAL:      // B -> B, W -> W (New Image)
+		pixels = 0xaa | (pixels >> 1);
+		break;
+	}
+	pixels = (pixels & pixel_mask) | (~pixel_mask & 0x55);
+	uint8_t p1 = (pixels >> 6) & 0x03;
+	uint8_t p2 = (pixels >> 4) & 0x03;
+	uint8_t p3 = (pixels >> 2) & 0x03;
+	uint8_t p4 = (pixels >> 0) & 0x03;
+	return (p1 << 0) | (p2 << 2) | (p3 << 4) | (p4 << 6);
+}
+
+// pixels on display are numbered from 1 so odd is actually bits 0,2,4,...
+static uint8_t odd_arithmetic(int stage, uint8_t data, int mask) {
+	uint8_t pixels = data & 0x55;
+	uint8_t pixel_mask = 0xff;
+	if (mask >= 0) {
+		pixel_mask = (mask ^ pixels) & 0x55;
+		pixel_mask |= pixel_mask << 1;
+	}
+	switch(stage) {
+	case EPD_PIXELS_COMPENSATE:  // B -> W, W -> B (Current Image)
+		pixels = 0xaa | (pixels ^ 0x55);
+		break;
+	case EPD_PIXELS_WHITE:       // B -> N, W -> W (Current Image)
+		pixels = 0x55 + (pixels ^ 0x55);
+		break;
+	case EPD_PIXELS_INVERSE:     // B -> N, W -> B (New Image)
+		pixels = 0x55 | ((pixels ^ 0x55) << 1);
+		break;
+	case EPD_PIXELS_NORMAL:      // B -> B, W -> W (New Image)
+		pixels = 0xaa | pixels;
+		break;
+	}
+	return (pixels & pixel_mask) | (~pixel_mask & 0x55);
+}
+
+// interleave bits: (byte)76543210 -> (16 bit).7.6.5.4.3.2.1
+static inline uint16_t interleave_bits(uint16_t value) {
+	value = (value | (value << 4)) & 0x0f0f;
+	value = (value | (value << 2)) & 0x3333;
+	value = (value | (value << 1)) & 0x5555;
+	return value;
+}
+
+// pixels on display are numbered from 1 (with the mask of the old
+// image, which the driver lost to a shadowed variable)
+static uint16_t all_arithmetic(int stage, uint8_t data, int mask) {
+	uint16_t pixels = interleave_bits(data);
+	uint16_t pixel_mask = 0xffff;
+	if (mask >= 0) {
+		pixel_mask = interleave_bits(mask);
+		pixel_mask = (pixel_mask ^ pixels) & 0x5555;
+		pixel_mask |= pixel_mask << 1;
+	}
+	switch(stage) {
+	case EPD_PIXELS_COMPENSATE:  // B -> W, W -> B (Current Image)
+		pixels = 0xaaaa | (pixels ^ 0x5555);
+		break;
+	case EPD_PIXELS_WHITE:       // B -> N, W -> W (Current Image)
+		pixels = 0x5555 + (pixels ^ 0x5555);
+		break;
+	case EPD_PIXELS_INVERSE:     // B -> N, W -> B (New Image)
+		pixels = 0x5555 | ((pixels ^ 0x5555) << 1);
+		break;
+	case EPD_PIXELS_NORMAL:      // B -> B, W -> W (New Image)
+		pixels = 0xaaaa | pixels;
+		break;
+	}
+	return (pixels & pixel_mask) | (~pixel_mask & 0x5555);
+}
+
+
+// V230_G2 arithmetic: normal or inverse (complemented) only, no mask
+// the driver uses the normal and compensate tables
+// ------------------------------------------------------------------
+
+static uint8_t v230_odd_arithmetic(bool inverse, uint8_t data) {
+	uint8_t pixels = inverse ? data ^ 0xff : data;
+	return 0xaa | pixels;
+}
+
+static uint8_t v230_even_arithmetic(bool inverse, uint8_t data) {
+	uint8_t pixels = inverse ? data ^ 0xff : data;
+	pixels >>= 1;
+	pixels |= 0xaa;
+	return ((pixels & 0xc0) >> 6)
+		| ((pixels & 0x30) >> 2)
+		| ((pixels & 0x0c) << 2)
+		| ((pixels & 0x03) << 6);
+}
+
+
+// NEON encoders against the tables
+// ---------------------------------
+
+// image bytes in a line of each panel size (1.44", 1.9", 2.0", 2.6" and 2.7")
+static const size_t line_bytes[] = {128 / 8, 144 / 8, 200 / 8, 232 / 8, 264 / 8};
+
+// random lines of each size and stage, with and without an old image
+#define RANDOM_LINES 2000
+
+// largest line and the output check area after it
+#define LINE_MAX 64
+#define GUARD 16
+
+enum {
+	ENCODE_ODD,
+	ENCODE_EVEN,
+	ENCODE_ALL
+};
+
+static const char *encoder_names[] = {"odd", "even", "all"};
+
+// the table encoders as in the V231_G2 driver, odd and all from the
+// last image byte, returns the bytes written
+static size_t table_line(int encoder, uint8_t *p, const uint8_t *data, const uint8_t *mask,
+			 size_t count, int stage, size_t start) {
+	uint8_t *output = p;
+	if (ENCODE_EVEN == encoder) {
+		for (size_t b = start; b < count; ++b) {
+			uint8_t value = EPD_even_pixels[stage][data[b]];
+			if (NULL != mask) {
+				uint8_t pixel_mask = EPD_even_mask[mask[b] ^ data[b]];
+				value = (value & pixel_mask) | (~pixel_mask & EPD_PIXELS_NOTHING);
+			}
+			*p++ = value;
+		}
+	} else if (ENCODE_ODD == encoder) {
+		for (size_t b = count - start; b > 0; --b) {
+			uint8_t value = EPD_odd_pixels[stage][data[b - 1]];
+			if (NULL != mask) {
+				uint8_t pixel_mask = EPD_odd_mask[mask[b - 1] ^ data[b - 1]];
+				value = (value & pixel_mask) | (~pixel_mask & EPD_PIXELS_NOTHING);
+			}
+			*p++ = value;
+		}
+	} else {
+		for (size_t b = count - start; b > 0; --b) {
+			uint16_t value = EPD_all_pixels[stage][data[b - 1]];
+			if (NULL != mask) {
+				uint16_t pixel_mask = EPD_all_mask[mask[b - 1] ^ data[b - 1]];
+				value = (value & pixel_mask) | (~pixel_mask & (EPD_PIXELS_NOTHING * 0x0101));
+			}
+			*p++ = value >> 8;
+			*p++ = value;
+		}
+	}
+	return p - output;
+}
+
+// NEON for the whole blocks then the tables for the rest, as the drivers do
+static size_t neon_line(int encoder, uint8_t *p, const uint8_t *data, const uint8_t *mask,
+			size_t count, int stage) {
+	size_t n;
+	switch(encoder) {
+	case ENCODE_ODD:
+		n = EPD_neon_odd_pixels(p, data, mask, count, stage);
+		return n + table_line(encoder, p + n, data, mask, count, stage, n);
+	case ENCODE_EVEN:
+		n = EPD_neon_even_pixels(p, data, mask, count, stage);
+		return n + table_line(encoder, p + n, data, mask, count, stage, n);
+	default:
+		n = EPD_neon_all_pixels(p, data, mask, count, stage);
+		return 2 * n + table_line(encoder, p + 2 * n, data, mask, count, stage, n);
+	}
+}
+
+static void random_bytes(uint8_t *p, size_t count) {
+	// mostly random with some runs of each colour, like real images
+	int kind = random() % 4;
+	for (size_t i = 0; i < count; ++i) {
+		p[i] = 0 == kind ? 0x00 : 1 == kind ? 0xff : random();
+	}
+}
+
+static unsigned long int check_neon(void) {
+	unsigned long int compared = 0;
+	srandom(1);
+	for (size_t size = 0; size < sizeof(line_bytes) / sizeof(line_bytes[0]); ++size) {
+		size_t count = line_bytes[size];
+		for (int stage = 0; stage < EPD_PIXELS_STAGES; ++stage) {
+			for (int encoder = ENCODE_ODD; encoder <= ENCODE_ALL; ++encoder) {
+				for (int n = 0; n < RANDOM_LINES; ++n) {
+					uint8_t data[LINE_MAX];
+					uint8_t old[LINE_MAX];
+					uint8_t expected[2 * LINE_MAX + GUARD];
+					uint8_t actual[2 * LINE_MAX + GUARD];
+					random_bytes(data, count);
+					random_bytes(old, count);
+					if (0 == n % 4) {
+						memcpy(old, data, count);  // unchanged line
+					}
+					// V230_G2 and full updates have no old image
+					const uint8_t *mask = (0 == n % 2) ? NULL : old;
+
+					memset(expected, 0xee, sizeof(expected));
+					memset(actual, 0xee, sizeof(actual));
+					size_t expected_length = table_line(encoder, expected, data, mask, count, stage, 0);
+					size_t actual_length = neon_line(encoder, actual, data, mask, count, stage);
+					++compared;
+					if (expected_length != actual_length || 0 != memcmp(expected, actual, sizeof(expected))) {
+						if (++failures <= 20) {
+							warnx("neon %s: %zu bytes stage %d%s: differs from the tables",
+							      encoder_names[encoder], count, stage, NULL == mask ? "" : " masked");
+						}
+					}
+				}
+			}
+		}
+	}
+	return compared;
+}
+
+// copies of each length up to this, from unaligned addresses and in place
+#define CONVERT_MAX 80
+
+static uint8_t reverse_bits(uint8_t b) {
+	uint8_t r = 0;
+	for (int i = 0; i < 8; ++i) {
+		r |= ((b >> i) & 1) << (7 - i);
+	}
+	return r;
+}
+
+// EPD_neon_convert then a byte at a time for the rest, as special_memcpy does
+static unsigned long int check_neon_convert(void) {
+	unsigned long int compared = 0;
+	for (size_t count = 0; count <= CONVERT_MAX; ++count) {
+		for (int mode = 0; mode < 4; ++mode) {
+			bool bit_reversed = 0 != (mode & 1);
+			uint8_t flip = 0 != (mode & 2) ? 0xff : 0x00;
+			for (size_t offset = 0; offset < 4; ++offset) {
+				uint8_t source[CONVERT_MAX + 8];
+				uint8_t expected[CONVERT_MAX + GUARD];
+				uint8_t actual[CONVERT_MAX + GUARD];
+				random_bytes(source, sizeof(source));
+				memset(expected, 0xee, sizeof(expected));
+				memset(actual, 0xee, sizeof(actual));
+				const uint8_t *s = source + offset;
+				for (size_t i = 0; i < count; ++i) {
+					expected[i] = (bit_reversed ? reverse_bits(s[i]) : s[i]) ^ flip;
+				}
+				size_t n = EPD_neon_convert(actual, s, count, bit_reversed, flip);
+				for (; n < count; ++n) {
+					actual[n] = (bit_reversed ? reverse_bits(s[n]) : s[n]) ^ flip;
+				}
+
+				// and converted in place
+				uint8_t *in_place = source + offset;
+				n = EPD_neon_convert(in_place, in_place, count, bit_reversed, flip);
+				for (; n < count; ++n) {
+					in_place[n] = (bit_reversed ? reverse_bits(in_place[n]) : in_place[n]) ^ flip;
+				}
+				compared += 2;
+				if (0 != memcmp(expected, actual, sizeof(expected)) || 0 != memcmp(expected, in_place, count)) {
+					if (++failures <= 20) {
+						warnx("neon convert: %zu bytes at +%zu%s%s: differs from the byte copy",
+						      count, offset, bit_reversed ? " reversed" : "", 0 != flip ? " inverted" : "");
+					}
+				}
+			}
+		}
+	}
+	return compared;
+}
+
+
+int main(int argc, char *argv[]) {
+	unsigned long int compared = 0;
+
+	for (int stage = 0; stage < EPD_PIXELS_STAGES; ++stage) {
+		for (unsigned int b = 0; b < 256; ++b) {
+
+			// full update
+			check("odd", stage, b, b, odd_arithmetic(stage, b, -1), EPD_odd_pixels[stage][b]);
+			check("even", stage, b, b, even_arithmetic(stage, b, -1), EPD_even_pixels[stage][b]);
+			check("all", stage, b, b, all_arithmetic(stage, b, -1), EPD_all_pixels[stage][b]);
+			compared += 3;
+
+			// partial update against every old image byte
+			for (unsigned int m = 0; m < 256; ++m) {
+				uint8_t odd_mask = EPD_odd_mask[m ^ b];
+				uint8_t even_mask = EPD_even_mask[m ^ b];
+				uint16_t all_mask = EPD_all_mask[m ^ b];
+				check("odd masked", stage, b, m, odd_arithmetic(stage, b, m),
+				      (uint8_t)((EPD_odd_pixels[stage][b] & odd_mask) | (~odd_mask & EPD_PIXELS_NOTHING)));
+				check("even masked", stage, b, m, even_arithmetic(stage, b, m),
+				      (uint8_t)((EPD_even_pixels[stage][b] & even_mask) | (~even_mask & EPD_PIXELS_NOTHING)));
+				check("all masked", stage, b, m, all_arithmetic(stage, b, m),
+				      (uint16_t)((EPD_all_pixels[stage][b] & all_mask) | (~all_mask & (EPD_PIXELS_NOTHING * 0x0101))));
+				compared += 3;
+			}
+		}
+	}
+
+	// V230_G2 inverse is the normal conversion of the complemented image
+	for (unsigned int b = 0; b < 256; ++b) {
+		for (int inverse = 0; inverse < 2; ++inverse) {
+			int stage = inverse ? EPD_PIXELS_COMPENSATE : EPD_PIXELS_NORMAL;
+			check("V230 odd", inverse, b, b, v230_odd_arithmetic(inverse, b), EPD_odd_pixels[stage][b]);
+			check("V230 even", inverse, b, b, v230_even_arithmetic(inverse, b), EPD_even_pixels[stage][b]);
+			compared += 2;
+		}
+	}
+
+	if (0 != failures) {
+		errx(1, "%lu of %lu table entries differ from the arithmetic", failures, compared);
+	}
+	printf("tables: %lu entries match the arithmetic\n", compared);
+
+	if (!EPD_neon_available()) {
+		printf("neon: not available on this CPU, not compared\n");
+		return 0;
+	}
+	compared = check_neon();
+	if (0 != failures) {
+		errx(1, "%lu of %lu NEON lines differ from the tables", failures, compared);
+	}
+	printf("neon: %lu lines match the tables\n", compared);
+
+	compared = check_neon_convert();
+	if (0 != failures) {
+		errx(1, "%lu of %lu NEON image copies differ", failures, compared);
+	}
+	printf("neon: %lu image copies match\n", compared);
+	return 0;
+}
@@ -0,0 +1,49 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+#if !defined(EPD_REGION_H)
+#define EPD_REGION_H 1
+
+#include <stdint.h>
+
+
+// rectangular region write
+//
+// Each region written to the region file is this header followed by
+// height rows of packed pixels, (width + 7) / 8 bytes per row with
+// the leftmost pixel in the top bit and 1 => black (the coding of the
+// display file).  The pixels are copied into display at x, y and a
+// partial update ('P') of only lines y to y + height - 1 is queued.
+//
+// A region may be split over several writes and one write may hold
+// several regions, all values are in host byte order.
+
+#define EPD_REGION_LE        0x0001  // leftmost pixel in the bottom bit (as LE/display)
+#define EPD_REGION_INVERSE   0x0002  // 1 => white (as display_inverse)
+#define EPD_REGION_NO_UPDATE 0x0004  // only change display, do not queue 'P'
+#define EPD_REGION_FLAGS     0x0007  // all defined flags, any other bit => EINVAL
+
+typedef struct {
+	uint16_t x;          // left pixel, any value (not just multiples of 8)
+	uint16_t y;          // top line
+	uint16_t width;      // pixels, x + width <= panel width
+	uint16_t height;     // lines, y + height <= panel height
+	uint16_t flags;      // EPD_REGION_*, other bits must be zero
+	uint16_t reserved;   // must be zero
+} EPD_region_header;
+
+#define EPD_REGION_ROW_BYTES(width) (((width) + 7) / 8)
+
+
+#endif
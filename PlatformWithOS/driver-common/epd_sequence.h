@@ -0,0 +1,59 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+#if !defined(EPD_SEQUENCE_H)
+#define EPD_SEQUENCE_H 1
+
+#include <stdint.h>
+
+
+// animation sequence upload
+//
+// A sequence written to the sequence file is this header followed by
+// frame_count frame entries, then frame_count images of image_size
+// bytes (the panel's byte count) coded as display unless
+// EPD_SEQUENCE_LE or EPD_SEQUENCE_INVERSE are set.  Once the whole
+// sequence has arrived it replaces any earlier one; nothing is shown
+// until 'S' is written to command.
+//
+// 'S' draws each image in turn as a partial update from the image
+// before it (from current for the first) with the COG left on, then
+// repeats the images loops times.  Playback stops after the image
+// being drawn once another command is queued; with loops zero it only
+// stops then.  A sequence may be split over several writes starting
+// at offset zero, all values are in host byte order.
+
+#define EPD_SEQUENCE_MAGIC 0x51445045  // "EPDQ" in memory order
+
+#define EPD_SEQUENCE_FRAMES_MAX 256
+
+#define EPD_SEQUENCE_LE      0x0001  // leftmost pixel in the bottom bit (as LE/display)
+#define EPD_SEQUENCE_INVERSE 0x0002  // 1 => white (as display_inverse)
+
+typedef struct {
+	uint32_t magic;              // EPD_SEQUENCE_MAGIC
+	uint16_t frame_count;        // 1 to EPD_SEQUENCE_FRAMES_MAX
+	uint16_t loops;              // times to draw all the images, 0 => until another command
+	uint16_t flags;              // EPD_SEQUENCE_*
+	uint16_t reserved;           // zero
+	uint32_t image_size;         // bytes in each image, the panel's byte count
+} EPD_sequence_header;
+
+typedef struct {
+	uint16_t stage_time;         // milliseconds as pu_stagetime (50 to 2000), 0 => pu_stagetime
+	uint16_t reserved;           // zero
+} EPD_sequence_frame;
+
+
+#endif
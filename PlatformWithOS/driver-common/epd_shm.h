@@ -0,0 +1,51 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+#if !defined(EPD_SHM_H)
+#define EPD_SHM_H 1
+
+#include <stdint.h>
+
+
+// shared memory frame buffer layout
+//
+// When epd_fuse is started with "-o shm=NAME" it creates the POSIX
+// shared memory object NAME (i.e. /dev/shm/NAME) containing this
+// header followed by EPD_SHM_SLOTS images.  A client maps it, draws
+// into a free slot in the same format as the display file (big
+// endian, 1 => black) and then writes the command followed by the
+// slot number to the command file e.g. "U1".
+//
+// A slot is free when (int32_t)(completed_sequence - slot_sequence[n]) >= 0
+// i.e. the last command that used it has completed, so a client can
+// draw the next image in one slot while the other is being displayed.
+
+#define EPD_SHM_MAGIC 0x31445045  // "EPD1" in memory order
+#define EPD_SHM_SLOTS 2
+
+typedef struct {
+	uint32_t magic;                                  // EPD_SHM_MAGIC
+	uint32_t header_size;                            // byte offset of slot 0
+	uint32_t slot_size;                              // byte offset between slots
+	uint32_t slot_count;                             // EPD_SHM_SLOTS
+	uint32_t width;                                  // panel width in pixels
+	uint32_t height;                                 // panel height in pixels
+	uint32_t image_size;                             // bytes of image in each slot
+	volatile uint32_t queued_sequence;               // sequence of the last queued command
+	volatile uint32_t completed_sequence;            // sequence of the last completed command
+	volatile uint32_t slot_sequence[EPD_SHM_SLOTS];  // sequence of the last command using each slot
+} EPD_shm_header;
+
+
+#endif
@@ -0,0 +1,75 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+#if !defined(EPD_SOCKET_H)
+#define EPD_SOCKET_H 1
+
+#include <stdint.h>
+
+#include "epd_region.h"
+
+
+// control socket messages
+//
+// When epd_fuse is started with "-o socket=PATH" it also listens on
+// the Unix domain stream socket PATH.  A client sends a request
+// followed by length bytes of pixels and gets one reply once the
+// command has completed, so an update is a single write and read on
+// a connection that can be kept open for any number of requests.
+// All fields are in host byte order.
+//
+// The pixels are a whole image (EPD_SOCKET_IMAGE, length is the
+// panel's byte count) or the rectangle in region (EPD_SOCKET_REGION,
+// height rows of EPD_REGION_ROW_BYTES(width) bytes, region.flags are
+// not used) and go into display as if written to the display or
+// region file, coded as display unless EPD_SOCKET_LE or
+// EPD_SOCKET_INVERSE are set.  The command ('U', 'P', 'F' or 'C', or
+// zero to only change display) is then queued as if written to the
+// command file, using temperature instead of the current setting if
+// EPD_SOCKET_TEMPERATURE is set.
+//
+// The reply error is 0, a positive EPD_error if the panel failed
+// or a negative errno if the request was not valid.  A request is not
+// read any further once its header is not valid, so the connection
+// is closed after that reply.
+
+#define EPD_SOCKET_MAGIC 0x53445045  // "EPDS" in memory order
+
+#define EPD_SOCKET_IMAGE       0x0001  // pixels are a whole image
+#define EPD_SOCKET_REGION      0x0002  // pixels are the rectangle in region
+#define EPD_SOCKET_LE          0x0004  // leftmost pixel in the bottom bit (as LE/display)
+#define EPD_SOCKET_INVERSE     0x0008  // 1 => white (as display_inverse)
+#define EPD_SOCKET_TEMPERATURE 0x0010  // use temperature for this command
+
+typedef struct {
+	uint32_t magic;              // EPD_SOCKET_MAGIC
+	uint32_t tag;                // any value, returned in the reply
+	uint32_t length;             // bytes of pixels after this header
+	uint16_t flags;              // EPD_SOCKET_*
+	uint8_t command;             // 'U', 'P', 'F', 'C' or 0
+	uint8_t display;             // panel number with --display, otherwise 0
+	int16_t temperature;         // Celsius, with EPD_SOCKET_TEMPERATURE
+	uint16_t reserved;           // zero
+	EPD_region_header region;    // with EPD_SOCKET_REGION
+} EPD_socket_request;
+
+typedef struct {
+	uint32_t magic;              // EPD_SOCKET_MAGIC
+	uint32_t tag;                // from the request
+	uint32_t sequence;           // of the queued command as in status (0 if none)
+	int32_t error;               // 0, EPD_error or -errno
+} EPD_socket_reply;
+
+
+#endif
@@ -25,6 +25,7 @@
 #include "gpio.h"
 #include "spi.h"
 #include "epd.h"
+#include "epd_frame.h"
 #include EPD_IO
 
 // 1.44" test images
@@ -148,21 +149,32 @@ static void usage(const char *program_name, const char *message, ...) {
 	       "| 2.6 "
 #endif
 	       "| 2.7 "
-	       "] [image-count]\n", program_name);
+	       "] [image-count | frame.epdf...]\n", program_name);
 	exit(1);
 }
 
+// true if the argument names a frame file i.e. ends in ".epdf"
+static bool is_frame_path(const char *arg) {
+	static const char suffix[] = ".epdf";
+	size_t length = strlen(arg);
+	return length >= sizeof(suffix) - 1 && 0 == strcmp(arg + length - (sizeof(suffix) - 1), suffix);
+}
+
 // the main test program
 int main(int argc, char *argv[]) {
 
 	int rc = 0;
 	EPD_size display_size = EPD_1_44;
+	int width = 128;
+	int height = 96;
 	const uint8_t *const *images = images_1_44;
 	int image_count = SIZE_OF_ARRAY(images_1_44);
+	char **frame_paths = NULL;  // pre-encoded frame files to show instead
+	int frame_count = 0;
 
 	if (argc < 2) {
 		usage(argv[0], "missing argument(s)");
-	} else if (argc > 3) {
+	} else if (argc > 3 && !is_frame_path(argv[2])) {
 		usage(argv[0], "extraneous extra argument(s)");
 	}
 
@@ -173,28 +185,39 @@ int main(int argc, char *argv[]) {
 #if EPD_1_9_SUPPORT
 	} else if (0 == strcmp("1.9", argv[1]) || 0 == strcmp("1_9", argv[1])) {
 		display_size = EPD_1_9;
+		width = 144;
+		height = 128;
 		images = images_1_9;
 		image_count = SIZE_OF_ARRAY(images_1_9);
 #endif
 	} else if (0 == strcmp("2.0", argv[1]) || 0 == strcmp("2_0", argv[1])) {
 		display_size = EPD_2_0;
+		width = 200;
+		height = 96;
 		images = images_2_0;
 		image_count = SIZE_OF_ARRAY(images_2_0);
 #if EPD_2_6_SUPPORT
 	} else if (0 == strcmp("2.6", argv[1]) || 0 == strcmp("2_6", argv[1])) {
 		display_size = EPD_2_6;
+		width = 232;
+		height = 128;
 		images = images_2_6;
 		image_count = SIZE_OF_ARRAY(images_2_6);
 #endif
 	} else if (0 == strcmp("2.7", argv[1]) || 0 == strcmp("2_7", argv[1])) {
 		display_size = EPD_2_7;
+		width = 264;
+		height = 176;
 		images = images_2_7;
 		image_count = SIZE_OF_ARRAY(images_2_7);
 	} else {
 		usage(argv[0], "unknown display size: %s", argv[1]);
 	}
 
-	if (argc > 2) {
+	if (argc > 2 && is_frame_path(argv[2])) {
+		frame_paths = &argv[2];
+		frame_count = argc - 2;
+	} else if (argc > 2) {
 		int n = atoi(argv[2]);
 		if (n < 0) {
 			usage(argv[0], "image-count cannot be negative");
@@ -249,7 +272,28 @@ int main(int argc, char *argv[]) {
 	EPD_clear(epd);
 	EPD_end(epd);
 
-	if (image_count > 0) {
+	if (frame_count > 0) {
+		printf("frames start\n");
+		for (int i = 0; i < frame_count; ++i) {
+			EPD_frame_type frame;
+			int error = EPD_frame_load(&frame, frame_paths[i], epd, width, height);
+			if (0 != error) {
+				rc = 1;
+				warnx("%s: %s", frame_paths[i], strerror(-error));
+				break;
+			}
+			printf("frame = %s%s\n", frame_paths[i], NULL == frame.old_image ? "" : " (from previous)");
+			EPD_begin(epd);
+#if EPD_ENCODED_AVAILABLE
+			EPD_encoded_image(epd, frame.stages);
+#endif
+			EPD_end(epd);
+			EPD_frame_free(&frame);
+			if (i < frame_count - 1) {
+				sleep(5);
+			}
+		}
+	} else if (image_count > 0) {
 		printf("images start\n");
 		for (int i = 0; i < image_count; ++i) {
 			printf("image = %d\n", i);
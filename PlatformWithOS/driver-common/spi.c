@@ -12,29 +12,48 @@
 // express or implied.  See the License for the specific language
 // governing permissions and limitations under the License.
 
-
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <time.h>
 #include <err.h>
 #include <sys/ioctl.h>
 #include <linux/spi/spidev.h>
 
 #include "spi.h"
+#include "spi_backend.h"
 
 
-// spi information
-struct SPI_struct {
-	int fd;
-	uint32_t bps;
-};
+// maximum segments for a single SPI_IOC_MESSAGE
+// (the SPI queue passes several lines of segments at once)
+#define SPI_VECTOR_MAX 128
+
+// spidev's limit on the bytes in one SPI_IOC_MESSAGE, and its default
+#define SPIDEV_BUFSIZ_PATH "/sys/module/spidev/parameters/bufsiz"
+#define SPIDEV_BUFSIZ_DEFAULT 4096
 
 
 // prototypes
 static void set_spi_mode(SPI_type *spi, uint8_t mode);
+static uint64_t monotonic_ns(void);
+
+static const SPI_backend spidev_backend;
+static const SPI_backend null_backend;
+
+// backends selected by path prefix, the last is the default
+static const SPI_backend *const backends[] = {
+	&null_backend,
+	&SPI_record_backend,
+	&SPI_replay_backend,
+#if defined(SPI_BCM2835_BACKEND)
+	&SPI_bcm2835_backend,
+#endif
+	&spidev_backend
+};
 
 
 // enable SPI access SPI fd
@@ -46,27 +65,41 @@ SPI_type *SPI_create(const char *spi_path, uint32_t bps) {
 		warn("falled to allocate SPI structure");
 		return NULL;
 	}
-	spi->fd = open(spi_path, O_RDWR);
-	if (spi->fd < 0) {
-		free(spi);
-		warn("cannot open: %s", spi_path);
-		return NULL;
-	}
 
 	spi->bps = bps;
+	spi->mode_valid = false;
+	spi->mode = SPI_MODE_0;
+	spi->data = NULL;
+	SPI_reset_stats(spi);
+
+	// select the backend
+	for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); ++i) {
+		const char *prefix = backends[i]->prefix;
+		size_t length = (NULL == prefix) ? 0 : strlen(prefix);
+		if (0 == length || 0 == strncmp(spi_path, prefix, length)) {
+			spi->backend = backends[i];
+			spi_path += length;
+			break;
+		}
+	}
 
+	if (!spi->backend->create(spi, spi_path)) {
+		free(spi);
+		return NULL;
+	}
 	return spi;
 }
 
 
 // release SPI fd (if open)
+// returns false if the backend failed e.g. a replay did not match
 bool SPI_destroy(SPI_type *spi) {
 	if (NULL == spi) {
 		return false;
 	}
-	close(spi->fd);
+	bool ok = spi->backend->destroy(spi);
 	free(spi);
-	return true;
+	return ok;
 }
 
 
@@ -96,41 +129,41 @@ void SPI_off(SPI_type *spi) {
 // send a data block to SPI
 // will only change CS if the SPI_CS bits are set
 void SPI_send(SPI_type *spi, const void *buffer, size_t length) {
-	struct spi_ioc_transfer transfer_buffer[1] = {
-		{
-			.tx_buf = (unsigned long)(buffer),
-			.rx_buf = 0,  // nothing to receive
-			.len = length,
-			.delay_usecs = 2,
-			.speed_hz = spi->bps,
-			.bits_per_word = 8,
-			.cs_change = 0
-		}
-	};
-
-	if (-1 == ioctl(spi->fd, SPI_IOC_MESSAGE(1), transfer_buffer)) {
-		warn("SPI: send failure");
-	}
+	const SPI_segment segment = {buffer, length};
+	SPI_send_vector(spi, &segment, 1);
 }
 
 // send a data block to SPI and return last bytes returned by slave
 // will only change CS if the SPI_CS bits are set
 void SPI_read(SPI_type *spi, const void *buffer, void *received, size_t length) {
-	struct spi_ioc_transfer transfer_buffer[1] = {
-		{
-			.tx_buf = (unsigned long)(buffer),
-			.rx_buf = (unsigned long)(received),
-			.len = length,
-			.delay_usecs = 2,
-			.speed_hz = spi->bps,
-			.bits_per_word = 8,
-			.cs_change = 0
-		}
-	};
+	uint64_t start = monotonic_ns();
+	spi->backend->read(spi, buffer, received, length);
+	spi->stats.bytes += length;
+	spi->stats.ns += monotonic_ns() - start;
+}
 
-	if (-1 == ioctl(spi->fd, SPI_IOC_MESSAGE(1), transfer_buffer)) {
-		warn("SPI: read failure");
+
+// send several data blocks as one chained transfer
+// CS is raised between each segment as if SPI_send was called for each one
+void SPI_send_vector(SPI_type *spi, const SPI_segment *segments, size_t count) {
+	uint64_t start = monotonic_ns();
+	spi->backend->send(spi, segments, count);
+	for (size_t i = 0; i < count; ++i) {
+		spi->stats.bytes += segments[i].length;
 	}
+	spi->stats.ns += monotonic_ns() - start;
+}
+
+
+// copy the counters
+void SPI_get_stats(SPI_type *spi, SPI_stats_type *stats) {
+	*stats = spi->stats;
+}
+
+
+// zero the counters
+void SPI_reset_stats(SPI_type *spi) {
+	memset(&spi->stats, 0, sizeof(spi->stats));
 }
 
 
@@ -139,25 +172,205 @@ void SPI_read(SPI_type *spi, const void *buffer, void *received, size_t length)
 
 static void set_spi_mode(SPI_type *spi, uint8_t in_mode) {
 
+	// nothing to do if device is already in this mode
+	if (spi->mode_valid && in_mode == spi->mode) {
+		return;
+	}
+
+	uint64_t start = monotonic_ns();
+	spi->backend->set_mode(spi, in_mode);
+	spi->stats.ns += monotonic_ns() - start;
+
+	spi->mode = in_mode;
+	spi->mode_valid = true;
+}
+
+
+// time for the counters
+static uint64_t monotonic_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+// spidev backend
+// ==============
+
+typedef struct {
+	int fd;
+	size_t bufsiz;  // most bytes in one message
+} spidev_data;
+
+
+// the kernel's message size limit, a module parameter
+static size_t spidev_bufsiz(void) {
+	unsigned long int bufsiz = 0;
+	FILE *f = fopen(SPIDEV_BUFSIZ_PATH, "r");
+	if (NULL != f) {
+		if (1 != fscanf(f, "%lu", &bufsiz)) {
+			bufsiz = 0;
+		}
+		fclose(f);
+	}
+	return (0 == bufsiz) ? SPIDEV_BUFSIZ_DEFAULT : bufsiz;
+}
+
+
+static bool spidev_create(SPI_type *spi, const char *path) {
+	spidev_data *data = malloc(sizeof(spidev_data));
+	if (NULL == data) {
+		warn("falled to allocate SPI device structure");
+		return false;
+	}
+	data->fd = open(path, O_RDWR);
+	if (data->fd < 0) {
+		free(data);
+		warn("cannot open: %s", path);
+		return false;
+	}
+	data->bufsiz = spidev_bufsiz();
+	spi->data = data;
+	return true;
+}
+
+
+static bool spidev_destroy(SPI_type *spi) {
+	spidev_data *data = spi->data;
+	close(data->fd);
+	free(data);
+	return true;
+}
+
+
+// ioctl on the device, counting the system calls
+static int spidev_ioctl(SPI_type *spi, unsigned long int request, void *argument) {
+	spidev_data *data = spi->data;
+	++spi->stats.calls;
+	return ioctl(data->fd, request, argument);
+}
+
+
+static void spidev_set_mode(SPI_type *spi, uint8_t in_mode) {
 	uint8_t mode = in_mode;
 	uint8_t bits = 8;
 	uint8_t lsb_first = 0;
 	uint32_t speed_hz = spi->bps;
 
 	// WR
-	if (-1 == ioctl(spi->fd, SPI_IOC_WR_MODE, &mode)) {
+	if (-1 == spidev_ioctl(spi, SPI_IOC_WR_MODE, &mode)) {
 		err(1,"SPI: cannot set SPI_IOC_WR_MODE  =%d", mode);
 	}
 
-	if (-1 == ioctl(spi->fd, SPI_IOC_WR_BITS_PER_WORD, &bits)) {
+	if (-1 == spidev_ioctl(spi, SPI_IOC_WR_BITS_PER_WORD, &bits)) {
 		err(1,"SPI: cannot set SPI_IOC_WR_BITS_PER_WORD = %d", bits);
 	}
 
-	if (-1 == ioctl(spi->fd, SPI_IOC_WR_LSB_FIRST, &lsb_first)) {
+	if (-1 == spidev_ioctl(spi, SPI_IOC_WR_LSB_FIRST, &lsb_first)) {
 		err(1,"SPI: cannot set SPI_IOC_WR_LSB_FIRST = %d", lsb_first);
 	}
 
-	if (-1 == ioctl(spi->fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed_hz)) {
+	if (-1 == spidev_ioctl(spi, SPI_IOC_WR_MAX_SPEED_HZ, &speed_hz)) {
 		err(1,"SPI: cannot set SPI_IOC_WR_MAX_SPEED_HZ = %d", speed_hz);
 	}
 }
+
+
+// each message has as many segments as fit SPI_VECTOR_MAX and bufsiz,
+// a segment larger than bufsiz is sent alone (and fails as before)
+static void spidev_send(SPI_type *spi, const SPI_segment *segments, size_t count) {
+	spidev_data *data = spi->data;
+	struct spi_ioc_transfer transfer_buffer[SPI_VECTOR_MAX];
+
+	while (count > 0) {
+		size_t n = 1;
+		size_t bytes = segments[0].length;
+		while (n < count && n < SPI_VECTOR_MAX && bytes + segments[n].length <= data->bufsiz) {
+			bytes += segments[n].length;
+			++n;
+		}
+
+		memset(transfer_buffer, 0, n * sizeof(transfer_buffer[0]));
+		for (size_t i = 0; i < n; ++i) {
+			transfer_buffer[i].tx_buf = (unsigned long)(segments[i].buffer);
+			transfer_buffer[i].rx_buf = 0;  // nothing to receive
+			transfer_buffer[i].len = segments[i].length;
+			transfer_buffer[i].delay_usecs = 2;
+			transfer_buffer[i].speed_hz = spi->bps;
+			transfer_buffer[i].bits_per_word = 8;
+			// deselect between segments, the end of message always deselects
+			transfer_buffer[i].cs_change = (i < n - 1) ? 1 : 0;
+		}
+
+		if (-1 == spidev_ioctl(spi, SPI_IOC_MESSAGE(n), transfer_buffer)) {
+			warn("SPI: send failure");
+		}
+		segments += n;
+		count -= n;
+	}
+}
+
+
+static void spidev_read(SPI_type *spi, const void *buffer, void *received, size_t length) {
+	struct spi_ioc_transfer transfer_buffer[1] = {
+		{
+			.tx_buf = (unsigned long)(buffer),
+			.rx_buf = (unsigned long)(received),
+			.len = length,
+			.delay_usecs = 2,
+			.speed_hz = spi->bps,
+			.bits_per_word = 8,
+			.cs_change = 0
+		}
+	};
+
+	if (-1 == spidev_ioctl(spi, SPI_IOC_MESSAGE(1), transfer_buffer)) {
+		warn("SPI: read failure");
+	}
+}
+
+
+static const SPI_backend spidev_backend = {
+	.prefix   = NULL,
+	.create   = spidev_create,
+	.destroy  = spidev_destroy,
+	.set_mode = spidev_set_mode,
+	.send     = spidev_send,
+	.read     = spidev_read
+};
+
+
+// null backend
+// ============
+
+static bool null_create(SPI_type *spi, const char *path) {
+	return true;
+}
+
+
+static bool null_destroy(SPI_type *spi) {
+	return true;
+}
+
+
+static void null_set_mode(SPI_type *spi, uint8_t mode) {
+}
+
+
+static void null_send(SPI_type *spi, const SPI_segment *segments, size_t count) {
+}
+
+
+static void null_read(SPI_type *spi, const void *buffer, void *received, size_t length) {
+	memset(received, 0, length);
+}
+
+
+static const SPI_backend null_backend = {
+	.prefix   = "null",
+	.create   = null_create,
+	.destroy  = null_destroy,
+	.set_mode = null_set_mode,
+	.send     = null_send,
+	.read     = null_read
+};
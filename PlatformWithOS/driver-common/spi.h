@@ -24,14 +24,38 @@
 // type to hold SPI data
 typedef struct SPI_struct SPI_type;
 
+// one data block of a chained transfer (see SPI_send_vector)
+typedef struct {
+	const void *buffer;
+	size_t length;
+} SPI_segment;
+
+// counters since SPI_create or SPI_reset_stats
+typedef struct {
+	uint64_t bytes;           // bytes transferred
+	unsigned long int calls;  // ioctl system calls, including mode changes
+	uint64_t ns;              // time spent in the ioctl calls
+} SPI_stats_type;
+
 
 // functions
 // =========
 
 // enable SPI access SPI fd
+// the path selects the backend:
+//   /dev/spidevB.C          the spidev device
+//   null                    discards everything, reads return zeros
+//   record:TRACE[:DEVICE]   writes a timed trace of everything to the
+//                           file TRACE and passes it on to DEVICE
+//                           (any of these paths, default: null)
+//   replay:TRACE            checks everything against the trace and
+//                           returns the bytes read from it, no delays
+//   bcm2835:CS              Raspberry Pi SPI0 registers driven directly,
+//                           CS is the chip select: 0 or 1
 SPI_type *SPI_create(const char *spi_path, uint32_t bps);
 
 // release SPI fd
+// returns false if the backend failed e.g. a replay did not match
 bool SPI_destroy(SPI_type *spi);
 
 // enable SPI, ensures a zero byte was sent (MOSI=0)
@@ -50,4 +74,14 @@ void SPI_send(SPI_type *spi, const void *buffer, size_t length);
 // will only change CS if the SPI_CS bits are set
 void SPI_read(SPI_type *spi, const void *buffer, void *received, size_t length);
 
+// send several data blocks as one chained transfer
+// CS is raised between each segment as if SPI_send was called for each one
+void SPI_send_vector(SPI_type *spi, const SPI_segment *segments, size_t count);
+
+// copy the counters
+void SPI_get_stats(SPI_type *spi, SPI_stats_type *stats);
+
+// zero the counters
+void SPI_reset_stats(SPI_type *spi);
+
 #endif
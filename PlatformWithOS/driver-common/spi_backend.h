@@ -0,0 +1,97 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+#if !defined(SPI_BACKEND_H)
+#define SPI_BACKEND_H 1
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "spi.h"
+
+
+// SPI backend interface
+//
+// spi.c keeps the mode cache and the counters and calls the backend
+// selected by the SPI_create path through this table.  Each backend
+// keeps its own state in SPI_type.data.
+
+typedef struct {
+	const char *prefix;    // path prefix that selects this backend, NULL for the default
+
+	// open the path (with the prefix removed), false on failure
+	bool (*create)(SPI_type *spi, const char *path);
+
+	// release all resources, false if the backend failed
+	bool (*destroy)(SPI_type *spi);
+
+	// only called when the mode changes
+	void (*set_mode)(SPI_type *spi, uint8_t mode);
+
+	// send segments with CS raised between them
+	void (*send)(SPI_type *spi, const SPI_segment *segments, size_t count);
+
+	// send buffer and receive the same length
+	void (*read)(SPI_type *spi, const void *buffer, void *received, size_t length);
+} SPI_backend;
+
+struct SPI_struct {
+	const SPI_backend *backend;
+	void *data;            // backend state
+	uint32_t bps;
+	bool mode_valid;       // false => mode must be sent to the device
+	uint8_t mode;          // last mode sent to the device
+	SPI_stats_type stats;  // the backend counts system calls, spi.c the rest
+};
+
+// backends in spi_trace.c
+extern const SPI_backend SPI_record_backend;
+extern const SPI_backend SPI_replay_backend;
+
+// backend in RaspberryPi/spi_bcm2835.c, only built for the Raspberry Pi
+// which defines SPI_BCM2835_BACKEND
+extern const SPI_backend SPI_bcm2835_backend;
+
+
+// trace file format
+// =================
+//
+// a header followed by one record for each mode change and each
+// transfer, all values in host byte order.  A chained transfer is
+// traced as one SEND per segment so a trace does not depend on how
+// the driver groups its transfers.
+
+#define SPI_TRACE_MAGIC "EPDSPI1\n"
+
+typedef struct {
+	char magic[8];         // SPI_TRACE_MAGIC
+	uint32_t bps;          // from SPI_create
+	uint32_t record_size;  // sizeof(SPI_trace_record)
+} SPI_trace_header;
+
+typedef enum {
+	SPI_TRACE_MODE = 1,    // one byte: the new SPI mode
+	SPI_TRACE_SEND = 2,    // length bytes sent
+	SPI_TRACE_READ = 3     // length bytes sent then length bytes received
+} SPI_trace_type;
+
+typedef struct {
+	uint32_t type;         // SPI_trace_type
+	uint32_t length;       // bytes in each data block
+	uint64_t time_ns;      // CLOCK_MONOTONIC time since SPI_create
+} SPI_trace_record;
+
+
+#endif
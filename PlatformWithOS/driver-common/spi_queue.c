@@ -0,0 +1,229 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <err.h>
+
+#include "spi.h"
+#include "spi_queue.h"
+
+
+// lines queued before the driver waits, enough for the thread to
+// miss a scheduling tick without the bus going idle
+#define SPI_QUEUE_ENTRIES 32
+
+// the thread only needs the line segments on its stack
+#define SPI_QUEUE_STACK_SIZE (64 * 1024)
+
+
+typedef struct {
+	uint8_t *buffer;
+	SPI_segment segments[SPI_QUEUE_SEGMENTS];
+	size_t count;
+} entry_type;
+
+struct SPI_queue_struct {
+	SPI_type *spi;
+	pthread_t thread;
+	pthread_mutex_t lock;           // protects all below
+	pthread_cond_t queued;          // an entry was queued or stop set
+	pthread_cond_t sent;            // entries were freed
+	entry_type entries[SPI_QUEUE_ENTRIES];
+	size_t head;                    // oldest entry queued or being sent
+	size_t count;                   // entries queued or being sent
+	bool stop;
+	bool producer_valid;            // producer's scheduling was copied
+	pthread_t producer;
+};
+
+
+// prototypes
+static void *submit_thread(void *arg);
+static void follow_producer(SPI_queue_type *queue);
+static void wait_for_entry(SPI_queue_type *queue);
+
+
+// start a queue for spi, each entry has a buffer of buffer_size bytes
+SPI_queue_type *SPI_queue_create(SPI_type *spi, size_t buffer_size) {
+
+	SPI_queue_type *queue = malloc(sizeof(SPI_queue_type));
+	if (NULL == queue) {
+		warn("falled to allocate SPI queue structure");
+		return NULL;
+	}
+	memset(queue, 0, sizeof(SPI_queue_type));
+	queue->spi = spi;
+
+	// all buffers in one block
+	uint8_t *buffers = malloc(SPI_QUEUE_ENTRIES * buffer_size);
+	if (NULL == buffers) {
+		free(queue);
+		warn("falled to allocate SPI queue buffers");
+		return NULL;
+	}
+	memset(buffers, 0, SPI_QUEUE_ENTRIES * buffer_size);
+	for (size_t i = 0; i < SPI_QUEUE_ENTRIES; ++i) {
+		queue->entries[i].buffer = &buffers[i * buffer_size];
+	}
+
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->queued, NULL);
+	pthread_cond_init(&queue->sent, NULL);
+
+	pthread_attr_t attributes;
+	pthread_attr_init(&attributes);
+	pthread_attr_setstacksize(&attributes, SPI_QUEUE_STACK_SIZE);
+	int rc = pthread_create(&queue->thread, &attributes, submit_thread, queue);
+	pthread_attr_destroy(&attributes);
+	if (0 != rc) {
+		errno = rc;
+		warn("failed to start SPI queue thread");
+		pthread_cond_destroy(&queue->sent);
+		pthread_cond_destroy(&queue->queued);
+		pthread_mutex_destroy(&queue->lock);
+		free(buffers);
+		free(queue);
+		return NULL;
+	}
+	return queue;
+}
+
+
+// send anything queued and stop the thread
+void SPI_queue_destroy(SPI_queue_type *queue) {
+	if (NULL == queue) {
+		return;
+	}
+	SPI_queue_flush(queue);
+
+	pthread_mutex_lock(&queue->lock);
+	queue->stop = true;
+	pthread_cond_signal(&queue->queued);
+	pthread_mutex_unlock(&queue->lock);
+	pthread_join(queue->thread, NULL);
+
+	pthread_cond_destroy(&queue->sent);
+	pthread_cond_destroy(&queue->queued);
+	pthread_mutex_destroy(&queue->lock);
+	free(queue->entries[0].buffer);
+	free(queue);
+}
+
+
+// the buffer of the next entry to be queued, waits for a free entry
+// (only the producer queues, so the entry stays free until it does)
+uint8_t *SPI_queue_buffer(SPI_queue_type *queue) {
+	pthread_mutex_lock(&queue->lock);
+	wait_for_entry(queue);
+	uint8_t *buffer = queue->entries[(queue->head + queue->count) % SPI_QUEUE_ENTRIES].buffer;
+	pthread_mutex_unlock(&queue->lock);
+	return buffer;
+}
+
+
+// queue a transfer of up to SPI_QUEUE_SEGMENTS segments
+void SPI_queue_send(SPI_queue_type *queue, const SPI_segment *segments, size_t count) {
+	if (count > SPI_QUEUE_SEGMENTS) {
+		errx(1, "SPI queue: %zu segments, maximum is %d", count, SPI_QUEUE_SEGMENTS);
+	}
+
+	pthread_mutex_lock(&queue->lock);
+	if (!queue->producer_valid || !pthread_equal(queue->producer, pthread_self())) {
+		follow_producer(queue);
+	}
+	wait_for_entry(queue);
+	entry_type *entry = &queue->entries[(queue->head + queue->count) % SPI_QUEUE_ENTRIES];
+	memcpy(entry->segments, segments, count * sizeof(SPI_segment));
+	entry->count = count;
+	++queue->count;
+	pthread_cond_signal(&queue->queued);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+
+// wait until everything queued has been sent
+void SPI_queue_flush(SPI_queue_type *queue) {
+	pthread_mutex_lock(&queue->lock);
+	while (queue->count > 0) {
+		pthread_cond_wait(&queue->sent, &queue->lock);
+	}
+	pthread_mutex_unlock(&queue->lock);
+}
+
+
+// internal functions
+// ==================
+
+// send every entry waiting as one chained transfer, the entries stay
+// in use until it returns so the producer cannot refill them
+static void *submit_thread(void *arg) {
+	SPI_queue_type *queue = arg;
+	SPI_segment segments[SPI_QUEUE_ENTRIES * SPI_QUEUE_SEGMENTS];
+
+	pthread_mutex_lock(&queue->lock);
+	for (;;) {
+		while (0 == queue->count && !queue->stop) {
+			pthread_cond_wait(&queue->queued, &queue->lock);
+		}
+		if (0 == queue->count) {
+			break;
+		}
+
+		size_t taken = queue->count;
+		size_t n = 0;
+		for (size_t i = 0; i < taken; ++i) {
+			const entry_type *entry = &queue->entries[(queue->head + i) % SPI_QUEUE_ENTRIES];
+			memcpy(&segments[n], entry->segments, entry->count * sizeof(SPI_segment));
+			n += entry->count;
+		}
+		pthread_mutex_unlock(&queue->lock);
+
+		SPI_send_vector(queue->spi, segments, n);
+
+		pthread_mutex_lock(&queue->lock);
+		queue->head = (queue->head + taken) % SPI_QUEUE_ENTRIES;
+		queue->count -= taken;
+		pthread_cond_broadcast(&queue->sent);
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return NULL;
+}
+
+
+// give the thread the scheduling of a new producer so a real time
+// update is not held up by a normal priority thread; the CPU affinity
+// is not copied so that the two can use different cores
+// (called with the lock held)
+static void follow_producer(SPI_queue_type *queue) {
+	int policy;
+	struct sched_param param;
+	queue->producer = pthread_self();
+	queue->producer_valid = true;
+	if (0 == pthread_getschedparam(queue->producer, &policy, &param)) {
+		pthread_setschedparam(queue->thread, policy, &param);
+	}
+}
+
+
+// wait until an entry is free (called with the lock held)
+static void wait_for_entry(SPI_queue_type *queue) {
+	while (queue->count >= SPI_QUEUE_ENTRIES) {
+		pthread_cond_wait(&queue->sent, &queue->lock);
+	}
+}
@@ -0,0 +1,65 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+#if !defined(SPI_QUEUE_H)
+#define SPI_QUEUE_H 1
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "spi.h"
+
+
+// SPI submission thread
+//
+// A panel driver queues the transfers of each line and goes on to
+// encode the next line while a thread sends them.  All lines waiting
+// when the thread is ready go out as one chained transfer, so the bus
+// is kept busy and a frame takes few system calls.  The transfers are
+// sent in the order queued with the same CS changes as calling
+// SPI_send_vector for each one.
+//
+// The thread takes the scheduling policy and priority of the thread
+// queuing lines, but not its CPU affinity.  Only that thread may use
+// the SPI device directly, and only once SPI_queue_flush has returned.
+
+// type to hold the queue
+typedef struct SPI_queue_struct SPI_queue_type;
+
+// most segments in one queued transfer
+#define SPI_QUEUE_SEGMENTS 6
+
+
+// functions
+// =========
+
+// start a queue for spi, each entry has a buffer of buffer_size bytes
+SPI_queue_type *SPI_queue_create(SPI_type *spi, size_t buffer_size);
+
+// send anything queued and stop the thread
+void SPI_queue_destroy(SPI_queue_type *queue);
+
+// the buffer of the next entry to be queued, waits for a free entry
+uint8_t *SPI_queue_buffer(SPI_queue_type *queue);
+
+// queue a transfer of up to SPI_QUEUE_SEGMENTS segments, which may
+// point into the buffer from SPI_queue_buffer, anything else must not
+// change until SPI_queue_flush
+void SPI_queue_send(SPI_queue_type *queue, const SPI_segment *segments, size_t count);
+
+// wait until everything queued has been sent
+void SPI_queue_flush(SPI_queue_type *queue);
+
+#endif
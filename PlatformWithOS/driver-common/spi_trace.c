@@ -0,0 +1,368 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <err.h>
+
+#include "spi.h"
+#include "spi_backend.h"
+
+
+// recording and replaying SPI traces (format in spi_backend.h)
+//
+//   record:TRACE[:DEVICE]  write every mode change and transfer to the
+//                          file TRACE and pass them on to DEVICE
+//                          (any SPI_create path, default: null)
+//   replay:TRACE           check every mode change and transfer against
+//                          TRACE and return the bytes read from it
+//
+// a replay runs at full speed, the recorded times are not used
+
+
+// prototypes
+static uint64_t monotonic_ns(void);
+
+
+// recorder
+// ========
+
+typedef struct {
+	FILE *file;
+	bool ok;               // false after a write error
+	uint64_t start;        // time of SPI_create
+	SPI_type *device;      // transfers are passed on to this
+} record_data;
+
+
+static void record(SPI_type *spi, SPI_trace_type type, const void *buffer, const void *received, size_t length) {
+	record_data *data = spi->data;
+	const SPI_trace_record header = {
+		.type = type,
+		.length = length,
+		.time_ns = monotonic_ns() - data->start
+	};
+	if (1 != fwrite(&header, sizeof(header), 1, data->file) ||
+	    length != fwrite(buffer, 1, length, data->file) ||
+	    (NULL != received && length != fwrite(received, 1, length, data->file))) {
+		if (data->ok) {
+			warn("SPI record: write failed");
+		}
+		data->ok = false;
+	}
+}
+
+
+// keep the system call count of the device
+static void record_calls(SPI_type *spi, unsigned long int before) {
+	record_data *data = spi->data;
+	spi->stats.calls += data->device->stats.calls - before;
+}
+
+
+static bool record_create(SPI_type *spi, const char *path) {
+	record_data *data = malloc(sizeof(record_data));
+	if (NULL == data) {
+		warn("falled to allocate SPI record structure");
+		return false;
+	}
+
+	const char *device_path = strchr(path, ':');
+	size_t length = (NULL == device_path) ? strlen(path) : (size_t)(device_path - path);
+	char *trace_path = strndup(path, length);
+	if (NULL == trace_path) {
+		free(data);
+		warn("falled to allocate SPI record structure");
+		return false;
+	}
+
+	data->device = SPI_create(NULL == device_path ? "null" : device_path + 1, spi->bps);
+	if (NULL == data->device) {
+		free(trace_path);
+		free(data);
+		return false;
+	}
+
+	data->file = fopen(trace_path, "wb");
+	if (NULL == data->file) {
+		warn("cannot create: %s", trace_path);
+		SPI_destroy(data->device);
+		free(trace_path);
+		free(data);
+		return false;
+	}
+	free(trace_path);
+
+	SPI_trace_header header = {
+		.magic = SPI_TRACE_MAGIC,
+		.bps = spi->bps,
+		.record_size = sizeof(SPI_trace_record)
+	};
+	data->ok = (1 == fwrite(&header, sizeof(header), 1, data->file));
+	data->start = monotonic_ns();
+	spi->data = data;
+	return true;
+}
+
+
+static bool record_destroy(SPI_type *spi) {
+	record_data *data = spi->data;
+	bool ok = data->ok;
+	if (0 != fclose(data->file)) {
+		warn("SPI record: close failed");
+		ok = false;
+	}
+	if (!SPI_destroy(data->device)) {
+		ok = false;
+	}
+	free(data);
+	return ok;
+}
+
+
+static void record_set_mode(SPI_type *spi, uint8_t mode) {
+	record_data *data = spi->data;
+	unsigned long int before = data->device->stats.calls;
+	record(spi, SPI_TRACE_MODE, &mode, NULL, 1);
+	data->device->backend->set_mode(data->device, mode);
+	data->device->mode = mode;
+	data->device->mode_valid = true;
+	record_calls(spi, before);
+}
+
+
+static void record_send(SPI_type *spi, const SPI_segment *segments, size_t count) {
+	record_data *data = spi->data;
+	unsigned long int before = data->device->stats.calls;
+	for (size_t i = 0; i < count; ++i) {
+		record(spi, SPI_TRACE_SEND, segments[i].buffer, NULL, segments[i].length);
+	}
+	SPI_send_vector(data->device, segments, count);
+	record_calls(spi, before);
+}
+
+
+static void record_read(SPI_type *spi, const void *buffer, void *received, size_t length) {
+	record_data *data = spi->data;
+	unsigned long int before = data->device->stats.calls;
+	SPI_read(data->device, buffer, received, length);
+	record(spi, SPI_TRACE_READ, buffer, received, length);
+	record_calls(spi, before);
+}
+
+
+const SPI_backend SPI_record_backend = {
+	.prefix   = "record:",
+	.create   = record_create,
+	.destroy  = record_destroy,
+	.set_mode = record_set_mode,
+	.send     = record_send,
+	.read     = record_read
+};
+
+
+// replayer
+// ========
+
+typedef struct {
+	uint8_t *trace;        // the whole trace file
+	size_t size;
+	size_t offset;         // of the next record
+	unsigned long int records;     // records used
+	unsigned long int mismatches;  // records with different data
+	bool diverged;         // a different transfer or the end of trace was
+	                       // reached, nothing more is compared
+} replay_data;
+
+
+static const char *const trace_names[] = {
+	"?", "mode", "send", "read"
+};
+
+
+// the data of the next record if it is the expected type and length
+// otherwise the replay has diverged and NULL is returned
+static const uint8_t *replay_next(SPI_type *spi, SPI_trace_type type, size_t length) {
+	replay_data *data = spi->data;
+	if (data->diverged) {
+		return NULL;
+	}
+
+	SPI_trace_record header;
+	size_t blocks = (SPI_TRACE_READ == type) ? 2 : 1;
+	if (data->offset + sizeof(header) > data->size) {
+		warnx("SPI replay: %s of %zu bytes after end of trace (record %lu)",
+		      trace_names[type], length, data->records);
+		data->diverged = true;
+		return NULL;
+	}
+	memcpy(&header, data->trace + data->offset, sizeof(header));
+	if (header.type != type || header.length != length ||
+	    data->offset + sizeof(header) + blocks * length > data->size) {
+		warnx("SPI replay: record %lu: expected %s of %u bytes, got %s of %zu bytes",
+		      data->records,
+		      header.type <= SPI_TRACE_READ ? trace_names[header.type] : "?", header.length,
+		      trace_names[type], length);
+		data->diverged = true;
+		return NULL;
+	}
+	const uint8_t *p = data->trace + data->offset + sizeof(header);
+	data->offset += sizeof(header) + blocks * length;
+	++data->records;
+	return p;
+}
+
+
+// compare the sent bytes with the trace
+static void replay_compare(SPI_type *spi, const uint8_t *expected, const void *buffer, size_t length) {
+	replay_data *data = spi->data;
+	if (0 != memcmp(expected, buffer, length)) {
+		if (0 == data->mismatches) {
+			const uint8_t *p = buffer;
+			size_t i = 0;
+			while (expected[i] == p[i]) {
+				++i;
+			}
+			warnx("SPI replay: record %lu: byte %zu is 0x%02x, trace has 0x%02x",
+			      data->records - 1, i, p[i], expected[i]);
+		}
+		++data->mismatches;
+	}
+}
+
+
+static bool replay_create(SPI_type *spi, const char *path) {
+	replay_data *data = malloc(sizeof(replay_data));
+	if (NULL == data) {
+		warn("falled to allocate SPI replay structure");
+		return false;
+	}
+
+	FILE *file = fopen(path, "rb");
+	if (NULL == file) {
+		warn("cannot open: %s", path);
+		free(data);
+		return false;
+	}
+
+	long int size = -1;
+	if (0 == fseek(file, 0, SEEK_END)) {
+		size = ftell(file);
+		rewind(file);
+	}
+	data->trace = (size > 0) ? malloc(size) : NULL;
+	if (NULL == data->trace || (size_t)size != fread(data->trace, 1, size, file)) {
+		warnx("cannot read: %s", path);
+		fclose(file);
+		free(data->trace);
+		free(data);
+		return false;
+	}
+	fclose(file);
+
+	SPI_trace_header header;
+	bool valid = (size_t)size >= sizeof(header);
+	if (valid) {
+		memcpy(&header, data->trace, sizeof(header));
+		valid = 0 == memcmp(header.magic, SPI_TRACE_MAGIC, sizeof(header.magic)) &&
+			sizeof(SPI_trace_record) == header.record_size;
+	}
+	if (!valid) {
+		warnx("not an SPI trace: %s", path);
+		free(data->trace);
+		free(data);
+		return false;
+	}
+
+	data->size = size;
+	data->offset = sizeof(header);
+	data->records = 0;
+	data->mismatches = 0;
+	data->diverged = false;
+	spi->data = data;
+	return true;
+}
+
+
+// returns false unless the whole trace was replayed without differences
+static bool replay_destroy(SPI_type *spi) {
+	replay_data *data = spi->data;
+	bool ok = true;
+	if (data->offset < data->size && !data->diverged) {
+		warnx("SPI replay: trace has data after record %lu", data->records);
+		ok = false;
+	}
+	if (data->diverged || 0 != data->mismatches) {
+		warnx("SPI replay: %lu records, %lu different%s", data->records, data->mismatches,
+		      data->diverged ? ", diverged" : "");
+		ok = false;
+	}
+	free(data->trace);
+	free(data);
+	return ok;
+}
+
+
+static void replay_set_mode(SPI_type *spi, uint8_t mode) {
+	const uint8_t *p = replay_next(spi, SPI_TRACE_MODE, 1);
+	if (NULL != p) {
+		replay_compare(spi, p, &mode, 1);
+	}
+}
+
+
+static void replay_send(SPI_type *spi, const SPI_segment *segments, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		const uint8_t *p = replay_next(spi, SPI_TRACE_SEND, segments[i].length);
+		if (NULL != p) {
+			replay_compare(spi, p, segments[i].buffer, segments[i].length);
+		}
+	}
+}
+
+
+static void replay_read(SPI_type *spi, const void *buffer, void *received, size_t length) {
+	const uint8_t *p = replay_next(spi, SPI_TRACE_READ, length);
+	if (NULL == p) {
+		memset(received, 0, length);
+		return;
+	}
+	replay_compare(spi, p, buffer, length);
+	memcpy(received, p + length, length);
+}
+
+
+const SPI_backend SPI_replay_backend = {
+	.prefix   = "replay:",
+	.create   = replay_create,
+	.destroy  = replay_destroy,
+	.set_mode = replay_set_mode,
+	.send     = replay_send,
+	.read     = replay_read
+};
+
+
+// internal functions
+// ==================
+
+// time for the trace records
+static uint64_t monotonic_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
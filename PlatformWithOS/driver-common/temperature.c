@@ -0,0 +1,145 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <err.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+
+#include "temperature.h"
+
+
+#define SOC_SENSOR_PATH "/sys/class/thermal/thermal_zone0/temp"
+#define LM75_PREFIX "lm75:"
+#define LM75_DEFAULT_ADDRESS 0x48
+
+struct TEMPERATURE_struct {
+	int fd;
+	bool lm75;     // false => text file of millidegrees
+};
+
+
+// open a temperature sensor
+TEMPERATURE_type *TEMPERATURE_create(const char *source) {
+
+	// allocate memory
+	TEMPERATURE_type *sensor = malloc(sizeof(TEMPERATURE_type));
+	if (NULL == sensor) {
+		warn("failed to allocate temperature structure");
+		return NULL;
+	}
+
+	if (0 == strcmp(source, "soc")) {
+		source = SOC_SENSOR_PATH;
+	}
+
+	sensor->lm75 = 0 == strncmp(source, LM75_PREFIX, strlen(LM75_PREFIX));
+	if (!sensor->lm75) {
+		sensor->fd = open(source, O_RDONLY);
+		if (sensor->fd < 0) {
+			warn("cannot open temperature sensor: %s", source);
+			free(sensor);
+			return NULL;
+		}
+		return sensor;
+	}
+
+	// lm75:DEVICE[:ADDRESS]
+	char *device = strdup(source + strlen(LM75_PREFIX));
+	if (NULL == device) {
+		warn("failed to allocate temperature device");
+		free(sensor);
+		return NULL;
+	}
+	long int address = LM75_DEFAULT_ADDRESS;
+	char *colon = strchr(device, ':');
+	if (NULL != colon) {
+		char *end = NULL;
+		*colon++ = '\0';
+		address = strtol(colon, &end, 0);
+		if (colon == end || '\0' != *end || address < 0x03 || address > 0x77) {
+			warnx("invalid LM75 address: %s", colon);
+			goto fail;
+		}
+	}
+
+	sensor->fd = open(device, O_RDWR);
+	if (sensor->fd < 0) {
+		warn("cannot open I2C device: %s", device);
+		goto fail;
+	}
+
+	if (-1 == ioctl(sensor->fd, I2C_SLAVE, address)) {
+		warn("cannot select I2C address 0x%02lx", address);
+		close(sensor->fd);
+		goto fail;
+	}
+
+	free(device);
+	return sensor;
+
+fail:
+	free(device);
+	free(sensor);
+	return NULL;
+}
+
+
+// close the sensor
+void TEMPERATURE_destroy(TEMPERATURE_type *sensor) {
+	if (NULL == sensor) {
+		return;
+	}
+	close(sensor->fd);
+	free(sensor);
+}
+
+
+// read the temperature in millidegrees Celsius
+bool TEMPERATURE_read(TEMPERATURE_type *sensor, int *millidegrees) {
+
+	if (sensor->lm75) {
+		// the power on pointer selects the temperature register:
+		// two bytes, MSB first, 9 bit two's complement in 0.5 degree steps
+		uint8_t data[2];
+		if (sizeof(data) != read(sensor->fd, data, sizeof(data))) {
+			return false;
+		}
+		int16_t value = (int16_t)((data[0] << 8) | data[1]);
+		*millidegrees = (value >> 7) * 500;
+		return true;
+	}
+
+	// sysfs sensor files must be read again from the start each time
+	char buffer[32];
+	ssize_t n = pread(sensor->fd, buffer, sizeof(buffer) - 1, 0);
+	if (n <= 0) {
+		return false;
+	}
+	buffer[n] = '\0';
+
+	char *end = NULL;
+	long int value = strtol(buffer, &end, 10);
+	if (buffer == end) {
+		return false;
+	}
+	*millidegrees = (int)value;
+	return true;
+}
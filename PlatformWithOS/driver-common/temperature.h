@@ -0,0 +1,45 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+
+#if !defined(TEMPERATURE_H)
+#define TEMPERATURE_H 1
+
+#include <stdbool.h>
+
+
+// type to hold temperature sensor data
+typedef struct TEMPERATURE_struct TEMPERATURE_type;
+
+
+// functions
+// =========
+
+// open a temperature sensor
+// the source selects the sensor:
+//   soc                     the SoC sensor (thermal_zone0)
+//   lm75:DEVICE[:ADDRESS]   an LM75 on the I2C bus DEVICE e.g. /dev/i2c-1
+//                           at ADDRESS (default: 0x48)
+//   PATH                    a file giving millidegrees Celsius e.g. a
+//                           hwmon /sys/class/hwmon/hwmon0/temp1_input
+TEMPERATURE_type *TEMPERATURE_create(const char *source);
+
+// close the sensor
+void TEMPERATURE_destroy(TEMPERATURE_type *sensor);
+
+// read the temperature in millidegrees Celsius
+// returns false if the sensor could not be read
+bool TEMPERATURE_read(TEMPERATURE_type *sensor, int *millidegrees);
+
+#endif
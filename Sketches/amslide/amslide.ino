@@ -104,7 +104,8 @@ const int Pin_SD_CS = 10;
 #if EPD_PWM_REQUIRED
 EPD_Class EPD(EPD_SIZE, Pin_PANEL_ON, Pin_BORDER, Pin_DISCHARGE, Pin_PWM, Pin_RESET, Pin_BUSY, Pin_EPD_CS);
 #else
-EPD_Class EPD(EPD_SIZE, Pin_PANEL_ON, Pin_BORDER, Pin_DISCHARGE, Pin_RESET, Pin_BUSY, Pin_EPD_CS);
+// size fixed at compile time so only its line encoder is linked
+EPD_Panel<EPD_SIZE> EPD(Pin_PANEL_ON, Pin_BORDER, Pin_DISCHARGE, Pin_RESET, Pin_BUSY, Pin_EPD_CS);
 #endif
 
 
@@ -302,15 +303,15 @@ void loop() {
 		// clear -> image1
 		EPD.frame_fixed_repeat(0, EPD_compensate);
 		EPD.frame_fixed_repeat(0, EPD_white);
-		EPD.frame_cb_repeat(0, next_image_reader, EPD_inverse);
-		EPD.frame_cb_repeat(0, next_image_reader, EPD_normal);
+		EPD.frame_cb_prefetch_repeat(0, next_image_reader, EPD_inverse);
+		EPD.frame_cb_prefetch_repeat(0, next_image_reader, EPD_normal);
 		++state;
 		break;
 	case 1:        // swap images
-		EPD.frame_cb_repeat(0, current_image_reader, EPD_compensate);
-		EPD.frame_cb_repeat(0, current_image_reader, EPD_white);
-		EPD.frame_cb_repeat(0, next_image_reader, EPD_inverse);
-		EPD.frame_cb_repeat(0, next_image_reader, EPD_normal);
+		EPD.frame_cb_prefetch_repeat(0, current_image_reader, EPD_compensate);
+		EPD.frame_cb_prefetch_repeat(0, current_image_reader, EPD_white);
+		EPD.frame_cb_prefetch_repeat(0, next_image_reader, EPD_inverse);
+		EPD.frame_cb_prefetch_repeat(0, next_image_reader, EPD_normal);
 		break;
 	}
 	EPD.end();   // power down the EPD panel
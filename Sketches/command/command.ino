@@ -28,6 +28,9 @@
 
 #include <inttypes.h>
 #include <ctype.h>
+#if defined(__AVR__)
+#include <util/crc16.h>
+#endif
 
 // required libraries
 #include <SPI.h>
@@ -40,7 +43,10 @@
 
 
 // version number
-#define COMMAND_VERSION "5"
+#define COMMAND_VERSION "6"
+
+// serial port speed for commands
+#define SERIAL_BAUD 9600
 
 
 // LED anode through resistor to I/O pin
@@ -59,6 +65,10 @@ static void flash_read(void *buffer, uint32_t address, uint16_t length);
 
 static uint16_t xbm_count;
 static bool xbm_parser(uint8_t *b);
+static void image_size(uint32_t count);
+
+static bool binary_baud(uint32_t baud);
+static bool binary_upload(uint32_t address, uint32_t *count);
 
 
 static uint8_t Serial_getc();
@@ -110,7 +120,7 @@ void setup() {
 	digitalWrite(Pin_EPD_CS, LOW);
 	digitalWrite(Pin_EPD_FLASH_CS, HIGH);
 
-	Serial.begin(9600);
+	Serial.begin(SERIAL_BAUD);
 #if defined(__AVR__)
 	// indefinite wait for USB CDC serial port to connect.  Arduino Leonardo only
 	while (!Serial) {
@@ -152,7 +162,8 @@ void loop() {
 		Serial.println("h          - this command");
 		Serial.println("d<ss> <ll> - dump sector in hex, ll * 16 bytes");
 		Serial.println("e<ss>      - erase sector to 0xff");
-		Serial.println("u<ss>      - upload XBM to sector");
+		Serial.println("u<ss>      - erase and upload XBM to sector");
+		Serial.println("b<ss> <bb> - binary upload to sector at baud/100 bb (0 => no change)");
 		Serial.println("i<ss>      - display an image on white screen");
 #if EPD_IMAGE_TWO_ARG
 		Serial.println("r<ss>      - revert an image back to white");
@@ -210,8 +221,9 @@ void loop() {
 					break;
 				}
 			}
-			EPD_FLASH.write_enable();
-			EPD_FLASH.write(address, buffer, count);
+			// sectors are erased as the upload reaches them and the
+			// FLASH works while the next bytes are parsed
+			EPD_FLASH.write_pages(address, buffer, count, true);
 			address += count;
 			if (sizeof(buffer) != count) {
 				break;
@@ -221,18 +233,39 @@ void loop() {
 		EPD_FLASH.write_disable();
 
 		Serial.println();
-		Serial.print(" read = ");
-		Serial_puthex_word(xbm_count);
-		if (128 * 96 / 8 == xbm_count) {
-			Serial.print(" 128x96 1.44");
-		} else if (200 * 96 / 8 == xbm_count) {
-			Serial.print(" 200x96 2.0");
-		} else if (264L * 176 / 8 == xbm_count) {
-			Serial.print(" 264x176 2.7");
-		} else {
-			Serial.print(" invalid image");
+		image_size(xbm_count);
+		break;
+	}
+
+	case 'b':
+	{
+		uint32_t address = Serial_gethex(true);
+		address <<= 12;
+		Serial.print(' ');
+		uint32_t baud = Serial_gethex(true);
+		baud *= 100;
+		if (0 == baud) {
+			baud = SERIAL_BAUD;
 		}
 		Serial.println();
+		Serial.print("binary upload: ");
+		Serial.print(baud);
+		Serial.println();
+
+		uint32_t count = 0;
+		bool ok = binary_baud(baud) && binary_upload(address, &count);
+		EPD_FLASH.write_disable();
+		digitalWrite(Pin_RED_LED, LED_OFF);
+
+		// let the last reply go before changing back
+		Serial.flush();
+		delay(20);
+		Serial.begin(SERIAL_BAUD);
+		Serial.println();
+		if (!ok) {
+			Serial.println("binary upload failed");
+		}
+		image_size(count);
 		break;
 	}
 
@@ -410,6 +443,227 @@ static bool xbm_parser(uint8_t *b) {
 }
 
 
+static void image_size(uint32_t count) {
+	Serial.print(" read = ");
+	if (count > 0xffff) {
+		Serial_puthex_double(count);
+	} else {
+		Serial_puthex_word(count);
+	}
+	if (128 * 96 / 8 == count) {
+		Serial.print(" 128x96 1.44");
+	} else if (200 * 96 / 8 == count) {
+		Serial.print(" 200x96 2.0");
+	} else if (264L * 176 / 8 == count) {
+		Serial.print(" 264x176 2.7");
+	} else {
+		Serial.print(" invalid image");
+	}
+	Serial.println();
+}
+
+
+// binary upload protocol
+//
+// After the "binary upload: <baud>" line both ends change to the new
+// baud and the host sends SYN until it gets ACK back (the old baud is
+// restored if nothing arrives).  The data then comes as blocks of:
+//
+//   SOH seq length data[length] crc_high crc_low
+//
+// seq counts from zero, length is 1..BINARY_BLOCK_SIZE (only the last
+// block may be short) and the CRC is XMODEM CRC16 (0x1021, zero start)
+// of seq, length and data.  "ACK seq" is sent once a block is written
+// to the FLASH, so up to BINARY_WINDOW blocks may be sent before
+// waiting for it.  A bad block gets "NAK seq" of the next block
+// wanted, and the host resends from there.  A zero length block ends
+// the upload with "ACK seq" after the last write and two CANs abort
+// it.
+//
+// Blocks are queued while the FLASH is busy, so a sector erase or page
+// write goes on while the next blocks arrive.
+
+#define BINARY_SOH 0x01
+#define BINARY_ACK 0x06
+#define BINARY_NAK 0x15
+#define BINARY_SYN 0x16
+#define BINARY_CAN 0x18
+
+#define BINARY_BLOCK_SIZE 64
+#define BINARY_WINDOW 4
+#define BINARY_SYNC_MS 2000
+#define BINARY_TIMEOUT_MS 5000
+
+static uint16_t crc16_update(uint16_t crc, uint8_t b) {
+#if defined(__AVR__)
+	return _crc_xmodem_update(crc, b);
+#else
+	crc ^= (uint16_t)(b) << 8;
+	for (uint8_t i = 0; i < 8; ++i) {
+		if (0 != (crc & 0x8000)) {
+			crc = (crc << 1) ^ 0x1021;
+		} else {
+			crc <<= 1;
+		}
+	}
+	return crc;
+#endif
+}
+
+
+// change baud and wait for the host to do the same
+static bool binary_baud(uint32_t baud) {
+	Serial.flush();
+	Serial.begin(baud);
+	uint32_t start = millis();
+	while (millis() - start < BINARY_SYNC_MS) {
+		if (Serial.available() > 0 && BINARY_SYN == Serial.read()) {
+			Serial.write(BINARY_ACK);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+// receive blocks into the FLASH from address (which must start a
+// sector), returns false on time out or abort
+static bool binary_upload(uint32_t address, uint32_t *count) {
+	static uint8_t block[BINARY_WINDOW][BINARY_BLOCK_SIZE];
+	static uint8_t block_length[BINARY_WINDOW];
+
+	enum {
+		STATE_WAIT, STATE_SEQ, STATE_LENGTH, STATE_DATA, STATE_CRC_HIGH, STATE_CRC_LOW
+	} state = STATE_WAIT;
+
+	uint8_t head = 0;        // oldest queued block
+	uint8_t queued = 0;      // blocks waiting to be written
+	uint8_t expected = 0;    // seq of the next new block
+	bool nak_sent = false;   // only one NAK until expected arrives
+	bool end = false;        // zero length block received
+	bool cancel = false;     // CAN received
+	uint32_t erased_end = address;
+
+	uint8_t seq = 0;
+	uint8_t length = 0;
+	uint8_t index = 0;
+	uint16_t crc = 0;
+	uint8_t *p = NULL;
+	uint32_t last = millis();
+
+	*count = 0;
+	for (;;) {
+
+		// the receive buffer is small, so empty it before the FLASH
+		// a full queue is not read from as the host cannot have sent more
+		while (!end && queued < BINARY_WINDOW && Serial.available() > 0) {
+			last = millis();
+			uint8_t c = Serial.read();
+
+			switch (state) {
+			case STATE_WAIT:
+				if (BINARY_SOH == c) {
+					state = STATE_SEQ;
+				} else if (BINARY_CAN == c && cancel) {
+					return false;
+				}
+				cancel = BINARY_CAN == c;
+				break;
+
+			case STATE_SEQ:
+				seq = c;
+				crc = crc16_update(0, c);
+				state = STATE_LENGTH;
+				break;
+
+			case STATE_LENGTH:
+				length = c;
+				crc = crc16_update(crc, c);
+				index = 0;
+				p = block[(head + queued) % BINARY_WINDOW];
+				state = 0 == length ? STATE_CRC_HIGH : STATE_DATA;
+				if (length > BINARY_BLOCK_SIZE) {
+					state = STATE_WAIT;  // framing lost
+					if (!nak_sent) {
+						Serial.write(BINARY_NAK);
+						Serial.write(expected);
+						nak_sent = true;
+					}
+				}
+				break;
+
+			case STATE_DATA:
+				p[index++] = c;
+				crc = crc16_update(crc, c);
+				if (index >= length) {
+					state = STATE_CRC_HIGH;
+				}
+				break;
+
+			case STATE_CRC_HIGH:
+				crc = crc16_update(crc, c);
+				state = STATE_CRC_LOW;
+				break;
+
+			case STATE_CRC_LOW:
+			{
+				crc = crc16_update(crc, c);  // zero if correct
+				state = STATE_WAIT;
+				uint8_t written = expected - queued;  // seq of the oldest queued block
+				if (0 == crc && seq == expected && 0 == length) {
+					end = true;
+				} else if (0 == crc && seq == expected) {
+					block_length[(head + queued) % BINARY_WINDOW] = length;
+					++queued;
+					++expected;
+					nak_sent = false;
+				} else if (0 == crc && (uint8_t)(seq - written) < queued) {
+					// still queued, its ACK comes after the write
+				} else if (0 == crc && (uint8_t)(written - 1 - seq) < 128) {
+					// already written, the ACK must have been lost
+					Serial.write(BINARY_ACK);
+					Serial.write(seq);
+				} else if (!nak_sent) {
+					Serial.write(BINARY_NAK);
+					Serial.write(expected);
+					nak_sent = true;
+				}
+				break;
+			}
+			}
+		}
+
+		// write the oldest block once the FLASH is free, erasing a new
+		// sector first and returning to the serial port while it erases
+		if (queued > 0) {
+			if (!EPD_FLASH.busy()) {
+				uint8_t n = block_length[head];
+				if (address + n > erased_end) {
+					EPD_FLASH.write_enable();
+					EPD_FLASH.sector_erase(erased_end);
+					erased_end += EPD_FLASH_SECTOR_SIZE;
+				} else {
+					EPD_FLASH.write_pages(address, block[head], n, false);
+					address += n;
+					*count += n;
+					Serial.write(BINARY_ACK);
+					Serial.write((uint8_t)(expected - queued));
+					head = (head + 1) % BINARY_WINDOW;
+					--queued;
+					digitalWrite(Pin_RED_LED, 0 != (*count & 0x400) ? LED_ON : LED_OFF);
+				}
+			}
+		} else if (end) {
+			Serial.write(BINARY_ACK);
+			Serial.write(expected);
+			return true;
+		} else if (millis() - last > BINARY_TIMEOUT_MS) {
+			return false;
+		}
+	}
+}
+
+
 // miscellaneous serial interface routines
 
 static uint8_t Serial_getc() {
@@ -22,10 +22,16 @@
 #include <Arduino.h>
 #endif
 
+#include <string.h>
 #include <SPI.h>
 
 #include "EPD_FLASH.h"
 
+// SPI libraries with transactions also transfer a whole buffer at once
+#if !defined(EPD_FLASH_BLOCK_TRANSFER) && defined(SPI_HAS_TRANSACTION)
+#define EPD_FLASH_BLOCK_TRANSFER 1
+#endif
+
 // delays - more consistent naming
 #define Delay_ms(ms) delay(ms)
 #define Delay_us(us) delayMicroseconds(us)
@@ -146,9 +152,14 @@ void EPD_FLASH_Class::read(void *buffer, uint32_t address, uint16_t length) {
 	SPI.transfer(address >> 8);
 	SPI.transfer(address);
 	SPI.transfer(EPD_FLASH_NOP); // read dummy byte
+#if EPD_FLASH_BLOCK_TRANSFER
+	memset(buffer, EPD_FLASH_NOP, length);
+	SPI.transfer(buffer, length);
+#else
 	for (uint8_t *p = (uint8_t *)buffer; length != 0; --length) {
 		*p++ = SPI.transfer(EPD_FLASH_NOP);
 	}
+#endif
 	this->spi_teardown();
 }
 
@@ -159,6 +170,14 @@ void EPD_FLASH_Class::wait_for_ready(void) {
 	}
 }
 
+// non-blocking check for a write or erase still in progress
+bool EPD_FLASH_Class::busy(void) {
+	this->spi_setup();
+	bool busy = this->is_busy();
+	this->spi_teardown();
+	return busy;
+}
+
 bool EPD_FLASH_Class::is_busy(void) {
 	digitalWrite(this->EPD_FLASH_CS, LOW);
 	Delay_us(10);
@@ -208,6 +227,26 @@ void EPD_FLASH_Class::write(uint32_t address, const void *buffer, uint16_t lengt
 }
 
 
+void EPD_FLASH_Class::write_pages(uint32_t address, const void *buffer, uint16_t length, bool erase) {
+	const uint8_t *p = (const uint8_t *)buffer;
+	while (length != 0) {
+		if (erase && 0 == (address & (EPD_FLASH_SECTOR_SIZE - 1))) {
+			this->write_enable();
+			this->sector_erase(address);
+		}
+		uint16_t n = EPD_FLASH_PAGE_SIZE - (address & (EPD_FLASH_PAGE_SIZE - 1));
+		if (n > length) {
+			n = length;
+		}
+		this->write_enable();
+		this->write(address, p, n);
+		address += n;
+		p += n;
+		length -= n;
+	}
+}
+
+
 #if defined(__AVR__)
 void EPD_FLASH_Class::write_from_progmem(uint32_t address, PROGMEM const void *buffer, uint16_t length) {
 	this->wait_for_ready();
@@ -51,12 +51,18 @@ private:
 
 public:
 	bool available(void);
+	bool busy(void);             // true while a write or erase is in progress
 	void info(uint8_t *maufacturer, uint16_t *device);
 	void read(void *buffer, uint32_t address, uint16_t length);
 	void write_enable(void);
 	void write_disable(void);
 	void write(uint32_t address, const void *buffer, uint16_t length);
 
+	// write any length split into pages, not waiting for the last one
+	// if erase is set, each sector is erased as the write reaches its
+	// first byte so an upload can continue while the sector erases
+	void write_pages(uint32_t address, const void *buffer, uint16_t length, bool erase);
+
 	// Arduino has separate memory spaces, but MSP430, ARM do not
 #if !defined(__AVR__)
 	// just alias the function name
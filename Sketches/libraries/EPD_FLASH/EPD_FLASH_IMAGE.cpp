@@ -0,0 +1,318 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+#if defined(ENERGIA)
+#include <Energia.h>
+#else
+#include <Arduino.h>
+#endif
+
+#include <string.h>
+
+#include "EPD_FLASH.h"
+#include "EPD_FLASH_IMAGE.h"
+
+
+// longest line of any panel (2.70")
+#define MAXIMUM_BYTES_PER_LINE (264 / 8)
+
+// "no image" value for image_index
+#define NO_IMAGE 0xffff
+
+#define HEADER_SIZE 8
+#define ENTRY_SIZE 8
+
+static const uint8_t header[HEADER_SIZE] = {'E', 'P', 'D', 'I', EPD_FLASH_IMAGE_VERSION, 0, 0, 0};
+
+
+// the default image store
+EPD_FLASH_IMAGE_Class EPD_FLASH_IMAGE;
+
+
+// local functions
+static void erase_to(uint32_t *erased_end, uint32_t end);
+static uint8_t encode_line(const uint8_t *line, uint8_t length, uint8_t *coded);
+
+
+EPD_FLASH_IMAGE_Class::EPD_FLASH_IMAGE_Class(void) :
+	directory(0), image_count(0), image_index(NO_IMAGE), offset_count(0) {
+}
+
+
+bool EPD_FLASH_IMAGE_Class::begin(uint16_t sector) {
+	this->directory = (uint32_t)(sector) << EPD_FLASH_SECTOR_SHIFT;
+	this->image_count = 0;
+	this->image_index = NO_IMAGE;
+
+	uint8_t buffer[HEADER_SIZE];
+	EPD_FLASH.read(buffer, this->directory, sizeof(buffer));
+	if (0 != memcmp(buffer, header, sizeof(header))) {
+		return false;
+	}
+
+	uint32_t address;
+	uint16_t size;
+	uint8_t bytes_per_line;
+	uint8_t lines;
+	while (this->image_count < EPD_FLASH_IMAGE_MAXIMUM &&
+	       this->entry(this->image_count, &address, &size, &bytes_per_line, &lines)) {
+		++this->image_count;
+	}
+	return true;
+}
+
+
+void EPD_FLASH_IMAGE_Class::format(uint16_t sector) {
+	this->directory = (uint32_t)(sector) << EPD_FLASH_SECTOR_SHIFT;
+	this->image_count = 0;
+	this->image_index = NO_IMAGE;
+
+	EPD_FLASH.write_enable();
+	EPD_FLASH.sector_erase(this->directory);
+	EPD_FLASH.write_pages(this->directory, header, sizeof(header), false);
+	EPD_FLASH.write_disable();
+}
+
+
+// read a directory entry, returns false if it is unused
+bool EPD_FLASH_IMAGE_Class::entry(uint16_t index, uint32_t *address, uint16_t *size, uint8_t *bytes_per_line, uint8_t *lines) {
+	uint8_t buffer[ENTRY_SIZE];
+	EPD_FLASH.read(buffer, this->directory + HEADER_SIZE + (uint32_t)(index) * ENTRY_SIZE, sizeof(buffer));
+	*address = (uint32_t)(buffer[0]) | ((uint32_t)(buffer[1]) << 8) | ((uint32_t)(buffer[2]) << 16) | ((uint32_t)(buffer[3]) << 24);
+	*size = buffer[4] | (buffer[5] << 8);
+	*bytes_per_line = buffer[6];
+	*lines = buffer[7];
+	return 0xffffffff != *address;
+}
+
+
+int EPD_FLASH_IMAGE_Class::store(PROGMEM const uint8_t *image, uint8_t bytes_per_line, uint8_t lines) {
+	uint8_t line_buffer[MAXIMUM_BYTES_PER_LINE];
+	uint8_t coded[MAXIMUM_BYTES_PER_LINE];
+
+	if (this->image_count >= EPD_FLASH_IMAGE_MAXIMUM ||
+	    0 == bytes_per_line || bytes_per_line > MAXIMUM_BYTES_PER_LINE || 0 == lines) {
+		return -1;
+	}
+
+	// images are packed after the directory sector
+	uint32_t address = this->directory + EPD_FLASH_SECTOR_SIZE;
+	if (this->image_count > 0) {
+		uint16_t last_size;
+		uint8_t last_bytes_per_line;
+		uint8_t last_lines;
+		this->entry(this->image_count - 1, &address, &last_size, &last_bytes_per_line, &last_lines);
+		address += last_size;
+	}
+
+	// first pass only sizes the image so a full chip is not half written
+	uint32_t size = 2 * ((uint32_t)(lines) + 1);
+	for (uint8_t line = 0; line < lines; ++line) {
+		for (uint8_t i = 0; i < bytes_per_line; ++i) {
+			line_buffer[i] = pgm_read_byte_near(image + line * bytes_per_line + i);
+		}
+		size += encode_line(line_buffer, bytes_per_line, coded);
+	}
+	if (size > 0xffff || address + size > (uint32_t)(EPD_FLASH_SECTOR_COUNT) * EPD_FLASH_SECTOR_SIZE) {
+		return -1;
+	}
+
+	// the rest of a partly used sector is still erased
+	uint32_t erased_end = (address + EPD_FLASH_SECTOR_SIZE - 1) & ~(uint32_t)(EPD_FLASH_SECTOR_SIZE - 1);
+	uint16_t offset = 2 * (lines + 1);
+	erase_to(&erased_end, address + offset);
+
+	for (uint8_t line = 0; line <= lines; ++line) {
+		uint8_t entry[2] = {(uint8_t)offset, (uint8_t)(offset >> 8)};
+		EPD_FLASH.write_pages(address + 2 * line, entry, sizeof(entry), false);
+		if (line == lines) {
+			break;
+		}
+		for (uint8_t i = 0; i < bytes_per_line; ++i) {
+			line_buffer[i] = pgm_read_byte_near(image + line * bytes_per_line + i);
+		}
+		uint8_t length = encode_line(line_buffer, bytes_per_line, coded);
+		erase_to(&erased_end, address + offset + length);
+		EPD_FLASH.write_pages(address + offset, length == bytes_per_line ? line_buffer : coded, length, false);
+		offset += length;
+	}
+
+	uint8_t entry[ENTRY_SIZE] = {
+		(uint8_t)address, (uint8_t)(address >> 8), (uint8_t)(address >> 16), (uint8_t)(address >> 24),
+		(uint8_t)offset, (uint8_t)(offset >> 8),
+		bytes_per_line, lines
+	};
+	EPD_FLASH.write_pages(this->directory + HEADER_SIZE + (uint32_t)(this->image_count) * ENTRY_SIZE, entry, sizeof(entry), false);
+	EPD_FLASH.write_disable();
+
+	this->image_index = NO_IMAGE;  // it may have been read as missing
+	return this->image_count++;
+}
+
+
+// get the start and end offsets of a line of the current image
+// offsets are read a few at a time since lines are mostly read in order
+bool EPD_FLASH_IMAGE_Class::line_offsets(uint8_t line, uint16_t *start, uint16_t *end) {
+	if (0 == this->offset_count || line < this->offset_first ||
+	    line + 1 >= this->offset_first + this->offset_count) {
+		uint8_t n = sizeof(this->offsets) / sizeof(this->offsets[0]);
+		if (n > this->image_lines + 1 - line) {
+			n = this->image_lines + 1 - line;
+		}
+		uint8_t *bytes = (uint8_t *)this->offsets;
+		EPD_FLASH.read(bytes, this->image_address + 2 * line, 2 * n);
+		for (uint8_t i = 0; i < n; ++i) {
+			this->offsets[i] = bytes[2 * i] | (bytes[2 * i + 1] << 8);
+		}
+		this->offset_first = line;
+		this->offset_count = n;
+	}
+	*start = this->offsets[line - this->offset_first];
+	*end = this->offsets[line + 1 - this->offset_first];
+	return *start <= *end;
+}
+
+
+// length may cover several lines (frame_cb_prefetch*)
+void EPD_FLASH_IMAGE_Class::read(void *buffer, uint32_t address, uint16_t length) {
+	uint8_t *p = (uint8_t *)buffer;
+	uint16_t index = address >> 16;
+
+	if (index != this->image_index) {
+		uint16_t size;
+		this->image_index = index;
+		this->offset_count = 0;
+		if (index >= this->image_count ||
+		    !this->entry(index, &this->image_address, &size, &this->image_bytes_per_line, &this->image_lines)) {
+			this->image_lines = 0;
+		}
+	}
+
+	if (0 == this->image_lines || 0 != length % this->image_bytes_per_line) {
+		memset(p, 0, length);  // missing image is white
+		return;
+	}
+	uint16_t line = (address & 0xffff) / this->image_bytes_per_line;
+	for (; length > 0; length -= this->image_bytes_per_line) {
+		this->read_line(p, line++);
+		p += this->image_bytes_per_line;
+	}
+}
+
+
+void EPD_FLASH_IMAGE_Class::read_line(uint8_t *p, uint16_t line) {
+	const uint16_t length = this->image_bytes_per_line;
+	uint16_t start;
+	uint16_t end;
+	if (line >= this->image_lines || !this->line_offsets(line, &start, &end)) {
+		memset(p, 0, length);  // missing line is white
+		return;
+	}
+
+	uint16_t coded_length = end - start;
+	if (coded_length == length) {
+		EPD_FLASH.read(p, this->image_address + start, length);
+		return;
+	}
+
+	// decode a chunk of the coded line at a time
+	uint8_t chunk[16];
+	uint8_t chunk_length = 0;
+	uint8_t chunk_index = 0;
+	uint32_t coded_address = this->image_address + start;
+	uint16_t count = 0;      // bytes left in the current run, 0 => control byte next
+	bool repeat = false;
+	uint16_t n = 0;
+
+	while (n < length && (coded_length > 0 || chunk_index < chunk_length)) {
+		if (chunk_index >= chunk_length) {
+			chunk_length = coded_length < sizeof(chunk) ? coded_length : sizeof(chunk);
+			EPD_FLASH.read(chunk, coded_address, chunk_length);
+			coded_address += chunk_length;
+			coded_length -= chunk_length;
+			chunk_index = 0;
+		}
+		uint8_t b = chunk[chunk_index++];
+		if (0 == count) {
+			if (b < 128) {
+				count = b + 1;
+				repeat = false;
+			} else if (b > 128) {
+				count = 257 - b;
+				repeat = true;
+			}
+		} else if (repeat) {
+			for (; count > 0 && n < length; --count) {
+				p[n++] = b;
+			}
+			count = 0;
+		} else {
+			p[n++] = b;
+			--count;
+		}
+	}
+	if (n < length) {
+		memset(p + n, 0, length - n);
+	}
+}
+
+
+void EPD_FLASH_IMAGE_reader(void *buffer, uint32_t address, uint16_t length) {
+	EPD_FLASH_IMAGE.read(buffer, address, length);
+}
+
+
+// erase sectors from erased_end until end is inside erased space
+static void erase_to(uint32_t *erased_end, uint32_t end) {
+	while (*erased_end < end) {
+		EPD_FLASH.write_enable();
+		EPD_FLASH.sector_erase(*erased_end);
+		*erased_end += EPD_FLASH_SECTOR_SIZE;
+	}
+}
+
+
+// PackBits code a line, returns length if coding would not be shorter
+// (coded is then unused and the line is stored raw)
+static uint8_t encode_line(const uint8_t *line, uint8_t length, uint8_t *coded) {
+	uint8_t n = 0;
+	uint8_t i = 0;
+	while (i < length) {
+		uint8_t run = 1;
+		while (i + run < length && run < 128 && line[i + run] == line[i]) {
+			++run;
+		}
+		if (run > 1) {
+			if (n + 2 >= length) {
+				return length;
+			}
+			coded[n++] = 257 - run;
+			coded[n++] = line[i];
+			i += run;
+			continue;
+		}
+		uint8_t j = i + 1;
+		while (j < length && j - i < 128 && !(j + 1 < length && line[j] == line[j + 1])) {
+			++j;
+		}
+		if (n + 1 + (j - i) >= length) {
+			return length;
+		}
+		coded[n++] = j - i - 1;
+		while (i < j) {
+			coded[n++] = line[i++];
+		}
+	}
+	return n;
+}
@@ -0,0 +1,105 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+#if !defined(EPD_FLASH_IMAGE_H)
+#define EPD_FLASH_IMAGE_H 1
+
+#if defined(ENERGIA)
+#include <Energia.h>
+#else
+#include <Arduino.h>
+#endif
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#else
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+#endif
+
+#include "EPD_FLASH.h"
+
+
+// compressed image store
+//
+// A directory sector holds an 8 byte header ("EPDI", version, zeros)
+// and then one 8 byte entry per image, unused entries are erased
+// (0xff).  Images are packed one after another from the sector
+// following the directory; each starts with a table of (lines + 1)
+// little endian 16 bit offsets of its lines from the image start, so
+// any line can be found.  A line as long as bytes_per_line is raw,
+// a shorter one is PackBits coded (control byte n of 0..127 is
+// followed by n + 1 literal bytes, 129..255 by one byte repeated
+// 257 - n times).  New images are only appended, format() erases the
+// directory to start again.
+
+#define EPD_FLASH_IMAGE_VERSION 1
+
+// maximum number of images in one directory
+#define EPD_FLASH_IMAGE_MAXIMUM ((EPD_FLASH_SECTOR_SIZE - 8) / 8)
+
+// address to give to frame_cb* with EPD_FLASH_IMAGE_reader to display
+// an image, the reader gets the line from the offset in the low bits
+#define EPD_FLASH_IMAGE_ADDRESS(index) ((uint32_t)(index) << 16)
+
+
+class EPD_FLASH_IMAGE_Class {
+private:
+	uint32_t directory;          // address of the directory sector
+	uint16_t image_count;
+
+	// the image being read and a few of its line offsets
+	uint16_t image_index;
+	uint32_t image_address;
+	uint8_t image_bytes_per_line;
+	uint8_t image_lines;
+	uint8_t offset_first;        // line of offsets[0]
+	uint8_t offset_count;        // 0 => none cached
+	uint16_t offsets[8];
+
+	bool entry(uint16_t index, uint32_t *address, uint16_t *size, uint8_t *bytes_per_line, uint8_t *lines);
+	bool line_offsets(uint8_t line, uint16_t *start, uint16_t *end);
+	void read_line(uint8_t *p, uint16_t line);
+	EPD_FLASH_IMAGE_Class(const EPD_FLASH_IMAGE_Class &f);  // prevent copy
+
+public:
+	// use the directory in sector, returns false (and count() == 0)
+	// if it is not formatted
+	bool begin(uint16_t sector);
+
+	// erase the directory so images are stored from the next sector again
+	void format(uint16_t sector);
+
+	// number of stored images
+	uint16_t count(void) const {
+		return this->image_count;
+	}
+
+	// compress and append an image, returns its index or -1 if the
+	// chip or directory is full
+	int store(PROGMEM const uint8_t *image, uint8_t bytes_per_line, uint8_t lines);
+
+	// EPD_reader for frame_cb*: decode one or more lines of an image
+	void read(void *buffer, uint32_t address, uint16_t length);
+
+	EPD_FLASH_IMAGE_Class(void);
+};
+
+extern EPD_FLASH_IMAGE_Class EPD_FLASH_IMAGE;
+
+// EPD_reader callback: EPD.frame_cb(EPD_FLASH_IMAGE_ADDRESS(n), EPD_FLASH_IMAGE_reader, stage)
+void EPD_FLASH_IMAGE_reader(void *buffer, uint32_t address, uint16_t length);
+
+#endif
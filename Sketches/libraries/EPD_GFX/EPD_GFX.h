@@ -21,6 +21,37 @@
 #include <Adafruit_GFX.h>
 
 
+// Banded mode (the default without EPD_ENABLE_EXTRA_SRAM)
+//
+// No frame buffer is kept, instead the sketch passes a draw function
+// to display() and it is called to redraw the whole scene into a strip
+// of EPD_GFX_BAND_LINES lines whenever the panel driver reads a line
+// outside the current strip; pixels outside the strip are dropped.
+// The driver reads the image through frame_cb-style callbacks so the
+// scene is redrawn once per band for every frame, the draw function
+// must therefore give the same pixels every time it is called for the
+// same scene.  The old image (for the compensate/white stages) is
+// either redrawn from the previous scene or read from an EPD_reader
+// (e.g. an image in EPD_FLASH).
+#if !defined(EPD_GFX_BANDED)
+#if defined(EPD_ENABLE_EXTRA_SRAM)
+#define EPD_GFX_BANDED 0
+#else
+#define EPD_GFX_BANDED 1
+#endif
+#endif
+
+#if !defined(EPD_GFX_BAND_LINES)
+#define EPD_GFX_BAND_LINES 8
+#endif
+
+
+class EPD_GFX;
+
+// draw a whole scene, scene is the pointer given to display()
+typedef void EPD_GFX_draw(EPD_GFX &gfx, const void *scene);
+
+
 class EPD_GFX : public Adafruit_GFX {
 
 private:
@@ -32,11 +63,71 @@ private:
 	static const int pixel_width = EPD_PIXEL_WIDTH;  // must be a multiple of 8
 	static const int pixel_height = EPD_PIXEL_HEIGHT;
 
+#if EPD_GFX_BANDED
+	static const int band_lines = EPD_GFX_BAND_LINES;
+
+	uint8_t band[(pixel_width / 8) * band_lines];
+	int16_t band_first;          // first line in band, < 0 => nothing drawn
+	EPD_GFX_draw *band_draw;     // the scene being sent
+	const void *band_scene;
+
+	// the display() being run, for band_reader
+	static EPD_GFX *&active(void) {
+		static EPD_GFX *gfx;
+		return gfx;
+	}
+
+	void band_select(EPD_GFX_draw *draw, const void *scene) {
+		this->band_draw = draw;
+		this->band_scene = scene;
+		this->band_first = -1;
+	}
+
+	// EPD_reader: address is the byte offset of the line(s) in the image
+	static void band_reader(void *buffer, uint32_t address, uint16_t length) {
+		EPD_GFX *gfx = active();
+		const uint16_t bytes_per_line = pixel_width / 8;
+		uint8_t *p = (uint8_t *)buffer;
+		for (int16_t line = address / bytes_per_line; length >= bytes_per_line; ++line) {
+			if (gfx->band_first < 0 || line < gfx->band_first || line >= gfx->band_first + band_lines) {
+				memset(gfx->band, 0, sizeof(gfx->band));
+				gfx->band_first = line - line % band_lines;
+				gfx->band_draw(*gfx, gfx->band_scene);
+			}
+			memcpy(p, &gfx->band[(line - gfx->band_first) * bytes_per_line], bytes_per_line);
+			p += bytes_per_line;
+			length -= bytes_per_line;
+		}
+	}
+
+	// clip y to the current band, returns false if nothing is left
+	bool band_clip(int16_t &y, int16_t &h) const {
+		if (y < this->band_first) {
+			h -= this->band_first - y;
+			y = this->band_first;
+		}
+		if (y + h > this->band_first + band_lines) {
+			h = this->band_first + band_lines - y;
+		}
+		return h > 0;
+	}
+#else
+
 #if EPD_IMAGE_TWO_ARG
 	uint8_t old_image[(uint32_t)(pixel_width) * (uint32_t)(pixel_height) / 8];
 #endif
 	uint8_t new_image[(uint32_t)(pixel_width) * (uint32_t)(pixel_height) / 8];
 
+	// lines changed since the last display: dirty_first to dirty_end - 1
+	int16_t dirty_first;
+	int16_t dirty_end;
+
+	void dirty_clear(void) {
+		this->dirty_first = pixel_height;
+		this->dirty_end = 0;
+	}
+#endif
+
 	EPD_GFX(EPD_Class&);  // disable copy constructor
 
 public:
@@ -50,6 +141,11 @@ public:
 	EPD_GFX(EPD_Class &epd, S5813A_Class &s5813a) :
 	Adafruit_GFX(this->pixel_width, this->pixel_height),
 		EPD(epd), S5813A(s5813a) {
+#if EPD_GFX_BANDED
+		this->band_select(NULL, NULL);
+#else
+		this->dirty_clear();
+#endif
 	}
 
 	void begin(void) {
@@ -61,16 +157,116 @@ public:
 		this->EPD.clear();
 		this->EPD.end();
 
+#if EPD_GFX_BANDED
+		this->band_select(NULL, NULL);
+#else
 		// clear buffers to white
 #if EPD_IMAGE_TWO_ARG
 		memset(this->old_image, 0, sizeof(this->old_image));
 #endif
 		memset(this->new_image, 0, sizeof(this->new_image));
+		this->dirty_clear();
+#endif
 	}
 
 	void end(void){
 	}
 
+#if EPD_GFX_BANDED
+
+	// set a single pixel in the current band
+	void drawPixel(int16_t x, int16_t y, uint16_t colour) {
+		if (x < 0 || x >= this->pixel_width || y < this->band_first || y >= this->band_first + band_lines) {
+			return; // outside the band
+		}
+		int bit = x & 0x07;
+		int byte = x / 8 + (y - this->band_first) * (pixel_width / 8);
+		int mask = 0x01 << bit;
+		if (BLACK == colour) {
+			this->band[byte] |= mask;
+		} else {
+			this->band[byte] &= ~mask;
+		}
+	}
+
+	// skip the parts of lines and fills outside the band
+	// since the whole scene is drawn once per band
+	void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t colour) {
+		if (y >= this->band_first && y < this->band_first + band_lines) {
+			Adafruit_GFX::drawFastHLine(x, y, w, colour);
+		}
+	}
+
+	void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t colour) {
+		if (this->band_clip(y, h)) {
+			Adafruit_GFX::drawFastVLine(x, y, h, colour);
+		}
+	}
+
+	void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t colour) {
+		if (this->band_clip(y, h)) {
+			Adafruit_GFX::fillRect(x, y, w, h, colour);
+		}
+	}
+
+	// refresh the display: change from the old scene to the new one
+	// old_scene == NULL => the panel is white (e.g. after begin())
+	void display(EPD_GFX_draw *draw, const void *scene, const void *old_scene) {
+
+		int temperature = this->S5813A.read();
+
+		active() = this;
+
+		// erase old, display new
+		this->EPD.begin();
+		this->EPD.setFactor(temperature);
+
+#if EPD_IMAGE_ONE_ARG
+		(void)old_scene;
+		this->band_select(draw, scene);
+		this->EPD.frame_cb_13(0, band_reader, EPD_inverse);
+		this->EPD.frame_stage2();
+		this->EPD.frame_cb_13(0, band_reader, EPD_normal);
+#elif EPD_IMAGE_TWO_ARG
+		if (NULL == old_scene) {
+			this->EPD.frame_fixed_repeat(0xaa, EPD_compensate);
+			this->EPD.frame_fixed_repeat(0xaa, EPD_white);
+		} else {
+			this->band_select(draw, old_scene);
+			this->EPD.frame_cb_repeat(0, band_reader, EPD_compensate);
+			this->EPD.frame_cb_repeat(0, band_reader, EPD_white);
+		}
+		this->band_select(draw, scene);
+		this->EPD.frame_cb_repeat(0, band_reader, EPD_inverse);
+		this->EPD.frame_cb_repeat(0, band_reader, EPD_normal);
+#else
+#error "unsupported image function"
+#endif
+		this->EPD.end();
+	}
+
+#if EPD_IMAGE_TWO_ARG
+	// as above but the old image is read from old_address by old_reader
+	void display(EPD_GFX_draw *draw, const void *scene, EPD_reader *old_reader, uint32_t old_address) {
+
+		int temperature = this->S5813A.read();
+
+		active() = this;
+
+		// erase old, display new
+		this->EPD.begin();
+		this->EPD.setFactor(temperature);
+		this->EPD.frame_cb_repeat(old_address, old_reader, EPD_compensate);
+		this->EPD.frame_cb_repeat(old_address, old_reader, EPD_white);
+		this->band_select(draw, scene);
+		this->EPD.frame_cb_repeat(0, band_reader, EPD_inverse);
+		this->EPD.frame_cb_repeat(0, band_reader, EPD_normal);
+		this->EPD.end();
+	}
+#endif
+
+#else
+
 	// set a single pixel in new_image
 	void drawPixel(int16_t x, int16_t y, uint16_t colour) {
 		if (x < 0 || x >= this->pixel_width || y < 0 || y >= this->pixel_height) {
@@ -79,13 +275,55 @@ public:
 		int bit = x & 0x07;
 		int byte = x / 8 + y * (pixel_width / 8);
 		int mask = 0x01 << bit;
+		uint8_t value = this->new_image[byte];
 		if (BLACK == colour) {
-			this->new_image[byte] |= mask;
+			value |= mask;
 		} else {
-			this->new_image[byte] &= ~mask;
+			value &= ~mask;
+		}
+		if (value != this->new_image[byte]) {
+			this->new_image[byte] = value;
+			if (y < this->dirty_first) {
+				this->dirty_first = y;
+			}
+			if (y >= this->dirty_end) {
+				this->dirty_end = y + 1;
+			}
 		}
 	}
 
+	// true if anything was drawn since the last display
+	bool dirty(void) const {
+		return this->dirty_first < this->dirty_end;
+	}
+
+	// refresh only the changed lines with a single partial update
+	// stage, much faster but the panel can ghost so call display()
+	// now and then; drivers without partial update run display()
+	void displayPartial(void) {
+#if EPD_PARTIAL_AVAILABLE && EPD_IMAGE_TWO_ARG && defined(EPD_ENABLE_EXTRA_SRAM)
+		if (!this->dirty()) {
+			return;
+		}
+
+		int temperature = this->S5813A.read();
+
+		this->EPD.begin();
+		this->EPD.setFactor(temperature);
+		this->EPD.partial_sram(this->old_image, this->new_image, this->dirty_first, this->dirty_end);
+		this->EPD.end();
+
+		// copy the changed lines of new over to old
+		const uint16_t bytes_per_line = pixel_width / 8;
+		memcpy(&this->old_image[this->dirty_first * bytes_per_line],
+		       &this->new_image[this->dirty_first * bytes_per_line],
+		       (this->dirty_end - this->dirty_first) * bytes_per_line);
+		this->dirty_clear();
+#else
+		this->display();
+#endif
+	}
+
 	// refresh the display: change from current image to new image
 	void display(void) {
 
@@ -98,7 +336,7 @@ public:
 #if defined(EPD_ENABLE_EXTRA_SRAM)
 
 #if EPD_IMAGE_ONE_ARG
-		this->EPD.image_sram(this->image);
+		this->EPD.image_sram(this->new_image);
 #elif EPD_IMAGE_TWO_ARG
 		this->EPD.image_sram(this->old_image, this->new_image);
 #else
@@ -114,7 +352,9 @@ public:
 		// copy new over to old
 		memcpy(this->old_image, this->new_image, sizeof(this->old_image));
 #endif
+		this->dirty_clear();
 	}
+#endif
 };
 
 
@@ -14,7 +14,7 @@
 // governing permissions and limitations under the License.
 
 
-// Notice: ***** Generated file: DO _NOT_ MODIFY, Created on: 2016-01-12 00:11:21 UTC *****
+// Notice: ***** Generated file: DO _NOT_ MODIFY, Created on: 2026-10-14 11:38:14 UTC *****
 
 
 // Simple demo with two functions:
@@ -36,6 +36,7 @@
 // required libraries
 #include <SPI.h>
 #include <EPD_FLASH.h>
+#include <EPD_FLASH_IMAGE.h>
 #include <EPD_V230_G2.h>
 #define SCREEN_SIZE 144
 #include <EPD_PANELS.h>
@@ -57,6 +58,15 @@
 // define a list of {sector, milliseconds}
 // #define DISPLAY_LIST {0, 5000}, {1, 5000}
 
+// store images compressed in an image directory instead of raw in
+// FLASH_SECTOR (see EPD_FLASH_IMAGE.h), many more images fit and fewer
+// bytes are read for each frame.  Each image is added once as number
+// FLASH_IMAGE_NUMBER (take the next free number for a new image) and
+// DISPLAY_LIST then gives {image number, milliseconds}
+// #define FLASH_IMAGES 1
+#define FLASH_DIRECTORY_SECTOR 0
+#define FLASH_IMAGE_NUMBER 0
+
 // no futher changed below this point
 
 // program version
@@ -108,6 +118,18 @@ static void flash_read(void *buffer, uint32_t address, uint16_t length);
 
 #if !defined(DISPLAY_LIST)
 static void flash_program(uint16_t sector, const void *buffer, uint16_t length);
+#if defined(FLASH_IMAGES)
+static void flash_store(uint16_t number, PROGMEM const void *buffer, uint8_t bytes_per_line, uint8_t lines);
+#endif
+#endif
+
+// address of an item in the display list and the matching reader
+#if defined(FLASH_IMAGES)
+#define FLASH_ADDRESS(item) EPD_FLASH_IMAGE_ADDRESS(item)
+#define FLASH_READER EPD_FLASH_IMAGE_reader
+#else
+#define FLASH_ADDRESS(item) ((uint32_t)(item) << EPD_FLASH_SECTOR_SHIFT)
+#define FLASH_READER flash_read
 #endif
 
 // define the E-Ink display
@@ -175,7 +197,17 @@ void setup() {
 	S5813A.begin(Pin_TEMPERATURE);
 
 	// if necessary program the flash
+#if defined(FLASH_IMAGES)
+	if (!EPD_FLASH_IMAGE.begin(FLASH_DIRECTORY_SECTOR)) {
+		Serial.println("FLASH: format image directory");
+		EPD_FLASH_IMAGE.format(FLASH_DIRECTORY_SECTOR);
+	}
+	Serial.print("FLASH: images = ");
+	Serial.println(EPD_FLASH_IMAGE.count(), DEC);
 #if !defined(DISPLAY_LIST)
+	flash_store(FLASH_IMAGE_NUMBER, IMAGE_BITS, EPD_PIXEL_WIDTH / 8, EPD_PIXEL_HEIGHT);
+#endif
+#elif !defined(DISPLAY_LIST)
 	flash_program(FLASH_SECTOR, IMAGE_BITS, sizeof(IMAGE_BITS));
 #endif
 }
@@ -191,6 +223,8 @@ typedef struct {
 static const display_list_type display_list = {
 #if defined(DISPLAY_LIST)
 	DISPLAY_LIST
+#elif defined(FLASH_IMAGES)
+	{FLASH_IMAGE_NUMBER, 5000}
 #else
 	{FLASH_SECTOR, 5000}
 #endif
@@ -234,8 +268,7 @@ void loop() {
 		break;
 
 	case 1:         // next image
-		uint32_t address = display_list[display_index].sector;
-		address <<= 12;
+		uint32_t address = FLASH_ADDRESS(display_list[display_index].sector);
 		delay_counts = display_list[display_index].delay_ms;
 
 		Serial.print("address[");
@@ -249,19 +282,19 @@ void loop() {
 #if EPD_IMAGE_ONE_ARG
 
 		// V230_G2
-		EPD.frame_cb_13(address, flash_read, EPD_inverse);
+		EPD.frame_cb_13(address, FLASH_READER, EPD_inverse);
 		EPD.frame_stage2();
-		EPD.frame_cb_13(address, flash_read, EPD_normal);
+		EPD.frame_cb_13(address, FLASH_READER, EPD_normal);
 
 #elif EPD_IMAGE_TWO_ARG
 
 		// V110_G1 and V231_G2
 		if (0xffffffff != old_address) {
-			EPD.frame_cb_repeat(old_address, flash_read, EPD_compensate);
-			EPD.frame_cb_repeat(old_address, flash_read, EPD_white);
+			EPD.frame_cb_repeat(old_address, FLASH_READER, EPD_compensate);
+			EPD.frame_cb_repeat(old_address, FLASH_READER, EPD_white);
 		}
-		EPD.frame_cb_repeat(address, flash_read, EPD_inverse);
-		EPD.frame_cb_repeat(address, flash_read, EPD_normal);
+		EPD.frame_cb_repeat(address, FLASH_READER, EPD_inverse);
+		EPD.frame_cb_repeat(address, FLASH_READER, EPD_normal);
 		// preserve address for next cycle
 		old_address = address;
 
@@ -355,3 +388,27 @@ static void flash_program(uint16_t sector, PROGMEM const void *buffer, uint16_t
 	EPD_FLASH.write_disable();
 }
 #endif
+
+
+#if !defined(DISPLAY_LIST) && defined(FLASH_IMAGES)
+// add image to the directory unless it is already there
+static void flash_store(uint16_t number, PROGMEM const void *buffer, uint8_t bytes_per_line, uint8_t lines) {
+	if (number < EPD_FLASH_IMAGE.count()) {
+		Serial.print("FLASH: image already stored = ");
+		Serial.println(number, DEC);
+		return;
+	}
+	if (number != EPD_FLASH_IMAGE.count()) {
+		Serial.print("FLASH: next free image number = ");
+		Serial.println(EPD_FLASH_IMAGE.count(), DEC);
+		return;
+	}
+	int n = EPD_FLASH_IMAGE.store((PROGMEM const uint8_t *)buffer, bytes_per_line, lines);
+	if (n < 0) {
+		Serial.println("FLASH: image store full");
+		return;
+	}
+	Serial.print("FLASH: stored image = ");
+	Serial.println(n, DEC);
+}
+#endif
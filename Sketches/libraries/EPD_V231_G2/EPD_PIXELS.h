@@ -0,0 +1,147 @@
+// Copyright 2013-2015 Pervasive Displays, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at:
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+// express or implied.  See the License for the specific language
+// governing permissions and limitations under the License.
+
+// G2 COG pixel stage encoding tables
+//
+// Each image byte is converted to the bytes sent to the COG by a
+// single table lookup instead of per-byte bit shuffling.  The tables
+// are built by the compiler from the same expressions the drivers
+// used, so no generated source needs to be kept in the repository.
+//
+// Note: keep this file identical in:
+//   PlatformWithOS/driver-common/epd_pixels.h
+//   Sketches/libraries/EPD_V231_G2/EPD_PIXELS.h
+
+#if !defined(EPD_PIXELS_H)
+#define EPD_PIXELS_H 1
+
+#include <stdint.h>
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#define EPD_PIXELS_STORAGE PROGMEM
+#define EPD_PIXELS_READ_8(table, index) pgm_read_byte_near(&(table)[index])
+#define EPD_PIXELS_READ_16(table, index) pgm_read_word_near(&(table)[index])
+#else
+#define EPD_PIXELS_STORAGE
+#define EPD_PIXELS_READ_8(table, index) ((table)[index])
+#define EPD_PIXELS_READ_16(table, index) ((table)[index])
+#endif
+
+
+// first index of the stage tables, same order as the V231 EPD_stage
+enum {
+	EPD_PIXELS_COMPENSATE,  // B -> W, W -> B (Current Image)
+	EPD_PIXELS_WHITE,       // B -> N, W -> W (Current Image)
+	EPD_PIXELS_INVERSE,     // B -> N, W -> B (New Image)
+	EPD_PIXELS_NORMAL,      // B -> B, W -> W (New Image)
+	EPD_PIXELS_STAGES
+};
+
+// value of an unchanged pixel pair in a partial update (nothing)
+#define EPD_PIXELS_NOTHING 0x55
+
+
+// expand a macro for the 256 values of a byte
+#define EPD_PIXELS_16_(fn, s, h)						\
+	fn(s, 0x##h##0), fn(s, 0x##h##1), fn(s, 0x##h##2), fn(s, 0x##h##3),	\
+	fn(s, 0x##h##4), fn(s, 0x##h##5), fn(s, 0x##h##6), fn(s, 0x##h##7),	\
+	fn(s, 0x##h##8), fn(s, 0x##h##9), fn(s, 0x##h##a), fn(s, 0x##h##b),	\
+	fn(s, 0x##h##c), fn(s, 0x##h##d), fn(s, 0x##h##e), fn(s, 0x##h##f)
+
+#define EPD_PIXELS_256_(fn, s)						\
+	EPD_PIXELS_16_(fn, s, 0), EPD_PIXELS_16_(fn, s, 1),		\
+	EPD_PIXELS_16_(fn, s, 2), EPD_PIXELS_16_(fn, s, 3),		\
+	EPD_PIXELS_16_(fn, s, 4), EPD_PIXELS_16_(fn, s, 5),		\
+	EPD_PIXELS_16_(fn, s, 6), EPD_PIXELS_16_(fn, s, 7),		\
+	EPD_PIXELS_16_(fn, s, 8), EPD_PIXELS_16_(fn, s, 9),		\
+	EPD_PIXELS_16_(fn, s, a), EPD_PIXELS_16_(fn, s, b),		\
+	EPD_PIXELS_16_(fn, s, c), EPD_PIXELS_16_(fn, s, d),		\
+	EPD_PIXELS_16_(fn, s, e), EPD_PIXELS_16_(fn, s, f)
+
+#define EPD_PIXELS_STAGES_(fn)						\
+	{ EPD_PIXELS_256_(fn, EPD_PIXELS_COMPENSATE) },			\
+	{ EPD_PIXELS_256_(fn, EPD_PIXELS_WHITE) },			\
+	{ EPD_PIXELS_256_(fn, EPD_PIXELS_INVERSE) },			\
+	{ EPD_PIXELS_256_(fn, EPD_PIXELS_NORMAL) }
+
+
+// middle scan, odd pixels: bits 0,2,4,...
+#define EPD_ODD_STAGE_(s, p)						\
+	(EPD_PIXELS_COMPENSATE == (s) ? 0xaa | ((p) ^ 0x55) :		\
+	 EPD_PIXELS_WHITE == (s)      ? 0x55 + ((p) ^ 0x55) :		\
+	 EPD_PIXELS_INVERSE == (s)    ? 0x55 | (((p) ^ 0x55) << 1) :	\
+	                                0xaa | (p))
+#define EPD_ODD_PIXEL_(s, b) ((uint8_t)EPD_ODD_STAGE_(s, (b) & 0x55))
+
+// middle scan, even pixels: bits 1,3,5,... sent in reverse pixel order
+#define EPD_EVEN_STAGE_(s, p)						\
+	(EPD_PIXELS_COMPENSATE == (s) ? 0xaa | (((p) ^ 0xaa) >> 1) :	\
+	 EPD_PIXELS_WHITE == (s)      ? 0x55 + (((p) ^ 0xaa) >> 1) :	\
+	 EPD_PIXELS_INVERSE == (s)    ? 0x55 | ((p) ^ 0xaa) :		\
+	                                0xaa | ((p) >> 1))
+#define EPD_REVERSE_PAIRS_(x)						\
+	((((x) >> 6) & 0x03) | ((((x) >> 4) & 0x03) << 2) |		\
+	 ((((x) >> 2) & 0x03) << 4) | (((x) & 0x03) << 6))
+#define EPD_EVEN_PIXEL_(s, b)						\
+	((uint8_t)EPD_REVERSE_PAIRS_((uint8_t)EPD_EVEN_STAGE_(s, (b) & 0xaa)))
+
+// scan-data-scan: all pixels, interleave bits: (byte)76543210 -> (16 bit).7.6.5.4.3.2.1
+#define EPD_INTERLEAVE_(b)						\
+	((((b) & 0x80) << 7) | (((b) & 0x40) << 6) |			\
+	 (((b) & 0x20) << 5) | (((b) & 0x10) << 4) |			\
+	 (((b) & 0x08) << 3) | (((b) & 0x04) << 2) |			\
+	 (((b) & 0x02) << 1) | (((b) & 0x01) << 0))
+#define EPD_ALL_STAGE_(s, p)						\
+	(EPD_PIXELS_COMPENSATE == (s) ? 0xaaaa | ((p) ^ 0x5555) :	\
+	 EPD_PIXELS_WHITE == (s)      ? 0x5555 + ((p) ^ 0x5555) :	\
+	 EPD_PIXELS_INVERSE == (s)    ? 0x5555 | (((p) ^ 0x5555) << 1) : \
+	                                0xaaaa | (p))
+#define EPD_ALL_PIXEL_(s, b) ((uint16_t)EPD_ALL_STAGE_(s, EPD_INTERLEAVE_(b)))
+
+// partial update masks indexed by (old ^ new), 1 bits => pixel changed
+#define EPD_ODD_MASK_(s, d) ((uint8_t)((((d) & 0x55) << 1) | ((d) & 0x55)))
+#define EPD_EVEN_MASK_(s, d)						\
+	((uint8_t)EPD_REVERSE_PAIRS_((uint8_t)(((d) & 0xaa) | (((d) & 0xaa) >> 1))))
+#define EPD_ALL_MASK_(s, d) ((uint16_t)((EPD_INTERLEAVE_(d) << 1) | EPD_INTERLEAVE_(d)))
+
+
+// stage tables: [stage][image byte] -> display byte(s)
+static const uint8_t EPD_odd_pixels[EPD_PIXELS_STAGES][256] EPD_PIXELS_STORAGE = {
+	EPD_PIXELS_STAGES_(EPD_ODD_PIXEL_)
+};
+
+static const uint8_t EPD_even_pixels[EPD_PIXELS_STAGES][256] EPD_PIXELS_STORAGE = {
+	EPD_PIXELS_STAGES_(EPD_EVEN_PIXEL_)
+};
+
+static const uint16_t EPD_all_pixels[EPD_PIXELS_STAGES][256] EPD_PIXELS_STORAGE = {
+	EPD_PIXELS_STAGES_(EPD_ALL_PIXEL_)
+};
+
+// partial update mask tables: [old ^ new] -> mask in display order
+// display = (stage_value & mask) | (~mask & EPD_PIXELS_NOTHING)
+static const uint8_t EPD_odd_mask[256] EPD_PIXELS_STORAGE = {
+	EPD_PIXELS_256_(EPD_ODD_MASK_, 0)
+};
+
+static const uint8_t EPD_even_mask[256] EPD_PIXELS_STORAGE = {
+	EPD_PIXELS_256_(EPD_EVEN_MASK_, 0)
+};
+
+static const uint16_t EPD_all_mask[256] EPD_PIXELS_STORAGE = {
+	EPD_PIXELS_256_(EPD_ALL_MASK_, 0)
+};
+
+#endif
@@ -19,10 +19,12 @@
 #endif
 
 #include <limits.h>
+#include <string.h>
 
 #include <SPI.h>
 
 #include "EPD_V231_G2.h"
+#include "EPD_PIXELS.h"
 
 // delays - more consistent naming
 #define Delay_ms(ms) delay(ms)
@@ -40,8 +42,12 @@
 static void SPI_on(void);
 static void SPI_off(void);
 static void SPI_put(uint8_t c);
+static void SPI_put_buffer(uint8_t *buffer, uint16_t length);
 static void SPI_send(uint8_t cs_pin, const uint8_t *buffer, uint16_t length);
 static uint8_t SPI_read(uint8_t cs_pin, const uint8_t *buffer, uint16_t length);
+static uint8_t *encode_line_runtime(const EPD_Class *epd, uint8_t *buffer, uint16_t line,
+				    const uint8_t *data, uint8_t fixed_value, bool read_progmem,
+				    EPD_stage stage, const uint8_t *mask);
 
 
 EPD_Class::EPD_Class(EPD_size _size,
@@ -57,83 +63,90 @@ EPD_Class::EPD_Class(EPD_size _size,
 	EPD_Pin_RESET(reset_pin),
 	EPD_Pin_BUSY(busy_pin),
 	EPD_Pin_EPD_CS(chip_select_pin),
-	size(_size) {
+	size(_size),
+	encoder(encode_line_runtime) {
 
-	this->base_stage_time = 480; // milliseconds
-	this->lines_per_display = 96;
-	this->dots_per_line = 128;
-	this->bytes_per_line = 128 / 8;
-	this->bytes_per_scan = 96 / 4;
+	this->setup();
+}
 
-	this->middle_scan = true; // => data-scan-data ELSE: scan-data-scan
-	this->pre_border_byte = false;
-	this->border_byte = EPD_BORDER_BYTE_ZERO;
 
-	// display size dependant items
-	{
-		static uint8_t cs[] = {0x72, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0f, 0xff, 0x00};
-		this->channel_select = cs;
-		this->channel_select_length = sizeof(cs);
-	}
+EPD_Class::EPD_Class(EPD_size _size,
+		     uint8_t panel_on_pin,
+		     uint8_t border_pin,
+		     uint8_t discharge_pin,
+		     uint8_t reset_pin,
+		     uint8_t busy_pin,
+		     uint8_t chip_select_pin,
+		     EPD_line_encoder *_encoder) :
+	EPD_Pin_PANEL_ON(panel_on_pin),
+	EPD_Pin_BORDER(border_pin),
+	EPD_Pin_DISCHARGE(discharge_pin),
+	EPD_Pin_RESET(reset_pin),
+	EPD_Pin_BUSY(busy_pin),
+	EPD_Pin_EPD_CS(chip_select_pin),
+	size(_size),
+	encoder(_encoder) {
+
+	this->setup();
+}
+
+
+template<EPD_size S>
+void EPD_Class::set_geometry(void) {
+	typedef EPD_geometry<S> G;
+	this->base_stage_time = G::BASE_STAGE_TIME; // milliseconds
+	this->lines_per_display = G::LINES_PER_DISPLAY;
+	this->dots_per_line = G::DOTS_PER_LINE;
+	this->bytes_per_line = G::BYTES_PER_LINE;
+	this->bytes_per_scan = G::BYTES_PER_SCAN;
+	this->middle_scan = G::MIDDLE_SCAN;
+	this->pre_border_byte = G::PRE_BORDER_BYTE;
+	this->border_byte = (EPD_border_byte)G::BORDER_BYTE;
+}
+
+
+void EPD_Class::setup(void) {
 
 	// set up size structure
 	switch (size) {
 	default:
-	case EPD_1_44:  // default so no change
+	case EPD_1_44: {
+		this->set_geometry<EPD_1_44>();
+		static uint8_t cs[] = {0x72, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0f, 0xff, 0x00};
+		this->channel_select = cs;
+		this->channel_select_length = sizeof(cs);
 		break;
+	}
 
 	case EPD_1_9: {
-		this->lines_per_display = 128;
-		this->bytes_per_line = 144 / 8;
-		this->middle_scan = false;
-		this->bytes_per_scan = 128 / 4 / 2; // scan/2 - data - scan/2
+		this->set_geometry<EPD_1_9>();
 		static uint8_t cs[] = {0x72, 0x00, 0x00, 0x00, 0x03, 0xfc, 0x00, 0x00, 0xff};
 		this->channel_select = cs;
 		this->channel_select_length = sizeof(cs);
-		this->pre_border_byte = false;
-		this->border_byte = EPD_BORDER_BYTE_SET;
 		break;
 	}
 
 	case EPD_2_0: {
-		this->lines_per_display = 96;
-		this->dots_per_line = 200;
-		this->bytes_per_line = 200 / 8;
-		this->bytes_per_scan = 96 / 4;
+		this->set_geometry<EPD_2_0>();
 		static uint8_t cs[] = {0x72, 0x00, 0x00, 0x00, 0x00, 0x01, 0xff, 0xe0, 0x00};
 		this->channel_select = cs;
 		this->channel_select_length = sizeof(cs);
-		this->pre_border_byte = true;
-		this->border_byte = EPD_BORDER_BYTE_NONE;
 		break;
 	}
 
 	case EPD_2_6: {
-		this->base_stage_time = 630; // milliseconds
-		this->lines_per_display = 128;
-		this->dots_per_line = 232;
-		this->bytes_per_line = 232 / 8;
-		this->middle_scan = false;
-		this->bytes_per_scan = 128 / 4 / 2; // scan/2 - data - scan/2
+		this->set_geometry<EPD_2_6>();
 		static uint8_t cs[] = {0x72, 0x00, 0x00, 0x1f, 0xe0, 0x00, 0x00, 0x00, 0xff};
 		this->channel_select = cs;
 		this->channel_select_length = sizeof(cs);
-		this->pre_border_byte = false;
-		this->border_byte = EPD_BORDER_BYTE_SET;
 		break;
 	}
 
 	case EPD_2_7: {
-		this->base_stage_time = 630; // milliseconds
-		this->lines_per_display = 176;
-		this->dots_per_line = 264;
-		this->bytes_per_line = 264 / 8;
-		this->bytes_per_scan = 176 / 4;
+		this->set_geometry<EPD_2_7>();
 		static uint8_t cs[] = {0x72, 0x00, 0x00, 0x00, 0x7f, 0xff, 0xfe, 0x00, 0x00};
 		this->channel_select = cs;
 		this->channel_select_length = sizeof(cs);
-		this->pre_border_byte = true;
-		this->border_byte = EPD_BORDER_BYTE_NONE;
 		break;
 	}
 	}
@@ -382,25 +395,34 @@ int EPD_Class::temperature_to_factor_10x(int temperature) const {
 // the image is arranged by line which matches the display size
 // so smallest would have 96 * 32 bytes
 
+// SPI stays on for the whole frame except in frame_cb* where the reader
+// may use the SPI bus between lines (e.g. EPD_FLASH)
+
 void EPD_Class::frame_fixed(uint8_t fixed_value, EPD_stage stage) {
+	SPI_on();
 	for (uint8_t line = 0; line < this->lines_per_display ; ++line) {
-		this->line(line, 0, fixed_value, false, stage);
+		this->send_line(line, 0, fixed_value, false, stage);
 	}
+	SPI_off();
 }
 
 
 void EPD_Class::frame_data(PROGMEM const uint8_t *image, EPD_stage stage){
+	SPI_on();
 	for (uint8_t line = 0; line < this->lines_per_display ; ++line) {
-		this->line(line, &image[line * this->bytes_per_line], 0, true, stage);
+		this->send_line(line, &image[line * this->bytes_per_line], 0, true, stage);
 	}
+	SPI_off();
 }
 
 
 #if defined(EPD_ENABLE_EXTRA_SRAM)
 void EPD_Class::frame_sram(const uint8_t *image, EPD_stage stage){
+	SPI_on();
 	for (uint8_t line = 0; line < this->lines_per_display ; ++line) {
-		this->line(line, &image[line * this->bytes_per_line], 0, false, stage);
+		this->send_line(line, &image[line * this->bytes_per_line], 0, false, stage);
 	}
+	SPI_off();
 }
 #endif
 
@@ -414,6 +436,25 @@ void EPD_Class::frame_cb(uint32_t address, EPD_reader *reader, EPD_stage stage)
 }
 
 
+// one read per group of lines: a single flash command (or file seek)
+// then the lines are sent back to back with SPI on
+void EPD_Class::frame_cb_prefetch(uint32_t address, EPD_reader *reader, EPD_stage stage) {
+	static uint8_t buffer[EPD_PREFETCH_LINES * (264 / 8)];
+	for (uint8_t line = 0; line < this->lines_per_display ; line += EPD_PREFETCH_LINES) {
+		uint8_t count = EPD_PREFETCH_LINES;
+		if (count > this->lines_per_display - line) {
+			count = this->lines_per_display - line;
+		}
+		reader(buffer, address + line * this->bytes_per_line, count * this->bytes_per_line);
+		SPI_on();
+		for (uint8_t i = 0; i < count; ++i) {
+			this->send_line(line + i, &buffer[i * this->bytes_per_line], 0, false, stage);
+		}
+		SPI_off();
+	}
+}
+
+
 void EPD_Class::frame_fixed_repeat(uint8_t fixed_value, EPD_stage stage) {
 	long stage_time = this->factored_stage_time;
 	do {
@@ -458,6 +499,45 @@ void EPD_Class::frame_sram_repeat(const uint8_t *image, EPD_stage stage) {
 		}
 	} while (stage_time > 0);
 }
+
+
+// Only need last stage for partial update
+// Lines without any changed pixels would only send "nothing" so they
+// are skipped, giving more frames to the changed lines
+bool EPD_Class::frame_partial(const uint8_t *old_image, const uint8_t *new_image, uint16_t first_line, uint16_t end_line) {
+	bool changed = false;
+	if (end_line > this->lines_per_display) {
+		end_line = this->lines_per_display;
+	}
+	SPI_on();
+	for (uint16_t line = first_line; line < end_line ; ++line) {
+		uint16_t n = line * this->bytes_per_line;
+		if (0 == memcmp(&old_image[n], &new_image[n], this->bytes_per_line)) {
+			continue;
+		}
+		this->send_line(line, &new_image[n], 0, false, EPD_normal, &old_image[n]);
+		changed = true;
+	}
+	SPI_off();
+	return changed;
+}
+
+
+void EPD_Class::frame_partial_repeat(const uint8_t *old_image, const uint8_t *new_image, uint16_t first_line, uint16_t end_line) {
+	long stage_time = this->factored_stage_time;
+	do {
+		unsigned long t_start = millis();
+		if (!this->frame_partial(old_image, new_image, first_line, end_line)) {
+			break;
+		}
+		unsigned long t_end = millis();
+		if (t_end > t_start) {
+			stage_time -= t_end - t_start;
+		} else {
+			stage_time -= t_start - t_end + 1 + ULONG_MAX;
+		}
+	} while (stage_time > 0);
+}
 #endif
 
 
@@ -476,236 +556,290 @@ void EPD_Class::frame_cb_repeat(uint32_t address, EPD_reader *reader, EPD_stage
 }
 
 
-// pixels on display are numbered from 1 so even is actually bits 1,3,5,...
-void EPD_Class::even_pixels(const uint8_t *data, uint8_t fixed_value, bool read_progmem, EPD_stage stage) {
-	for (uint16_t b = 0; b < this->bytes_per_line; ++b) {
-		if (0 != data) {
-#if !defined(__AVR__)
-			uint8_t pixels = data[b] & 0xaa;
-#else
-			// AVR has multiple memory spaces
-			uint8_t pixels;
-			if (read_progmem) {
-				pixels = pgm_read_byte_near(data + b) & 0xaa;
-			} else {
-				pixels = data[b] & 0xaa;
-			}
-#endif
-			switch(stage) {
-			case EPD_compensate:  // B -> W, W -> B (Current Image)
-				pixels = 0xaa | ((pixels ^ 0xaa) >> 1);
-				break;
-			case EPD_white:       // B -> N, W -> W (Current Image)
-				pixels = 0x55 + ((pixels ^ 0xaa) >> 1);
-				break;
-			case EPD_inverse:     // B -> N, W -> B (New Image)
-				pixels = 0x55 | (pixels ^ 0xaa);
-				break;
-			case EPD_normal:       // B -> B, W -> W (New Image)
-				pixels = 0xaa | (pixels >> 1);
-				break;
-			}
-			uint8_t p1 = (pixels >> 6) & 0x03;
-			uint8_t p2 = (pixels >> 4) & 0x03;
-			uint8_t p3 = (pixels >> 2) & 0x03;
-			uint8_t p4 = (pixels >> 0) & 0x03;
-			pixels = (p1 << 0) | (p2 << 2) | (p3 << 4) | (p4 << 6);
-			SPI_put(pixels);
+void EPD_Class::frame_cb_prefetch_repeat(uint32_t address, EPD_reader *reader, EPD_stage stage) {
+	long stage_time = this->factored_stage_time;
+	do {
+		unsigned long t_start = millis();
+		this->frame_cb_prefetch(address, reader, stage);
+		unsigned long t_end = millis();
+		if (t_end > t_start) {
+			stage_time -= t_end - t_start;
 		} else {
-			SPI_put(fixed_value);
+			stage_time -= t_start - t_end + 1 + ULONG_MAX;
 		}
-	}
+	} while (stage_time > 0);
 }
 
-// pixels on display are numbered from 1 so odd is actually bits 0,2,4,...
-void EPD_Class::odd_pixels(const uint8_t *data, uint8_t fixed_value, bool read_progmem, EPD_stage stage) {
-	for (uint16_t b = this->bytes_per_line; b > 0; --b) {
-		if (0 != data) {
-#if !defined(__AVR__)
-			uint8_t pixels = data[b - 1] & 0x55;
-#else
-			// AVR has multiple memory spaces
-			uint8_t pixels;
-			if (read_progmem) {
-				pixels = pgm_read_byte_near(data + b- 1) & 0x55;
-			} else {
-				pixels = data[b - 1] & 0x55;
-			}
-#endif
-			switch(stage) {
-			case EPD_compensate:  // B -> W, W -> B (Current Image)
-				pixels = 0xaa | (pixels ^ 0x55);
-				break;
-			case EPD_white:       // B -> N, W -> W (Current Image)
-				pixels = 0x55 + (pixels ^ 0x55);
-				break;
-			case EPD_inverse:     // B -> N, W -> B (New Image)
-				pixels = 0x55 | ((pixels ^ 0x55) << 1);
-				break;
-			case EPD_normal:       // B -> B, W -> W (New Image)
-				pixels = 0xaa | pixels;
-				break;
-			}
-			SPI_put(pixels);
-		} else {
-			SPI_put(fixed_value);
+
+// geometry read from an EPD_Class at run time, with the same interface
+// as EPD_geometry<size> so the encoders below are written once
+struct EPD_runtime_geometry {
+	const EPD_Class &epd;
+	EPD_runtime_geometry(const EPD_Class &e) : epd(e) {
+	}
+	uint16_t bytes_per_line(void) const {
+		return this->epd.bytes_per_line;
+	}
+	uint16_t bytes_per_scan(void) const {
+		return this->epd.bytes_per_scan;
+	}
+	bool middle_scan(void) const {
+		return this->epd.middle_scan;
+	}
+	bool pre_border_byte(void) const {
+		return this->epd.pre_border_byte;
+	}
+	EPD_border_byte border_byte(void) const {
+		return this->epd.border_byte;
+	}
+};
+
+
+// the pixel functions encode into the line buffer and return the next
+// free byte, the image byte source is chosen once per line rather than
+// once per byte
+
+// pixels on display are numbered from 1 so even is actually bits 1,3,5,...
+template<class G>
+static uint8_t *encode_even_pixels(const G &g, uint8_t *p, const uint8_t *data, uint8_t fixed_value, bool read_progmem, EPD_stage stage, const uint8_t *mask) {
+	const uint8_t *pixels = EPD_even_pixels[stage];
+	if (0 == data) {
+		memset(p, fixed_value, g.bytes_per_line());
+		return p + g.bytes_per_line();
+	}
+	if (NULL != mask) {
+		for (uint16_t b = 0; b < g.bytes_per_line(); ++b) {
+			uint8_t pixel_mask = EPD_PIXELS_READ_8(EPD_even_mask, mask[b] ^ data[b]);
+			*p++ = (EPD_PIXELS_READ_8(pixels, data[b]) & pixel_mask) | (~pixel_mask & EPD_PIXELS_NOTHING);
+		}
+		return p;
+	}
+#if defined(__AVR__)
+	// AVR has multiple memory spaces
+	if (read_progmem) {
+		for (uint16_t b = 0; b < g.bytes_per_line(); ++b) {
+			*p++ = EPD_PIXELS_READ_8(pixels, pgm_read_byte_near(data + b));
 		}
+		return p;
+	}
+#endif
+	for (uint16_t b = 0; b < g.bytes_per_line(); ++b) {
+		*p++ = EPD_PIXELS_READ_8(pixels, data[b]);
 	}
+	return p;
 }
 
-// interleave bits: (byte)76543210 -> (16 bit).7.6.5.4.3.2.1
-static inline uint16_t interleave_bits(uint16_t value) {
-	value = (value | (value << 4)) & 0x0f0f;
-	value = (value | (value << 2)) & 0x3333;
-	value = (value | (value << 1)) & 0x5555;
-	return value;
+// pixels on display are numbered from 1 so odd is actually bits 0,2,4,...
+template<class G>
+static uint8_t *encode_odd_pixels(const G &g, uint8_t *p, const uint8_t *data, uint8_t fixed_value, bool read_progmem, EPD_stage stage, const uint8_t *mask) {
+	const uint8_t *pixels = EPD_odd_pixels[stage];
+	if (0 == data) {
+		memset(p, fixed_value, g.bytes_per_line());
+		return p + g.bytes_per_line();
+	}
+	if (NULL != mask) {
+		for (uint16_t b = g.bytes_per_line(); b > 0; --b) {
+			uint8_t pixel_mask = EPD_PIXELS_READ_8(EPD_odd_mask, mask[b - 1] ^ data[b - 1]);
+			*p++ = (EPD_PIXELS_READ_8(pixels, data[b - 1]) & pixel_mask) | (~pixel_mask & EPD_PIXELS_NOTHING);
+		}
+		return p;
+	}
+#if defined(__AVR__)
+	// AVR has multiple memory spaces
+	if (read_progmem) {
+		for (uint16_t b = g.bytes_per_line(); b > 0; --b) {
+			*p++ = EPD_PIXELS_READ_8(pixels, pgm_read_byte_near(data + b - 1));
+		}
+		return p;
+	}
+#endif
+	for (uint16_t b = g.bytes_per_line(); b > 0; --b) {
+		*p++ = EPD_PIXELS_READ_8(pixels, data[b - 1]);
+	}
+	return p;
 }
 
 // pixels on display are numbered from 1
-void EPD_Class::all_pixels(const uint8_t *data, uint8_t fixed_value, bool read_progmem, EPD_stage stage) {
-	for (uint16_t b = this->bytes_per_line; b > 0; --b) {
-		if (NULL != data) {
+template<class G>
+static uint8_t *encode_all_pixels(const G &g, uint8_t *p, const uint8_t *data, uint8_t fixed_value, bool read_progmem, EPD_stage stage, const uint8_t *mask) {
+	const uint16_t *pixels = EPD_all_pixels[stage];
+	if (NULL == data) {
+		memset(p, fixed_value, 2 * g.bytes_per_line());
+		return p + 2 * g.bytes_per_line();
+	}
+	if (NULL != mask) {
+		for (uint16_t b = g.bytes_per_line(); b > 0; --b) {
+			uint16_t pixel_mask = EPD_PIXELS_READ_16(EPD_all_mask, mask[b - 1] ^ data[b - 1]);
+			uint16_t value = (EPD_PIXELS_READ_16(pixels, data[b - 1]) & pixel_mask) | (~pixel_mask & (EPD_PIXELS_NOTHING * 0x0101));
+			*p++ = value >> 8;
+			*p++ = value;
+		}
+		return p;
+	}
+	for (uint16_t b = g.bytes_per_line(); b > 0; --b) {
 #if !defined(__AVR__)
-			uint8_t px = data[b - 1];
+		uint8_t px = data[b - 1];
 #else
-			// AVR has multiple memory spaces
-			uint8_t px;
-			if (read_progmem) {
-				px = pgm_read_byte_near(data + b - 1);
-			} else {
-				px = data[b - 1];
-			}
-#endif
-			uint16_t pixels = interleave_bits(px);
-			switch(stage) {
-			case EPD_compensate:  // B -> W, W -> B (Current Image)
-				pixels = 0xaaaa | (pixels ^ 0x5555);
-				break;
-			case EPD_white:       // B -> N, W -> W (Current Image)
-				pixels = 0x5555 + (pixels ^ 0x5555);
-				break;
-			case EPD_inverse:     // B -> N, W -> B (New Image)
-				pixels = 0x5555 | ((pixels ^ 0x5555) << 1);
-				break;
-			case EPD_normal:       // B -> B, W -> W (New Image)
-				pixels = 0xaaaa | pixels;
-				break;
-			}
-			SPI_put(pixels >> 8);
-			SPI_put(pixels);
+		// AVR has multiple memory spaces
+		uint8_t px;
+		if (read_progmem) {
+			px = pgm_read_byte_near(data + b - 1);
 		} else {
-			SPI_put(fixed_value);
-			SPI_put(fixed_value);
+			px = data[b - 1];
 		}
+#endif
+		uint16_t value = EPD_PIXELS_READ_16(pixels, px);
+		*p++ = value >> 8;
+		*p++ = value;
 	}
+	return p;
 }
 
 
-void EPD_Class::nothing_frame() {
-	for (int line = 0; line < this->lines_per_display; ++line) {
-		this->line(0x7fffu, 0, 0x00, false, EPD_compensate);
-	}
-}
-
-
-void EPD_Class::dummy_line() {
-	this->line(0x7fffu, 0, 0x00, false, EPD_compensate);
-}
-
-
-void EPD_Class::border_dummy_line() {
-	this->line(0x7fffu, 0, 0x00, false, EPD_normal);
-}
-
-
-// output one line of scan and data bytes to the display
-void EPD_Class::line(uint16_t line, const uint8_t *data, uint8_t fixed_value, bool read_progmem, EPD_stage stage) {
-
-	SPI_on();
-
-	// send data
-	Delay_us(10);
-	SPI_send(this->EPD_Pin_EPD_CS, CU8(0x70, 0x0a), 2);
-	Delay_us(10);
-
-	// CS low
-	digitalWrite(this->EPD_Pin_EPD_CS, LOW);
-	SPI_put(0x72);
+// one line as sent to the COG: 0x72, optional border byte, data and scan
+// bytes and the border byte
+template<class G>
+static uint8_t *encode_line(const G &g, uint8_t *p, uint16_t line, const uint8_t *data, uint8_t fixed_value, bool read_progmem, EPD_stage stage, const uint8_t *mask) {
+	*p++ = 0x72;
 
-	if (this->pre_border_byte) {
-		SPI_put(0x00);
+	if (g.pre_border_byte()) {
+		*p++ = 0x00;
 	}
 
-	if (this->middle_scan) {
+	if (g.middle_scan()) {
 		// data bytes
-		this->odd_pixels(data, fixed_value, read_progmem, stage);
+		p = encode_odd_pixels(g, p, data, fixed_value, read_progmem, stage, mask);
 
 		// scan line
-		for (uint16_t b = this->bytes_per_scan; b > 0; --b) {
-			uint8_t n = 0x00;
-			if (line / 4 == b - 1) {
-				n = 0x03 << (2 * (line & 0x03));
-			}
-			SPI_put(n);
+		memset(p, 0x00, g.bytes_per_scan());
+		if (line / 4 < g.bytes_per_scan()) {
+			p[g.bytes_per_scan() - 1 - line / 4] = 0x03 << (2 * (line & 0x03));
 		}
+		p += g.bytes_per_scan();
 
 		// data bytes
-		this->even_pixels(data, fixed_value, read_progmem, stage);
+		p = encode_even_pixels(g, p, data, fixed_value, read_progmem, stage, mask);
 
 	} else {
 		// even scan line, but as lines on display are numbered from 1, line: 1,3,5,...
-		for (uint16_t b = 0; b < this->bytes_per_scan; ++b) {
-			uint8_t n = 0x00;
-			if (0 != (line & 0x01) && line / 8 == b) {
-				n = 0xc0 >> (line & 0x06);
-			}
-			SPI_put(n);
+		memset(p, 0x00, g.bytes_per_scan());
+		if (0 != (line & 0x01) && line / 8 < g.bytes_per_scan()) {
+			p[line / 8] = 0xc0 >> (line & 0x06);
 		}
+		p += g.bytes_per_scan();
 
 		// data bytes
-		this->all_pixels(data, fixed_value, read_progmem, stage);
+		p = encode_all_pixels(g, p, data, fixed_value, read_progmem, stage, mask);
 
 		// odd scan line, but as lines on display are numbered from 1, line: 0,2,4,6,...
-		for (uint16_t b = this->bytes_per_scan; b > 0; --b) {
-			uint8_t n = 0x00;
-			if (0 == (line & 0x01) && line / 8 == b - 1) {
-				n = 0x03 << (line & 0x06);
-			}
-			SPI_put(n);
+		memset(p, 0x00, g.bytes_per_scan());
+		if (0 == (line & 0x01) && line / 8 < g.bytes_per_scan()) {
+			p[g.bytes_per_scan() - 1 - line / 8] = 0x03 << (line & 0x06);
 		}
+		p += g.bytes_per_scan();
 	}
 
 	// post data border byte
-	switch (this->border_byte) {
+	switch (g.border_byte()) {
 	case EPD_BORDER_BYTE_NONE:  // no border byte requred
 		break;
 
 	case EPD_BORDER_BYTE_ZERO:  // border byte == 0x00 requred
-		SPI_put(0x00);
+		*p++ = 0x00;
 		break;
 
 	case EPD_BORDER_BYTE_SET:   // border byte needs to be set
-		switch(stage) {
-		case EPD_compensate:
-		case EPD_white:
-		case EPD_inverse:
-			SPI_put(0x00);
-			break;
-		case EPD_normal:
-			SPI_put(0xaa);
-			break;
-		}
+		*p++ = EPD_normal == stage ? 0xaa : 0x00;
 		break;
 	}
+	return p;
+}
+
+
+static uint8_t *encode_line_runtime(const EPD_Class *epd, uint8_t *buffer, uint16_t line,
+				    const uint8_t *data, uint8_t fixed_value, bool read_progmem,
+				    EPD_stage stage, const uint8_t *mask) {
+	return encode_line(EPD_runtime_geometry(*epd), buffer, line, data, fixed_value, read_progmem, stage, mask);
+}
+
+
+template<EPD_size S>
+uint8_t *EPD_encode_line(const EPD_Class *epd, uint8_t *buffer, uint16_t line,
+			 const uint8_t *data, uint8_t fixed_value, bool read_progmem,
+			 EPD_stage stage, const uint8_t *mask) {
+	(void)epd;
+	return encode_line(EPD_geometry<S>(), buffer, line, data, fixed_value, read_progmem, stage, mask);
+}
+
+#define EPD_ENCODE_LINE_(size)						\
+	template uint8_t *EPD_encode_line<size>(const EPD_Class *epd, uint8_t *buffer, uint16_t line, \
+						const uint8_t *data, uint8_t fixed_value, bool read_progmem, \
+						EPD_stage stage, const uint8_t *mask)
+EPD_ENCODE_LINE_(EPD_1_44);
+EPD_ENCODE_LINE_(EPD_1_9);
+EPD_ENCODE_LINE_(EPD_2_0);
+EPD_ENCODE_LINE_(EPD_2_6);
+EPD_ENCODE_LINE_(EPD_2_7);
+
+
+uint8_t *EPD_Class::even_pixels(uint8_t *p, const uint8_t *data, uint8_t fixed_value, bool read_progmem, EPD_stage stage, const uint8_t *mask) {
+	return encode_even_pixels(EPD_runtime_geometry(*this), p, data, fixed_value, read_progmem, stage, mask);
+}
+
+uint8_t *EPD_Class::odd_pixels(uint8_t *p, const uint8_t *data, uint8_t fixed_value, bool read_progmem, EPD_stage stage, const uint8_t *mask) {
+	return encode_odd_pixels(EPD_runtime_geometry(*this), p, data, fixed_value, read_progmem, stage, mask);
+}
+
+uint8_t *EPD_Class::all_pixels(uint8_t *p, const uint8_t *data, uint8_t fixed_value, bool read_progmem, EPD_stage stage, const uint8_t *mask) {
+	return encode_all_pixels(EPD_runtime_geometry(*this), p, data, fixed_value, read_progmem, stage, mask);
+}
+
+void EPD_Class::nothing_frame() {
+	SPI_on();
+	for (int line = 0; line < this->lines_per_display; ++line) {
+		this->send_line(0x7fffu, 0, 0x00, false, EPD_compensate);
+	}
+	SPI_off();
+}
+
+
+void EPD_Class::dummy_line() {
+	this->line(0x7fffu, 0, 0x00, false, EPD_compensate);
+}
+
+
+void EPD_Class::border_dummy_line() {
+	this->line(0x7fffu, 0, 0x00, false, EPD_normal);
+}
+
+
+// output one line of scan and data bytes to the display
+void EPD_Class::line(uint16_t line, const uint8_t *data, uint8_t fixed_value, bool read_progmem, EPD_stage stage) {
+	SPI_on();
+	this->send_line(line, data, fixed_value, read_progmem, stage);
+	SPI_off();
+}
+
 
-       // CS high
-       digitalWrite(this->EPD_Pin_EPD_CS, HIGH);
+// each line is built here first and then sent in one burst
+static uint8_t line_buffer[2 + 2 * (264 / 8) + 176 / 4 + 1];
 
-       // output data to panel
-       SPI_send(this->EPD_Pin_EPD_CS, CU8(0x70, 0x02), 2);
-       SPI_send(this->EPD_Pin_EPD_CS, CU8(0x72, 0x07), 2);
+// output one line with SPI already on
+void EPD_Class::send_line(uint16_t line, const uint8_t *data, uint8_t fixed_value, bool read_progmem, EPD_stage stage, const uint8_t *mask) {
+	uint8_t *p = this->encoder(this, line_buffer, line, data, fixed_value, read_progmem, stage, mask);
 
-       SPI_off();
+	// send data
+	Delay_us(10);
+	SPI_send(this->EPD_Pin_EPD_CS, CU8(0x70, 0x0a), 2);
+	Delay_us(10);
+
+	digitalWrite(this->EPD_Pin_EPD_CS, LOW);
+	SPI_put_buffer(line_buffer, p - line_buffer);
+	digitalWrite(this->EPD_Pin_EPD_CS, HIGH);
+
+	// output data to panel
+	SPI_send(this->EPD_Pin_EPD_CS, CU8(0x70, 0x02), 2);
+	SPI_send(this->EPD_Pin_EPD_CS, CU8(0x72, 0x07), 2);
 }
 
 
@@ -744,6 +878,32 @@ static void SPI_put(uint8_t c) {
 }
 
 
+// send a whole buffer, its contents may be overwritten
+static void SPI_put_buffer(uint8_t *buffer, uint16_t length) {
+#if defined(__AVR__)
+	// the next byte is fetched while the current one shifts out and
+	// SPDR is loaded as soon as the transfer completes
+	uint8_t c = *buffer++;
+	SPDR = c;
+	while (0 != --length) {
+		c = *buffer++;
+		while (0 == (SPSR & _BV(SPIF))) {
+		}
+		SPDR = c;
+	}
+	while (0 == (SPSR & _BV(SPIF))) {
+	}
+	(void)SPDR;  // clear SPIF
+#elif defined(SPI_HAS_TRANSACTION)
+	SPI.transfer(buffer, length);
+#else
+	for (uint16_t i = 0; i < length; ++i) {
+		SPI_put(buffer[i]);
+	}
+#endif
+}
+
+
 static void SPI_send(uint8_t cs_pin, const uint8_t *buffer, uint16_t length) {
 	// CS low
 	digitalWrite(cs_pin, LOW);
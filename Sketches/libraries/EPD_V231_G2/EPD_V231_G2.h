@@ -40,7 +40,7 @@
 #define EPD_PWM_REQUIRED      0
 #define EPD_IMAGE_ONE_ARG     0
 #define EPD_IMAGE_TWO_ARG     1
-#define EPD_PARTIAL_AVAILABLE 0
+#define EPD_PARTIAL_AVAILABLE 1
 
 // display panels supported
 #define EPD_1_44_SUPPORT      1
@@ -55,6 +55,11 @@
 #define EPD_ENABLE_EXTRA_SRAM 1
 #endif
 
+// lines fetched by one reader call in frame_cb_prefetch*
+#if !defined(EPD_PREFETCH_LINES)
+#define EPD_PREFETCH_LINES 2
+#endif
+
 typedef enum {
 	EPD_1_44,        // 128 x 96
 	EPD_1_9,         // 144 x 128
@@ -85,6 +90,54 @@ typedef enum {
 
 typedef void EPD_reader(void *buffer, uint32_t address, uint16_t length);
 
+
+// panel geometry known at compile time
+// EPD_geometry<size>::LINES_PER_DISPLAY etc. are constants and the
+// functions give the same values with the interface the line encoder
+// uses, so EPD_Panel<size> gets an encoder with fixed loop counts
+template<EPD_size S> struct EPD_geometry;
+
+#define EPD_GEOMETRY_(size, stage_time, lines, dots, scan, middle, pre_border, border) \
+	template<> struct EPD_geometry<size> {				\
+		enum {							\
+			BASE_STAGE_TIME = stage_time,			\
+			LINES_PER_DISPLAY = lines,			\
+			DOTS_PER_LINE = dots,				\
+			BYTES_PER_LINE = dots / 8,			\
+			BYTES_PER_SCAN = scan,				\
+			MIDDLE_SCAN = middle,				\
+			PRE_BORDER_BYTE = pre_border,			\
+			BORDER_BYTE = border				\
+		};							\
+		static uint16_t bytes_per_line(void) { return BYTES_PER_LINE; } \
+		static uint16_t bytes_per_scan(void) { return BYTES_PER_SCAN; } \
+		static bool middle_scan(void) { return MIDDLE_SCAN; }	\
+		static bool pre_border_byte(void) { return PRE_BORDER_BYTE; } \
+		static EPD_border_byte border_byte(void) { return (EPD_border_byte)BORDER_BYTE; } \
+	}
+
+// middle_scan => data-scan-data ELSE: scan/2 - data - scan/2
+//             size      ms   lines dots scan bytes    middle pre    post border byte
+EPD_GEOMETRY_(EPD_1_44, 480,  96,  128, 96 / 4,      true,  false, EPD_BORDER_BYTE_ZERO);
+EPD_GEOMETRY_(EPD_1_9,  480,  128, 144, 128 / 4 / 2, false, false, EPD_BORDER_BYTE_SET);
+EPD_GEOMETRY_(EPD_2_0,  480,  96,  200, 96 / 4,      true,  true,  EPD_BORDER_BYTE_NONE);
+EPD_GEOMETRY_(EPD_2_6,  630,  128, 232, 128 / 4 / 2, false, false, EPD_BORDER_BYTE_SET);
+EPD_GEOMETRY_(EPD_2_7,  630,  176, 264, 176 / 4,     true,  true,  EPD_BORDER_BYTE_NONE);
+
+
+// encode one line for the COG into buffer, returns the end of the line
+class EPD_Class;
+typedef uint8_t *EPD_line_encoder(const EPD_Class *epd, uint8_t *buffer, uint16_t line,
+				  const uint8_t *data, uint8_t fixed_value, bool read_progmem,
+				  EPD_stage stage, const uint8_t *mask);
+
+// the encoder for one panel size (instantiated in EPD_V231_G2.cpp)
+template<EPD_size S>
+uint8_t *EPD_encode_line(const EPD_Class *epd, uint8_t *buffer, uint16_t line,
+			 const uint8_t *data, uint8_t fixed_value, bool read_progmem,
+			 EPD_stage stage, const uint8_t *mask);
+
+
 class EPD_Class {
 private:
 	const uint8_t EPD_Pin_PANEL_ON;
@@ -111,9 +164,17 @@ private:
 	PROGMEM const uint8_t *channel_select;
 	uint16_t channel_select_length;
 
+	EPD_line_encoder *encoder;
+
+	friend struct EPD_runtime_geometry;
+
 	EPD_Class(const EPD_Class &f);  // prevent copy
 
+	void setup(void);
+	template<EPD_size S> void set_geometry(void);
+
 	void power_off(void);
+	void send_line(uint16_t line, const uint8_t *data, uint8_t fixed_value, bool read_progmem, EPD_stage stage, const uint8_t *mask = NULL);
 	void nothing_frame(void);
 	void dummy_line(void);
 	void border_dummy_line(void);
@@ -168,6 +229,14 @@ public:
 		this->frame_sram_repeat(new_image, EPD_inverse);
 		this->frame_sram_repeat(new_image, EPD_normal);
 	}
+
+	// partial update (SRAM version): only the normal stage is run and
+	// only lines first_line to end_line - 1 that differ are sent, the
+	// unchanged pixels in them are sent as "nothing"
+	void partial_sram(const uint8_t *old_image, const uint8_t *new_image,
+			  uint16_t first_line = 0, uint16_t end_line = 0xffff) {
+		this->frame_partial_repeat(old_image, new_image, first_line, end_line);
+	}
 #endif
 
 	// Low level API calls
@@ -181,21 +250,32 @@ public:
 #endif
 	void frame_cb(uint32_t address, EPD_reader *reader, EPD_stage stage);
 
+	// as frame_cb but each reader call fills EPD_PREFETCH_LINES
+	// consecutive lines, so the reader must accept a length that is a
+	// multiple of the line length (a linear image on flash or in a file)
+	void frame_cb_prefetch(uint32_t address, EPD_reader *reader, EPD_stage stage);
+
 	// stage_time frame refresh
 	void frame_fixed_repeat(uint8_t fixed_value, EPD_stage stage);
 	void frame_data_repeat(PROGMEM const uint8_t *new_image, EPD_stage stage);
 #if defined(EPD_ENABLE_EXTRA_SRAM)
 	void frame_sram_repeat(const uint8_t *new_image, EPD_stage stage);
+
+	// partial update frames, false if no line in the range changed
+	bool frame_partial(const uint8_t *old_image, const uint8_t *new_image, uint16_t first_line, uint16_t end_line);
+	void frame_partial_repeat(const uint8_t *old_image, const uint8_t *new_image, uint16_t first_line, uint16_t end_line);
 #endif
 	void frame_cb_repeat(uint32_t address, EPD_reader *reader, EPD_stage stage);
+	void frame_cb_prefetch_repeat(uint32_t address, EPD_reader *reader, EPD_stage stage);
 
 	// convert temperature to compensation factor
 	int temperature_to_factor_10x(int temperature) const;
 
-	// called by line()
-	void even_pixels(const uint8_t *data, uint8_t fixed_value, bool read_progmem, EPD_stage stage);
-	void odd_pixels(const uint8_t *data, uint8_t fixed_value, bool read_progmem, EPD_stage stage);
-	void all_pixels(const uint8_t *data, uint8_t fixed_value, bool read_progmem, EPD_stage stage);
+	// called by line() to encode into its buffer, return the next free byte
+	// mask (SRAM old image) => pixels where data == mask are "nothing"
+	uint8_t *even_pixels(uint8_t *p, const uint8_t *data, uint8_t fixed_value, bool read_progmem, EPD_stage stage, const uint8_t *mask = NULL);
+	uint8_t *odd_pixels(uint8_t *p, const uint8_t *data, uint8_t fixed_value, bool read_progmem, EPD_stage stage, const uint8_t *mask = NULL);
+	uint8_t *all_pixels(uint8_t *p, const uint8_t *data, uint8_t fixed_value, bool read_progmem, EPD_stage stage, const uint8_t *mask = NULL);
 
 	// single line display - very low-level
 	// also has to handle AVR progmem
@@ -212,6 +292,35 @@ public:
 		  uint8_t busy_pin,
 		  uint8_t chip_select_pin);
 
+protected:
+	// for EPD_Panel: use encoder instead of the run time sized one
+	EPD_Class(EPD_size _size,
+		  uint8_t panel_on_pin,
+		  uint8_t border_pin,
+		  uint8_t discharge_pin,
+		  uint8_t reset_pin,
+		  uint8_t busy_pin,
+		  uint8_t chip_select_pin,
+		  EPD_line_encoder *encoder);
+};
+
+
+// an EPD_Class for one panel size fixed at compile time, e.g.
+//   EPD_Panel<EPD_2_7> EPD(Pin_PANEL_ON, ...);
+// the line encoder has constant geometry and with --gc-sections the
+// run time sized encoder is not linked
+template<EPD_size S>
+class EPD_Panel : public EPD_Class {
+public:
+	EPD_Panel(uint8_t panel_on_pin,
+		  uint8_t border_pin,
+		  uint8_t discharge_pin,
+		  uint8_t reset_pin,
+		  uint8_t busy_pin,
+		  uint8_t chip_select_pin) :
+		EPD_Class(S, panel_on_pin, border_pin, discharge_pin, reset_pin, busy_pin, chip_select_pin,
+			  EPD_encode_line<S>) {
+	}
 };
 
 #endif
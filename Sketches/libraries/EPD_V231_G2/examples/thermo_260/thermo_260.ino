@@ -14,7 +14,7 @@
 // governing permissions and limitations under the License.
 
 
-// Notice: ***** Generated file: DO _NOT_ MODIFY, Created on: 2016-01-12 00:11:21 UTC *****
+// Notice: ***** Generated file: DO _NOT_ MODIFY, Created on: 2026-10-14 11:43:46 UTC *****
 
 
 // graphic temperature display
@@ -153,21 +153,19 @@ void setup() {
 }
 
 
-// main loop
-void loop() {
-	int temperature = S5813A.read();
-	Serial.print("Temperature = ");
-	Serial.print(temperature);
-	Serial.println(" Celcius");
+// draw the whole display for a temperature
+// (banded EPD_GFX calls this once for each band)
+static void draw_thermo(EPD_GFX &gfx, const void *scene) {
+	int temperature = *(const int *)scene;
 
-	int h = G_EPD.height();
-	int w = G_EPD.width();
+	int h = gfx.height();
+	int w = gfx.width();
 
-	G_EPD.drawRect(1, 1, w - 2, h - 2, EPD_GFX::BLACK);
-	G_EPD.drawRect(3, 3, w - 6, h - 6, EPD_GFX::BLACK);
+	gfx.drawRect(1, 1, w - 2, h - 2, EPD_GFX::BLACK);
+	gfx.drawRect(3, 3, w - 6, h - 6, EPD_GFX::BLACK);
 
-	G_EPD.fillTriangle(135,20, 186,40, 152,84, EPD_GFX::BLACK);
-	G_EPD.fillTriangle(139,26, 180,44, 155,68, EPD_GFX::WHITE);
+	gfx.fillTriangle(135,20, 186,40, 152,84, EPD_GFX::BLACK);
+	gfx.fillTriangle(139,26, 180,44, 155,68, EPD_GFX::WHITE);
 
 	char temp[sizeof("-999 C")];
 	snprintf(temp, sizeof(temp), "%4d C", temperature);
@@ -175,11 +173,11 @@ void loop() {
 	int x = 20;
 	int y = 30;
 	for (int i = 0; i < sizeof(temp) - 1; ++i, x += 14) {
-		G_EPD.drawChar(x, y, temp[i], EPD_GFX::BLACK, EPD_GFX::WHITE, 2);
+		gfx.drawChar(x, y, temp[i], EPD_GFX::BLACK, EPD_GFX::WHITE, 2);
 	}
 
 	// small circle for degrees symbol
-	G_EPD.drawCircle(20 + 4 * 14 + 6, 30, 4, EPD_GFX::BLACK);
+	gfx.drawCircle(20 + 4 * 14 + 6, 30, 4, EPD_GFX::BLACK);
 
 // 100 difference just to simplify things
 // so 1 pixel = 1 degree
@@ -199,8 +197,8 @@ void loop() {
 	int bar_x0 = 24;
 	int bar_y0 = 60;
 
-	G_EPD.fillRect(bar_x0, bar_y0, T_MAX - T_MIN, bar_h, EPD_GFX::WHITE);
-	G_EPD.fillRect(bar_x0, bar_y0, bar_w, bar_h, EPD_GFX::BLACK);
+	gfx.fillRect(bar_x0, bar_y0, T_MAX - T_MIN, bar_h, EPD_GFX::WHITE);
+	gfx.fillRect(bar_x0, bar_y0, bar_w, bar_h, EPD_GFX::BLACK);
 
 	// scale
 	for (int t0 = T_MIN; t0 < T_MAX; t0 += 5) {
@@ -208,17 +206,35 @@ void loop() {
 		int tick = 8;
 		if (0 == t0) {
 			tick = 12;
-			G_EPD.drawCircle(bar_x0 + t, bar_y0 + 16, 3, EPD_GFX::BLACK);
+			gfx.drawCircle(bar_x0 + t, bar_y0 + 16, 3, EPD_GFX::BLACK);
 		} else if (0 == t0 % 10) {
 			tick = 10;
 		}
-		G_EPD.drawLine(bar_x0 + t, bar_y0 + tick, bar_x0 + t, bar_y0 + 6, EPD_GFX::BLACK);
-		G_EPD.drawLine(bar_x0 + t, bar_y0 + 6, bar_x0 + t + 5, bar_y0 + 6, EPD_GFX::BLACK);
-		G_EPD.drawLine(bar_x0 + t + 5, bar_y0 + 6, bar_x0 + t + 5, bar_y0 + 8, EPD_GFX::BLACK);
+		gfx.drawLine(bar_x0 + t, bar_y0 + tick, bar_x0 + t, bar_y0 + 6, EPD_GFX::BLACK);
+		gfx.drawLine(bar_x0 + t, bar_y0 + 6, bar_x0 + t + 5, bar_y0 + 6, EPD_GFX::BLACK);
+		gfx.drawLine(bar_x0 + t + 5, bar_y0 + 6, bar_x0 + t + 5, bar_y0 + 8, EPD_GFX::BLACK);
 	}
+}
+
+
+// main loop
+void loop() {
+	int temperature = S5813A.read();
+	Serial.print("Temperature = ");
+	Serial.print(temperature);
+	Serial.println(" Celcius");
 
 	// update the display
+#if EPD_GFX_BANDED
+	static int old_temperature;
+	static bool first = true;
+	G_EPD.display(draw_thermo, &temperature, first ? NULL : &old_temperature);
+	old_temperature = temperature;
+	first = false;
+#else
+	draw_thermo(G_EPD, &temperature);
 	G_EPD.display();
+#endif
 
 	// flash LED for a number of seconds
 	for (int x = 0; x < LOOP_DELAY_SECONDS * 10; ++x) {